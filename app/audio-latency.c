@@ -0,0 +1,103 @@
+/*
+ * The Real SoundTracker - adaptive output latency
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+
+#include "audio-latency.h"
+#include "audio-stats.h"
+
+/* No going down for this long after going up */
+#define AUDIO_LATENCY_HOLD   10000000   /* microseconds */
+
+/* ...and this long between two steps down */
+#define AUDIO_LATENCY_STEP    1000000   /* microseconds */
+
+static void
+audio_latency_report (audio_latency *l)
+{
+    audio_stats_latency(l->periods * l->period_us);
+}
+
+void
+audio_latency_init (audio_latency *l,
+		    int min,
+		    int max,
+		    int periods,
+		    guint32 period_frames,
+		    int rate,
+		    guint64 now)
+{
+    g_assert(min >= 1 && max >= min && rate > 0);
+
+    l->min = min;
+    l->max = max;
+    l->periods = CLAMP(periods, min, max);
+    l->period_us = (guint64)period_frames * 1000000 / rate;
+    l->peak_us = 0;
+    l->next_shrink = now + AUDIO_LATENCY_HOLD;
+    l->underrun = FALSE;
+
+    audio_latency_report(l);
+}
+
+void
+audio_latency_underrun (audio_latency *l)
+{
+    l->underrun = TRUE;
+}
+
+/* After waking up, the driver has periods - 1 periods queued, which
+   must last until the next one has been mixed */
+static inline gboolean
+audio_latency_safe (audio_latency *l,
+		    int periods)
+{
+    return 2 * (guint64)l->peak_us < (guint64)(periods - 1) * l->period_us;
+}
+
+gboolean
+audio_latency_update (audio_latency *l,
+		      guint32 mix_us,
+		      guint64 now)
+{
+    // The peak decays by half in about 45 periods
+    l->peak_us = MAX(mix_us, l->peak_us - l->peak_us / 64);
+
+    if(l->underrun || !audio_latency_safe(l, l->periods)) {
+	l->underrun = FALSE;
+	l->next_shrink = now + AUDIO_LATENCY_HOLD;
+	if(l->periods < l->max) {
+	    l->periods++;
+	    audio_latency_report(l);
+	    return TRUE;
+	}
+	return FALSE;
+    }
+
+    if(now >= l->next_shrink && l->periods > l->min
+       && audio_latency_safe(l, l->periods - 1)) {
+	l->next_shrink = now + AUDIO_LATENCY_STEP;
+	l->periods--;
+	audio_latency_report(l);
+	return TRUE;
+    }
+
+    return FALSE;
+}
@@ -0,0 +1,64 @@
+/*
+ * The Real SoundTracker - adaptive output latency (header)
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _AUDIO_LATENCY_H
+#define _AUDIO_LATENCY_H
+
+#include <glib.h>
+
+/* An output driver that can change how many periods it keeps queued
+   in the device while playing uses this to pick that number. It goes
+   up by one right after an underrun, or as soon as mixing a period
+   takes more than half the time the queued periods last; it goes down
+   by one when things have been quiet for a while and mixing is fast
+   enough for one period less. The number chosen is reported to
+   audio_stats, so that the GUI can show the latency.
+
+   Everything here is called from the audio thread only. The current
+   time (from audio_stats_now()) is passed in, so that render-check.c
+   can run through the decisions without waiting. */
+
+typedef struct audio_latency {
+    int min, max;               /* bounds for periods */
+    int periods;                /* number of periods to keep queued */
+    guint32 period_us;          /* time one period lasts */
+    guint32 peak_us;            /* longest time for mixing a period, decaying */
+    guint64 next_shrink;        /* earliest time for going down again */
+    gboolean underrun;          /* reported since the last update */
+} audio_latency;
+
+/* periods is the number to start with; it is clamped to the bounds */
+void          audio_latency_init      (audio_latency *l,
+				       int min,
+				       int max,
+				       int periods,
+				       guint32 period_frames,
+				       int rate,
+				       guint64 now);
+
+void          audio_latency_underrun  (audio_latency *l);
+
+/* To be called after every period with the time audio_mix() took for
+   it (in microseconds). Returns TRUE if l->periods has changed. */
+gboolean      audio_latency_update    (audio_latency *l,
+				       guint32 mix_us,
+				       guint64 now);
+
+#endif /* _AUDIO_LATENCY_H */
@@ -0,0 +1,275 @@
+/*
+ * The Real SoundTracker - audio engine statistics
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <sys/time.h>
+
+#include "audio-stats.h"
+
+/* Every block of data below has a single writer. It makes the
+   sequence counter odd while it is updating the data, and readers
+   retry until they got a copy with the same even counter before and
+   after. Resetting is done by the writers themselves when they see
+   that the reset generation has changed. */
+
+typedef struct stage_data {
+    volatile gint seq;
+    gint generation;
+    audio_stats_timing t;
+} stage_data;
+
+static stage_data stages[AUDIO_STATS_NUM_STAGES];
+
+typedef struct engine_data {
+    guint32 blocks;
+    int load, load_peak;
+    st_mixer_stats voices;
+} engine_data;
+
+static struct {
+    volatile gint seq;
+    gint generation;
+    engine_data d;
+} engine;
+
+/* Underruns can be reported from any thread, e.g. by JACK. A slot is
+   claimed by atomically setting its name. */
+static struct {
+    volatile gpointer name;
+    volatile gint underruns;
+} drivers[AUDIO_STATS_MAX_DRIVERS];
+
+static volatile gint latency_us = 0;
+
+static volatile gint reset_generation = 0;
+
+guint64
+audio_stats_now (void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (guint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static inline void
+write_begin (volatile gint *seq)
+{
+    g_atomic_int_inc((gint*)seq);
+}
+
+static inline void
+write_end (volatile gint *seq)
+{
+    g_atomic_int_inc((gint*)seq);
+}
+
+static void
+read_consistent (volatile gint *seq,
+		 void *dest,
+		 const void *src,
+		 size_t size)
+{
+    gint s1, s2;
+
+    do {
+	s1 = g_atomic_int_get((gint*)seq);
+	memcpy(dest, src, size);
+	s2 = g_atomic_int_get((gint*)seq);
+    } while((s1 & 1) || s1 != s2);
+}
+
+static void
+timing_add (audio_stats_timing *t,
+	    guint32 us)
+{
+    int b = 0;
+    guint32 v;
+
+    for(v = us; v && b < AUDIO_STATS_BUCKETS - 1; v >>= 1) {
+	b++;
+    }
+
+    t->count++;
+    t->total += us;
+    if(us > t->max) {
+	t->max = us;
+    }
+    t->hist[b]++;
+}
+
+guint64
+audio_stats_stage_end (audio_stats_stage stage,
+		       guint64 start)
+{
+    stage_data *s = &stages[stage];
+    guint64 now = audio_stats_now();
+    gint gen = g_atomic_int_get((gint*)&reset_generation);
+
+    write_begin(&s->seq);
+    if(s->generation != gen) {
+	memset(&s->t, 0, sizeof(s->t));
+	s->generation = gen;
+    }
+    timing_add(&s->t, now > start ? now - start : 0);
+    write_end(&s->seq);
+
+    return now;
+}
+
+void
+audio_stats_block_end (guint64 start,
+		       guint32 count,
+		       int mixfreq,
+		       const st_mixer_stats *voices)
+{
+    guint64 now = audio_stats_stage_end(AUDIO_STATS_BLOCK, start);
+    gint gen = g_atomic_int_get((gint*)&reset_generation);
+    int load, i;
+
+    if(count == 0 || mixfreq == 0) {
+	return;
+    }
+
+    // Time spent relative to the time the block lasts when played
+    load = (now - start) * mixfreq / 1000 / count;
+
+    write_begin(&engine.seq);
+    if(engine.generation != gen) {
+	memset(&engine.d, 0, sizeof(engine.d));
+	engine.generation = gen;
+	for(i = 0; i < AUDIO_STATS_MAX_DRIVERS; i++) {
+	    g_atomic_int_set((gint*)&drivers[i].underruns, 0);
+	}
+    }
+    engine.d.blocks++;
+    engine.d.load = (engine.d.load * 7 + load) / 8;
+    if(load > engine.d.load_peak) {
+	engine.d.load_peak = load;
+    }
+    if(voices) {
+	engine.d.voices = *voices;
+    }
+    write_end(&engine.seq);
+}
+
+void
+audio_stats_underrun (const char *driver)
+{
+    const char *name;
+    int i;
+
+    for(i = 0; i < AUDIO_STATS_MAX_DRIVERS; i++) {
+	name = g_atomic_pointer_get(&drivers[i].name);
+	if(!name) {
+	    if(!g_atomic_pointer_compare_and_exchange(&drivers[i].name, NULL, (gpointer)driver)) {
+		// Somebody else was faster, look at this slot again
+		i--;
+		continue;
+	    }
+	    name = driver;
+	}
+	if(name == driver || !strcmp(name, driver)) {
+	    g_atomic_int_inc((gint*)&drivers[i].underruns);
+	    return;
+	}
+    }
+}
+
+void
+audio_stats_latency (guint32 us)
+{
+    g_atomic_int_set((gint*)&latency_us, us);
+}
+
+void
+audio_stats_reset (void)
+{
+    g_atomic_int_inc((gint*)&reset_generation);
+}
+
+void
+audio_stats_get (audio_stats *s)
+{
+    engine_data d;
+    int i;
+
+    for(i = 0; i < AUDIO_STATS_NUM_STAGES; i++) {
+	read_consistent(&stages[i].seq, &s->stage[i], &stages[i].t, sizeof(s->stage[i]));
+    }
+
+    read_consistent(&engine.seq, &d, &engine.d, sizeof(d));
+    s->blocks = d.blocks;
+    s->load = d.load;
+    s->load_peak = d.load_peak;
+    s->voices = d.voices;
+    s->latency_us = g_atomic_int_get((gint*)&latency_us);
+
+    for(i = 0; i < AUDIO_STATS_MAX_DRIVERS; i++) {
+	s->drivers[i].name = g_atomic_pointer_get(&drivers[i].name);
+	if(!s->drivers[i].name) {
+	    break;
+	}
+	s->drivers[i].underruns = g_atomic_int_get((gint*)&drivers[i].underruns);
+    }
+    s->num_drivers = i;
+}
+
+void
+audio_stats_dump (FILE *f)
+{
+    static const char * const stagenames[AUDIO_STATS_NUM_STAGES] = {
+	"block", "player", "mixer", "convert", "resample"
+    };
+    audio_stats s;
+    int i, j;
+
+    audio_stats_get(&s);
+
+    fprintf(f, "blocks %u\n", s.blocks);
+    fprintf(f, "load %d.%d\n", s.load / 10, s.load % 10);
+    fprintf(f, "load_peak %d.%d\n", s.load_peak / 10, s.load_peak % 10);
+    fprintf(f, "voices.active %u\n", s.voices.active_voices);
+    fprintf(f, "voices.culled %u\n", s.voices.culled_voices);
+    fprintf(f, "samples.mixed %" G_GUINT64_FORMAT "\n", s.voices.mixed_samples);
+    fprintf(f, "samples.culled %" G_GUINT64_FORMAT "\n", s.voices.culled_samples);
+    fprintf(f, "latency_us %u\n", s.latency_us);
+
+    for(i = 0; i < AUDIO_STATS_NUM_STAGES; i++) {
+	audio_stats_timing *t = &s.stage[i];
+
+	fprintf(f, "%s.count %u\n", stagenames[i], t->count);
+	fprintf(f, "%s.total_us %" G_GUINT64_FORMAT "\n", stagenames[i], t->total);
+	fprintf(f, "%s.max_us %u\n", stagenames[i], t->max);
+	fprintf(f, "%s.hist", stagenames[i]);
+	for(j = 0; j < AUDIO_STATS_BUCKETS; j++) {
+	    fprintf(f, " %u", t->hist[j]);
+	}
+	fprintf(f, "\n");
+    }
+
+    for(i = 0; i < s.num_drivers; i++) {
+	fprintf(f, "underruns.%s %u\n", s.drivers[i].name, s.drivers[i].underruns);
+    }
+
+    fflush(f);
+}
@@ -0,0 +1,102 @@
+/*
+ * The Real SoundTracker - audio engine statistics (header)
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _AUDIO_STATS_H
+#define _AUDIO_STATS_H
+
+#include <stdio.h>
+#include <glib.h>
+
+#include "mixer.h"
+
+/* Timing and load statistics of the audio engine. Each stage is
+   written by one thread only (the audio thread, or the player thread
+   in pipelined mode) and guarded by a sequence counter, so neither
+   the writers nor the readers ever take a lock. */
+
+typedef enum audio_stats_stage {
+    AUDIO_STATS_BLOCK = 0,     /* a whole audio_mix() call */
+    AUDIO_STATS_PLAYER,        /* xmplayer_play() */
+    AUDIO_STATS_MIXER,         /* mixer->mix() */
+    AUDIO_STATS_CONVERT,       /* sample format conversion */
+    AUDIO_STATS_RESAMPLE,      /* rate conversion, see audio_set_mixrate() */
+    AUDIO_STATS_NUM_STAGES
+} audio_stats_stage;
+
+/* Bucket n counts durations from 2^(n-1) to 2^n - 1 microseconds;
+   the last bucket takes everything longer. */
+#define AUDIO_STATS_BUCKETS 20
+
+#define AUDIO_STATS_MAX_DRIVERS 8
+
+typedef struct audio_stats_timing {
+    guint32 count;
+    guint32 max;                        /* microseconds */
+    guint64 total;                      /* microseconds */
+    guint32 hist[AUDIO_STATS_BUCKETS];
+} audio_stats_timing;
+
+typedef struct audio_stats {
+    audio_stats_timing stage[AUDIO_STATS_NUM_STAGES];
+    guint32 blocks;                     /* number of audio_mix() calls */
+    int load;                           /* DSP load in per mille, smoothed */
+    int load_peak;                      /* highest unsmoothed DSP load */
+    st_mixer_stats voices;              /* last values from mixer->getstats() */
+    guint32 latency_us;                 /* of the output driver, 0 = unknown */
+    int num_drivers;
+    struct {
+	const char *name;
+	guint32 underruns;
+    } drivers[AUDIO_STATS_MAX_DRIVERS];
+} audio_stats;
+
+/* --- Functions called by the audio thread */
+
+guint64      audio_stats_now          (void);
+
+/* Account the time since 'start' (from audio_stats_now()) to a stage
+   and return the current time. */
+guint64      audio_stats_stage_end    (audio_stats_stage stage,
+				       guint64 start);
+
+/* Account a whole audio_mix() call producing 'count' samples */
+void         audio_stats_block_end    (guint64 start,
+				       guint32 count,
+				       int mixfreq,
+				       const st_mixer_stats *voices);
+
+/* Called by the output drivers when the device ran dry or a write
+   failed. 'driver' must be a static string. */
+void         audio_stats_underrun     (const char *driver);
+
+/* Called by the output drivers with the time from mixing to hearing
+   the output, whenever it has been set up or has changed (0 when the
+   driver is closed) */
+void         audio_stats_latency      (guint32 us);
+
+/* --- Functions called by the GUI thread */
+
+void         audio_stats_reset        (void);
+void         audio_stats_get          (audio_stats *s);
+
+/* Write all statistics as "key value" lines */
+void         audio_stats_dump         (FILE *f);
+
+#endif /* _AUDIO_STATS_H */
@@ -51,6 +51,12 @@
 #include "event-waiter.h"
 #include "gui-settings.h"
 #include "tracer.h"
+#include "audio-stats.h"
+#include "st-subs.h"
+#include "song-analysis.h"
+#include "scope-capture.h"
+#include "resample.h"
+#include "render-parallel.h"
 
 st_mixer *mixer = NULL;
 st_io_driver *playback_driver = NULL;
@@ -94,11 +100,30 @@ static pthread_t threadid;
 
 static int playing = 0;
 static gboolean playing_noloop;
+static gboolean render_worker = FALSE;
+
+/* Stem buffers while in audio_mix_stems() */
+static void **mix_stems = NULL;
+static int mix_stems_mode, mix_numstems;
+
+/* After playing on the editing driver has been stopped, the device is
+   kept open and fed with silence from the idle mixer until
+   idle_deadline (in audio_stats_now() time) has passed. */
+static gboolean idling = FALSE;
+static int idle_timeout = 10;
+static guint64 idle_deadline;
+
+static gboolean analysis_pending = FALSE;
 
 // --- for audio_mix() "main loop":
 
 static int mixfmt_req, mixfmt, mixfmt_conv;
 static int mixfreq_req;
+
+/* Rate to run the mixer at, converting to the rate of the output in
+   audio_mix_resampled() (0 = the rate of the output) */
+static int mixrate = 0;
+static resample *resampler = NULL;
 static int audio_numchannels;
 static float audio_ampfactor = 1.0;
 
@@ -130,10 +155,296 @@ static GList *inputs = NULL;
 gint16 *scopebufs[32];
 gint32 scopebuf_length;
 scopebuf_endpoint scopebuf_start, scopebuf_end;
-int scopebuf_freq;
+double scopebuf_freq;
 gboolean scopebuf_ready;
 
+/* Number of scope buffer entries per scope picture; see scope-capture.h */
+#define AUDIO_SCOPE_BUCKETS 64
+
+/* Pipelined playing: xmplayer_play() runs ahead of the mixer on its
+   own thread. The driver_*() calls it makes are not passed to the
+   mixer directly, but queued together with the time of the tick they
+   belong to. audio_mix() applies them as soon as the mixer has
+   reached that time. */
+
+typedef enum audio_event_type {
+    AUDIO_EVENT_TICK,         /* start of a player tick, carries position */
+    AUDIO_EVENT_SYNC,         /* start of a batch from outside the player thread */
+    AUDIO_EVENT_STARTNOTE,
+    AUDIO_EVENT_STOPNOTE,
+    AUDIO_EVENT_SETSMPLPOS,
+    AUDIO_EVENT_SETSMPLEND,
+    AUDIO_EVENT_SETFREQ,
+    AUDIO_EVENT_SETVOLUME,
+    AUDIO_EVENT_SETPANNING,
+    AUDIO_EVENT_SETCUTOFF,
+    AUDIO_EVENT_SETRESO,
+} audio_event_type;
+
+typedef struct audio_event {
+    audio_event_type type;
+    int channel;
+    union {
+	st_mixer_sample_info *si;
+	guint32 offset;
+	float f;
+	struct {
+	    double time;
+	    int songpos, patpos, tempo, bpm;
+	} tick;
+    } u;
+} audio_event;
+
+#define AUDIO_EVENTQ_SIZE 16384
+/* Space kept free before a tick is started; a tick never produces
+   more events than this, so the player thread doesn't block inside
+   it while holding player_mutex. */
+#define AUDIO_EVENTQ_RESERVE 1024
+
+static audio_event eventq[AUDIO_EVENTQ_SIZE];
+static int eventq_tail;           /* next event to be applied by the mixer */
+static int eventq_head;           /* end of the events visible to the mixer */
+static int eventq_fill;           /* end of the batch being written */
+static GMutex *eventq_mutex;
+static GCond *eventq_cond;        /* signalled when the mixer has made progress */
+static GMutex *player_mutex;      /* held while the player state is touched */
+
+static pthread_t player_threadid;
+static gboolean pipeline_active = FALSE, pipeline_quit;
+static double pipeline_lookahead = 0.0, pipeline_lookahead_req = 0.0;
+static double pipeline_queued_time, pipeline_mixed_time;
+
+/* Live input queue, see audio.h. Only the input thread writes to it,
+   and only the audio thread reads from it. */
+
+#define AUDIO_INPUTQ_SIZE 256
+
+static audio_input_event inputq[AUDIO_INPUTQ_SIZE];
+static gint inputq_head, inputq_tail;
+static int inputpipe[2] = { -1, -1 };  /* wakes up the audio thread */
+static gint input_instrument = 1;
+static gboolean input_direct = FALSE;  /* driver_*() calls bypass the pipeline */
+
 void                audio_prepare_for_playing                (void);
+static gboolean     audio_open_editing_driver                (void);
+
+static void
+audio_event_apply (audio_event *e)
+{
+    switch(e->type) {
+    case AUDIO_EVENT_STARTNOTE:
+	mixer->startnote(e->channel, e->u.si);
+	break;
+    case AUDIO_EVENT_STOPNOTE:
+	mixer->stopnote(e->channel);
+	break;
+    case AUDIO_EVENT_SETSMPLPOS:
+	mixer->setsmplpos(e->channel, e->u.offset);
+	break;
+    case AUDIO_EVENT_SETSMPLEND:
+	mixer->setsmplend(e->channel, e->u.offset);
+	break;
+    case AUDIO_EVENT_SETFREQ:
+	mixer->setfreq(e->channel, e->u.f);
+	break;
+    case AUDIO_EVENT_SETVOLUME:
+	mixer->setvolume(e->channel, e->u.f);
+	break;
+    case AUDIO_EVENT_SETPANNING:
+	mixer->setpanning(e->channel, e->u.f);
+	break;
+    case AUDIO_EVENT_SETCUTOFF:
+	if(mixer->setchcutoff) {
+	    mixer->setchcutoff(e->channel, e->u.f);
+	}
+	break;
+    case AUDIO_EVENT_SETRESO:
+	if(mixer->setchreso) {
+	    mixer->setchreso(e->channel, e->u.f);
+	}
+	break;
+    default:
+	break;
+    }
+}
+
+/* Append an event to the batch being written. Must be called with
+   player_mutex held; the batch becomes visible to the mixer with
+   audio_event_publish(). */
+static void
+audio_event_put (audio_event *e)
+{
+    int next = (eventq_fill + 1) % AUDIO_EVENTQ_SIZE;
+
+    if(next == eventq_tail) {
+	if(!pthread_equal(pthread_self(), player_threadid)) {
+	    /* We are the mixer thread ourselves, so we can't wait for
+	       the queue to drain. Apply the event right now instead. */
+	    audio_event_apply(e);
+	    return;
+	}
+	g_mutex_lock(eventq_mutex);
+	while(next == eventq_tail && !pipeline_quit) {
+	    g_cond_wait(eventq_cond, eventq_mutex);
+	}
+	g_mutex_unlock(eventq_mutex);
+	if(pipeline_quit) {
+	    return;
+	}
+    }
+
+    eventq[eventq_fill] = *e;
+    eventq_fill = next;
+}
+
+static void
+audio_event_publish (void)
+{
+    g_mutex_lock(eventq_mutex);
+    eventq_head = eventq_fill;
+    g_mutex_unlock(eventq_mutex);
+}
+
+static inline void
+audio_player_lock (void)
+{
+    if(pipeline_active) {
+	g_mutex_lock(player_mutex);
+    }
+}
+
+static inline void
+audio_player_unlock (void)
+{
+    if(pipeline_active) {
+	g_mutex_unlock(player_mutex);
+    }
+}
+
+/* Start a batch of driver calls made from outside the player
+   thread. It is applied together with the latest queued tick. */
+static void
+audio_player_lock_sync (void)
+{
+    audio_event e;
+
+    audio_player_lock();
+    if(pipeline_active) {
+	e.type = AUDIO_EVENT_SYNC;
+	e.u.tick.time = pipeline_queued_time;
+	audio_event_put(&e);
+    }
+}
+
+static void
+audio_player_unlock_sync (void)
+{
+    if(pipeline_active) {
+	audio_event_publish();
+    }
+    audio_player_unlock();
+}
+
+static inline int
+audio_event_space (void)
+{
+    return (eventq_tail - eventq_fill - 1 + AUDIO_EVENTQ_SIZE) % AUDIO_EVENTQ_SIZE;
+}
+
+static void
+audio_player_thread (void)
+{
+    audio_event e;
+    double t;
+    guint64 start;
+    int marker;
+
+    while(1) {
+	g_mutex_lock(eventq_mutex);
+	while(!pipeline_quit
+	      && (pipeline_queued_time - pipeline_mixed_time >= pipeline_lookahead
+		  || audio_event_space() < AUDIO_EVENTQ_RESERVE)) {
+	    g_cond_wait(eventq_cond, eventq_mutex);
+	}
+	g_mutex_unlock(eventq_mutex);
+
+	if(pipeline_quit) {
+	    break;
+	}
+
+	g_mutex_lock(player_mutex);
+
+	if(pitchbend_req != pitchbend) {
+	    pitchbend = pitchbend_req;
+	}
+
+	marker = eventq_fill;
+	e.type = AUDIO_EVENT_TICK;
+	e.u.tick.time = pipeline_queued_time = audio_next_tick_time_bent;
+	audio_event_put(&e);
+
+	start = audio_stats_now();
+	t = xmplayer_play();
+	audio_stats_stage_end(AUDIO_STATS_PLAYER, start);
+	audio_next_tick_time_bent += (t - audio_next_tick_time_unbent) * (100.0 / (100.0 + pitchbend));
+	audio_next_tick_time_unbent = t;
+
+	/* The position has been put into the tick marker already, but it
+	   is only known now. Patch it in before anybody can see it. */
+	e.u.tick.songpos = player_songpos;
+	e.u.tick.patpos = player_patpos;
+	e.u.tick.tempo = player_tempo;
+	e.u.tick.bpm = player_bpm;
+	eventq[marker].u = e.u;
+
+	audio_event_publish();
+
+	g_mutex_unlock(player_mutex);
+    }
+
+    pthread_exit(NULL);
+}
+
+static void
+audio_pipeline_start (void)
+{
+    pipeline_lookahead = pipeline_lookahead_req;
+    if(pipeline_lookahead <= 0.0) {
+	return;
+    }
+
+    if(!eventq_mutex) {
+	eventq_mutex = g_mutex_new();
+	eventq_cond = g_cond_new();
+	player_mutex = g_mutex_new();
+    }
+
+    eventq_tail = eventq_head = eventq_fill = 0;
+    pipeline_queued_time = 0.0;
+    pipeline_mixed_time = 0.0;
+    pipeline_quit = FALSE;
+    pipeline_active = TRUE;
+
+    if(0 != pthread_create(&player_threadid, NULL, (void*(*)(void*))audio_player_thread, NULL)) {
+	pipeline_active = FALSE;
+    }
+}
+
+static void
+audio_pipeline_stop (void)
+{
+    if(!pipeline_active) {
+	return;
+    }
+
+    g_mutex_lock(eventq_mutex);
+    pipeline_quit = TRUE;
+    g_cond_broadcast(eventq_cond);
+    g_mutex_unlock(eventq_mutex);
+
+    pthread_join(player_threadid, NULL);
+    pipeline_active = FALSE;
+}
 
 static void
 audio_raise_priority (void)
@@ -164,6 +475,78 @@ audio_restore_priority (void)
     nice_value = 0;
 }
 
+static void
+audio_release_driver (void)
+{
+    current_driver->common.release(current_driver_object);
+    current_driver = NULL;
+    current_driver_object = NULL;
+    idling = FALSE;
+}
+
+static void
+audio_idle_release (void)
+{
+    if(idling) {
+	audio_release_driver();
+    }
+}
+
+static void
+audio_idle_start (void)
+{
+    // Silence all voices; audio_mix() doesn't call the player while idle
+    mixer->reset();
+    idling = TRUE;
+    idle_deadline = audio_stats_now() + (guint64)idle_timeout * 1000000;
+}
+
+/* Continue on the idle device. Unlike audio_prepare_for_playing(), the
+   mixer's time line isn't reset since the driver's play time keeps on
+   running; the player's time starts at 0 again. */
+static void
+audio_idle_resume (void)
+{
+    idling = FALSE;
+    pitchbend = pitchbend_req;
+
+    playing = 1;
+    playing_noloop = FALSE;
+
+    audio_next_tick_time_bent = audio_current_playback_time_bent;
+    audio_next_tick_time_unbent = 0.0;
+
+    time_buffer_clear(audio_playerpos_tb);
+    time_buffer_clear(audio_clipping_indicator_tb);
+    time_buffer_clear(audio_mixer_position_tb);
+
+    event_waiter_reset(audio_songpos_ew);
+    event_waiter_reset(audio_tempo_ew);
+    event_waiter_reset(audio_bpm_ew);
+}
+
+static gboolean
+audio_open_editing_driver (void)
+{
+    if(idling) {
+	if(current_driver == editing_driver && current_driver_object == editing_driver_object) {
+	    audio_idle_resume();
+	    return TRUE;
+	}
+	// The editing driver has been changed in the meantime
+	audio_release_driver();
+    }
+
+    if(editing_driver->common.open(editing_driver_object)) {
+	current_driver_object = editing_driver_object;
+	current_driver = editing_driver;
+	audio_prepare_for_playing();
+	return TRUE;
+    }
+
+    return FALSE;
+}
+
 static void
 audio_ctlpipe_init_player (void)
 {
@@ -183,6 +566,8 @@ audio_ctlpipe_play_song (int songpos,
     g_assert(xm != NULL);
     g_assert(!playing);
 
+    audio_idle_release();
+
     if(playback_driver->common.open(playback_driver_object)) {
 	current_driver_object = playback_driver_object;
 	current_driver = playback_driver;
@@ -202,6 +587,7 @@ audio_ctlpipe_play_song (int songpos,
 		    mixer->loadchsettings(i);
 	}
 
+	audio_pipeline_start();
 	a = AUDIO_BACKPIPE_PLAYING_STARTED;
     } else {
 	a = AUDIO_BACKPIPE_DRIVER_OPEN_FAILED;
@@ -211,8 +597,11 @@ audio_ctlpipe_play_song (int songpos,
 }
 
 static void
-audio_ctlpipe_render_song_to_file (gchar *filename)
+audio_ctlpipe_render_song_to_file (gchar *filename,
+				   int stems,
+				   gboolean stems_mix)
 {
+    st_file_render_params *params;
     audio_backpipe_id a = AUDIO_BACKPIPE_DRIVER_OPEN_FAILED;
     extern st_io_driver driver_out_file;
 
@@ -222,11 +611,16 @@ audio_ctlpipe_render_song_to_file (gchar *filename)
     g_assert(!playing);
 
 #if USE_SNDFILE || !defined (NO_AUDIOFILE)
+    audio_idle_release();
+
     if(file_driver_object != NULL) {
 	driver_out_file.common.destroy(file_driver_object);
     }
     file_driver_object = driver_out_file.common.new();
-    *((gchar**)file_driver_object) = g_strdup(filename);
+    params = file_driver_object;
+    params->filename = g_strdup(filename);
+    params->stems = stems;
+    params->stems_mix = stems_mix;
 
     if(driver_out_file.common.open(file_driver_object)) {
 	current_driver_object = file_driver_object;
@@ -255,21 +649,20 @@ audio_ctlpipe_play_pattern (int pattern,
     g_assert(!playing);
 
     if(only1row) {
-	if(editing_driver->common.open(editing_driver_object)) {
-	    current_driver_object = editing_driver_object;
-	    current_driver = editing_driver;
-	    audio_prepare_for_playing();
+	if(audio_open_editing_driver()) {
 	    xmplayer_init_play_pattern(pattern, patpos, only1row);
 	    a = AUDIO_BACKPIPE_PLAYING_NOTE_STARTED;
 	} else {
 	    a = AUDIO_BACKPIPE_DRIVER_OPEN_FAILED;
 	}
     } else {
+	audio_idle_release();
 	if(playback_driver->common.open(playback_driver_object)) {
 	    current_driver_object = playback_driver_object;
 	    current_driver = playback_driver;
 	    audio_prepare_for_playing();
 	    xmplayer_init_play_pattern(pattern, patpos, only1row);
+	    audio_pipeline_start();
 	    a = AUDIO_BACKPIPE_PLAYING_PATTERN_STARTED;
 	} else {
 	    a = AUDIO_BACKPIPE_DRIVER_OPEN_FAILED;
@@ -286,14 +679,8 @@ audio_ctlpipe_play_note (int channel,
 {
     audio_backpipe_id a = AUDIO_BACKPIPE_PLAYING_NOTE_STARTED;
 
-    if(!playing) {
-	if(editing_driver->common.open(editing_driver_object)) {
-	    current_driver_object = editing_driver_object;
-	    current_driver = editing_driver;
-	    audio_prepare_for_playing();
-	} else {
-	    a = AUDIO_BACKPIPE_DRIVER_OPEN_FAILED;
-	}
+    if(!playing && !audio_open_editing_driver()) {
+	a = AUDIO_BACKPIPE_DRIVER_OPEN_FAILED;
     }
 
     write(backpipe, &a, sizeof(a));
@@ -301,7 +688,9 @@ audio_ctlpipe_play_note (int channel,
     if(!playing)
 	return;
 
+    audio_player_lock_sync();
     xmplayer_play_note(channel, note, instrument);
+    audio_player_unlock_sync();
 }
 
 static void
@@ -313,14 +702,8 @@ audio_ctlpipe_play_note_full (int channel,
 {
     audio_backpipe_id a = AUDIO_BACKPIPE_PLAYING_NOTE_STARTED;
 
-    if(!playing) {
-	if(editing_driver->common.open(editing_driver_object)) {
-	    current_driver_object = editing_driver_object;
-	    current_driver = editing_driver;
-	    audio_prepare_for_playing();
-	} else {
-	    a = AUDIO_BACKPIPE_DRIVER_OPEN_FAILED;
-	}
+    if(!playing && !audio_open_editing_driver()) {
+	a = AUDIO_BACKPIPE_DRIVER_OPEN_FAILED;
     }
 
     write(backpipe, &a, sizeof(a));
@@ -328,7 +711,9 @@ audio_ctlpipe_play_note_full (int channel,
     if(!playing)
 	return;
 
+    audio_player_lock_sync();
     xmplayer_play_note_full(channel, note, sample, offset, count);
+    audio_player_unlock_sync();
 }
 
 static void
@@ -337,7 +722,41 @@ audio_ctlpipe_play_note_keyoff (int channel)
     if(!playing)
 	return;
 
+    audio_player_lock();
     xmplayer_play_note_keyoff(channel);
+    audio_player_unlock();
+}
+
+static void
+audio_ctlpipe_release_device (void)
+{
+    audio_backpipe_id a = AUDIO_BACKPIPE_DEVICE_RELEASED;
+
+    audio_idle_release();
+    write(backpipe, &a, sizeof(a));
+}
+
+static void
+audio_ctlpipe_analyze_song (void)
+{
+    audio_backpipe_id a = AUDIO_BACKPIPE_SONG_ANALYZED;
+    song_analysis *result;
+
+    g_assert(xm != NULL);
+
+    if(playing) {
+	// The player is busy, do it as soon as it has stopped
+	analysis_pending = TRUE;
+	return;
+    }
+    analysis_pending = FALSE;
+
+    // The mixer is replaced meanwhile, so no driver must be calling it
+    audio_idle_release();
+
+    result = song_analysis_run();
+    write(backpipe, &a, sizeof(a));
+    write(backpipe, &result, sizeof(result));
 }
 
 static void
@@ -346,11 +765,15 @@ audio_ctlpipe_stop_playing (void)
     audio_backpipe_id a = AUDIO_BACKPIPE_PLAYING_STOPPED;
 
     if(playing == 1) {
+	audio_pipeline_stop();
 	xmplayer_stop();
-	current_driver->common.release(current_driver_object);
-	current_driver = NULL;
-	current_driver_object = NULL;
 	playing = 0;
+	if(idle_timeout > 0
+	   && current_driver == editing_driver && current_driver_object == editing_driver_object) {
+	    audio_idle_start();
+	} else {
+	    audio_release_driver();
+	}
     }
 
     if(set_songpos_wait_for != -1) {
@@ -362,6 +785,10 @@ audio_ctlpipe_stop_playing (void)
     write(backpipe, &a, sizeof(a));
 
     audio_raise_priority();
+
+    if(analysis_pending && !playing) {
+	audio_ctlpipe_analyze_song();
+    }
 }
 
 static void
@@ -369,7 +796,9 @@ audio_ctlpipe_set_songpos (int songpos)
 {
     g_assert(playing);
 
+    audio_player_lock();
     xmplayer_set_songpos(songpos);
+    audio_player_unlock();
     if(set_songpos_wait_for != -1) {
 	/* confirm previous request */
 	event_waiter_confirm(audio_songpos_ew, 0.0);
@@ -380,7 +809,9 @@ audio_ctlpipe_set_songpos (int songpos)
 static void
 audio_ctlpipe_set_tempo (int tempo)
 {
+    audio_player_lock();
     xmplayer_set_tempo(tempo);
+    audio_player_unlock();
     if(confirm_tempo != 0) {
 	/* confirm previous request */
 	event_waiter_confirm(audio_tempo_ew, 0.0);
@@ -391,7 +822,9 @@ audio_ctlpipe_set_tempo (int tempo)
 static void
 audio_ctlpipe_set_bpm (int bpm)
 {
+    audio_player_lock();
     xmplayer_set_bpm(bpm);
+    audio_player_unlock();
     if(confirm_bpm != 0) {
 	/* confirm previous request */
 	event_waiter_confirm(audio_bpm_ew, 0.0);
@@ -404,7 +837,9 @@ audio_ctlpipe_set_pattern (int pattern)
 {
     g_assert(playing);
 
+    audio_player_lock();
     xmplayer_set_pattern(pattern);
+    audio_player_unlock();
 }
 
 static void
@@ -438,11 +873,36 @@ readpipe (int fd, void *p, int count)
     }
 }
 
+static void
+audio_input_discard (void)
+{
+    g_atomic_int_set(&inputq_tail, g_atomic_int_get(&inputq_head));
+}
+
+/* The input thread has queued something. The events are played by
+   audio_mix(), so all there is to do is to make sure it is running. */
+static void
+audio_input_wakeup (void)
+{
+    char buf[64];
+
+    while(read(inputpipe[0], buf, sizeof(buf)) == sizeof(buf))
+	;
+
+    if(playing && playing_noloop) {
+	// Rendering to a file, don't mix the keyboard into it
+	audio_input_discard();
+    } else if(!playing && !audio_open_editing_driver()) {
+	audio_input_discard();
+    }
+}
+
 static void
 audio_thread (void)
 {
-    struct pollfd pfd[5] = {
+    struct pollfd pfd[2 + AUDIO_MAX_POLL_INPUTS] = {
 	{ ctlpipe, POLLIN, 0 },
+	{ -1, POLLIN, 0 },
     };
     GList *pl;
     PollInput *pi;
@@ -450,6 +910,9 @@ audio_thread (void)
     int a[4], i, npl;
     void *b;
     float af;
+    gboolean pulling;
+    int timeout;
+    guint64 now;
 
     static char *msgbuf = NULL;
     static int msgbuflen = 0;
@@ -458,8 +921,11 @@ audio_thread (void)
 
   loop:
     pfd[0].revents = 0;
+    pfd[1].fd = inputpipe[0];
+    pfd[1].revents = 0;
+    pulling = playing && current_driver && current_driver->pull;
 
-    for(pl = inputs, npl = 1; pl; pl = pl->next, npl++) {
+    for(pl = inputs, npl = 2; pl; pl = pl->next, npl++) {
 	pi = pl->data;
 	if(pi->fd == -1) {
 	    inputs = g_list_remove(inputs, pi);
@@ -473,7 +939,17 @@ audio_thread (void)
 	    pfd[npl].events |= POLLOUT;
     }
 
-    if(poll(pfd, npl, -1) == -1) {
+    // Pull-model drivers are run in between, so don't wait then
+    if(pulling) {
+	timeout = 0;
+    } else if(idling) {
+	now = audio_stats_now();
+	timeout = idle_deadline > now ? (idle_deadline - now) / 1000 + 1 : 0;
+    } else {
+	timeout = -1;
+    }
+
+    if(poll(pfd, npl, timeout) == -1) {
 	if(errno == EINTR)
 	    goto loop;
 	perror("audio_thread:poll():");
@@ -511,15 +987,21 @@ audio_thread (void)
 	case AUDIO_CTLPIPE_STOP_PLAYING:
 	    audio_ctlpipe_stop_playing();
 	    break;
+	case AUDIO_CTLPIPE_RELEASE_DEVICE:
+	    audio_ctlpipe_release_device();
+	    break;
+	case AUDIO_CTLPIPE_ANALYZE_SONG:
+	    audio_ctlpipe_analyze_song();
+	    break;
 	case AUDIO_CTLPIPE_RENDER_SONG_TO_FILE:
-	    readpipe(ctlpipe, a, sizeof(a[0]));
-	    if(msgbuflen < a[0] + 1) {
+	    readpipe(ctlpipe, a, 3 * sizeof(a[0]));
+	    if(msgbuflen < a[2] + 1) {
 		g_free(msgbuf);
-		msgbuf = g_new(char, a[0] + 1);
-		msgbuflen = a[0] + 1;
+		msgbuf = g_new(char, a[2] + 1);
+		msgbuflen = a[2] + 1;
 	    }
-	    readpipe(ctlpipe, msgbuf, a[0] + 1);
-	    audio_ctlpipe_render_song_to_file(msgbuf);
+	    readpipe(ctlpipe, msgbuf, a[2] + 1);
+	    audio_ctlpipe_render_song_to_file(msgbuf, a[0], a[1]);
 	    break;
 	case AUDIO_CTLPIPE_SET_SONGPOS:
 	    read(ctlpipe, a, 1 * sizeof(a[0]));
@@ -540,7 +1022,7 @@ audio_thread (void)
 	case AUDIO_CTLPIPE_SET_MIXER:
 	    read(ctlpipe, &b, sizeof(b));
 	    mixer = b;
-	    if(playing) {
+	    if(playing || idling) {
 		mixer->reset();
 		mixfmt_req = -666;
 		mixer->setnumch(audio_numchannels);
@@ -555,6 +1037,18 @@ audio_thread (void)
 	    readpipe(ctlpipe, a, 1 * sizeof(a[0]));
 	    audio_ctlpipe_set_bpm(a[0]);
 	    break;
+	case AUDIO_CTLPIPE_SET_LOOKAHEAD:
+	    readpipe(ctlpipe, a, 1 * sizeof(a[0]));
+	    pipeline_lookahead_req = (double)CLAMP(a[0], 0, AUDIO_MAX_LOOKAHEAD) / 1000;
+	    break;
+	case AUDIO_CTLPIPE_SET_IDLE_TIMEOUT:
+	    readpipe(ctlpipe, a, 1 * sizeof(a[0]));
+	    idle_timeout = CLAMP(a[0], 0, AUDIO_MAX_IDLE_TIMEOUT);
+	    break;
+	case AUDIO_CTLPIPE_SET_MIXRATE:
+	    readpipe(ctlpipe, a, 1 * sizeof(a[0]));
+	    mixrate = a[0] ? CLAMP(a[0], AUDIO_MIN_MIXRATE, AUDIO_MAX_MIXRATE) : 0;
+	    break;
 	default:
 	    fprintf(stderr, "\n\n*** audio_thread: unknown ctlpipe id %d\n\n\n", c);
 	    pthread_exit(NULL);
@@ -562,16 +1056,22 @@ audio_thread (void)
 	}
     }
 
-    for(pl = inputs, i = 1; i < npl; pl = pl->next, i++) {
+    if(pfd[1].revents & POLLIN) {
+	audio_input_wakeup();
+    }
+
+    for(pl = inputs, i = 2; i < npl; pl = pl->next, i++) {
 	pi = pl->data;
 	if(pi->fd == -1)
 	    continue;
-	if(pfd[i].revents & pfd[i].events) {
+	if(pfd[i].revents & (pfd[i].events | POLLERR)) {
 	    int x = 0;
 	    if(pfd[i].revents & POLLIN)
 		x |= GDK_INPUT_READ;
 	    if(pfd[i].revents & POLLOUT)
 		x |= GDK_INPUT_WRITE;
+	    if(pfd[i].revents & POLLERR)
+		x |= GDK_INPUT_EXCEPTION;
 	    pi->function(pi->data, pi->fd, x);
 
 	    if(playing_noloop & player_looped) {
@@ -583,6 +1083,18 @@ audio_thread (void)
 	}
     }
 
+    // The ctlpipe handlers may have stopped playing or changed the driver
+    if(playing && current_driver && current_driver->pull) {
+	if(current_driver->pull(current_driver_object) == 0
+	   || (playing_noloop & player_looped)) {
+	    audio_ctlpipe_stop_playing();
+	}
+    }
+
+    if(idling && audio_stats_now() >= idle_deadline) {
+	audio_release_driver();
+    }
+
     goto loop;
 }
 
@@ -603,6 +1115,11 @@ audio_init (int c,
 
     memset(player_mute_channels, 0, sizeof(player_mute_channels));
 
+    if(pipe(inputpipe) == 0) {
+	fcntl(inputpipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(inputpipe[1], F_SETFL, O_NONBLOCK);
+    }
+
     if(!(audio_playerpos_tb = time_buffer_new(10.0)))
 	return FALSE;
     if(!(audio_clipping_indicator_tb = time_buffer_new(10.0)))
@@ -630,6 +1147,53 @@ audio_set_mixer (st_mixer *newmixer)
     write(audio_ctlpipe, &newmixer, sizeof(newmixer));
 }
 
+void
+audio_set_lookahead (int milliseconds)
+{
+    audio_ctlpipe_id i = AUDIO_CTLPIPE_SET_LOOKAHEAD;
+    write(audio_ctlpipe, &i, sizeof(i));
+    write(audio_ctlpipe, &milliseconds, sizeof(milliseconds));
+}
+
+void
+audio_set_idle_timeout (int seconds)
+{
+    audio_ctlpipe_id i = AUDIO_CTLPIPE_SET_IDLE_TIMEOUT;
+    write(audio_ctlpipe, &i, sizeof(i));
+    write(audio_ctlpipe, &seconds, sizeof(seconds));
+}
+
+void
+audio_set_mixrate (int hz)
+{
+    audio_ctlpipe_id i = AUDIO_CTLPIPE_SET_MIXRATE;
+    write(audio_ctlpipe, &i, sizeof(i));
+    write(audio_ctlpipe, &hz, sizeof(hz));
+}
+
+void
+audio_input_event_put (const audio_input_event *e)
+{
+    int head = g_atomic_int_get(&inputq_head);
+    int next = (head + 1) % AUDIO_INPUTQ_SIZE;
+    char c = 0;
+
+    if(inputpipe[1] == -1 || next == g_atomic_int_get(&inputq_tail)) {
+	// The audio thread doesn't keep up, so this couldn't be played in time anyway
+	return;
+    }
+
+    inputq[head] = *e;
+    g_atomic_int_set(&inputq_head, next);
+    write(inputpipe[1], &c, 1);
+}
+
+void
+audio_input_set_instrument (int instrument)
+{
+    g_atomic_int_set(&input_instrument, instrument);
+}
+
 static void
 mixer_mix_format (STMixerFormat m, int s)
 {
@@ -713,6 +1277,9 @@ audio_prepare_for_playing (void)
     mixer->reset();
     mixfmt_req = -666;
     pitchbend = pitchbend_req;
+    if(resampler) {
+	resample_reset(resampler);
+    }
 
     playing = 1;
     playing_noloop = FALSE;
@@ -737,11 +1304,13 @@ audio_prepare_for_playing (void)
     scopebuf_end.offset = 0;
     scopebuf_end.time = 0.0;
     scopebuf_ready = FALSE;
-    if(gui_settings.scopes_buffer_size / 32 > scopebuf_length) {
-	scopebuf_length = gui_settings.scopes_buffer_size / 32;
+    scope_capture_reset();
+    if(gui_settings.scopes_buffer_size / 64 > scopebuf_length) {
+	// Two values per entry
+	scopebuf_length = gui_settings.scopes_buffer_size / 64;
 	for(i = 0; i < 32; i++) {
 	    g_free(scopebufs[i]);
-	    scopebufs[i] = g_new(gint16, scopebuf_length);
+	    scopebufs[i] = g_new(gint16, 2 * scopebuf_length);
 	    if(!scopebufs[i])
 		return;
 	}
@@ -749,19 +1318,58 @@ audio_prepare_for_playing (void)
     scopebuf_ready = TRUE;
 }
 
+/* Which stem a voice goes to, see st_mixer.mixstems */
+static int
+audio_stem_of (int channel,
+	       st_mixer_sample_info *sample)
+{
+    const char *s = (const char*)sample, *ins = (const char*)xm->instruments;
+
+    if(mix_stems_mode == AUDIO_STEMS_CHANNELS) {
+	return channel;
+    }
+
+    // The samples the mixer plays are those of the module's instruments
+    if(s >= ins && s < ins + sizeof(xm->instruments)) {
+	return (s - ins) / sizeof(STInstrument);
+    }
+
+    return -1;
+}
+
+static void *
+mixer_mix_stems (void *dest,
+		 guint32 count)
+{
+    int i;
+
+    if(!mixer->mixstems) {
+	for(i = 0; i < mix_numstems; i++) {
+	    if(mix_stems[i]) {
+		memset(mix_stems[i], 0, count * 4);
+		mix_stems[i] += count * 4;
+	    }
+	}
+	return mixer->mix(dest, count, NULL, 0);
+    }
+
+    return mixer->mixstems(dest, mix_stems, audio_stem_of, mix_numstems, count);
+}
+
 static void *
 mixer_mix_and_handle_scopes (void *dest,
 			     guint32 count)
 {
-    int n;
+    int n, b;
     extern ScopeGroup *scopegroup;
     audio_clipping_indicator *c;
     audio_mixer_position *p;
+    guint64 start;
 
     // See comments in audio.h for Oscilloscope stuff
 
     while(count) {
-	n = scopebuf_length - scopebuf_end.offset;
+	n = scope_capture_frames(scopebuf_length - scopebuf_end.offset);
 	if(n > count)
 	    n = count;
 
@@ -769,11 +1377,21 @@ mixer_mix_and_handle_scopes (void *dest,
 	    n = audio_visual_feedback_counter;
 	}
 
-     	dest = scopegroup->scopes_on && scopebuf_ready ? mixer->mix(dest, n, scopebufs, scopebuf_end.offset) : mixer->mix(dest, n, NULL, 0);
+	start = audio_stats_now();
+	if(mix_stems) {
+	    dest = mixer_mix_stems(dest, n);
+	} else if(!dest) {
+	    mixer->mix(NULL, n, NULL, 0);
+	} else {
+	    // Nobody looks at the scopes of a render worker (and there may be no GUI)
+	    dest = !render_worker && scopegroup->scopes_on && scopebuf_ready ? mixer->mix(dest, n, scopebufs, scopebuf_end.offset) : mixer->mix(dest, n, NULL, 0);
+	}
+	audio_stats_stage_end(AUDIO_STATS_MIXER, start);
 
-	scopebuf_end.offset += n;
-	scopebuf_end.time += (double)n / scopebuf_freq;
-	audio_mixer_current_time += (double)n / scopebuf_freq;
+	b = scope_capture_advance(n);
+	scopebuf_end.offset += b;
+	scopebuf_end.time += b / scopebuf_freq;
+	audio_mixer_current_time += (double)n / mixfreq_req;
 	count -= n;
 	audio_visual_feedback_counter -= n;
 	
@@ -788,11 +1406,11 @@ mixer_mix_and_handle_scopes (void *dest,
 	if(audio_visual_feedback_counter == 0) {
 	    /* Get up-to-date info from mixer about current sample positions */
 	    audio_visual_feedback_counter = audio_visual_feedback_update_interval;
-	    if((p = g_new(audio_mixer_position, 1))) {
+	    if(!render_worker && (p = g_new(audio_mixer_position, 1))) {
 		mixer->dumpstatus(p->dump);
 		time_buffer_add(audio_mixer_position_tb, p, audio_mixer_current_time);
 	    }
-	    if((c = g_new(audio_clipping_indicator, 1))) {
+	    if(!render_worker && (c = g_new(audio_clipping_indicator, 1))) {
 		c->clipping = audio_visual_feedback_clipping;
 		if(audio_visual_feedback_clipping) {
 		    audio_visual_feedback_clipping--;
@@ -801,7 +1419,7 @@ mixer_mix_and_handle_scopes (void *dest,
 	    }
 	}
 
-	if(scopebuf_end.time - scopebuf_start.time >= (double)scopebuf_length / scopebuf_freq) {
+	if(scopebuf_end.time - scopebuf_start.time >= scopebuf_length / scopebuf_freq) {
 	    // adjust scopebuf_start
 	    int d = scopebuf_end.offset - scopebuf_start.offset;
 	    if(d < 0)
@@ -809,7 +1427,7 @@ mixer_mix_and_handle_scopes (void *dest,
 	    g_assert(d >= 0);
 	    scopebuf_start.offset += d;
 	    scopebuf_start.offset %= scopebuf_length;
-	    scopebuf_start.time += (double)d / scopebuf_freq;
+	    scopebuf_start.time += d / scopebuf_freq;
 	}
     }
 
@@ -824,6 +1442,7 @@ mixer_mix (void *dest,
     static void *buf = NULL;
     int b, i, c, d;
     void *ende;
+    guint64 start;
 
     if(count == 0)
 	return dest;
@@ -835,10 +1454,12 @@ mixer_mix (void *dest,
        necessary: 16 bits / 8 bits, mono / stereo, little endian / big
        endian, unsigned / signed */
 
-    if(mixfmt_conv == 0) {
+    if(mixfmt_conv == 0 || !dest) {
 	return mixer_mix_and_handle_scopes(dest, count);
     }
 
+    g_assert(!mix_stems);
+
     b = count;
     c = 8;
     d = 1;
@@ -859,6 +1480,7 @@ mixer_mix (void *dest,
 
     g_assert(buf != NULL);
     ende = mixer_mix_and_handle_scopes(buf, count);
+    start = audio_stats_now();
 
     if(mixfmt_conv & MIXFMT_CONV_TO_MONO) {
 	if(mixfmt & MIXFMT_16) {
@@ -925,6 +1547,8 @@ mixer_mix (void *dest,
 	}
     }
 
+    audio_stats_stage_end(AUDIO_STATS_CONVERT, start);
+
     return ende;
 }
 
@@ -936,65 +1560,136 @@ driver_setnumch (int numchannels)
     mixer->setnumch(numchannels);
 }
 
+static void
+driver_queue (audio_event_type type,
+	      int channel,
+	      audio_event *e)
+{
+    e->type = type;
+    e->channel = channel;
+    if(input_direct) {
+	/* Live input is played right away, not after the ticks the
+	   player has computed in advance */
+	audio_event_apply(e);
+	return;
+    }
+    audio_event_put(e);
+}
+
 void
 driver_startnote (int channel,
 		  st_mixer_sample_info *si)
 {
+    audio_event e;
+
     if(si->length != 0) {
-	mixer->startnote(channel, si);
+	if(pipeline_active) {
+	    e.u.si = si;
+	    driver_queue(AUDIO_EVENT_STARTNOTE, channel, &e);
+	} else {
+	    mixer->startnote(channel, si);
+	}
     }
 }
 
 void
 driver_stopnote (int channel)
 {
-    mixer->stopnote(channel);
+    audio_event e;
+
+    if(pipeline_active) {
+	driver_queue(AUDIO_EVENT_STOPNOTE, channel, &e);
+    } else {
+	mixer->stopnote(channel);
+    }
 }
 
 void
 driver_setsmplpos (int channel,
 		   guint32 offset)
 {
-    mixer->setsmplpos(channel, offset);
+    audio_event e;
+
+    if(pipeline_active) {
+	e.u.offset = offset;
+	driver_queue(AUDIO_EVENT_SETSMPLPOS, channel, &e);
+    } else {
+	mixer->setsmplpos(channel, offset);
+    }
 }
 
 void
 driver_setsmplend (int channel,
 		   guint32 offset)
 {
-    mixer->setsmplend(channel, offset);
+    audio_event e;
+
+    if(pipeline_active) {
+	e.u.offset = offset;
+	driver_queue(AUDIO_EVENT_SETSMPLEND, channel, &e);
+    } else {
+	mixer->setsmplend(channel, offset);
+    }
 }
 
 void
 driver_setfreq (int channel,
 		float frequency)
 {
-    mixer->setfreq(channel, frequency * ((100.0 + pitchbend) / 100.0));
+    audio_event e;
+
+    frequency *= (100.0 + pitchbend) / 100.0;
+
+    if(pipeline_active) {
+	e.u.f = frequency;
+	driver_queue(AUDIO_EVENT_SETFREQ, channel, &e);
+    } else {
+	mixer->setfreq(channel, frequency);
+    }
 }
 
 void
 driver_setvolume (int channel,
 		  float volume)
 {
+    audio_event e;
+
     g_assert(volume >= 0.0 && volume <= 1.0);
-    
-    mixer->setvolume(channel, volume);
+
+    if(pipeline_active) {
+	e.u.f = volume;
+	driver_queue(AUDIO_EVENT_SETVOLUME, channel, &e);
+    } else {
+	mixer->setvolume(channel, volume);
+    }
 }
 
 void
 driver_setpanning (int channel,
 		   float panning)
 {
+    audio_event e;
+
     g_assert(panning >= -1.0 && panning <= +1.0);
 
-    mixer->setpanning(channel, panning);
+    if(pipeline_active) {
+	e.u.f = panning;
+	driver_queue(AUDIO_EVENT_SETPANNING, channel, &e);
+    } else {
+	mixer->setpanning(channel, panning);
+    }
 }
 
 void
 driver_set_ch_filter_freq (int channel,
 			   float freq)
 {
-    if(mixer->setchcutoff) {
+    audio_event e;
+
+    if(pipeline_active) {
+	e.u.f = freq;
+	driver_queue(AUDIO_EVENT_SETCUTOFF, channel, &e);
+    } else if(mixer->setchcutoff) {
 	mixer->setchcutoff(channel, freq);
     }
 }
@@ -1003,7 +1698,12 @@ void
 driver_set_ch_filter_reso (int channel,
 			   float freq)
 {
-    if(mixer->setchreso) {
+    audio_event e;
+
+    if(pipeline_active) {
+	e.u.f = freq;
+	driver_queue(AUDIO_EVENT_SETRESO, channel, &e);
+    } else if(mixer->setchreso) {
 	mixer->setchreso(channel, freq);
     }
 }
@@ -1015,8 +1715,15 @@ audio_poll_add (int fd,
 		gpointer data)
 {
     PollInput *input;
+    GList *l;
+    int n = 0;
 
-    g_assert(g_list_length(inputs) < 5);
+    // Removed ones stay in the list until the audio thread drops them
+    for(l = inputs; l; l = l->next) {
+	if(((PollInput*)l->data)->fd != -1)
+	    n++;
+    }
+    g_assert(n < AUDIO_MAX_POLL_INPUTS);
 
     input = g_new(PollInput, 1);
     input->fd = fd;
@@ -1037,39 +1744,296 @@ audio_poll_remove (gpointer input)
 }
 
 void
-audio_mix (void *dest,
-	   guint32 count,
-	   int mixfreq,
-	   int mixformat)
+audio_render_worker_start (void)
 {
-    int nonewtick = FALSE;
+    render_worker = TRUE;
+}
 
-    // Set mixer parameters
-    if(mixfmt_req != mixformat) {
-	mixfmt_req = mixformat;
-	mixer_mix_format(mixformat & 15, (mixformat & ST_MIXER_FORMAT_STEREO) != 0);
+int
+audio_stems_count (int mode)
+{
+    return mode == AUDIO_STEMS_CHANNELS ? xm->num_channels : 128;
+}
+
+gboolean
+audio_stem_used (int mode,
+		 int stem)
+{
+    if(mode == AUDIO_STEMS_CHANNELS) {
+	return TRUE;
     }
-    scopebuf_freq = mixfreq_req = mixfreq;
-    mixer->setmixfreq(mixfreq);
 
-    audio_visual_feedback_update_interval = mixfreq / audio_visual_feedback_updates_per_second;
+    return st_instrument_num_samples(&xm->instruments[stem]) != 0
+	&& st_instrument_used_in_song(xm, stem + 1);
+}
+
+gchar *
+audio_stem_filename (const gchar *filename,
+		     int mode,
+		     int stem)
+{
+    int l = strlen(filename);
+    gchar *base, *fn;
+
+    if(l > 4 && !strcasecmp(filename + l - 4, ".wav")) {
+	l -= 4;
+    }
+    base = g_strndup(filename, l);
+    fn = g_strdup_printf("%s-%s%02d.wav", base,
+			 mode == AUDIO_STEMS_CHANNELS ? "ch" : "ins", stem + 1);
+    g_free(base);
+
+    return fn;
+}
+
+void
+audio_mix_stems (void *dest,
+		 void *stems[],
+		 int mode,
+		 guint32 count,
+		 int mixfreq)
+{
+    mix_stems = stems;
+    mix_stems_mode = mode;
+    mix_numstems = audio_stems_count(mode);
+
+#ifdef WORDS_BIGENDIAN
+    audio_mix(dest, count, mixfreq, ST_MIXER_FORMAT_S16_BE | ST_MIXER_FORMAT_STEREO);
+#else
+    audio_mix(dest, count, mixfreq, ST_MIXER_FORMAT_S16_LE | ST_MIXER_FORMAT_STEREO);
+#endif
+
+    mix_stems = NULL;
+}
+
+static void
+audio_player_position_update (int songpos,
+			      int patpos,
+			      int tempo,
+			      int bpm)
+{
+    audio_player_pos *p;
+
+    if(render_worker) {
+	return;
+    }
+
+    // Update player position time buffer
+    if((p = g_new(audio_player_pos, 1))) {
+	p->songpos = songpos;
+	p->patpos = patpos;
+	p->tempo = tempo;
+	p->bpm = bpm;
+	time_buffer_add(audio_playerpos_tb, p, audio_current_playback_time_bent);
+    }
+
+    // Confirm pending event requests
+    if(set_songpos_wait_for != -1 && songpos == set_songpos_wait_for) {
+	event_waiter_confirm(audio_songpos_ew, audio_current_playback_time_bent);
+	set_songpos_wait_for = -1;
+    }
+    if(confirm_tempo) {
+	event_waiter_confirm(audio_tempo_ew, audio_current_playback_time_bent);
+	confirm_tempo = 0;
+    }
+    if(confirm_bpm) {
+	event_waiter_confirm(audio_bpm_ew, audio_current_playback_time_bent);
+	confirm_bpm = 0;
+    }
+}
+
+/* audio_mix() for pipelined playing: mix up to the time of the next
+   queued tick, then apply all driver calls belonging to it. */
+static void *
+audio_mix_pipelined (void *dest,
+		     guint32 count,
+		     int mixfreq)
+{
+    audio_event *e;
+    int head, samples_left;
+    gboolean due;
+
+    while(count) {
+	g_mutex_lock(eventq_mutex);
+	head = eventq_head;
+	g_mutex_unlock(eventq_mutex);
+
+	due = FALSE;
+	if(eventq_tail == head) {
+	    // The player thread is late. Keep the voices running.
+	    samples_left = count;
+	} else {
+	    e = &eventq[eventq_tail];
+	    g_assert(e->type == AUDIO_EVENT_TICK || e->type == AUDIO_EVENT_SYNC);
+	    samples_left = (e->u.tick.time - audio_current_playback_time_bent) * mixfreq;
+	    if(samples_left < 0) {
+		samples_left = 0;
+	    }
+	    if(samples_left <= count) {
+		due = TRUE;
+	    } else {
+		samples_left = count;
+	    }
+	}
+
+	dest = mixer_mix(dest, samples_left);
+	count -= samples_left;
+	audio_current_playback_time_bent += (double) samples_left / mixfreq;
+
+	if(due) {
+	    int tail = eventq_tail;
+
+	    e = &eventq[tail];
+	    if(e->type == AUDIO_EVENT_TICK) {
+		audio_player_position_update(e->u.tick.songpos, e->u.tick.patpos,
+					     e->u.tick.tempo, e->u.tick.bpm);
+	    }
+
+	    for(tail = (tail + 1) % AUDIO_EVENTQ_SIZE; tail != head; tail = (tail + 1) % AUDIO_EVENTQ_SIZE) {
+		e = &eventq[tail];
+		if(e->type == AUDIO_EVENT_TICK || e->type == AUDIO_EVENT_SYNC) {
+		    break;
+		}
+		audio_event_apply(e);
+	    }
+
+	    g_mutex_lock(eventq_mutex);
+	    eventq_tail = tail;
+	    g_cond_broadcast(eventq_cond);
+	    g_mutex_unlock(eventq_mutex);
+	}
+    }
+
+    g_mutex_lock(eventq_mutex);
+    pipeline_mixed_time = audio_current_playback_time_bent;
+    g_cond_broadcast(eventq_cond);
+    g_mutex_unlock(eventq_mutex);
+
+    return dest;
+}
+
+static void
+audio_mix_stats (guint64 start,
+		 guint32 count,
+		 int mixfreq)
+{
+    st_mixer_stats voices;
+
+    if(mixer->getstats) {
+	mixer->getstats(&voices);
+	audio_stats_block_end(start, count, mixfreq, &voices);
+    } else {
+	audio_stats_block_end(start, count, mixfreq, NULL);
+    }
+}
+
+/* Offset in the block at which the oldest queued input event is to
+   be played, or count if that's not in this block. Events are played
+   one block after they have arrived, keeping their distances. */
+static guint32
+audio_input_next (guint64 now,
+		  guint32 count,
+		  int mixfreq)
+{
+    guint64 ago;
+
+    if(inputq_tail == g_atomic_int_get(&inputq_head)) {
+	return count;
+    }
+
+    if(inputq[inputq_tail].time >= now) {
+	return count;
+    }
+    ago = (now - inputq[inputq_tail].time) * mixfreq / 1000000;
+
+    return ago >= count ? 0 : count - ago;
+}
+
+static void
+audio_input_play (guint64 now)
+{
+    audio_input_event *e = &inputq[inputq_tail];
+    audio_backpipe_id a = AUDIO_BACKPIPE_INPUT_EVENT;
+    audio_player_pos p;
+    double songtime;
+
+    // Where the song was when the key was pressed, for recording. The
+    // GUI thread discards the entries it is done with, so only peek.
+    e->songpos = e->patpos = -1;
+    songtime = current_driver->get_play_time(current_driver_object) - (double)(now - e->time) / 1000000;
+    if(time_buffer_peek(audio_playerpos_tb, songtime, &p, sizeof(p))) {
+	e->songpos = p.songpos;
+	e->patpos = p.patpos;
+    }
+
+    switch(e->type) {
+    case AUDIO_INPUT_NOTE:
+	if(e->instrument == 0) {
+	    e->instrument = g_atomic_int_get(&input_instrument);
+	}
+	audio_player_lock();
+	input_direct = TRUE;
+	xmplayer_play_note(e->channel, e->note, e->instrument);
+	input_direct = FALSE;
+	audio_player_unlock();
+	break;
+    case AUDIO_INPUT_KEYOFF:
+	audio_player_lock();
+	input_direct = TRUE;
+	xmplayer_play_note_keyoff(e->channel);
+	input_direct = FALSE;
+	audio_player_unlock();
+	break;
+    default:
+	break;
+    }
+
+    write(backpipe, &a, sizeof(a));
+    write(backpipe, e, sizeof(*e));
+
+    g_atomic_int_set(&inputq_tail, (inputq_tail + 1) % AUDIO_INPUTQ_SIZE);
+}
+
+static void *
+audio_mix_part (void *dest,
+		guint32 count,
+		int mixfreq)
+{
+    int nonewtick = FALSE;
+    guint64 start;
+
+    if(pipeline_active) {
+	return audio_mix_pipelined(dest, count, mixfreq);
+    }
 
     while(count) {
 	// Mix either until the next time is reached when we should call the XM player,
 	// or until the current mixing buffer is full.
 	int samples_left = (audio_next_tick_time_bent - audio_current_playback_time_bent) * mixfreq;
 
-	if(samples_left > count) {
-	    // No new player tick this time...
+	if(samples_left > count || idling) {
+	    // No new player tick this time... (the player is stopped while
+	    // the device is idle, so only silence is mixed then)
 	    samples_left = count;
 	    nonewtick = TRUE;
 	}
 
 	if(playing_noloop && player_looped) {
 	    // "noloop" mode for file renderer -- make rest of buffer silent
-	    memset(dest, 0,
-		   samples_left * ((mixfmt & MIXFMT_16) ? 2 : 1)
-		                * ((mixfmt & MIXFMT_STEREO) ? 2 : 1));
+	    int bytes = samples_left * ((mixfmt & MIXFMT_16) ? 2 : 1)
+		                     * ((mixfmt & MIXFMT_STEREO) ? 2 : 1);
+	    int i;
+
+	    if(dest) {
+		memset(dest, 0, bytes);
+		dest += bytes;
+	    }
+	    for(i = 0; mix_stems && i < mix_numstems; i++) {
+		if(mix_stems[i]) {
+		    memset(mix_stems[i], 0, bytes);
+		    mix_stems[i] += bytes;
+		}
+	    }
 	} else {
 	    dest = mixer_mix(dest, samples_left);
 	}
@@ -1078,7 +2042,6 @@ audio_mix (void *dest,
 
 	if(!nonewtick) {
 	    double t;
-	    audio_player_pos *p = g_new(audio_player_pos, 1);
 
 	    // Pitchbend variable must be updated directly before or after a tick,
 	    // not in the middle of a filled mixing buffer.
@@ -1088,32 +2051,284 @@ audio_mix (void *dest,
 
 	    // The following three lines, and the stuff in driver_setfreq() contain all
 	    // necessary code to handle the pitchbending feature.
+	    start = audio_stats_now();
 	    t = xmplayer_play();
+	    audio_stats_stage_end(AUDIO_STATS_PLAYER, start);
 	    audio_next_tick_time_bent += (t - audio_next_tick_time_unbent) * (100.0 / (100.0 + pitchbend));
 	    audio_next_tick_time_unbent = t;
 
-	    // Update player position time buffer
-	    if(p) {
-		p->songpos = player_songpos;
-		p->patpos = player_patpos;
-		p->tempo = player_tempo;
-		p->bpm = player_bpm;
-                time_buffer_add(audio_playerpos_tb, p, audio_current_playback_time_bent);
-	    }
+	    audio_player_position_update(player_songpos, player_patpos, player_tempo, player_bpm);
+	}
+    }
 
-	    // Confirm pending event requests
-	    if(set_songpos_wait_for != -1 && player_songpos == set_songpos_wait_for) {
-		event_waiter_confirm(audio_songpos_ew, audio_current_playback_time_bent);
-		set_songpos_wait_for = -1;
-	    }
-	    if(confirm_tempo) {
-		event_waiter_confirm(audio_tempo_ew, audio_current_playback_time_bent);
-		confirm_tempo = 0;
-	    }
-	    if(confirm_bpm) {
-		event_waiter_confirm(audio_bpm_ew, audio_current_playback_time_bent);
-		confirm_bpm = 0;
+    return dest;
+}
+
+/* audio_mix() at the rate of the mixer. Queued input events are only
+   played if input is set; they are placed relative to the end of the
+   block, so that must be done by one call per audio_mix() only. */
+static void
+audio_mix_rate (void *dest,
+		guint32 count,
+		int mixfreq,
+		int mixformat,
+		guint64 start,
+		gboolean input)
+{
+    guint32 done = 0, n;
+    int step;
+
+    input = input && !playing_noloop && !idling;
+
+    // Set mixer parameters
+    if(mixfmt_req != mixformat) {
+	mixfmt_req = mixformat;
+	mixer_mix_format(mixformat & 15, (mixformat & ST_MIXER_FORMAT_STEREO) != 0);
+    }
+    mixer->setmixfreq(mixfreq);
+
+    // One scope buffer entry for about every pixel of the scopes
+    step = MAX(1, mixfreq / (AUDIO_SCOPE_BUCKETS * MAX(1, gui_settings.scopes_update_freq)));
+    if(mixfreq != mixfreq_req || step != scope_capture_step()) {
+	// What the scope buffers hold so far is for another rate
+	scope_capture_set_step(step);
+	scopebuf_freq = (double)mixfreq / step;
+	scopebuf_start = scopebuf_end;
+    }
+    mixfreq_req = mixfreq;
+
+    audio_visual_feedback_update_interval = mixfreq / audio_visual_feedback_updates_per_second;
+
+    // Split the block where queued input events are to be played
+    while(1) {
+	n = input ? audio_input_next(start, count, mixfreq) : count;
+	if(n > done) {
+	    dest = audio_mix_part(dest, n - done, mixfreq);
+	    done = n;
+	}
+	if(done == count) {
+	    break;
+	}
+	audio_input_play(start);
+    }
+}
+
+/* From signed 16 bit in machine endianness to the given format */
+static void
+audio_convert_s16 (void *dest,
+		   const gint16 *src,
+		   guint32 samples,
+		   int format)
+{
+    guint32 i;
+
+    if(format == ST_MIXER_FORMAT_S8 || format == ST_MIXER_FORMAT_U8) {
+	gint8 *b = dest;
+	for(i = 0; i < samples; i++)
+	    *b++ = *src++ >> 8;
+	if(format == ST_MIXER_FORMAT_U8) {
+	    guint8 *c = dest;
+	    for(i = 0; i < samples; i++)
+		*c++ += 128;
+	}
+	return;
+    }
+
+    memcpy(dest, src, samples * 2);
+    if(format == ST_MIXER_FORMAT_U16_LE || format == ST_MIXER_FORMAT_U16_BE) {
+	guint16 *c = dest;
+	for(i = 0; i < samples; i++)
+	    *c++ += 32768;
+    }
+#ifdef WORDS_BIGENDIAN
+    if(format == ST_MIXER_FORMAT_S16_LE || format == ST_MIXER_FORMAT_U16_LE) {
+#else
+    if(format == ST_MIXER_FORMAT_S16_BE || format == ST_MIXER_FORMAT_U16_BE) {
+#endif
+	byteswap_16_array(dest, samples);
+    }
+}
+
+/* audio_mix() with the mixer running at mixrate. The mixer always
+   puts out native 16 bit then, which is converted to the rate and the
+   format of the output. The filter delays the output by about
+   resample_history() / 2 frames, a millisecond or two, which is left
+   out of the timing. */
+static void
+audio_mix_resampled (void *dest,
+		     guint32 count,
+		     int mixfreq,
+		     int mixformat,
+		     guint64 start)
+{
+    static gint16 *buf = NULL;
+    static guint32 bufsize = 0;
+    int channels = (mixformat & ST_MIXER_FORMAT_STEREO) ? 2 : 1;
+#ifdef WORDS_BIGENDIAN
+    int format = ST_MIXER_FORMAT_S16_BE | (mixformat & ST_MIXER_FORMAT_STEREO);
+#else
+    int format = ST_MIXER_FORMAT_S16_LE | (mixformat & ST_MIXER_FORMAT_STEREO);
+#endif
+    guint32 n, skip;
+    guint64 t;
+
+    if(!resampler || resample_inrate(resampler) != mixrate
+       || resample_outrate(resampler) != mixfreq || resample_channels(resampler) != channels) {
+	resample_free(resampler);
+	resampler = resample_new(channels, mixrate, mixfreq);
+    }
+
+    n = resample_needed(resampler, count);
+    if(MAX(n, count) * channels > bufsize) {
+	g_free(buf);
+	bufsize = MAX(n, count) * channels;
+	buf = g_new(gint16, bufsize);
+    }
+
+    // Without output, only what the filter looks at next needs to be
+    // mixed -- render-parallel.c depends on getting the same output
+    skip = dest ? 0 : n - MIN(n, resample_history(resampler));
+    if(skip) {
+	audio_mix_rate(NULL, skip, mixrate, format, start, TRUE);
+	resample_write(resampler, NULL, skip);
+    }
+    audio_mix_rate(buf, n - skip, mixrate, format, start, !skip);
+    resample_write(resampler, buf, n - skip);
+
+    t = audio_stats_now();
+    resample_read(resampler, dest ? buf : NULL, count);
+    if(dest) {
+	audio_convert_s16(dest, buf, count * channels, mixformat & 15);
+    }
+    audio_stats_stage_end(AUDIO_STATS_RESAMPLE, t);
+}
+
+void
+audio_mix (void *dest,
+	   guint32 count,
+	   int mixfreq,
+	   int mixformat)
+{
+    guint64 start = audio_stats_now();
+
+    // Stems are written at the rate of the output directly
+    if(mixrate && mixrate != mixfreq && !mix_stems) {
+	audio_mix_resampled(dest, count, mixfreq, mixformat, start);
+    } else {
+	audio_mix_rate(dest, count, mixfreq, mixformat, start, TRUE);
+    }
+
+    audio_mix_stats(start, count, mixfreq);
+}
+
+typedef struct audio_render_target {
+    audio_render_func func;
+    void *data;
+} audio_render_target;
+
+static gboolean
+audio_render_write (void *data,
+		    void *buf,
+		    int frames)
+{
+    audio_render_target *t = data;
+
+    t->func(buf, frames, t->data);
+    return TRUE;
+}
+
+guint32
+audio_render_song (st_mixer *m,
+		   int mixfreq,
+		   int rate,
+		   int mixformat,
+		   int workers,
+		   int stems,
+		   guint32 maxframes,
+		   audio_render_func func,
+		   void *data)
+{
+    audio_render_target target = { func, data };
+    render_parallel *parallel = NULL;
+    int frames;
+    st_mixer *oldmixer = mixer;
+    gboolean oldworker = render_worker;
+    int oldrate = mixrate;
+    int framesize = ((mixformat & 15) == ST_MIXER_FORMAT_S8 || (mixformat & 15) == ST_MIXER_FORMAT_U8 ? 1 : 2)
+	            * ((mixformat & ST_MIXER_FORMAT_STEREO) ? 2 : 1);
+    guint32 done = 0;
+    gboolean ended;
+    void *buf, **stembufs = NULL, **stemptrs = NULL;
+    int i, numstems = 0;
+
+    g_assert(xm != NULL);
+    g_assert(!playing && !idling);
+
+    buf = g_malloc(AUDIO_RENDER_BLOCK * framesize);
+
+    if(stems != AUDIO_STEMS_NONE) {
+	numstems = audio_stems_count(stems);
+	stembufs = g_new(void*, numstems);
+	stemptrs = g_new(void*, numstems);
+	for(i = 0; i < numstems; i++) {
+	    stembufs[i] = g_malloc(AUDIO_RENDER_BLOCK * framesize);
+	}
+	workers = 1;
+    }
+
+    // Nobody picks up the position and scope feedback here
+    render_worker = TRUE;
+    mixer = m;
+    mixer->setampfactor(audio_ampfactor);
+    mixrate = rate;
+
+    audio_prepare_for_playing();
+    playing_noloop = TRUE;
+    xmplayer_init_play_song(0, 0, TRUE);
+
+    if(workers > 1) {
+	parallel = render_parallel_new(workers, AUDIO_RENDER_BLOCK, mixfreq, mixformat, framesize,
+				       audio_render_write, &target);
+    }
+
+    while(!player_looped && done < maxframes) {
+	if(parallel) {
+	    if(!(frames = render_parallel_pull(parallel))) {
+		break;
 	    }
+	    done += frames;
+	    continue;
+	}
+	if(stembufs) {
+	    // As audio_mix_stems(), in any format; mixstems() moves the
+	    // pointers on
+	    memcpy(stemptrs, stembufs, numstems * sizeof(void*));
+	    mix_stems = stemptrs;
+	    mix_stems_mode = stems;
+	    mix_numstems = numstems;
 	}
+	audio_mix(buf, AUDIO_RENDER_BLOCK, mixfreq, mixformat);
+	mix_stems = NULL;
+	func(buf, AUDIO_RENDER_BLOCK, data);
+	done += AUDIO_RENDER_BLOCK;
+    }
+    ended = player_looped;
+
+    if(parallel) {
+	render_parallel_free(parallel);
     }
+    xmplayer_stop();
+    playing = 0;
+    playing_noloop = FALSE;
+    mixer = oldmixer;
+    render_worker = oldworker;
+    mixrate = oldrate;
+    g_free(buf);
+    for(i = 0; i < numstems; i++) {
+	g_free(stembufs[i]);
+    }
+    g_free(stembufs);
+    g_free(stemptrs);
+
+    return ended ? done : 0;
 }
@@ -35,7 +35,7 @@
 
 typedef enum audio_ctlpipe_id {
     AUDIO_CTLPIPE_INIT_PLAYER=2000,    /* void */
-    AUDIO_CTLPIPE_RENDER_SONG_TO_FILE, /* int len, string (len+1 bytes) */
+    AUDIO_CTLPIPE_RENDER_SONG_TO_FILE, /* int stems, int stems_mix, int len, string (len+1 bytes) */
     AUDIO_CTLPIPE_PLAY_SONG,           /* int songpos, int patpos */
     AUDIO_CTLPIPE_PLAY_PATTERN,        /* int pattern, int patpos, int only_one_row */
     AUDIO_CTLPIPE_PLAY_NOTE,           /* int channel, int note, int instrument */
@@ -49,6 +49,11 @@ typedef enum audio_ctlpipe_id {
     AUDIO_CTLPIPE_SET_MIXER,           /* st_mixer* */
     AUDIO_CTLPIPE_SET_TEMPO,           /* int */
     AUDIO_CTLPIPE_SET_BPM,             /* int */
+    AUDIO_CTLPIPE_SET_LOOKAHEAD,       /* int milliseconds, 0 = off */
+    AUDIO_CTLPIPE_SET_IDLE_TIMEOUT,    /* int seconds, 0 = off */
+    AUDIO_CTLPIPE_SET_MIXRATE,         /* int Hz, 0 = the rate of the output */
+    AUDIO_CTLPIPE_RELEASE_DEVICE,      /* void, closes the editing output if it is idle */
+    AUDIO_CTLPIPE_ANALYZE_SONG,        /* void, answered once nothing is playing anymore */
 } audio_ctlpipe_id;
 
 typedef enum audio_backpipe_id {
@@ -59,6 +64,9 @@ typedef enum audio_backpipe_id {
     AUDIO_BACKPIPE_PLAYING_STOPPED,
     AUDIO_BACKPIPE_ERROR_MESSAGE,      /* int len, string (len+1 bytes) */
     AUDIO_BACKPIPE_WARNING_MESSAGE,    /* int len, string (len+1 bytes) */
+    AUDIO_BACKPIPE_DEVICE_RELEASED,
+    AUDIO_BACKPIPE_SONG_ANALYZED,      /* song_analysis*, to be freed by the receiver */
+    AUDIO_BACKPIPE_INPUT_EVENT,        /* audio_input_event, after it has been played */
 } audio_backpipe_id;
 
 extern int audio_ctlpipe, audio_backpipe;
@@ -72,7 +80,12 @@ extern int audio_ctlpipe, audio_backpipe;
    So the amount of data contained in this buffer at any time is simply
    scopebuf_end.time - scopebuf_start.time, regardless of the offsets. Then you
    simply walk through the scopebufs[] array starting at offset scopebuf_start.offset,
-   modulo scopebuf_length, until you reach scopebuf_end.offset. */
+   modulo scopebuf_length, until you reach scopebuf_end.offset.
+
+   An entry doesn't stand for a single frame, but for the
+   1 / scopebuf_freq seconds of a bucket (see scope-capture.h), and is
+   made of two values, the lowest and the highest one in that time. The
+   offsets and scopebuf_length count entries, not values. */
 
 extern gboolean scopebuf_ready;
 extern gint16 *scopebufs[32];
@@ -82,7 +95,7 @@ typedef struct scopebuf_endpoint {
     double time;
 } scopebuf_endpoint;
 extern scopebuf_endpoint scopebuf_start, scopebuf_end;
-extern int scopebuf_freq;
+extern double scopebuf_freq;
 
 /* === Player position time buffer */
 
@@ -132,8 +145,82 @@ gboolean     audio_init               (int ctlpipe, int backpipe);
 
 void         audio_set_mixer          (st_mixer *mixer);
 
+/* Let the player run ahead of the mixer on its own thread by up to
+   the given time (0 = run the player on the audio thread) */
+#define AUDIO_MAX_LOOKAHEAD 250        /* milliseconds */
+void         audio_set_lookahead      (int milliseconds);
+
+/* Keep the editing output open and running on silence for the given
+   time after playing has been stopped, so that the next note can be
+   started without reopening the device (0 = close it immediately) */
+#define AUDIO_MAX_IDLE_TIMEOUT 60      /* seconds */
+void         audio_set_idle_timeout   (int seconds);
+
+/* Run the mixer at the given rate and convert its output to the rate
+   of the output driver, e.g. a low one to save time, or a high one
+   for less aliasing (0 = mix at the rate of the output) */
+#define AUDIO_MIN_MIXRATE 8000         /* Hz */
+#define AUDIO_MAX_MIXRATE 192000       /* Hz */
+void         audio_set_mixrate        (int hz);
+
+/* Offline rendering: plays the current module once from the start
+   with the given mixer and no driver, passing the output on in blocks
+   of AUDIO_RENDER_BLOCK frames (the last one is padded with silence).
+   The mixer runs at mixrate, converted to mixfreq (0 = at mixfreq).
+   Works directly on the player and mixer state, so it may only be
+   called while the audio thread isn't playing anything, e.g. before
+   the GUI is up. Returns the number of frames rendered, or 0 if the
+   song didn't end within maxframes. With more than one worker, the
+   song is rendered by render_parallel, which must not make any
+   difference to the output. With stems other than AUDIO_STEMS_NONE,
+   the stems are mixed along (serially) and thrown away, which must
+   not make any difference either. */
+#define AUDIO_RENDER_BLOCK 1024
+typedef void (*audio_render_func) (const void *buf, guint32 frames, void *data);
+guint32      audio_render_song        (st_mixer *m,
+				       int mixfreq,
+				       int mixrate,
+				       int mixformat,
+				       int workers,
+				       int stems,
+				       guint32 maxframes,
+				       audio_render_func func,
+				       void *data);
+
 void         readpipe                 (int fd, void *p, int count);
 
+/* === Live input
+
+   Events from an input device (MIDI) are queued from the thread
+   reading the device, along with the time they arrived at, and are
+   triggered by the mixer at the matching offset in the next block.
+   After that, they are passed on to the GUI for recording. */
+
+typedef enum audio_input_type {
+    AUDIO_INPUT_NOTE,                  /* plays note in channel (may be a key-off note) */
+    AUDIO_INPUT_KEYOFF,                /* releases the note playing in channel */
+    AUDIO_INPUT_PROGRAM,               /* selects instrument, only passed on */
+} audio_input_type;
+
+typedef struct audio_input_event {
+    audio_input_type type;
+    int channel;
+    int note;
+    int instrument;                    /* 0 = the one set by audio_input_set_instrument() */
+    int volume;                        /* for recording, -1 = none */
+    guint64 time;                      /* audio_stats_now() on arrival */
+
+    /* Filled in by the audio thread: the position that could be heard
+       when the event arrived, -1 if nothing was playing */
+    int songpos, patpos;
+} audio_input_event;
+
+/* Queue an event; only one thread (other than the audio thread) may
+   do that */
+void         audio_input_event_put    (const audio_input_event *e);
+/* Instrument for notes that don't name one; may be called from anywhere */
+void         audio_input_set_instrument (int instrument);
+
 /* --- Functions called by the player */
 
 void     driver_setnumch      (int numchannels);
@@ -49,6 +49,12 @@ GList *mixers = NULL;
 static GtkWidget *audioconfig_mixer_list;
 static st_mixer *audioconfig_current_mixer = NULL;
 static gboolean audioconfig_disable_mixer_selection = FALSE;
+static GtkWidget *audioconfig_lookahead_spin;
+static int audioconfig_lookahead = 0;
+static GtkWidget *audioconfig_idle_timeout_spin;
+static int audioconfig_idle_timeout = 10;
+static GtkWidget *audioconfig_mixrate_spin;
+static int audioconfig_mixrate = 0;
 
 typedef struct audio_object {
     const char *title;
@@ -124,9 +130,10 @@ audioconfig_list_select (GtkTreeSelection *sel, guint page)
 	g_free(str);
 
 	if(new_driver != old_driver) {
-	    // stop playing and sampling here
+	    // stop playing and sampling here, and close the old device
 	    sample_editor_stop_sampling();
 	    gui_play_stop();
+	    gui_release_device();
 
 	    // get new driver object
 	    *object->driver_object = audio_driver_objects[page][row];
@@ -190,6 +197,27 @@ audioconfig_initialize_mixer_list (void)
     gui_list_select(audioconfig_mixer_list, active);
 }
 
+static void
+audioconfig_lookahead_changed (GtkSpinButton *spin)
+{
+    audioconfig_lookahead = gtk_spin_button_get_value_as_int(spin);
+    audio_set_lookahead(audioconfig_lookahead);
+}
+
+static void
+audioconfig_idle_timeout_changed (GtkSpinButton *spin)
+{
+    audioconfig_idle_timeout = gtk_spin_button_get_value_as_int(spin);
+    audio_set_idle_timeout(audioconfig_idle_timeout);
+}
+
+static void
+audioconfig_mixrate_changed (GtkSpinButton *spin)
+{
+    audioconfig_mixrate = gtk_spin_button_get_value_as_int(spin);
+    audio_set_mixrate(audioconfig_mixrate);
+}
+
 static void
 audioconfig_notebook_add_page (GtkNotebook *nbook, guint n)
 {
@@ -302,6 +330,21 @@ audioconfig_dialog (void)
     audioconfig_mixer_list = thing;
     audioconfig_initialize_mixer_list();
 
+    // Player thread lookahead (0 = player runs inside the mixing thread)
+    gui_put_labelled_spin_button(box2, _("Player lookahead [ms]:"), 0, AUDIO_MAX_LOOKAHEAD,
+				 &audioconfig_lookahead_spin, audioconfig_lookahead_changed, NULL);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(audioconfig_lookahead_spin), audioconfig_lookahead);
+
+    // Time the editing output is kept open after the last note (0 = close at once)
+    gui_put_labelled_spin_button(box2, _("Keep editing output open [s]:"), 0, AUDIO_MAX_IDLE_TIMEOUT,
+				 &audioconfig_idle_timeout_spin, audioconfig_idle_timeout_changed, NULL);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(audioconfig_idle_timeout_spin), audioconfig_idle_timeout);
+
+    // Rate the mixer runs at, converted to the rate of the output (0 = the output's)
+    gui_put_labelled_spin_button(box2, _("Mixing rate [Hz] (0 = output rate):"), 0, AUDIO_MAX_MIXRATE,
+				 &audioconfig_mixrate_spin, audioconfig_mixrate_changed, NULL);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(audioconfig_mixrate_spin), audioconfig_mixrate);
+
     /* The button area */
     thing = gtk_hseparator_new();
     gtk_widget_show(thing);
@@ -376,6 +419,23 @@ audioconfig_load_config (void)
 	    audioconfig_driver_load_config(&audio_objects[i]);
 	}
     }
+
+    f = prefs_open_read("mixer");
+    if(f) {
+	if(prefs_get_int(f, "lookahead", &audioconfig_lookahead)) {
+	    audioconfig_lookahead = CLAMP(audioconfig_lookahead, 0, AUDIO_MAX_LOOKAHEAD);
+	}
+	if(prefs_get_int(f, "idle-timeout", &audioconfig_idle_timeout)) {
+	    audioconfig_idle_timeout = CLAMP(audioconfig_idle_timeout, 0, AUDIO_MAX_IDLE_TIMEOUT);
+	}
+	if(prefs_get_int(f, "mixrate", &audioconfig_mixrate)) {
+	    audioconfig_mixrate = CLAMP(audioconfig_mixrate, 0, AUDIO_MAX_MIXRATE);
+	}
+	prefs_close(f);
+    }
+    audio_set_lookahead(audioconfig_lookahead);
+    audio_set_idle_timeout(audioconfig_idle_timeout);
+    audio_set_mixrate(audioconfig_mixrate);
 }
 
 void
@@ -441,6 +501,9 @@ audioconfig_save_config (void)
     f = prefs_open_write("mixer");
     if(f) {
 	prefs_put_string(f, "mixer", audioconfig_current_mixer->id);
+	prefs_put_int(f, "lookahead", audioconfig_lookahead);
+	prefs_put_int(f, "idle-timeout", audioconfig_idle_timeout);
+	prefs_put_int(f, "mixrate", audioconfig_mixrate);
 	prefs_close(f);
     }
 
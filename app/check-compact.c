@@ -0,0 +1,262 @@
+/*
+ * The Real SoundTracker - check of the compact module format
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "audio.h"
+#include "check-modules.h"
+#include "errors.h"
+#include "gui-settings.h"
+#include "preferences.h"
+#include "st-subs.h"
+#include "xm.h"
+#include "xm-compact.h"
+#include "xm-player.h"
+
+static gboolean
+check_compact_differs (const char *module,
+		       const char *where,
+		       const char *field,
+		       long a,
+		       long b)
+{
+    if(a != b) {
+	fprintf(stderr, "%s/stc: %s%s is %ld instead of %ld\n",
+		module, where, field, b, a);
+    }
+
+    return a != b;
+}
+
+#define DIFFERS(field) check_compact_differs(module, where, #field, a->field, b->field)
+
+static gboolean
+check_compact_envelope_differs (const char *module,
+				const char *where,
+				STEnvelope *a,
+				STEnvelope *b)
+{
+    int i;
+
+    if(DIFFERS(num_points) || DIFFERS(sustain_point) || DIFFERS(loop_start)
+       || DIFFERS(loop_end) || DIFFERS(flags)) {
+	return TRUE;
+    }
+    for(i = 0; i < a->num_points; i++) {
+	if(DIFFERS(points[i].pos) || DIFFERS(points[i].val)) {
+	    return TRUE;
+	}
+    }
+
+    return FALSE;
+}
+
+static gboolean
+check_compact_sample_differs (const char *module,
+			      const char *where,
+			      STSample *a,
+			      STSample *b)
+{
+    if(strcmp(a->name, b->name)) {
+	fprintf(stderr, "%s/stc: %sname differs\n", module, where);
+	return TRUE;
+    }
+    if(DIFFERS(volume) || DIFFERS(finetune) || DIFFERS(panning) || DIFFERS(relnote)
+       || DIFFERS(treat_as_8bit) || DIFFERS(sample.format) || DIFFERS(sample.looptype)
+       || DIFFERS(sample.length) || DIFFERS(sample.loopstart) || DIFFERS(sample.loopend)) {
+	return TRUE;
+    }
+    if(a->sample.length
+       && memcmp(a->sample.data, b->sample.data,
+		 a->sample.length * st_sample_bytes_per_sample(&a->sample))) {
+	fprintf(stderr, "%s/stc: %sdata differs\n", module, where);
+	return TRUE;
+    }
+
+    return FALSE;
+}
+
+static gboolean
+check_compact_instrument_differs (const char *module,
+				  const char *where,
+				  STInstrument *a,
+				  STInstrument *b)
+{
+    char w[64];
+    int i;
+
+    if(strcmp(a->name, b->name) || memcmp(a->samplemap, b->samplemap, sizeof(a->samplemap))) {
+	fprintf(stderr, "%s/stc: %sname or sample map differs\n", module, where);
+	return TRUE;
+    }
+    if(DIFFERS(vibtype) || DIFFERS(vibrate) || DIFFERS(vibdepth) || DIFFERS(vibsweep)
+       || DIFFERS(volfade)) {
+	return TRUE;
+    }
+    g_snprintf(w, sizeof(w), "%svolume envelope ", where);
+    if(check_compact_envelope_differs(module, w, &a->vol_env, &b->vol_env)) {
+	return TRUE;
+    }
+    g_snprintf(w, sizeof(w), "%spanning envelope ", where);
+    if(check_compact_envelope_differs(module, w, &a->pan_env, &b->pan_env)) {
+	return TRUE;
+    }
+    for(i = 0; i < sizeof(a->samples) / sizeof(a->samples[0]); i++) {
+	g_snprintf(w, sizeof(w), "%ssample %d ", where, i);
+	if(check_compact_sample_differs(module, w, &a->samples[i], &b->samples[i])) {
+	    return TRUE;
+	}
+    }
+
+    return FALSE;
+}
+
+static gboolean
+check_compact_xm_differs (const char *module,
+			  XM *a,
+			  XM *b)
+{
+    const char *where = "";
+    char w[64];
+    int i, row, ch;
+
+    if(strcmp(a->name, b->name)
+       || memcmp(a->pattern_order_table, b->pattern_order_table, a->song_length)) {
+	fprintf(stderr, "%s/stc: name or order table differs\n", module);
+	return TRUE;
+    }
+    if(DIFFERS(flags) || DIFFERS(num_channels) || DIFFERS(tempo) || DIFFERS(bpm)
+       || DIFFERS(song_length) || DIFFERS(restart_position)) {
+	return TRUE;
+    }
+
+    for(i = 0; i < sizeof(a->patterns) / sizeof(a->patterns[0]); i++) {
+	g_snprintf(w, sizeof(w), "pattern %d ", i);
+	if(check_compact_differs(module, w, "length", a->patterns[i].length, b->patterns[i].length)) {
+	    return TRUE;
+	}
+	for(row = 0; row < a->patterns[i].length; row++) {
+	    for(ch = 0; ch < a->num_channels; ch++) {
+		if(memcmp(xm_pattern_note(&a->patterns[i], ch, row),
+			  xm_pattern_note(&b->patterns[i], ch, row), sizeof(XMNote))) {
+		    fprintf(stderr, "%s/stc: pattern %d row %d channel %d differs\n",
+			    module, i, row, ch);
+		    return TRUE;
+		}
+	    }
+	}
+    }
+
+    for(i = 0; i < sizeof(a->instruments) / sizeof(a->instruments[0]); i++) {
+	g_snprintf(w, sizeof(w), "instrument %d ", i);
+	if(check_compact_instrument_differs(module, w, &a->instruments[i], &b->instruments[i])) {
+	    return TRUE;
+	}
+    }
+
+    return FALSE;
+}
+
+#undef DIFFERS
+
+/* Saves the module in the compact format and loads it again. Everything
+   the format keeps must come back the same; what it doesn't keep
+   (empty trailing samples, instruments and patterns) is the same as
+   in a new module, in both. */
+static gboolean
+check_compact_module (const char *module,
+		      XM *m)
+{
+    FILE *f = tmpfile();
+    XM *c = NULL;
+    gboolean ok;
+
+    ok = f && xm_compact_save(m, f, FALSE, NULL, NULL)
+	&& fseek(f, 0, SEEK_SET) == 0 && (c = xm_compact_load(f));
+    if(!ok) {
+	fprintf(stderr, "%s/stc: not saved and loaded\n", module);
+    } else {
+	ok = !check_compact_xm_differs(module, m, c);
+    }
+
+    if(c) {
+	XM_Free(c);
+    }
+    if(f) {
+	fclose(f);
+    }
+
+    return ok;
+}
+
+/* xm.c and st-subs.c call into the player and the GUI, which aren't
+   linked in here */
+gui_prefs gui_settings;
+st_mixer *mixer = NULL;
+int player_tempo, player_bpm;
+
+void
+xmplayer_envelopes_changed (void)
+{
+}
+
+void
+error_error (const char *text)
+{
+    fprintf(stderr, "%s\n", text);
+}
+
+void
+error_warning (const char *text)
+{
+    fprintf(stderr, "%s\n", text);
+}
+
+char *
+prefs_get_prefsdir (void)
+{
+    return ".";
+}
+
+int
+main (void)
+{
+    XM *m;
+    int i, failed = 0;
+
+    g_thread_init(NULL);
+
+    for(i = 0; i < CHECK_MODULES; i++) {
+	if(!(m = check_module_new(i))) {
+	    fprintf(stderr, "%s: out of memory\n", check_module_name(i));
+	    failed++;
+	    continue;
+	}
+	if(!check_compact_module(check_module_name(i), m)) {
+	    failed++;
+	}
+	XM_Free(m);
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * The Real SoundTracker - check of the sample import
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sample-import.h"
+
+/* Float samples with the values each of them must become, the first
+   16 going through the SIMD conversion (if there is one), the last 4
+   through the plain C one */
+static const float import_floats[] = {
+    NAN, INFINITY, -INFINITY, 2.0, -2.0, 1.0, -1.0, 0.0,
+    0.25, -0.25, 0.5, -0.5, -NAN, NAN, 0.0, 1.0,
+    NAN, -INFINITY, 0.5, -0.5
+};
+static const gint16 import_expected[] = {
+    -32768, 32767, -32768, 32767, -32768, 32767, -32767, 0,
+    8192, -8192, 16384, -16384, -32768, -32768, 0, 32767,
+    -32768, -32768, 16384, -16384
+};
+
+static int
+check_import_read (void *source,
+		   void *buf,
+		   int count)
+{
+    int *pos = source;
+
+    count = MIN(count, (int)(sizeof(import_floats) / sizeof(import_floats[0])) - *pos);
+    memcpy(buf, import_floats + *pos, count * sizeof(float));
+    *pos += count;
+
+    return count;
+}
+
+/* Imports the floats in a thread, like the sample editor does, and
+   compares the result */
+int
+main (void)
+{
+    sample_import *imp;
+    gint16 *data;
+    int pos = 0, i, failed = 0;
+
+    g_thread_init(NULL);
+    imp = sample_import_start(check_import_read, &pos, SAMPLE_IMPORT_FLOAT, 1,
+			      SAMPLE_IMPORT_MONO, sizeof(import_floats) / sizeof(import_floats[0]));
+    if(!imp || sample_import_finish(imp, &data) != SAMPLE_IMPORT_OK) {
+	fprintf(stderr, "import: float samples not converted\n");
+	return 1;
+    }
+
+    for(i = 0; i < sizeof(import_floats) / sizeof(import_floats[0]); i++) {
+	if(data[i] != import_expected[i]) {
+	    fprintf(stderr, "import: float %g becomes %d instead of %d\n",
+		    import_floats[i], data[i], import_expected[i]);
+	    failed++;
+	}
+    }
+
+    free(data);
+    return failed ? 1 : 0;
+}
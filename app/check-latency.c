@@ -0,0 +1,106 @@
+/*
+ * The Real SoundTracker - check of the adaptive latency
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+
+#include "audio-latency.h"
+
+static gboolean
+check_latency_step (const char *what,
+		    audio_latency *l,
+		    guint32 mix_us,
+		    guint64 now,
+		    gboolean changed,
+		    int periods)
+{
+    gboolean c = audio_latency_update(l, mix_us, now);
+
+    if(c != changed || l->periods != periods) {
+	fprintf(stderr, "latency: %s gives %d periods (%s) instead of %d (%s)\n",
+		what, l->periods, c ? "changed" : "unchanged",
+		periods, changed ? "changed" : "unchanged");
+	return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Runs audio_latency through going up and down, with 1024 frame
+   periods at 44100 Hz (23219 microseconds) */
+int
+main (void)
+{
+    audio_latency l;
+    guint64 t = 0, last = 0;
+    int i, failed = 0, shrinks = 0;
+
+    audio_latency_init(&l, 2, 8, 4, 1024, 44100, t);
+    if(l.periods != 4) {
+	fprintf(stderr, "latency: starts with %d periods instead of 4\n", l.periods);
+	failed++;
+    }
+
+    // Fast mixing doesn't go down before the hold time is over
+    t += 1000000;
+    failed += !check_latency_step("fast mixing", &l, 1000, t, FALSE, 4);
+
+    // An underrun goes up right away
+    audio_latency_underrun(&l);
+    failed += !check_latency_step("underrun", &l, 1000, t, TRUE, 5);
+    failed += !check_latency_step("after underrun", &l, 1000, t, FALSE, 5);
+
+    // So does mixing a period taking more than half the queued time
+    failed += !check_latency_step("slow mixing", &l, 40000, t, FALSE, 5);
+    failed += !check_latency_step("slower mixing", &l, 50000, t, TRUE, 6);
+
+    // Not beyond max
+    for(i = 0; i < 3; i++) {
+	audio_latency_underrun(&l);
+	audio_latency_update(&l, 1000, t);
+    }
+    failed += !check_latency_step("going up to max", &l, 1000, t, FALSE, 8);
+    audio_latency_underrun(&l);
+    failed += !check_latency_step("underrun at max", &l, 1000, t, FALSE, 8);
+
+    /* Going down, one period per step, not before the hold time and
+       not faster than a step a second, until min is reached */
+    last = t;
+    for(i = 0; i < 30000000 / 23219; i++) {
+	t += 23219;
+	if(audio_latency_update(&l, 1000, t)) {
+	    if(t - last < (shrinks ? 1000000 : 10000000)) {
+		fprintf(stderr, "latency: goes down to %d periods after %d microseconds\n",
+			l.periods, (int)(t - last));
+		failed++;
+	    }
+	    last = t;
+	    shrinks++;
+	}
+    }
+    if(shrinks != 6 || l.periods != 2) {
+	fprintf(stderr, "latency: went down %d times to %d periods instead of 6 times to 2\n",
+		shrinks, l.periods);
+	failed++;
+    }
+
+    return failed ? 1 : 0;
+}
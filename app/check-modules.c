@@ -0,0 +1,486 @@
+/*
+ * The Real SoundTracker - test modules
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* The test modules are built right here instead of being shipped as
+   files, so that they can't get lost and it's obvious what each of
+   them is supposed to exercise. They only have to stay the same:
+   changing one of them invalidates its reference lines in
+   render-check.ref. */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include "check-modules.h"
+
+/* Octave 0..7, semitone 0..11 */
+#define NOTE(octave, semitone) ((octave) * 12 + (semitone) + 1)
+
+/* Effect numbers beyond F, as in the tracker's fx column */
+#define FX_G 16
+#define FX_H 17
+#define FX_K 20
+#define FX_L 21
+#define FX_P 25
+#define FX_Q 26
+#define FX_R 27
+#define FX_T 29
+#define FX_X 33
+#define FX_Z 35
+
+enum {
+    WAVE_SAW,
+    WAVE_SQUARE,
+    WAVE_TRIANGLE,
+    WAVE_NOISE
+};
+
+static void
+check_module_sample (STSample *s,
+		     int wave,
+		     guint32 length,
+		     gboolean bits16,
+		     int looptype,
+		     guint32 loopstart,
+		     guint32 loopend)
+{
+    guint32 seed = 0x1234567, i;
+    int v;
+
+    if(!(s->sample.data = malloc(length * (bits16 ? 2 : 1)))) {
+	return;
+    }
+
+    for(i = 0; i < length; i++) {
+	switch(wave) {
+	case WAVE_SAW:
+	    v = (i & 63) * 1024 - 32768;
+	    break;
+	case WAVE_SQUARE:
+	    v = (i & 32) ? 24576 : -24576;
+	    break;
+	case WAVE_TRIANGLE:
+	    v = (i & 32) ? 63 - (i & 63) : (i & 63);
+	    v = v * 2048 - 32768;
+	    break;
+	default:
+	    seed = seed * 1103515245 + 12345;
+	    v = (gint16)(seed >> 16);
+	    break;
+	}
+	if(looptype == ST_MIXER_SAMPLE_LOOPTYPE_NONE) {
+	    // Let one-shots decay, so that their end is audible
+	    v = v * (int)(length - i) / (int)length;
+	}
+	if(bits16) {
+	    ((gint16*)s->sample.data)[i] = v;
+	} else {
+	    ((gint8*)s->sample.data)[i] = v >> 8;
+	}
+    }
+
+    s->sample.length = length;
+    s->sample.looptype = looptype;
+    s->sample.loopstart = loopstart;
+    s->sample.loopend = loopend;
+    s->sample.format = bits16 ? ST_MIXER_SAMPLE_FORMAT_16BIT : ST_MIXER_SAMPLE_FORMAT_8BIT;
+    s->treat_as_8bit = !bits16;
+    s->volume = 64;
+    s->panning = 128;
+}
+
+/* points are pos, val pairs */
+static void
+check_module_envelope (STEnvelope *e,
+		       int flags,
+		       int sustain_point,
+		       int loop_start,
+		       int loop_end,
+		       int num_points,
+		       const guint16 *points)
+{
+    int i;
+
+    for(i = 0; i < num_points; i++) {
+	e->points[i].pos = points[2 * i];
+	e->points[i].val = points[2 * i + 1];
+    }
+    e->num_points = num_points;
+    e->sustain_point = sustain_point;
+    e->loop_start = loop_start;
+    e->loop_end = loop_end;
+    e->flags = flags;
+}
+
+static void
+check_module_instruments (XM *xm)
+{
+    static const guint16 vol5[] = { 0, 0,  4, 64,  16, 40,  32, 48,  64, 20 };
+    static const guint16 pan5[] = { 0, 0,  20, 64,  40, 32 };
+    static const guint16 vol7[] = { 0, 64,  10, 32,  40, 0 };
+    static const guint16 pan7[] = { 0, 32,  8, 0,  16, 64 };
+    STInstrument *ins;
+
+    // 1: one-shot saw, 8 bit
+    check_module_sample(&xm->instruments[0].samples[0], WAVE_SAW, 4096, FALSE,
+			ST_MIXER_SAMPLE_LOOPTYPE_NONE, 0, 0);
+
+    // 2: square with a forward loop, 8 bit
+    check_module_sample(&xm->instruments[1].samples[0], WAVE_SQUARE, 2048, FALSE,
+			ST_MIXER_SAMPLE_LOOPTYPE_AMIGA, 512, 2048);
+
+    // 3: triangle with a ping-pong loop, 16 bit
+    check_module_sample(&xm->instruments[2].samples[0], WAVE_TRIANGLE, 3000, TRUE,
+			ST_MIXER_SAMPLE_LOOPTYPE_PINGPONG, 1000, 3000);
+
+    // 4: looped noise, for the filters
+    check_module_sample(&xm->instruments[3].samples[0], WAVE_NOISE, 1024, TRUE,
+			ST_MIXER_SAMPLE_LOOPTYPE_AMIGA, 0, 1024);
+
+    // 5: saw with looped volume and panning envelopes, fadeout and auto-vibrato
+    ins = &xm->instruments[4];
+    check_module_sample(&ins->samples[0], WAVE_SAW, 2048, TRUE,
+			ST_MIXER_SAMPLE_LOOPTYPE_AMIGA, 0, 2048);
+    check_module_envelope(&ins->vol_env, EF_ON | EF_SUSTAIN | EF_LOOP, 2, 2, 3, 5, vol5);
+    check_module_envelope(&ins->pan_env, EF_ON | EF_LOOP, 0, 0, 2, 3, pan5);
+    ins->volfade = 0x200;
+    ins->vibtype = 1;
+    ins->vibsweep = 16;
+    ins->vibdepth = 8;
+    ins->vibrate = 20;
+
+    // 6: one-shot triangle, transposed, detuned and panned left
+    ins = &xm->instruments[5];
+    check_module_sample(&ins->samples[0], WAVE_TRIANGLE, 8192, TRUE,
+			ST_MIXER_SAMPLE_LOOPTYPE_NONE, 0, 0);
+    ins->samples[0].relnote = 12;
+    ins->samples[0].finetune = -32;
+    ins->samples[0].panning = 64;
+
+    // 7: square with a one-shot volume envelope and a sustained
+    // panning envelope
+    ins = &xm->instruments[6];
+    check_module_sample(&ins->samples[0], WAVE_SQUARE, 2048, FALSE,
+			ST_MIXER_SAMPLE_LOOPTYPE_AMIGA, 0, 2048);
+    check_module_envelope(&ins->vol_env, EF_ON, 0, 0, 0, 3, vol7);
+    check_module_envelope(&ins->pan_env, EF_ON | EF_SUSTAIN, 1, 0, 0, 3, pan7);
+    ins->volfade = 0x800;
+}
+
+static void
+put (XM *xm,
+     int pattern,
+     int channel,
+     int row,
+     int note,
+     int instrument,
+     int volume,
+     int fxtype,
+     int fxparam)
+{
+    XMNote *n = xm_pattern_note(&xm->patterns[pattern], channel, row);
+
+    n->note = note;
+    n->instrument = instrument;
+    n->volume = volume;
+    n->fxtype = fxtype;
+    n->fxparam = fxparam;
+}
+
+/* Sets the volume and effect columns of a number of rows */
+static void
+cells (XM *xm,
+       int pattern,
+       int channel,
+       int row,
+       int num_rows,
+       int volume,
+       int fxtype,
+       int fxparam)
+{
+    XMNote *n;
+    int i;
+
+    for(i = 0; i < num_rows; i++) {
+	n = xm_pattern_note(&xm->patterns[pattern], channel, row + i);
+	n->volume = volume;
+	n->fxtype = fxtype;
+	n->fxparam = fxparam;
+    }
+}
+
+static void
+build_loops (XM *xm)
+{
+    int ch, row;
+
+    // Every instrument at low to high pitches
+    for(ch = 0; ch < 6; ch++) {
+	for(row = 0; row < 64; row += 16) {
+	    put(xm, 0, ch, row, NOTE(1 + row / 8, ch), ch + 1, 0, 0, 0);
+	}
+    }
+
+    // Sample offsets, inside the ping-pong loop and beyond the end
+    put(xm, 0, 6, 8, NOTE(4, 0), 3, 0, 0x9, 0x04);
+    put(xm, 0, 6, 40, NOTE(4, 0), 3, 0, 0x9, 0x10);
+
+    // Key off without envelope, restart with the volume column
+    put(xm, 0, 7, 0, NOTE(4, 0), 2, 0, 0, 0);
+    put(xm, 0, 7, 24, XM_PATTERN_NOTE_OFF, 0, 0, 0, 0);
+    put(xm, 0, 7, 32, NOTE(4, 0), 2, 0x30, 0, 0);
+}
+
+static void
+build_effects (XM *xm)
+{
+    xm->song_length = 3;
+    xm->pattern_order_table[0] = 0;
+    xm->pattern_order_table[1] = 1;
+    xm->pattern_order_table[2] = 2;
+
+    // Arpeggio, portamento up and down, fine portamento
+    put(xm, 0, 0, 0, NOTE(4, 0), 2, 0, 0x0, 0x37);
+    cells(xm, 0, 0, 1, 15, 0, 0x0, 0x37);
+    cells(xm, 0, 0, 16, 16, 0, 0x1, 0x08);
+    cells(xm, 0, 0, 32, 16, 0, 0x2, 0x10);
+    cells(xm, 0, 0, 48, 4, 0, 0xE, 0x14);
+    cells(xm, 0, 0, 52, 4, 0, 0xE, 0x23);
+    cells(xm, 0, 0, 56, 8, 0, 0xE, 0x1F);
+
+    // Tone portamento, vibrato (also square), vibrato + volume slide
+    put(xm, 0, 1, 0, NOTE(3, 0), 3, 0, 0, 0);
+    put(xm, 0, 1, 8, NOTE(4, 7), 0, 0, 0x3, 0x10);
+    cells(xm, 0, 1, 9, 7, 0, 0x3, 0x00);
+    cells(xm, 0, 1, 16, 16, 0, 0x4, 0x48);
+    put(xm, 0, 1, 32, 0, 0, 0, 0xE, 0x41);
+    cells(xm, 0, 1, 33, 15, 0, 0x4, 0x8F);
+    cells(xm, 0, 1, 48, 16, 0, 0x6, 0x02);
+
+    // Tremolo, tremor, volume slides
+    put(xm, 0, 2, 0, NOTE(4, 4), 2, 0, 0x7, 0x46);
+    cells(xm, 0, 2, 1, 15, 0, 0x7, 0x46);
+    cells(xm, 0, 2, 16, 16, 0, FX_T, 0x31);
+    cells(xm, 0, 2, 32, 16, 0, 0xA, 0x02);
+    put(xm, 0, 2, 48, 0, 0, 0, 0xC, 0x10);
+    cells(xm, 0, 2, 49, 7, 0, 0xE, 0xA2);
+    cells(xm, 0, 2, 56, 8, 0, 0xE, 0xB4);
+
+    // Panning, panning slide, volume column effects
+    put(xm, 0, 3, 0, NOTE(3, 4), 3, 0, 0x8, 0x00);
+    put(xm, 0, 3, 8, 0, 0, 0, 0x8, 0x80);
+    put(xm, 0, 3, 16, 0, 0, 0, 0x8, 0xFF);
+    cells(xm, 0, 3, 24, 8, 0, FX_P, 0x40);
+    put(xm, 0, 3, 32, 0, 0, 0xC4, 0xE, 0x8C);
+    cells(xm, 0, 3, 40, 8, 0xD2, 0, 0);
+    cells(xm, 0, 3, 48, 4, 0x62, 0, 0);
+    cells(xm, 0, 3, 52, 4, 0x93, 0, 0);
+    cells(xm, 0, 3, 56, 4, 0xA4, 0, 0);
+    cells(xm, 0, 3, 60, 4, 0xB6, 0, 0);
+
+    // Retrigger, multi retrigger, note cut, note delay, key off
+    put(xm, 0, 4, 0, NOTE(4, 0), 2, 0, 0xE, 0x93);
+    put(xm, 0, 4, 16, NOTE(4, 0), 2, 0, FX_R, 0x53);
+    cells(xm, 0, 4, 17, 7, 0, FX_R, 0x53);
+    put(xm, 0, 4, 32, NOTE(5, 0), 2, 0, 0xE, 0xC3);
+    put(xm, 0, 4, 40, NOTE(5, 2), 2, 0, 0xE, 0xD2);
+    put(xm, 0, 4, 48, NOTE(4, 0), 5, 0, FX_K, 0x03);
+
+    // Sample offset, global volume, finetune
+    put(xm, 0, 5, 0, NOTE(4, 0), 1, 0, 0x9, 0x08);
+    put(xm, 0, 5, 16, NOTE(4, 0), 1, 0, FX_G, 0x20);
+    cells(xm, 0, 5, 24, 8, 0, FX_H, 0x04);
+    put(xm, 0, 5, 40, NOTE(4, 0), 1, 0, FX_G, 0x40);
+    put(xm, 0, 5, 48, NOTE(4, 0), 1, 0, 0xE, 0x5C);
+
+    // Extra fine portamento, glissando, tremolo type, envelope position
+    put(xm, 0, 6, 0, NOTE(4, 0), 3, 0, FX_X, 0x14);
+    put(xm, 0, 6, 4, 0, 0, 0, FX_X, 0x25);
+    put(xm, 0, 6, 16, NOTE(3, 0), 3, 0, 0xE, 0x31);
+    put(xm, 0, 6, 20, NOTE(4, 0), 0, 0, 0x3, 0x08);
+    cells(xm, 0, 6, 21, 11, 0, 0x3, 0x00);
+    put(xm, 0, 6, 32, NOTE(4, 0), 3, 0, 0xE, 0x71);
+    cells(xm, 0, 6, 33, 15, 0, 0x7, 0x48);
+    put(xm, 0, 6, 48, NOTE(4, 0), 5, 0, FX_L, 0x10);
+
+    // Tempo and BPM, pattern delay
+    put(xm, 0, 7, 16, 0, 0, 0, 0xF, 0x04);
+    put(xm, 0, 7, 32, 0, 0, 0, 0xF, 0x90);
+    put(xm, 0, 7, 48, 0, 0, 0, 0xF, 0x06);
+    put(xm, 0, 7, 50, 0, 0, 0, 0xF, 0x7D);
+    put(xm, 0, 7, 56, 0, 0, 0, 0xE, 0xE2);
+
+    // Pattern loop, then position jump forward
+    put(xm, 1, 0, 0, NOTE(4, 0), 2, 0, 0xE, 0x60);
+    put(xm, 1, 0, 4, NOTE(4, 7), 2, 0, 0, 0);
+    put(xm, 1, 0, 7, 0, 0, 0, 0xE, 0x62);
+    put(xm, 1, 0, 8, NOTE(5, 0), 2, 0, 0, 0);
+    put(xm, 1, 0, 15, 0, 0, 0, 0xB, 0x02);
+    put(xm, 1, 1, 0, NOTE(4, 0), 4, 0x20, 0, 0);
+    put(xm, 1, 1, 8, NOTE(5, 0), 4, 0x20, 0, 0);
+
+    // Pattern break, ending the song
+    put(xm, 2, 0, 0, NOTE(4, 0), 3, 0, 0, 0);
+    put(xm, 2, 0, 8, 0, 0, 0, 0xD, 0x00);
+}
+
+static void
+build_envelopes (XM *xm)
+{
+    // Sustain, loop and fadeout after key off
+    put(xm, 0, 0, 0, NOTE(4, 0), 5, 0, 0, 0);
+    put(xm, 0, 0, 16, XM_PATTERN_NOTE_OFF, 0, 0, 0, 0);
+    put(xm, 0, 0, 24, NOTE(4, 7), 5, 0, 0, 0);
+    put(xm, 0, 0, 48, XM_PATTERN_NOTE_OFF, 0, 0, 0, 0);
+
+    // Key off by effect
+    put(xm, 0, 1, 0, NOTE(3, 0), 5, 0, 0, 0);
+    put(xm, 0, 1, 8, 0, 0, 0, FX_K, 0x02);
+
+    // One-shot volume envelope, sustained panning envelope
+    put(xm, 0, 2, 0, NOTE(4, 0), 7, 0, 0, 0);
+    put(xm, 0, 2, 32, NOTE(5, 0), 7, 0, 0, 0);
+    put(xm, 0, 2, 40, XM_PATTERN_NOTE_OFF, 0, 0, 0, 0);
+
+    // Envelope position, high pitch
+    put(xm, 0, 3, 0, NOTE(6, 0), 5, 0, 0, 0);
+    put(xm, 0, 3, 12, 0, 0, 0, FX_L, 0x20);
+    put(xm, 0, 3, 56, XM_PATTERN_NOTE_OFF, 0, 0, 0, 0);
+}
+
+static void
+build_filters (XM *xm)
+{
+    int row;
+
+    // Cutoff sweeps, without and with resonance
+    put(xm, 0, 0, 0, NOTE(4, 0), 4, 0, FX_Z, 0x00);
+    put(xm, 0, 1, 0, NOTE(3, 0), 4, 0, FX_Q, 0xC0);
+    for(row = 1; row < 64; row++) {
+	cells(xm, 0, 0, row, 1, 0, FX_Z, row * 4);
+	cells(xm, 0, 1, row, 1, 0, FX_Z, 255 - row * 4);
+    }
+
+    // Resonance changes, then switching the filter off again
+    put(xm, 0, 2, 0, NOTE(4, 0), 2, 0, FX_Z, 0x40);
+    put(xm, 0, 2, 1, 0, 0, 0, FX_Q, 0x80);
+    put(xm, 0, 2, 32, 0, 0, 0, FX_Q, 0xFF);
+    put(xm, 0, 2, 48, 0, 0, 0, FX_Z, 0xFF);
+    put(xm, 0, 2, 49, 0, 0, 0, FX_Q, 0x00);
+
+    // Low cutoff, full resonance
+    put(xm, 0, 3, 0, NOTE(2, 0), 3, 0, FX_Z, 0x10);
+    put(xm, 0, 3, 1, 0, 0, 0, FX_Q, 0xFF);
+}
+
+static void
+build_amiga (XM *xm)
+{
+    xm->flags = XM_FLAGS_AMIGA_FREQ;
+
+    put(xm, 0, 0, 0, NOTE(4, 0), 2, 0, 0x1, 0x20);
+    cells(xm, 0, 0, 1, 15, 0, 0x1, 0x20);
+    cells(xm, 0, 0, 16, 16, 0, 0x2, 0x20);
+
+    put(xm, 0, 1, 0, NOTE(2, 0), 3, 0, 0, 0);
+    put(xm, 0, 1, 4, NOTE(5, 0), 0, 0, 0x3, 0x40);
+    cells(xm, 0, 1, 5, 27, 0, 0x3, 0x00);
+
+    put(xm, 0, 2, 0, NOTE(4, 0), 5, 0, 0x4, 0x6A);
+    cells(xm, 0, 2, 1, 31, 0, 0x4, 0x00);
+    cells(xm, 0, 2, 32, 16, 0, 0x0, 0x47);
+
+    put(xm, 0, 3, 0, NOTE(3, 0), 6, 0, 0xE, 0x1F);
+    cells(xm, 0, 3, 1, 15, 0, 0xE, 0x1F);
+    cells(xm, 0, 3, 16, 16, 0, 0xE, 0x2F);
+    cells(xm, 0, 3, 32, 16, 0, FX_X, 0x1F);
+}
+
+static void
+build_protracker (XM *xm)
+{
+    xm->flags = XM_FLAGS_IS_MOD | XM_FLAGS_AMIGA_FREQ;
+    xm->num_channels = 4;
+
+    put(xm, 0, 0, 0, NOTE(3, 0), 2, 0, 0x0, 0x47);
+    cells(xm, 0, 0, 1, 15, 0, 0x0, 0x47);
+    cells(xm, 0, 0, 16, 16, 0, 0x1, 0x04);
+
+    put(xm, 0, 1, 0, NOTE(2, 0), 3, 0, 0, 0);
+    put(xm, 0, 1, 8, NOTE(3, 0), 0, 0, 0x3, 0x08);
+    cells(xm, 0, 1, 9, 23, 0, 0x3, 0x00);
+    cells(xm, 0, 1, 32, 16, 0, 0x4, 0x46);
+
+    put(xm, 0, 2, 0, NOTE(3, 4), 1, 0, 0xA, 0x01);
+    put(xm, 0, 2, 16, NOTE(3, 7), 1, 0, 0xC, 0x20);
+    cells(xm, 0, 2, 17, 15, 0, 0xA, 0x10);
+
+    put(xm, 0, 3, 0, NOTE(2, 0), 4, 0, 0xF, 0x05);
+    put(xm, 0, 3, 32, NOTE(2, 0), 4, 0, 0xF, 0x7D);
+    put(xm, 0, 3, 48, 0, 0, 0, 0xE, 0xC4);
+}
+
+static void
+build_channels32 (XM *xm)
+{
+    int ch, row;
+
+    xm->num_channels = 32;
+
+    // Everything at once, to see what the mixers cost
+    for(ch = 0; ch < 32; ch++) {
+	for(row = 0; row < 64; row += 8) {
+	    put(xm, 0, ch, row, NOTE(2 + (ch + row / 8) % 5, ch % 12), ch % 6 + 1,
+		0x10 + 16 * (ch % 4), 0x8, ch * 8);
+	}
+    }
+}
+
+static const struct {
+    const char *name;
+    void (*build) (XM *xm);
+} modules[] = {
+    { "loops", build_loops },
+    { "effects", build_effects },
+    { "envelopes", build_envelopes },
+    { "filters", build_filters },
+    { "amiga", build_amiga },
+    { "protracker", build_protracker },
+    { "channels32", build_channels32 }
+};
+
+const char *
+check_module_name (int n)
+{
+    return modules[n].name;
+}
+
+XM *
+check_module_new (int n)
+{
+    XM *xm = XM_New();
+
+    if(xm) {
+	check_module_instruments(xm);
+	modules[n].build(xm);
+    }
+
+    return xm;
+}
@@ -0,0 +1,37 @@
+/*
+ * The Real SoundTracker - test modules (header)
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _CHECK_MODULES_H
+#define _CHECK_MODULES_H
+
+#include "xm.h"
+
+/* Modules covering the effects, loop types, envelopes and filters,
+   used by "soundtracker --render-check" and check-compact. The last
+   one plays 32 channels at once, for the benchmark. */
+#define CHECK_MODULES          7
+#define CHECK_MODULE_HEAVIEST  (CHECK_MODULES - 1)
+
+const char *  check_module_name       (int n);
+
+/* Builds test module n, returns NULL if out of memory */
+XM *          check_module_new        (int n);
+
+#endif /* _CHECK_MODULES_H */
@@ -33,9 +33,21 @@ typedef struct st_io_driver {
     // get time offset since first sound output
     double   (*get_play_time) (void *d);
     int      (*get_play_rate) (void *d);
+
+    // Optional pull-model interface, for drivers that don't have a
+    // file descriptor to wait on. If set, the driver doesn't call
+    // audio_poll_add(); instead the audio thread calls pull()
+    // repeatedly while the driver is open, and the driver requests
+    // as many frames as it wants by calling audio_mix() itself.
+    // Returns the number of frames produced, or 0 on error.
+    int      (*pull)          (void *d);
 } st_io_driver;
 
-/* Install / remove poll() handlers, similar to gdk_input_add() */
+/* Install / remove poll() handlers, similar to gdk_input_add(). At
+   most AUDIO_MAX_POLL_INPUTS can be installed at a time. Errors on the
+   descriptor are passed on as GDK_INPUT_EXCEPTION. */
+#define AUDIO_MAX_POLL_INPUTS 4
+
 gpointer audio_poll_add       (int fd,
 			       GdkInputCondition cond,
 			       GdkInputFunction func,
@@ -56,11 +68,56 @@ void     audio_time           (double);
 void     audio_sampled        (gint16 *data,
 			       int count);
 
+/* dest may be NULL to only advance the player and the mixer, which
+   then end up in exactly the same state as when mixing */
 void     audio_mix            (void *dest,
 			       guint32 count,
 			       int mixfreq,
 			       int mixformat);
 
+/* To be called in a process fork()ed from the audio thread, which is
+   going to call audio_mix() only (see render-parallel.c): leaves out
+   the bookkeeping for the GUI, which nobody would pick up there. */
+void     audio_render_worker_start (void);
+
+/* Stem export: each channel, or each instrument, is additionally
+   rendered on its own */
+enum {
+    AUDIO_STEMS_NONE = 0,
+    AUDIO_STEMS_CHANNELS,
+    AUDIO_STEMS_INSTRUMENTS
+};
+
+/* The file output driver's object starts with this, and audio.c fills
+   it in before opening it */
+typedef struct st_file_render_params {
+    gchar *filename;
+    int stems;                  /* AUDIO_STEMS_* */
+    gboolean stems_mix;         /* render the full mix to 'filename', too */
+} st_file_render_params;
+
+/* Number of stems for the current module, and whether a stem is worth
+   writing at all (i.e. an instrument is played in the song) */
+int      audio_stems_count    (int mode);
+gboolean audio_stem_used      (int mode,
+			       int stem);
+
+/* File name for a stem, derived from the one for the full mix:
+   "song.wav" -> "song-ch01.wav" or "song-ins01.wav" */
+gchar *  audio_stem_filename  (const gchar *filename,
+			       int mode,
+			       int stem);
+
+/* Like audio_mix(), but additionally renders the stems into the
+   buffers in stems[] (NULL entries are left out) in one go, and dest
+   may be NULL. Everything is 16 bit stereo in machine byte order. If
+   the mixer can't render stems, they are left silent. */
+void     audio_mix_stems      (void *dest,
+			       void *stems[],
+			       int mode,
+			       guint32 count,
+			       int mixfreq);
+
 void     sample_editor_sampled            (void *dest,
 					   guint32 count,
 					   int mixfreq,
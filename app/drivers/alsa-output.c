@@ -42,6 +42,7 @@
 #include "i18n.h"
 #include "driver-inout.h"
 #include "mixer.h"
+#include "audio-stats.h"
 #include "errors.h"
 #include "gui-subs.h"
 #include "preferences.h"
@@ -92,7 +93,8 @@ alsa_poll_ready_playing (gpointer data,
     int w;
     struct timeval tv;
 
-    if((w = snd_pcm_write(d->soundfd, d->sndbuf, byte_count) != byte_count)) {
+    if((w = snd_pcm_write(d->soundfd, d->sndbuf, byte_count)) != byte_count) {
+      audio_stats_underrun("alsa");
       if(w == -1) {
 	fprintf(stderr, "driver_alsa: write() returned -1.\n");
       } else {
@@ -0,0 +1,743 @@
+/*
+ * The Real SoundTracker - ALSA 1.x (output) driver.
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+
+#if DRIVER_ALSA_09x
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+
+#include <alsa/asoundlib.h>
+
+#include <glib.h>
+#include <glib/gprintf.h>
+#include <gtk/gtk.h>
+
+#include "i18n.h"
+#include "driver-inout.h"
+#include "mixer.h"
+#include "audio-stats.h"
+#include "audio-latency.h"
+#include "errors.h"
+#include "gui-subs.h"
+#include "preferences.h"
+
+/* This driver uses the mmap interface of alsa-lib: audio_mix()
+   renders directly into the ring buffer of the device, so there is no
+   intermediate buffer and no copying. The device name is passed on to
+   snd_pcm_open() unchanged, so besides real hardware any PCM plugin
+   can be used, e.g. "null" or "file:FILE=/tmp/out.raw,FORMAT=raw".
+
+   With adaptive latency, the configured number of periods is only an
+   upper bound: the buffer is set up that large, but it is only filled
+   up to the number of periods audio_latency picks, which the device
+   is told by the wake-up threshold (avail_min). */
+
+#define ALSA1X_MAX_POLLFDS AUDIO_MAX_POLL_INPUTS
+
+typedef struct alsa1x_driver {
+    GtkWidget *configwidget;
+    GtkWidget *prefs_device_w;
+    GtkWidget *prefs_resolution_w[2];
+    GtkWidget *prefs_channels_w[2];
+    GtkWidget *prefs_mixfreq_w[7];
+    GtkWidget *bufsizespin_w, *bufsizelabel_w, *periodsspin_w, *estimatelabel_w;
+    GtkWidget *adaptive_w;
+
+    snd_pcm_t *pcm;
+    unsigned int playrate;
+    int stereo;
+    int bits;
+    int mf;
+    snd_pcm_uframes_t period_size;
+    snd_pcm_uframes_t buffer_size;
+
+    /* Protects the pcm against concurrent use by the audio thread and
+       get_play_time() called from the GUI thread */
+    GMutex *pcmmutex;
+
+    struct pollfd pfds[ALSA1X_MAX_POLLFDS];
+    gpointer polltags[ALSA1X_MAX_POLLFDS];
+    int npfds;
+    guint64 written;             /* frames committed since opening */
+
+    audio_latency latency;
+    int periods;                 /* number of periods to keep queued */
+
+    /* Time spent mixing and frames mixed since the last update of
+       the latency */
+    guint64 mix_us;
+    snd_pcm_uframes_t mix_frames;
+
+    gchar p_device[128];
+    int p_resolution;
+    int p_channels;
+    int p_mixfreq;
+    int p_fragsize;              /* log2 of the period size in frames */
+    int p_periods;
+    gboolean p_adaptive;
+} alsa1x_driver;
+
+static const int mixfreqs[] = { 8000, 16000, 22050, 44100, 48000, 96000, 192000, -1 };
+
+/* Wake up when there's room for a period more than the number to keep
+   queued */
+static int
+alsa1x_set_avail_min (alsa1x_driver *d)
+{
+    snd_pcm_sw_params_t *swparams;
+
+    snd_pcm_sw_params_alloca(&swparams);
+    snd_pcm_sw_params_current(d->pcm, swparams);
+    snd_pcm_sw_params_set_avail_min(d->pcm, swparams, d->buffer_size - (d->periods - 1) * d->period_size);
+    return snd_pcm_sw_params(d->pcm, swparams);
+}
+
+static gboolean
+alsa1x_recover (alsa1x_driver *d,
+		int err)
+{
+    if(err == -EPIPE) {
+	audio_stats_underrun("alsa1x");
+	if(d->p_adaptive) {
+	    audio_latency_underrun(&d->latency);
+	}
+    }
+
+    if((err = snd_pcm_recover(d->pcm, err, 1)) < 0) {
+	fprintf(stderr, "driver_alsa1x: can't recover from error: %s\n", snd_strerror(err));
+	return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void
+alsa1x_poll_ready_playing (gpointer data,
+			   gint source,
+			   GdkInputCondition condition)
+{
+    alsa1x_driver * const d = data;
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset, frames;
+    snd_pcm_sframes_t avail, committed;
+    int err, n, old;
+    guint64 start;
+    unsigned short revents;
+
+    g_mutex_lock(d->pcmmutex);
+
+    /* The descriptors don't necessarily mean what they say (plugins
+       like dmix wake us up through a socket), so let alsa-lib decode
+       them. We are called once for each one that is ready. */
+    for(n = 0; n < d->npfds; n++) {
+	d->pfds[n].revents = 0;
+	if(d->pfds[n].fd == source) {
+	    if(condition & GDK_INPUT_READ)
+		d->pfds[n].revents |= POLLIN;
+	    if(condition & GDK_INPUT_WRITE)
+		d->pfds[n].revents |= POLLOUT;
+	    if(condition & GDK_INPUT_EXCEPTION)
+		d->pfds[n].revents |= POLLERR;
+	}
+    }
+    if(snd_pcm_poll_descriptors_revents(d->pcm, d->pfds, d->npfds, &revents) < 0
+       || !(revents & (POLLOUT | POLLERR))) {
+	g_mutex_unlock(d->pcmmutex);
+	return;
+    }
+
+    /* Fill up to the number of periods to keep queued, but not more
+       than that many periods -- some plugins (null, file) are always
+       ready. */
+    for(n = d->periods; n > 0; n--) {
+	avail = snd_pcm_avail_update(d->pcm);
+	if(avail < 0) {
+	    if(!alsa1x_recover(d, avail)) {
+		break;
+	    }
+	    continue;
+	}
+	if((snd_pcm_uframes_t)avail < d->period_size
+	   || d->buffer_size - avail >= d->periods * d->period_size) {
+	    break;
+	}
+
+	frames = d->period_size;
+	if((err = snd_pcm_mmap_begin(d->pcm, &areas, &offset, &frames)) < 0) {
+	    if(!alsa1x_recover(d, err)) {
+		break;
+	    }
+	    continue;
+	}
+
+	/* Interleaved access: all channels share the first area. Don't
+	   block get_play_time() while mixing. */
+	g_mutex_unlock(d->pcmmutex);
+	start = audio_stats_now();
+	audio_mix((guint8*)areas[0].addr + (areas[0].first + offset * areas[0].step) / 8,
+		  frames, d->playrate, d->mf);
+	start = audio_stats_now() - start;
+	g_mutex_lock(d->pcmmutex);
+
+	committed = snd_pcm_mmap_commit(d->pcm, offset, frames);
+	if(committed < 0 || committed != frames) {
+	    if(!alsa1x_recover(d, committed >= 0 ? -EPIPE : committed)) {
+		break;
+	    }
+	    continue;
+	}
+	d->written += frames;
+
+	if(!d->p_adaptive) {
+	    continue;
+	}
+
+	/* mmap_begin() stops at the end of the buffer, so this may have
+	   been part of a period only */
+	d->mix_us += start;
+	d->mix_frames += frames;
+	if(d->mix_frames < d->period_size) {
+	    continue;
+	}
+	start = d->mix_us * d->period_size / d->mix_frames;
+	d->mix_us = 0;
+	d->mix_frames = 0;
+
+	if(audio_latency_update(&d->latency, start, audio_stats_now())) {
+	    old = d->periods;
+	    d->periods = d->latency.periods;
+	    if((err = alsa1x_set_avail_min(d)) < 0) {
+		// With fewer periods and the old threshold, we'd be woken up
+		// with nothing to do over and over again
+		fprintf(stderr, "driver_alsa1x: can't set wake-up threshold: %s\n", snd_strerror(err));
+		d->periods = d->latency.periods = old;
+		audio_stats_latency((guint64)old * d->period_size * 1000000 / d->playrate);
+	    }
+	}
+    }
+
+    g_mutex_unlock(d->pcmmutex);
+}
+
+static void
+prefs_init_from_structure (alsa1x_driver *d)
+{
+    int i;
+
+    gtk_toggle_button_set_state(GTK_TOGGLE_BUTTON(d->prefs_resolution_w[d->p_resolution / 8 - 1]), TRUE);
+    gtk_toggle_button_set_state(GTK_TOGGLE_BUTTON(d->prefs_channels_w[d->p_channels - 1]), TRUE);
+
+    for(i = 0; mixfreqs[i] != -1; i++) {
+	if(d->p_mixfreq == mixfreqs[i])
+	    break;
+    }
+    if(mixfreqs[i] == -1) {
+	i = 3;
+    }
+    gtk_toggle_button_set_state(GTK_TOGGLE_BUTTON(d->prefs_mixfreq_w[i]), TRUE);
+
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(d->bufsizespin_w), d->p_fragsize);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(d->periodsspin_w), d->p_periods);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(d->adaptive_w), d->p_adaptive);
+
+    gtk_entry_set_text(GTK_ENTRY(d->prefs_device_w), d->p_device);
+}
+
+static void
+prefs_update_estimate (alsa1x_driver *d)
+{
+    char buf[128];
+
+    g_sprintf(buf, d->p_adaptive ? _("Estimated audio delay: at most %f milliseconds")
+	      : _("Estimated audio delay: %f milliseconds"),
+	      (double)(1000 * (1 << d->p_fragsize) * d->p_periods) / d->p_mixfreq);
+    gtk_label_set_text(GTK_LABEL(d->estimatelabel_w), buf);
+}
+
+static void
+prefs_resolution_changed (void *a,
+			  alsa1x_driver *d)
+{
+    d->p_resolution = (find_current_toggle(d->prefs_resolution_w, 2) + 1) * 8;
+}
+
+static void
+prefs_channels_changed (void *a,
+			alsa1x_driver *d)
+{
+    d->p_channels = find_current_toggle(d->prefs_channels_w, 2) + 1;
+}
+
+static void
+prefs_mixfreq_changed (void *a,
+		       alsa1x_driver *d)
+{
+    d->p_mixfreq = mixfreqs[find_current_toggle(d->prefs_mixfreq_w, 7)];
+    prefs_update_estimate(d);
+}
+
+static void
+prefs_fragsize_changed (GtkSpinButton *w,
+			alsa1x_driver *d)
+{
+    char buf[64];
+
+    d->p_fragsize = gtk_spin_button_get_value_as_int(w);
+
+    g_sprintf(buf, _("(%d samples)"), 1 << d->p_fragsize);
+    gtk_label_set_text(GTK_LABEL(d->bufsizelabel_w), buf);
+    prefs_update_estimate(d);
+}
+
+static void
+prefs_periods_changed (GtkSpinButton *w,
+		       alsa1x_driver *d)
+{
+    d->p_periods = gtk_spin_button_get_value_as_int(w);
+    prefs_update_estimate(d);
+}
+
+static void
+prefs_adaptive_changed (GtkToggleButton *w,
+			alsa1x_driver *d)
+{
+    d->p_adaptive = gtk_toggle_button_get_active(w);
+    prefs_update_estimate(d);
+}
+
+static void
+alsa1x_device_changed (void *a,
+		       alsa1x_driver *d)
+{
+    strncpy(d->p_device, gtk_entry_get_text(GTK_ENTRY(d->prefs_device_w)), 127);
+}
+
+static void
+alsa1x_make_config_widgets (alsa1x_driver *d)
+{
+    GtkWidget *thing, *mainbox, *box2, *box3;
+    static const char *resolutionlabels[] = { "8 bits", "16 bits", NULL };
+    static const char *channelslabels[] = { "Mono", "Stereo", NULL };
+    static const char *mixfreqlabels[] = { "8000", "16000", "22050", "44100", "48000", "96000", "192000", NULL };
+
+    d->configwidget = mainbox = gtk_vbox_new(FALSE, 2);
+
+    thing = gtk_label_new(_("These changes won't take effect until you restart playing."));
+    gtk_widget_show(thing);
+    gtk_box_pack_start(GTK_BOX(mainbox), thing, FALSE, TRUE, 0);
+
+    thing = gtk_hseparator_new();
+    gtk_widget_show(thing);
+    gtk_box_pack_start(GTK_BOX(mainbox), thing, FALSE, TRUE, 0);
+
+    box2 = gtk_hbox_new(FALSE, 4);
+    gtk_widget_show(box2);
+    gtk_box_pack_start(GTK_BOX(mainbox), box2, FALSE, TRUE, 0);
+
+    thing = gtk_label_new(_("Output device (e.g. 'default', 'hw:0,0' or 'null'):"));
+    gtk_widget_show(thing);
+    gtk_box_pack_start(GTK_BOX(box2), thing, FALSE, TRUE, 0);
+    add_empty_hbox(box2);
+    thing = gtk_entry_new_with_max_length(126);
+    gtk_widget_show(thing);
+    gtk_box_pack_start(GTK_BOX(box2), thing, FALSE, TRUE, 0);
+    gtk_entry_set_text(GTK_ENTRY(thing), d->p_device);
+    g_signal_connect_after(thing, "changed",
+			     G_CALLBACK(alsa1x_device_changed), d);
+    d->prefs_device_w = thing;
+
+    box2 = gtk_hbox_new(FALSE, 4);
+    gtk_widget_show(box2);
+    gtk_box_pack_start(GTK_BOX(mainbox), box2, FALSE, TRUE, 0);
+
+    thing = gtk_label_new(_("Resolution:"));
+    gtk_widget_show(thing);
+    gtk_box_pack_start(GTK_BOX(box2), thing, FALSE, TRUE, 0);
+    add_empty_hbox(box2);
+    make_radio_group_full(resolutionlabels, box2, d->prefs_resolution_w, FALSE, TRUE, (void(*)())prefs_resolution_changed, d);
+
+    box2 = gtk_hbox_new(FALSE, 4);
+    gtk_widget_show(box2);
+    gtk_box_pack_start(GTK_BOX(mainbox), box2, FALSE, TRUE, 0);
+
+    thing = gtk_label_new(_("Channels:"));
+    gtk_widget_show(thing);
+    gtk_box_pack_start(GTK_BOX(box2), thing, FALSE, TRUE, 0);
+    add_empty_hbox(box2);
+    make_radio_group_full(channelslabels, box2, d->prefs_channels_w, FALSE, TRUE, (void(*)())prefs_channels_changed, d);
+
+    box2 = gtk_hbox_new(FALSE, 4);
+    gtk_widget_show(box2);
+    gtk_box_pack_start(GTK_BOX(mainbox), box2, FALSE, TRUE, 0);
+
+    thing = gtk_label_new(_("Frequency [Hz]:"));
+    gtk_widget_show(thing);
+    gtk_box_pack_start(GTK_BOX(box2), thing, FALSE, TRUE, 0);
+    add_empty_hbox(box2);
+    make_radio_group_full(mixfreqlabels, box2, d->prefs_mixfreq_w, FALSE, TRUE, (void(*)())prefs_mixfreq_changed, d);
+
+    box2 = gtk_hbox_new(FALSE, 4);
+    gtk_widget_show(box2);
+    gtk_box_pack_start(GTK_BOX(mainbox), box2, FALSE, TRUE, 0);
+
+    thing = gtk_label_new(_("Period Size:"));
+    gtk_widget_show(thing);
+    gtk_box_pack_start(GTK_BOX(box2), thing, FALSE, TRUE, 0);
+    add_empty_hbox(box2);
+
+    box3 = gtk_vbox_new(FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(box2), box3, FALSE, TRUE, 0);
+    gtk_widget_show(box3);
+
+    d->bufsizespin_w = thing = gtk_spin_button_new(GTK_ADJUSTMENT(gtk_adjustment_new(5.0, 5.0, 15.0, 1.0, 1.0, 0.0)), 0, 0);
+    gtk_box_pack_start(GTK_BOX(box3), thing, FALSE, TRUE, 0);
+    gtk_widget_show(thing);
+    g_signal_connect(thing, "value-changed",
+			G_CALLBACK(prefs_fragsize_changed), d);
+
+    d->bufsizelabel_w = thing = gtk_label_new("");
+    gtk_box_pack_start(GTK_BOX(box3), thing, FALSE, TRUE, 0);
+    gtk_widget_show(thing);
+
+    box2 = gtk_hbox_new(FALSE, 4);
+    gtk_widget_show(box2);
+    gtk_box_pack_start(GTK_BOX(mainbox), box2, FALSE, TRUE, 0);
+
+    thing = gtk_label_new(_("Periods:"));
+    gtk_widget_show(thing);
+    gtk_box_pack_start(GTK_BOX(box2), thing, FALSE, TRUE, 0);
+    add_empty_hbox(box2);
+
+    d->periodsspin_w = thing = gtk_spin_button_new(GTK_ADJUSTMENT(gtk_adjustment_new(2.0, 2.0, 16.0, 1.0, 1.0, 0.0)), 0, 0);
+    gtk_box_pack_start(GTK_BOX(box2), thing, FALSE, TRUE, 0);
+    gtk_widget_show(thing);
+    g_signal_connect(thing, "value-changed",
+			G_CALLBACK(prefs_periods_changed), d);
+
+    thing = d->adaptive_w = gtk_check_button_new_with_label(_("Adapt the latency to the load, up to this many periods"));
+    gtk_box_pack_start(GTK_BOX(mainbox), thing, FALSE, TRUE, 0);
+    gtk_widget_show(thing);
+    g_signal_connect(thing, "toggled",
+		     G_CALLBACK(prefs_adaptive_changed), d);
+
+    box2 = gtk_hbox_new(FALSE, 4);
+    gtk_widget_show(box2);
+    gtk_box_pack_start(GTK_BOX(mainbox), box2, FALSE, TRUE, 0);
+
+    add_empty_hbox(box2);
+    d->estimatelabel_w = thing = gtk_label_new("");
+    gtk_box_pack_start(GTK_BOX(box2), thing, FALSE, TRUE, 0);
+    gtk_widget_show(thing);
+    add_empty_hbox(box2);
+
+    prefs_init_from_structure(d);
+}
+
+static GtkWidget *
+alsa1x_getwidget (void *dp)
+{
+    alsa1x_driver * const d = dp;
+
+    return d->configwidget;
+}
+
+static void *
+alsa1x_new (void)
+{
+    alsa1x_driver *d = g_new(alsa1x_driver, 1);
+
+    strcpy(d->p_device, "default");
+    d->p_mixfreq = 44100;
+    d->p_channels = 2;
+    d->p_resolution = 16;
+    d->p_fragsize = 10; // 1024
+    d->p_periods = 2;
+    d->p_adaptive = FALSE;
+    d->periods = 0;
+    d->pcm = NULL;
+    d->npfds = 0;
+    d->pcmmutex = g_mutex_new();
+
+    alsa1x_make_config_widgets(d);
+
+    return d;
+}
+
+static void
+alsa1x_destroy (void *dp)
+{
+    alsa1x_driver * const d = dp;
+
+    gtk_widget_destroy(d->configwidget);
+    g_mutex_free(d->pcmmutex);
+
+    g_free(dp);
+}
+
+static void
+alsa1x_release (void *dp)
+{
+    alsa1x_driver * const d = dp;
+    int i;
+
+    for(i = 0; i < d->npfds; i++) {
+	audio_poll_remove(d->polltags[i]);
+    }
+    d->npfds = 0;
+
+    g_mutex_lock(d->pcmmutex);
+    if(d->pcm) {
+	snd_pcm_drop(d->pcm);
+	snd_pcm_close(d->pcm);
+	d->pcm = NULL;
+	audio_stats_latency(0);
+    }
+    g_mutex_unlock(d->pcmmutex);
+}
+
+/* Pick the first sample format the device supports, in order of
+   preference, and return the matching mixer format */
+static int
+alsa1x_choose_format (alsa1x_driver *d,
+		      snd_pcm_hw_params_t *hwparams)
+{
+    static const struct {
+	snd_pcm_format_t format;
+	int bits;
+	int mf;
+    } formats[] = {
+	{ SND_PCM_FORMAT_S16_LE, 16, ST_MIXER_FORMAT_S16_LE },
+	{ SND_PCM_FORMAT_S16_BE, 16, ST_MIXER_FORMAT_S16_BE },
+	{ SND_PCM_FORMAT_U16_LE, 16, ST_MIXER_FORMAT_U16_LE },
+	{ SND_PCM_FORMAT_U16_BE, 16, ST_MIXER_FORMAT_U16_BE },
+	{ SND_PCM_FORMAT_S8, 8, ST_MIXER_FORMAT_S8 },
+	{ SND_PCM_FORMAT_U8, 8, ST_MIXER_FORMAT_U8 },
+    };
+    int i, start = d->p_resolution == 16 ? 0 : 4;
+
+    for(i = start; i < sizeof(formats) / sizeof(formats[0]); i++) {
+	if(snd_pcm_hw_params_set_format(d->pcm, hwparams, formats[i].format) == 0) {
+	    d->bits = formats[i].bits;
+	    return formats[i].mf;
+	}
+    }
+
+    return -1;
+}
+
+static gboolean
+alsa1x_open (void *dp)
+{
+    alsa1x_driver * const d = dp;
+    snd_pcm_hw_params_t *hwparams;
+    snd_pcm_sw_params_t *swparams;
+    unsigned int channels, periods;
+    int err, mf, i, n;
+    char buf[256];
+
+    snd_pcm_hw_params_alloca(&hwparams);
+    snd_pcm_sw_params_alloca(&swparams);
+
+    if((err = snd_pcm_open(&d->pcm, d->p_device, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK)) < 0) {
+	g_sprintf(buf, _("Couldn't open ALSA device '%s' for sound output:\n%s"), d->p_device, snd_strerror(err));
+	error_error(buf);
+	d->pcm = NULL;
+	goto out;
+    }
+
+    if((err = snd_pcm_hw_params_any(d->pcm, hwparams)) < 0
+       || (err = snd_pcm_hw_params_set_access(d->pcm, hwparams, SND_PCM_ACCESS_MMAP_INTERLEAVED)) < 0) {
+	g_sprintf(buf, _("ALSA device '%s' doesn't support mmap access:\n%s"), d->p_device, snd_strerror(err));
+	error_error(buf);
+	goto out;
+    }
+
+    if((mf = alsa1x_choose_format(d, hwparams)) == -1) {
+	error_error(_("Required sound output format not supported.\n"));
+	goto out;
+    }
+
+    channels = d->p_channels;
+    if(snd_pcm_hw_params_set_channels_near(d->pcm, hwparams, &channels) < 0
+       || channels > 2) {
+	error_error(_("Required sound output format not supported.\n"));
+	goto out;
+    }
+    d->stereo = channels == 2;
+    if(d->stereo) {
+	mf |= ST_MIXER_FORMAT_STEREO;
+    }
+    d->mf = mf;
+
+    d->playrate = d->p_mixfreq;
+    snd_pcm_hw_params_set_rate_near(d->pcm, hwparams, &d->playrate, NULL);
+
+    // Period / buffer size negotiation
+    d->period_size = 1 << d->p_fragsize;
+    snd_pcm_hw_params_set_period_size_near(d->pcm, hwparams, &d->period_size, NULL);
+    periods = d->p_periods;
+    snd_pcm_hw_params_set_periods_near(d->pcm, hwparams, &periods, NULL);
+
+    if((err = snd_pcm_hw_params(d->pcm, hwparams)) < 0) {
+	g_sprintf(buf, _("Couldn't configure ALSA device '%s':\n%s"), d->p_device, snd_strerror(err));
+	error_error(buf);
+	goto out;
+    }
+
+    snd_pcm_hw_params_get_period_size(hwparams, &d->period_size, NULL);
+    snd_pcm_hw_params_get_buffer_size(hwparams, &d->buffer_size);
+
+    /* Adaptive latency starts where it ended the last time, at least
+       two periods are needed to mix one while the other is played */
+    periods = d->buffer_size / d->period_size;
+    if(d->p_adaptive && periods > 2) {
+	audio_latency_init(&d->latency, 2, periods, d->periods ? d->periods : periods,
+			   d->period_size, d->playrate, audio_stats_now());
+	d->periods = d->latency.periods;
+    } else {
+	d->periods = periods;
+	audio_stats_latency((guint64)periods * d->period_size * 1000000 / d->playrate);
+    }
+
+    /* Start playing as soon as the periods to keep queued have been
+       filled, and wake us up whenever a period can be written. */
+    snd_pcm_sw_params_current(d->pcm, swparams);
+    snd_pcm_sw_params_set_start_threshold(d->pcm, swparams, d->periods * d->period_size);
+    snd_pcm_sw_params_set_avail_min(d->pcm, swparams, d->buffer_size - (d->periods - 1) * d->period_size);
+    if((err = snd_pcm_sw_params(d->pcm, swparams)) < 0) {
+	g_sprintf(buf, _("Couldn't configure ALSA device '%s':\n%s"), d->p_device, snd_strerror(err));
+	error_error(buf);
+	goto out;
+    }
+
+    n = snd_pcm_poll_descriptors_count(d->pcm);
+    if(n < 1 || n > ALSA1X_MAX_POLLFDS
+       || snd_pcm_poll_descriptors(d->pcm, d->pfds, n) != n) {
+	error_error(_("Couldn't get the poll descriptors from ALSA.\n"));
+	goto out;
+    }
+
+    d->written = 0;
+    d->mix_us = 0;
+    d->mix_frames = 0;
+    for(i = 0; i < n; i++) {
+	d->polltags[i] = audio_poll_add(d->pfds[i].fd,
+					((d->pfds[i].events & POLLIN) ? GDK_INPUT_READ : 0)
+					| ((d->pfds[i].events & POLLOUT) ? GDK_INPUT_WRITE : 0),
+					alsa1x_poll_ready_playing, d);
+    }
+    d->npfds = n;
+
+    return TRUE;
+
+  out:
+    alsa1x_release(dp);
+    return FALSE;
+}
+
+static double
+alsa1x_get_play_time (void *dp)
+{
+    alsa1x_driver * const d = dp;
+    snd_pcm_sframes_t delay = 0;
+    guint64 played;
+
+    g_mutex_lock(d->pcmmutex);
+    if(d->pcm == NULL) {
+	g_mutex_unlock(d->pcmmutex);
+	return 0.0;
+    }
+    if(snd_pcm_state(d->pcm) != SND_PCM_STATE_RUNNING || snd_pcm_delay(d->pcm, &delay) < 0) {
+	// Not started yet (or in an xrun): nothing of the buffer was played
+	delay = d->written < d->buffer_size ? d->written : d->buffer_size;
+    }
+    played = d->written > (guint64)delay ? d->written - delay : 0;
+    g_mutex_unlock(d->pcmmutex);
+
+    return (double)played / d->playrate;
+}
+
+static inline int
+alsa1x_get_play_rate (void *d)
+{
+    alsa1x_driver * const dp = d;
+    return dp->playrate;
+}
+
+static gboolean
+alsa1x_loadsettings (void *dp,
+		     prefs_node *f)
+{
+    alsa1x_driver * const d = dp;
+
+    prefs_get_string(f, "alsa1x-device", d->p_device);
+    prefs_get_int(f, "alsa1x-resolution", &d->p_resolution);
+    prefs_get_int(f, "alsa1x-channels", &d->p_channels);
+    prefs_get_int(f, "alsa1x-mixfreq", &d->p_mixfreq);
+    prefs_get_int(f, "alsa1x-fragsize", &d->p_fragsize);
+    prefs_get_int(f, "alsa1x-periods", &d->p_periods);
+    prefs_get_int(f, "alsa1x-adaptive", &d->p_adaptive);
+
+    prefs_init_from_structure(d);
+
+    return TRUE;
+}
+
+static gboolean
+alsa1x_savesettings (void *dp,
+		     prefs_node *f)
+{
+    alsa1x_driver * const d = dp;
+
+    prefs_put_string(f, "alsa1x-device", d->p_device);
+    prefs_put_int(f, "alsa1x-resolution", d->p_resolution);
+    prefs_put_int(f, "alsa1x-channels", d->p_channels);
+    prefs_put_int(f, "alsa1x-mixfreq", d->p_mixfreq);
+    prefs_put_int(f, "alsa1x-fragsize", d->p_fragsize);
+    prefs_put_int(f, "alsa1x-periods", d->p_periods);
+    prefs_put_int(f, "alsa1x-adaptive", d->p_adaptive);
+
+    return TRUE;
+}
+
+st_io_driver driver_out_alsa1x = {
+    { "ALSA 1.x Output",
+
+      alsa1x_new,
+      alsa1x_destroy,
+
+      alsa1x_open,
+      alsa1x_release,
+
+      alsa1x_getwidget,
+      alsa1x_loadsettings,
+      alsa1x_savesettings,
+    },
+
+    alsa1x_get_play_time,
+    alsa1x_get_play_rate
+};
+
+#endif /* DRIVER_ALSA_09x */
@@ -42,6 +42,7 @@
 #include "i18n.h"
 #include "driver-inout.h"
 #include "mixer.h"
+#include "audio-stats.h"
 #include "errors.h"
 #include "gui-subs.h"
 #include "preferences.h"
@@ -94,6 +95,7 @@ alsa_poll_ready_playing (gpointer data,
 
     w = snd_pcm_write(d->soundfd, d->sndbuf, byte_count);
     if(w != byte_count) {
+      audio_stats_underrun("alsa2");
       if(w < 0) {
 	fprintf(stderr, "driver_alsa2: write() returned -1.\n--- \"%s\"", snd_strerror(w));
       } else {
@@ -39,6 +39,7 @@
 #include "i18n.h"
 #include "driver-inout.h"
 #include "mixer.h"
+#include "audio-stats.h"
 #include "errors.h"
 #include "gui-subs.h"
 #include "preferences.h"
@@ -69,7 +70,8 @@ esd_poll_ready_playing (gpointer data,
     struct timeval tv;
 
     if(!d->firstpoll) {
-	if((w = write(d->out_sock, d->sndbuf, ESD_BUF_SIZE) != ESD_BUF_SIZE)) {
+	if((w = write(d->out_sock, d->sndbuf, ESD_BUF_SIZE)) != ESD_BUF_SIZE) {
+	    audio_stats_underrun("esd");
 	    if(w == -1) {
 		fprintf(stderr, "driver_esd: write() returned -1.\n");
 	    } else {
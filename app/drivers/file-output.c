@@ -39,59 +39,147 @@
 #include "errors.h"
 #include "gui-subs.h"
 #include "preferences.h"
+#include "render-parallel.h"
 
 typedef struct sndfile_driver {
-    gchar *filename; /* must be the first entry. is altered by audio.c (hack, hack) */
+    st_file_render_params params; /* must be the first entry. is filled in by audio.c */
 
     SNDFILE *outfile;
     SF_INFO sfinfo;
 
-    int pipe[2];
-    gpointer polltag;
-    int firstpoll;
-
     gint16 *sndbuf;
     int sndbuf_size;
     double playtime;
 
+    int numstems;
+    SNDFILE **stemfiles;          /* NULL for stems left out */
+    void **stembufs;
+    gint16 *stembuf;              /* one block for each stem */
+
     int p_resolution;
     int p_channels;
     int p_mixfreq;
+    int p_workers;
+
+    render_parallel *parallel;
 
     GtkWidget *configwidget;
+    GtkWidget *prefs_mixfreq_w[5];
 } sndfile_driver;
 
-static void
-sndfile_poll_ready_playing (gpointer data,
-			 gint source,
-			 GdkInputCondition condition)
+/* Renders aren't limited by what a sound card can play, so the high
+   rates are there for mastering */
+static const int mixfreqs[] = { 44100, 48000, 88200, 96000, 192000, -1 };
+
+static gboolean
+sndfile_write (void *dp,
+	       void *buf,
+	       int frames)
+{
+    sndfile_driver * const d = dp;
+
+    return sf_writef_short(d->outfile, buf, frames) == frames;
+}
+
+static int
+sndfile_pull_stems (sndfile_driver *d)
+{
+    int frames = d->sndbuf_size / 4;
+    int i;
+
+    for(i = 0; i < d->numstems; i++) {
+	d->stembufs[i] = d->stemfiles[i] ? d->stembuf + i * frames * 2 : NULL;
+    }
+
+    audio_mix_stems(d->outfile ? d->sndbuf : NULL, d->stembufs, d->params.stems, frames, d->p_mixfreq);
+
+    if(d->outfile && !sndfile_write(d, d->sndbuf, frames)) {
+	return 0;
+    }
+    for(i = 0; i < d->numstems; i++) {
+	if(d->stemfiles[i]
+	   && sf_writef_short(d->stemfiles[i], d->stembuf + i * frames * 2, frames) != frames) {
+	    return 0;
+	}
+    }
+    d->playtime += (double)frames / d->p_mixfreq;
+
+    return frames;
+}
+
+static int
+sndfile_pull (void *dp)
 {
-    sndfile_driver * const d = data;
+    sndfile_driver * const d = dp;
+    int frames = d->sndbuf_size / 4;
 
-    if(!d->firstpoll) {
-	sf_writef_short (d->outfile, d->sndbuf, d->sndbuf_size / 4);
-	d->playtime += (double)(d->sndbuf_size) / 4 / d->p_mixfreq;
+    if(d->params.stems) {
+	return sndfile_pull_stems(d);
+    }
+
+    if(d->parallel) {
+	frames = render_parallel_pull(d->parallel);
+	d->playtime += (double)frames / d->p_mixfreq;
+	return frames;
     }
 
-    d->firstpoll = FALSE;
 #ifdef WORDS_BIGENDIAN
-    audio_mix(d->sndbuf, d->sndbuf_size / 4, d->p_mixfreq, ST_MIXER_FORMAT_S16_BE | ST_MIXER_FORMAT_STEREO);
+    audio_mix(d->sndbuf, frames, d->p_mixfreq, ST_MIXER_FORMAT_S16_BE | ST_MIXER_FORMAT_STEREO);
 #else
-    audio_mix(d->sndbuf, d->sndbuf_size / 4, d->p_mixfreq, ST_MIXER_FORMAT_S16_LE | ST_MIXER_FORMAT_STEREO);
+    audio_mix(d->sndbuf, frames, d->p_mixfreq, ST_MIXER_FORMAT_S16_LE | ST_MIXER_FORMAT_STEREO);
 #endif
 
+    if(!sndfile_write(d, d->sndbuf, frames)) {
+	return 0;
+    }
+    d->playtime += (double)frames / d->p_mixfreq;
+
+    return frames;
+}
+
+static void
+sndfile_prefs_init_from_structure (sndfile_driver *d)
+{
+    int i;
+
+    for(i = 0; mixfreqs[i] != -1; i++) {
+	if(d->p_mixfreq == mixfreqs[i])
+	    break;
+    }
+    if(mixfreqs[i] == -1) {
+	i = 0;
+    }
+    // Setting a button that is active already doesn't call back
+    d->p_mixfreq = mixfreqs[i];
+    gtk_toggle_button_set_state(GTK_TOGGLE_BUTTON(d->prefs_mixfreq_w[i]), TRUE);
+}
+
+static void
+sndfile_prefs_mixfreq_changed (void *a,
+                               sndfile_driver *d)
+{
+    d->p_mixfreq = mixfreqs[find_current_toggle(d->prefs_mixfreq_w, 5)];
 }
 
 static void
 sndfile_make_config_widgets (sndfile_driver *d)
 {
-    GtkWidget *thing, *mainbox;
+    GtkWidget *thing, *mainbox, *box2;
+    static const char *mixfreqlabels[] = { "44100", "48000", "88200", "96000", "192000", NULL };
 
     d->configwidget = mainbox = gtk_vbox_new(FALSE, 2);
-   
-    thing = gtk_label_new(_("no settings (yet), sorry!"));
-    gtk_box_pack_start(GTK_BOX(mainbox), thing, FALSE, TRUE, 0);
+
+    box2 = gtk_hbox_new(FALSE, 4);
+    gtk_widget_show(box2);
+    gtk_box_pack_start(GTK_BOX(mainbox), box2, FALSE, TRUE, 0);
+
+    thing = gtk_label_new(_("Frequency [Hz]:"));
     gtk_widget_show(thing);
+    gtk_box_pack_start(GTK_BOX(box2), thing, FALSE, TRUE, 0);
+    add_empty_hbox(box2);
+    make_radio_group_full(mixfreqlabels, box2, d->prefs_mixfreq_w, FALSE, TRUE, (void(*)())sndfile_prefs_mixfreq_changed, d);
+
+    sndfile_prefs_init_from_structure(d);
 }
 
 static GtkWidget *
@@ -110,13 +198,17 @@ sndfile_new (void)
     d->p_mixfreq = 44100;
     d->p_channels = 2;
     d->p_resolution = 16;
+    d->p_workers = render_parallel_default_workers();
+    d->parallel = NULL;
     d->sndbuf = NULL;
-    d->polltag = NULL;
+    d->outfile = NULL;
+    d->numstems = 0;
+    d->stemfiles = NULL;
+    d->stembufs = NULL;
+    d->stembuf = NULL;
 
     sndfile_make_config_widgets(d);
 
-    pipe(d->pipe);
-
     return d;
 }
 
@@ -125,12 +217,9 @@ sndfile_destroy (void *dp)
 {
     sndfile_driver * const d = dp;
 
-    close(d->pipe[0]);
-    close(d->pipe[1]);
-
     gtk_widget_destroy(d->configwidget);
 
-    g_free(d->filename);
+    g_free(d->params.filename);
 
     g_free(dp);
 }
@@ -139,38 +228,69 @@ static void
 sndfile_release (void *dp)
 {
     sndfile_driver * const d = dp;
+    int i;
+
+    if(d->parallel) {
+	render_parallel_free(d->parallel);
+	d->parallel = NULL;
+    }
 
     free(d->sndbuf);
     d->sndbuf = NULL;
 
-    audio_poll_remove(d->polltag);
-    d->polltag = NULL;
-
     if(d->outfile != NULL) {
 	sf_close(d->outfile);
 	d->outfile = NULL;
     }
+
+    for(i = 0; i < d->numstems; i++) {
+	if(d->stemfiles[i]) {
+	    sf_close(d->stemfiles[i]);
+	}
+    }
+    g_free(d->stemfiles);
+    d->stemfiles = NULL;
+    g_free(d->stembufs);
+    d->stembufs = NULL;
+    free(d->stembuf);
+    d->stembuf = NULL;
+    d->numstems = 0;
+}
+
+static SNDFILE *
+sndfile_create (sndfile_driver *d,
+		const gchar *filename)
+{
+    SNDFILE *f = sf_open (filename, SFM_WRITE, &d->sfinfo);
+
+    if(!f) {
+	error_error(_("Can't open file for writing."));
+	return NULL;
+    }
+
+    /* In case we're running setuid root... */
+    chown(filename, getuid(), getgid());
+
+    return f;
 }
 
 static gboolean
 sndfile_open (void *dp)
 {
     sndfile_driver * const d = dp;
+    gchar *fn;
+    int i;
 
     d->sfinfo.channels = 2 ;
-    d->sfinfo.samplerate = 44100 ;
+    d->sfinfo.samplerate = d->p_mixfreq ;
     d->sfinfo.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16 ;
 
-    d->outfile = sf_open (d->filename, SFM_WRITE, &d->sfinfo);
-
-    if(!d->outfile) {
-	error_error(_("Can't open file for writing."));
-	goto out;
+    if(!d->params.stems || d->params.stems_mix) {
+	if(!(d->outfile = sndfile_create(d, d->params.filename))) {
+	    goto out;
+	}
     }
 
-    /* In case we're running setuid root... */
-    chown(d->filename, getuid(), getgid());
-
     d->sndbuf_size = 16384;
     d->sndbuf = malloc(d->sndbuf_size);
     if(!d->sndbuf) {
@@ -178,10 +298,39 @@ sndfile_open (void *dp)
 	goto out;
     }
 
-    d->polltag = audio_poll_add(d->pipe[1], GDK_INPUT_WRITE, sndfile_poll_ready_playing, d);
-    d->firstpoll = TRUE;
+    if(d->params.stems) {
+	d->numstems = audio_stems_count(d->params.stems);
+	d->stemfiles = g_new0(SNDFILE*, d->numstems);
+	d->stembufs = g_new(void*, d->numstems);
+	d->stembuf = malloc(d->numstems * d->sndbuf_size);
+	if(!d->stembuf) {
+	    error_error("Can't allocate mix buffer.");
+	    goto out;
+	}
+	for(i = 0; i < d->numstems; i++) {
+	    if(audio_stem_used(d->params.stems, i)) {
+		fn = audio_stem_filename(d->params.filename, d->params.stems, i);
+		d->stemfiles[i] = sndfile_create(d, fn);
+		g_free(fn);
+		if(!d->stemfiles[i]) {
+		    goto out;
+		}
+	    }
+	}
+    }
+
     d->playtime = 0.0;
 
+    if(d->p_workers > 1 && !d->params.stems) {
+	d->parallel = render_parallel_new(d->p_workers, d->sndbuf_size / 4, d->p_mixfreq,
+#ifdef WORDS_BIGENDIAN
+					  ST_MIXER_FORMAT_S16_BE | ST_MIXER_FORMAT_STEREO,
+#else
+					  ST_MIXER_FORMAT_S16_LE | ST_MIXER_FORMAT_STEREO,
+#endif
+					  4, sndfile_write, d);
+    }
+
     return TRUE;
 
   out:
@@ -192,7 +341,7 @@ sndfile_open (void *dp)
 static double
 sndfile_get_play_time (void *dp)
 {
-  //    sndfile_driver * const d = dp;
+    sndfile_driver * const d = dp;
 
     return d->playtime;
 }
@@ -201,7 +350,12 @@ static gboolean
 sndfile_loadsettings (void *dp,
 		   prefs_node *f)
 {
-//    sndfile_driver * const d = dp;
+    sndfile_driver * const d = dp;
+
+    prefs_get_int(f, "render-workers", &d->p_workers);
+    prefs_get_int(f, "render-mixfreq", &d->p_mixfreq);
+
+    sndfile_prefs_init_from_structure(d);
 
     return TRUE;
 }
@@ -210,7 +364,10 @@ static gboolean
 sndfile_savesettings (void *dp,
 		   prefs_node *f)
 {
-//    sndfile_driver * const d = dp;
+    sndfile_driver * const d = dp;
+
+    prefs_put_int(f, "render-workers", d->p_workers);
+    prefs_put_int(f, "render-mixfreq", d->p_mixfreq);
 
     return TRUE;
 }
@@ -230,6 +387,9 @@ st_io_driver driver_out_file = {
     },
 
     sndfile_get_play_time,
+    NULL,
+
+    sndfile_pull
 };
 
 #elif !defined (NO_AUDIOFILE)
@@ -250,53 +410,140 @@ st_io_driver driver_out_file = {
 #include "errors.h"
 #include "gui-subs.h"
 #include "preferences.h"
+#include "render-parallel.h"
 
 typedef struct file_driver {
-    gchar *filename; /* must be the first entry. is altered by audio.c (hack, hack) */
+    st_file_render_params params; /* must be the first entry. is filled in by audio.c */
 
     AFfilehandle outfile;
-    int pipe[2];
-    gpointer polltag;
-    int firstpoll;
 
     gint16 *sndbuf;
     int sndbuf_size;
     double playtime;
 
+    int numstems;
+    AFfilehandle *stemfiles;      /* 0 for stems left out */
+    void **stembufs;
+    gint16 *stembuf;              /* one block for each stem */
+
     int p_resolution;
     int p_channels;
     int p_mixfreq;
+    int p_workers;
+
+    render_parallel *parallel;
 
     GtkWidget *configwidget;
+    GtkWidget *prefs_mixfreq_w[5];
 } file_driver;
 
-static void
-file_poll_ready_playing (gpointer data,
-			 gint source,
-			 GdkInputCondition condition)
+static const int mixfreqs[] = { 44100, 48000, 88200, 96000, 192000, -1 };
+
+static gboolean
+file_write (void *dp,
+	    void *buf,
+	    int frames)
+{
+    file_driver * const d = dp;
+
+    return afWriteFrames(d->outfile, AF_DEFAULT_TRACK, buf, frames) == frames;
+}
+
+static int
+file_pull_stems (file_driver *d)
+{
+    int frames = d->sndbuf_size / 4;
+    int i;
+
+    for(i = 0; i < d->numstems; i++) {
+	d->stembufs[i] = d->stemfiles[i] ? d->stembuf + i * frames * 2 : NULL;
+    }
+
+    audio_mix_stems(d->outfile ? d->sndbuf : NULL, d->stembufs, d->params.stems, frames, d->p_mixfreq);
+
+    if(d->outfile && !file_write(d, d->sndbuf, frames)) {
+	return 0;
+    }
+    for(i = 0; i < d->numstems; i++) {
+	if(d->stemfiles[i]
+	   && afWriteFrames(d->stemfiles[i], AF_DEFAULT_TRACK, d->stembuf + i * frames * 2, frames) != frames) {
+	    return 0;
+	}
+    }
+    d->playtime += (double)frames / d->p_mixfreq;
+
+    return frames;
+}
+
+static int
+file_pull (void *dp)
 {
-    file_driver * const d = data;
+    file_driver * const d = dp;
+    int frames = d->sndbuf_size / 4;
+
+    if(d->params.stems) {
+	return file_pull_stems(d);
+    }
+
+    if(d->parallel) {
+	frames = render_parallel_pull(d->parallel);
+	d->playtime += (double)frames / d->p_mixfreq;
+	return frames;
+    }
+
+    audio_mix(d->sndbuf, frames, d->p_mixfreq, ST_MIXER_FORMAT_S16_LE | ST_MIXER_FORMAT_STEREO);
 
-    if(!d->firstpoll) {
-	afWriteFrames(d->outfile, AF_DEFAULT_TRACK, d->sndbuf, d->sndbuf_size / 4);
-	d->playtime += (double)(d->sndbuf_size) / 4 / d->p_mixfreq;
+    if(!file_write(d, d->sndbuf, frames)) {
+	return 0;
     }
+    d->playtime += (double)frames / d->p_mixfreq;
 
-    d->firstpoll = FALSE;
+    return frames;
+}
+
+static void
+file_prefs_init_from_structure (file_driver *d)
+{
+    int i;
+
+    for(i = 0; mixfreqs[i] != -1; i++) {
+	if(d->p_mixfreq == mixfreqs[i])
+	    break;
+    }
+    if(mixfreqs[i] == -1) {
+	i = 0;
+    }
+    // Setting a button that is active already doesn't call back
+    d->p_mixfreq = mixfreqs[i];
+    gtk_toggle_button_set_state(GTK_TOGGLE_BUTTON(d->prefs_mixfreq_w[i]), TRUE);
+}
 
-    audio_mix(d->sndbuf, d->sndbuf_size / 4, d->p_mixfreq, ST_MIXER_FORMAT_S16_LE | ST_MIXER_FORMAT_STEREO);
+static void
+file_prefs_mixfreq_changed (void *a,
+                            file_driver *d)
+{
+    d->p_mixfreq = mixfreqs[find_current_toggle(d->prefs_mixfreq_w, 5)];
 }
 
 static void
 file_make_config_widgets (file_driver *d)
 {
-    GtkWidget *thing, *mainbox;
+    GtkWidget *thing, *mainbox, *box2;
+    static const char *mixfreqlabels[] = { "44100", "48000", "88200", "96000", "192000", NULL };
 
     d->configwidget = mainbox = gtk_vbox_new(FALSE, 2);
-   
-    thing = gtk_label_new(_("no settings (yet), sorry!"));
-    gtk_box_pack_start(GTK_BOX(mainbox), thing, FALSE, TRUE, 0);
+
+    box2 = gtk_hbox_new(FALSE, 4);
+    gtk_widget_show(box2);
+    gtk_box_pack_start(GTK_BOX(mainbox), box2, FALSE, TRUE, 0);
+
+    thing = gtk_label_new(_("Frequency [Hz]:"));
     gtk_widget_show(thing);
+    gtk_box_pack_start(GTK_BOX(box2), thing, FALSE, TRUE, 0);
+    add_empty_hbox(box2);
+    make_radio_group_full(mixfreqlabels, box2, d->prefs_mixfreq_w, FALSE, TRUE, (void(*)())file_prefs_mixfreq_changed, d);
+
+    file_prefs_init_from_structure(d);
 }
 
 static GtkWidget *
@@ -315,13 +562,17 @@ file_new (void)
     d->p_mixfreq = 44100;
     d->p_channels = 2;
     d->p_resolution = 16;
+    d->p_workers = render_parallel_default_workers();
+    d->parallel = NULL;
     d->sndbuf = NULL;
-    d->polltag = NULL;
+    d->outfile = 0;
+    d->numstems = 0;
+    d->stemfiles = NULL;
+    d->stembufs = NULL;
+    d->stembuf = NULL;
 
     file_make_config_widgets(d);
 
-    pipe(d->pipe);
-
     return d;
 }
 
@@ -330,12 +581,9 @@ file_destroy (void *dp)
 {
     file_driver * const d = dp;
 
-    close(d->pipe[0]);
-    close(d->pipe[1]);
-
     gtk_widget_destroy(d->configwidget);
 
-    g_free(d->filename);
+    g_free(d->params.filename);
 
     g_free(dp);
 }
@@ -344,39 +592,73 @@ static void
 file_release (void *dp)
 {
     file_driver * const d = dp;
+    int i;
+
+    if(d->parallel) {
+	render_parallel_free(d->parallel);
+	d->parallel = NULL;
+    }
 
     free(d->sndbuf);
     d->sndbuf = NULL;
 
-    audio_poll_remove(d->polltag);
-    d->polltag = NULL;
-
     if(d->outfile != 0) {
 	afCloseFile(d->outfile);
 	d->outfile = 0;
     }
+
+    for(i = 0; i < d->numstems; i++) {
+	if(d->stemfiles[i] != 0) {
+	    afCloseFile(d->stemfiles[i]);
+	}
+    }
+    g_free(d->stemfiles);
+    d->stemfiles = NULL;
+    g_free(d->stembufs);
+    d->stembufs = NULL;
+    free(d->stembuf);
+    d->stembuf = NULL;
+    d->numstems = 0;
 }
 
-static gboolean
-file_open (void *dp)
+static AFfilehandle
+file_create (file_driver *d,
+	     const gchar *filename)
 {
-    file_driver * const d = dp;
     AFfilesetup outfilesetup;
+    AFfilehandle f;
 
     outfilesetup = afNewFileSetup();
     afInitFileFormat(outfilesetup, AF_FILE_WAVE);
     afInitChannels(outfilesetup, AF_DEFAULT_TRACK, 2);
     afInitSampleFormat(outfilesetup, AF_DEFAULT_TRACK, AF_SAMPFMT_TWOSCOMP, 16);
-    d->outfile = afOpenFile(d->filename, "w", outfilesetup);
+    afInitRate(outfilesetup, AF_DEFAULT_TRACK, d->p_mixfreq);
+    f = afOpenFile(filename, "w", outfilesetup);
     afFreeFileSetup(outfilesetup);
 
-    if(!d->outfile) {
+    if(!f) {
 	error_error(_("Can't open file for writing."));
-	goto out;
+	return 0;
     }
 
     /* In case we're running setuid root... */
-    chown(d->filename, getuid(), getgid());
+    chown(filename, getuid(), getgid());
+
+    return f;
+}
+
+static gboolean
+file_open (void *dp)
+{
+    file_driver * const d = dp;
+    gchar *fn;
+    int i;
+
+    if(!d->params.stems || d->params.stems_mix) {
+	if(!(d->outfile = file_create(d, d->params.filename))) {
+	    goto out;
+	}
+    }
 
     d->sndbuf_size = 16384;
     d->sndbuf = malloc(d->sndbuf_size);
@@ -385,10 +667,35 @@ file_open (void *dp)
 	goto out;
     }
 
-    d->polltag = audio_poll_add(d->pipe[1], GDK_INPUT_WRITE, file_poll_ready_playing, d);
-    d->firstpoll = TRUE;
+    if(d->params.stems) {
+	d->numstems = audio_stems_count(d->params.stems);
+	d->stemfiles = g_new0(AFfilehandle, d->numstems);
+	d->stembufs = g_new(void*, d->numstems);
+	d->stembuf = malloc(d->numstems * d->sndbuf_size);
+	if(!d->stembuf) {
+	    error_error("Can't allocate mix buffer.");
+	    goto out;
+	}
+	for(i = 0; i < d->numstems; i++) {
+	    if(audio_stem_used(d->params.stems, i)) {
+		fn = audio_stem_filename(d->params.filename, d->params.stems, i);
+		d->stemfiles[i] = file_create(d, fn);
+		g_free(fn);
+		if(!d->stemfiles[i]) {
+		    goto out;
+		}
+	    }
+	}
+    }
+
     d->playtime = 0.0;
 
+    if(d->p_workers > 1 && !d->params.stems) {
+	d->parallel = render_parallel_new(d->p_workers, d->sndbuf_size / 4, d->p_mixfreq,
+					  ST_MIXER_FORMAT_S16_LE | ST_MIXER_FORMAT_STEREO,
+					  4, file_write, d);
+    }
+
     return TRUE;
 
   out:
@@ -416,7 +723,12 @@ static gboolean
 file_loadsettings (void *dp,
 		   prefs_node *f)
 {
-//    file_driver * const d = dp;
+    file_driver * const d = dp;
+
+    prefs_get_int(f, "render-workers", &d->p_workers);
+    prefs_get_int(f, "render-mixfreq", &d->p_mixfreq);
+
+    file_prefs_init_from_structure(d);
 
     return TRUE;
 }
@@ -425,7 +737,10 @@ static gboolean
 file_savesettings (void *dp,
 		   prefs_node *f)
 {
-//    file_driver * const d = dp;
+    file_driver * const d = dp;
+
+    prefs_put_int(f, "render-workers", d->p_workers);
+    prefs_put_int(f, "render-mixfreq", d->p_mixfreq);
 
     return TRUE;
 }
@@ -445,7 +760,9 @@ st_io_driver driver_out_file = {
     },
 
     file_get_play_time,
-    file_get_play_rate
+    file_get_play_rate,
+
+    file_pull
 };
 
 #endif /* NO_AUDIOFILE */
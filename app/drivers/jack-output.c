@@ -55,6 +55,7 @@
 #include "i18n.h"
 #include "driver-inout.h"
 #include "mixer.h"
+#include "audio-stats.h"
 #include "errors.h"
 #include "gui.h"
 #include "preferences.h"
@@ -201,6 +202,13 @@ jack_driver_process_wrapper (nframes_t nframes, void *arg)
 	return 0;
 }
 
+static int
+jack_driver_xrun_callback (void *arg)
+{
+	audio_stats_underrun ("jack");
+	return 0;
+}
+
 static void
 jack_driver_prefs_transport_callback (void *a, jack_driver *d)
 {
@@ -350,6 +358,7 @@ jack_driver_new (void)
 
 	jack_set_process_callback (d->client,jack_driver_process_wrapper, d);
 	jack_set_sample_rate_callback (d->client,jack_driver_sample_rate_callback, d);
+	jack_set_xrun_callback (d->client, jack_driver_xrun_callback, d);
 	jack_on_shutdown (d->client, jack_driver_server_has_shutdown, d);
 	
 	if (jack_activate (d->client)) {
@@ -48,6 +48,7 @@
 #include "i18n.h"
 #include "driver-inout.h"
 #include "mixer.h"
+#include "audio-stats.h"
 #include "errors.h"
 #include "gui-subs.h"
 #include "preferences.h"
@@ -100,7 +101,8 @@ oss_poll_ready_playing (gpointer data,
     if(!d->firstpoll) {
 	size = (d->stereo + 1) * (d->bits / 8) * d->fragsize;
 
-	if((w = write(d->soundfd, d->sndbuf, size) != size)) {
+	if((w = write(d->soundfd, d->sndbuf, size)) != size) {
+	    audio_stats_underrun("oss");
 	    if(w == -1) {
 		fprintf(stderr, "driver_oss: write() returned -1.\n");
 	    } else {
@@ -373,6 +375,7 @@ oss_release (void *dp)
 	ioctl(d->soundfd, SNDCTL_DSP_RESET, 0);
 	close(d->soundfd);
 	d->soundfd = -1;
+	audio_stats_latency(0);
     }
 }
 
@@ -459,6 +462,9 @@ oss_open (void *dp)
 	d->fragsize /= 2;
     }
 
+    /* The fragments are fixed once set up, so this never changes */
+    audio_stats_latency((guint64)d->numfrags * d->fragsize * 1000000 / d->playrate);
+
     d->polltag = audio_poll_add(d->soundfd, GDK_INPUT_WRITE, oss_poll_ready_playing, d);
     d->firstpoll = TRUE;
     d->playtime = 0;
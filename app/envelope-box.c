@@ -29,6 +29,7 @@
 #include "gui-subs.h"
 #include "envelope-box.h"
 #include "xm.h"
+#include "xm-player.h"
 #include "gui-settings.h"
 
 static STEnvelope dummy_envelope = {
@@ -302,6 +303,7 @@ envelope_box_insert_point (EnvelopeBox *e,
     e->current->points[before].pos = pos;
     e->current->points[before].val = val;
     e->current->num_points++;
+    xmplayer_envelopes_changed();
 
     // Update GUI
     gtk_spin_button_set_value(e->spin_length, e->current->num_points);
@@ -335,6 +337,7 @@ envelope_box_delete_point (EnvelopeBox *e,
     memmove(&e->current->points[n], &e->current->points[n + 1],
 	    (ST_MAX_ENVELOPE_POINTS - 1 - n) * sizeof(e->current->points[0]));
     e->current->num_points--;
+    xmplayer_envelopes_changed();
 
     // Update GUI
     gtk_spin_button_set_value(e->spin_length, e->current->num_points);
@@ -374,6 +377,7 @@ envelope_box_move_point (EnvelopeBox *e,
     // Update envelope structure
     e->current->points[n].pos += dpos;
     e->current->points[n].val += dval;
+    xmplayer_envelopes_changed();
 
     // Update GUI
     envelope_box_block_loop_spins(e, TRUE);
@@ -738,6 +742,7 @@ static void handle_toggle_button(GtkToggleButton *t, EnvelopeBox *e)
 	e->current->flags |= flag;
     else
 	e->current->flags &= ~flag;
+    xmplayer_envelopes_changed();
 
     xm_set_modified(1);
 }
@@ -756,6 +761,7 @@ static void handle_spin_button(GtkSpinButton *s, EnvelopeBox *e)
     g_return_if_fail(p != NULL);
 
     *p = gtk_spin_button_get_value_as_int(s);
+    xmplayer_envelopes_changed();
 
     xm_set_modified(1);
 }
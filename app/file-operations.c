@@ -36,6 +36,7 @@
 #include "gui-subs.h"
 #include "gui.h"
 #include "errors.h"
+#include "module-index.h"
 
 /* Welcome! Heavy gtk+ hacking going on here! :-) */
 
@@ -47,6 +48,8 @@ static GtkWidget *typeradio[DIALOG_LAST];
 static GtkFileSelection *fileops_current_dialog = NULL;
 static guint handler_id_f, handler_id_d;
 
+static GtkWidget *search_list, *module_info;
+
 static GtkWidget *
 fileops_filesel_get_confirm_area (GtkFileSelection *fs)
 {
@@ -160,10 +163,92 @@ typeradio_changed (void)
 	fileops_refresh_list(fileops_current_dialog, FALSE);
 }
 
+static void
+fileops_format_length (const module_index_entry *e,
+		       gchar *length,
+		       gsize size)
+{
+    if(e->duration >= 0) {
+	g_snprintf(length, size, "%d:%02d", e->duration / 60000, e->duration / 1000 % 60);
+    } else {
+	g_strlcpy(length, "?", size);
+    }
+}
+
+/* Shows what the index knows about the file selected in the Load
+   Module dialog. A file that hasn't been indexed yet gets queued, its
+   information shows up when it is selected again. */
+static void
+fileops_module_selected (GtkTreeSelection *sel,
+			 GtkFileSelection *fs)
+{
+    module_index_entry *e;
+    gchar *text, length[16];
+
+    e = module_index_lookup(gtk_file_selection_get_filename(fs));
+    if(e && e->is_module) {
+	fileops_format_length(e, length, sizeof(length));
+	text = g_strdup_printf(_("%s\n%d channels, %d patterns, %d instruments\nLength: %s"),
+			       e->name, e->num_channels, e->num_patterns, e->num_instruments, length);
+	gtk_label_set_text(GTK_LABEL(module_info), text);
+	g_free(text);
+    } else {
+	gtk_label_set_text(GTK_LABEL(module_info), "");
+    }
+    module_index_entry_free(e);
+}
+
+/* Looks the text up in the metadata of the modules in the directories
+   that have been visited with the load dialog */
+static void
+fileops_search_activate (GtkEntry *entry)
+{
+    GList *found, *l;
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    module_index_entry *e;
+    gchar *base, length[16];
+
+    found = module_index_search(gtk_entry_get_text(entry));
+
+    model = gui_list_freeze(search_list);
+    gui_list_clear_with_model(model);
+    for(l = found; l; l = l->next) {
+	e = l->data;
+	base = g_path_get_basename(e->path);
+	fileops_format_length(e, length, sizeof(length));
+	gtk_list_store_append(GTK_LIST_STORE(model), &iter);
+	gtk_list_store_set(GTK_LIST_STORE(model), &iter, 0, base, 1, e->name, 2, length, 3, e->path, -1);
+	g_free(base);
+	module_index_entry_free(e);
+    }
+    gui_list_thaw(search_list, model);
+    g_list_free(found);
+}
+
+static void
+fileops_search_selected (GtkTreeSelection *sel)
+{
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *path;
+
+    if(!gtk_tree_selection_get_selected(sel, &model, &iter)) {
+	return;
+    }
+
+    gtk_tree_model_get(model, &iter, 3, &path, -1);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(typeradio[DIALOG_LOAD_MOD]), TRUE);
+    gtk_file_selection_set_filename(GTK_FILE_SELECTION(fileops_dialogs[DIALOG_LOAD_MOD]), path);
+    g_free(path);
+}
+
 void
 fileops_page_create (GtkNotebook *nb)
 {
     GtkWidget *hbox, *vbox, *thing;
+    static gchar *searchtitles[4];
+    static GType searchtypes[4] = { G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING };
     static const char *labels1[] = {
 	N_("Load Module"),
 	N_("Save Module"),
@@ -193,6 +278,39 @@ fileops_page_create (GtkNotebook *nb)
     gtk_widget_set_sensitive(typeradio[DIALOG_SAVE_SAMPLE], FALSE);
 #endif
 
+    thing = gtk_hseparator_new();
+    gtk_box_pack_start(GTK_BOX(vbox), thing, FALSE, FALSE, 4);
+    gtk_widget_show(thing);
+
+    thing = gtk_label_new(_("Find module:"));
+    gtk_misc_set_alignment(GTK_MISC(thing), 0.0, 0.5);
+    gtk_box_pack_start(GTK_BOX(vbox), thing, FALSE, FALSE, 0);
+    gtk_widget_show(thing);
+
+    thing = gtk_entry_new();
+    gtk_box_pack_start(GTK_BOX(vbox), thing, FALSE, FALSE, 0);
+    gtk_widget_show(thing);
+    g_signal_connect(thing, "activate", G_CALLBACK(fileops_search_activate), NULL);
+    gui_hang_tooltip(thing, _("Search the names in the modules of the directories opened so far"));
+
+    searchtitles[0] = _("File");
+    searchtitles[1] = _("Song");
+    searchtitles[2] = _("Length");
+    searchtitles[3] = "";
+    search_list = gui_list_in_scrolled_window(4, searchtitles, vbox, searchtypes, NULL, NULL,
+					      GTK_SELECTION_BROWSE);
+    gtk_tree_view_column_set_visible(gtk_tree_view_get_column(GTK_TREE_VIEW(search_list), 3), FALSE);
+    gtk_widget_set_size_request(search_list, 200, -1);
+    gui_list_handle_selection(search_list, G_CALLBACK(fileops_search_selected), NULL);
+
+    module_info = gtk_label_new("");
+    gtk_misc_set_alignment(GTK_MISC(module_info), 0.0, 0.0);
+    gtk_label_set_justify(GTK_LABEL(module_info), GTK_JUSTIFY_LEFT);
+    gtk_box_pack_start(GTK_BOX(vbox), module_info, FALSE, FALSE, 4);
+    gtk_widget_show(module_info);
+    gui_list_handle_selection(GTK_FILE_SELECTION(fileops_dialogs[DIALOG_LOAD_MOD])->file_list,
+			      G_CALLBACK(fileops_module_selected), fileops_dialogs[DIALOG_LOAD_MOD]);
+
     thing = gtk_vseparator_new();
     gtk_box_pack_start(GTK_BOX(hbox), thing, FALSE, FALSE, 0);
     gtk_widget_show(thing);
@@ -248,6 +366,14 @@ fileops_refresh_list (GtkFileSelection *fs,
 	gtk_file_selection_set_filename (GTK_FILE_SELECTION (fs), "." G_DIR_SEPARATOR_S);
 	if(grab)
 		gtk_widget_grab_focus (GTK_FILE_SELECTION (fs)->selection_entry);
+
+    if(GTK_WIDGET(fs) == fileops_dialogs[DIALOG_LOAD_MOD]) {
+	gchar *dir = g_path_get_dirname(gtk_file_selection_get_filename(fs));
+
+	/* get the metadata of the modules in there ready */
+	module_index_scan(dir, FALSE);
+	g_free(dir);
+    }
 }
 
 /* simple, non-recursive file eraser... make it better! :-) */
@@ -0,0 +1,188 @@
+/*
+ * The Real SoundTracker - GUI update clock for playback displays
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* The clock runs at the rate of the most demanding view; the others
+   are left out of frames until they are due. What a frame costs is
+   measured from its start until the main loop gets idle again, so
+   that the drawing the views have queued is included; if that takes
+   up too much of the time, the clock slows down. */
+
+#include <config.h>
+
+#include "frame-clock.h"
+#include "audio.h"
+#include "audio-stats.h"
+
+/* Share of the time the GUI may spend on the views */
+#define FRAME_CLOCK_LOAD 0.25
+
+/* The rate never drops below this, however slow drawing is */
+#define FRAME_CLOCK_MIN_FREQ 10
+
+struct frame_clock_view {
+    frame_clock_func func;
+    gpointer data;
+    GtkWidget *widget;
+    int freq;
+    guint64 due;            // audio_stats_now() of the next update
+};
+
+static GSList *views = NULL;
+
+static gint timer = -1;
+static int period;          // ms
+static double last_songtime;
+
+static guint64 frame_start;
+static gboolean measuring = FALSE;
+static guint64 cost = 0;    // average time per frame, us
+
+static int
+frame_clock_period (void)
+{
+    GSList *l;
+    int freq = FRAME_CLOCK_MIN_FREQ, p;
+
+    for(l = views; l; l = l->next) {
+	freq = MAX(freq, ((frame_clock_view*)l->data)->freq);
+    }
+
+    p = MAX(1000 / freq, cost / 1000 / FRAME_CLOCK_LOAD);
+    return MIN(p, 1000 / FRAME_CLOCK_MIN_FREQ);
+}
+
+static gboolean
+frame_clock_measure (gpointer data)
+{
+    cost = (7 * cost + audio_stats_now() - frame_start) / 8;
+    measuring = FALSE;
+    return FALSE;
+}
+
+static gint
+frame_clock_tick (gpointer data)
+{
+    GSList *l;
+    frame_clock_view *v;
+    double songtime;
+    guint64 now;
+    int p;
+
+    if(current_driver_object == NULL) {
+	/* Can happen when audio thread stops on its own. Note that
+	 * frame_clock_stop() is called in gui.c::read_mixer_pipe(). */
+	return TRUE;
+    }
+
+    songtime = current_driver->get_play_time(current_driver_object);
+
+    // Nothing to do if the driver hasn't moved on since the last frame
+    if(songtime != last_songtime) {
+	last_songtime = songtime;
+	now = audio_stats_now();
+
+	for(l = views; l; l = l->next) {
+	    v = l->data;
+	    // Rather half a frame too early than half a frame too late
+	    if(now + period * 500 < v->due) {
+		continue;
+	    }
+	    v->due = now + 1000000 / v->freq;
+	    if(v->widget && !GTK_WIDGET_MAPPED(v->widget)) {
+		continue;
+	    }
+	    v->func(songtime, v->data);
+	}
+
+	if(!measuring) {
+	    measuring = TRUE;
+	    frame_start = now;
+	    g_idle_add_full(G_PRIORITY_LOW, frame_clock_measure, NULL, NULL);
+	}
+    }
+
+    p = frame_clock_period();
+    if(p != period) {
+	period = p;
+	timer = gtk_timeout_add(period, frame_clock_tick, NULL);
+	return FALSE;
+    }
+
+    return TRUE;
+}
+
+frame_clock_view *
+frame_clock_add_view (frame_clock_func func,
+		      gpointer data,
+		      GtkWidget *widget,
+		      int freq)
+{
+    frame_clock_view *v = g_new0(frame_clock_view, 1);
+
+    v->func = func;
+    v->data = data;
+    v->widget = widget;
+    v->freq = MAX(freq, 1);
+    views = g_slist_append(views, v);
+
+    return v;
+}
+
+void
+frame_clock_set_view_freq (frame_clock_view *v,
+			   int freq)
+{
+    // The clock picks this up with its next frame
+    v->freq = MAX(freq, 1);
+}
+
+void
+frame_clock_start (void)
+{
+    GSList *l;
+
+    if(timer != -1)
+	return;
+
+    for(l = views; l; l = l->next) {
+	((frame_clock_view*)l->data)->due = 0;
+    }
+    last_songtime = -1.0;
+    period = frame_clock_period();
+    timer = gtk_timeout_add(period, frame_clock_tick, NULL);
+}
+
+void
+frame_clock_stop (void)
+{
+    GSList *l;
+    frame_clock_view *v;
+
+    if(timer == -1)
+	return;
+
+    gtk_timeout_remove(timer);
+    timer = -1;
+
+    for(l = views; l; l = l->next) {
+	v = l->data;
+	v->func(-1.0, v->data);
+    }
+}
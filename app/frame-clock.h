@@ -0,0 +1,50 @@
+/*
+ * The Real SoundTracker - GUI update clock for playback displays (header)
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _FRAME_CLOCK_H
+#define _FRAME_CLOCK_H
+
+#include <gtk/gtk.h>
+
+/* While something is playing, one timer asks the driver for the play
+   time and hands it to every view that follows the playback (pattern
+   position, scopes, ...). */
+
+/* Called with the time of what is being heard right now, or with a
+   negative time once playing has stopped */
+typedef void (*frame_clock_func) (double songtime,
+				  gpointer data);
+
+typedef struct frame_clock_view frame_clock_view;
+
+/* A view is updated at most 'freq' times a second, and not at all
+   while 'widget' (if not NULL) isn't mapped */
+frame_clock_view *   frame_clock_add_view        (frame_clock_func func,
+						  gpointer data,
+						  GtkWidget *widget,
+						  int freq);
+
+void                 frame_clock_set_view_freq   (frame_clock_view *v,
+						  int freq);
+
+void                 frame_clock_start           (void);
+void                 frame_clock_stop            (void);
+
+#endif /* _FRAME_CLOCK_H */
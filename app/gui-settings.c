@@ -74,6 +74,9 @@ gui_prefs gui_settings = {
     TRUE,
     0,
 
+    0,
+    TRUE,
+
     "~/",
     "~/",
     "~/",
@@ -92,6 +95,7 @@ gui_prefs gui_settings = {
 
 static GtkWidget *configwindow = NULL;
 static GtkWidget *ts_box = NULL;
+static GtkWidget *stems_radio[3];
 
 static void           prefs_scopesfreq_changed                  (int value);
 static void           prefs_trackerfreq_changed                 (int value);
@@ -203,6 +207,18 @@ gui_settings_perm_toggled (GtkWidget *widget)
     gui_settings.store_perm = GTK_TOGGLE_BUTTON(widget)->active;
 }
 
+static void
+gui_settings_stems_changed (void)
+{
+    gui_settings.render_stems = find_current_toggle(stems_radio, 3);
+}
+
+static void
+gui_settings_stems_mix_toggled (GtkWidget *widget)
+{
+    gui_settings.render_stems_mix = GTK_TOGGLE_BUTTON(widget)->active;
+}
+
 void
 gui_settings_highlight_rows_changed (GtkSpinButton *spin)
 {
@@ -305,6 +321,12 @@ gui_settings_dialog (void)
     GtkWidget *mainbox, *mainhbox, *thing, *box1, *hbox, *vbox1;
     GtkTooltips *tooltips;
     gchar stmp[5];
+    static const char *stemslabels[] = {
+	N_("None"),
+	N_("Channels"),
+	N_("Instruments"),
+	NULL
+    };
 
     if(configwindow != NULL) {
 	if (!gdk_window_is_visible(configwindow->window))
@@ -407,6 +429,18 @@ gui_settings_dialog (void)
     gtk_signal_connect(GTK_OBJECT(thing), "toggled",
 		       GTK_SIGNAL_FUNC(gui_settings_perm_toggled), NULL);
 
+    thing = make_labelled_radio_group_box(_("Render WAV stems:"), stemslabels, stems_radio, gui_settings_stems_changed);
+    gtk_toggle_button_set_state(GTK_TOGGLE_BUTTON(stems_radio[gui_settings.render_stems]), TRUE);
+    gtk_box_pack_start(GTK_BOX(vbox1), thing, FALSE, TRUE, 0);
+    gtk_widget_show(thing);
+
+    thing = gtk_check_button_new_with_label(_("Render the full mix along with the stems"));
+    gtk_toggle_button_set_state(GTK_TOGGLE_BUTTON(thing), gui_settings.render_stems_mix);
+    gtk_box_pack_start(GTK_BOX(vbox1), thing, FALSE, TRUE, 0);
+    gtk_widget_show(thing);
+    g_signal_connect(thing, "toggled",
+		       G_CALLBACK(gui_settings_stems_mix_toggled), NULL);
+
     gui_subs_set_slider_value(&prefs_scopesfreq_slider, gui_settings.scopes_update_freq);
     gui_subs_set_slider_value(&prefs_trackerfreq_slider, gui_settings.tracker_update_freq);
 
@@ -550,6 +584,9 @@ gui_settings_load_config (void)
   	prefs_get_int(f, "sharp", &gui_settings.sharp);
   	prefs_get_int(f, "bh", &gui_settings.bh);
 	prefs_get_int(f, "store-permanent", &gui_settings.store_perm);
+	prefs_get_int(f, "render-stems", &gui_settings.render_stems);
+	gui_settings.render_stems = CLAMP(gui_settings.render_stems, 0, 2);
+	prefs_get_int(f, "render-stems-mix", &gui_settings.render_stems_mix);
 	
 	if(gui_settings.store_perm)
 	    prefs_get_int(f, "permanent-channels", &gui_settings.permanent_channels);
@@ -625,6 +662,8 @@ gui_settings_save_config (void)
     prefs_put_int(f, "sharp", gui_settings.sharp);
     prefs_put_int(f, "bh", gui_settings.bh);
     prefs_put_int(f, "store-permanent", gui_settings.store_perm);
+    prefs_put_int(f, "render-stems", gui_settings.render_stems);
+    prefs_put_int(f, "render-stems-mix", gui_settings.render_stems_mix);
 
     if(gui_settings.store_perm)
 	prefs_put_int(f, "permanent-channels", gui_settings.permanent_channels);
@@ -60,6 +60,9 @@ typedef struct gui_prefs {
     gboolean store_perm;
     guint32 permanent_channels;
 
+    int render_stems;              /* AUDIO_STEMS_* */
+    gboolean render_stems_mix;
+
     gchar loadmod_path[128];
     gchar savemod_path[128];
     gchar savemodaswav_path[128];
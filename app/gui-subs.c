@@ -69,6 +69,22 @@ statusbar_update (int message, gboolean force_update)
     }
 }
 
+/* Like statusbar_update(), with the progress of a lengthy operation
+   appended to the message */
+void
+statusbar_update_progress (int message, int percent)
+{
+    gchar *text = g_strdup_printf("%s %d%%", _(status_messages[message]), percent);
+
+#ifdef USE_GNOME
+    gnome_appbar_set_status(GNOME_APPBAR(status_bar), text);
+#else
+    gtk_statusbar_pop(GTK_STATUSBAR(status_bar), statusbar_context_id);
+    gtk_statusbar_push(GTK_STATUSBAR(status_bar), statusbar_context_id, text);
+#endif
+    g_free(text);
+}
+
 int
 find_current_toggle (GtkWidget **widgets, int count)
 {
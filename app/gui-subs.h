@@ -52,6 +52,8 @@ extern GtkWidget *st_clock;
 
 void                 statusbar_update                 (int message,
 						       gboolean force_gui_update);
+void                 statusbar_update_progress        (int message,
+						       int percent);
 
 GtkWidget*           file_selection_create            (const gchar *title,
 						       void(*clickfunc)());
@@ -26,6 +26,7 @@
 #include <math.h>
 
 #include <unistd.h>
+#include <signal.h>
 
 #include "poll.h"
 
@@ -47,6 +48,7 @@
 #include "xm.h"
 #include "st-subs.h"
 #include "audio.h"
+#include "audio-stats.h"
 #include "xm-player.h"
 #include "tracker.h"
 #include "main.h"
@@ -64,6 +66,9 @@
 #include "file-operations.h"
 #include "playlist.h"
 #include "extspinbutton.h"
+#include "midi.h"
+#include "frame-clock.h"
+#include "pattern-undo.h"
 
 int gui_playing_mode = 0;
 int notebook_current_page = NOTEBOOK_PAGE_FILE;
@@ -146,6 +151,9 @@ static GdkColor gui_clipping_led_on, gui_clipping_led_off;
 static GtkWidget *gui_clipping_led;
 static gboolean gui_clipping_led_status;
 
+static GtkWidget *gui_audio_stats_label;
+static volatile sig_atomic_t gui_audio_stats_dump_requested = 0;
+
 static int editing_pat = 0;
 
 static int gui_ewc_startstop = 0;
@@ -404,20 +412,89 @@ gui_load_callback (gint reply,
     }
 }
 
+/* Modules are saved in the background; only one save runs at a time */
+static XMSaveJob *save_job = NULL;
+static gboolean save_job_song;
+static gchar *save_job_filename;
+static XM *save_job_xm;          /* the module that is being saved, NULL once it is freed */
+static guint save_job_timeout;
+
+static void
+gui_save_finish (void)
+{
+    int ok = XM_SaveAsyncFinish(save_job);
+
+    save_job = NULL;
+
+    if(ok) {
+	statusbar_update(save_job_song ? STATUS_SONG_SAVED : STATUS_MODULE_SAVED, FALSE);
+	if(save_job_xm)
+	    gui_update_title(save_job_filename);
+    } else {
+	// Editing has gone on meanwhile, the module is still unsaved
+	if(save_job_xm && !save_job_song)
+	    save_job_xm->modified = 1;
+	statusbar_update(STATUS_IDLE, FALSE);
+    }
+
+    fileops_refresh_list(GTK_FILE_SELECTION(fileops_dialogs[save_job_song ? DIALOG_SAVE_SONG_AS_XM : DIALOG_SAVE_MOD]), FALSE);
+    g_free(save_job_filename);
+}
+
+static gint
+gui_save_timeout (gpointer data)
+{
+    int permille = XM_SaveAsyncProgress(save_job);
+
+    if(permille >= 0) {
+	statusbar_update_progress(save_job_song ? STATUS_SAVING_SONG : STATUS_SAVING_MODULE, permille / 10);
+	return TRUE;
+    }
+
+    gui_save_finish();
+    return FALSE;
+}
+
+void
+gui_save_wait (void)
+{
+    if(save_job) {
+	gtk_timeout_remove(save_job_timeout);
+	gui_save_finish();
+    }
+}
+
+static void
+gui_save_start (const gchar *filename,
+		gboolean song)
+{
+    gui_save_wait();
+
+    statusbar_update(song ? STATUS_SAVING_SONG : STATUS_SAVING_MODULE, TRUE);
+    save_job = XM_SaveAsync(xm, filename, song);
+    if(!save_job) {
+	gnome_error_dialog(_("Not enough memory to save the module."));
+	statusbar_update(STATUS_IDLE, FALSE);
+	return;
+    }
+
+    save_job_song = song;
+    save_job_filename = g_strdup(filename);
+    save_job_xm = xm;
+    save_job_timeout = gtk_timeout_add(100, gui_save_timeout, NULL);
+
+    /* Changes made from now on aren't part of the saved file */
+    if(!song)
+	xm->modified = 0;
+    gui_auto_switch_page();
+}
+
 static void
 gui_save_callback (gint reply,
 		   gpointer data)
 {
     if(reply == 0) {
-	statusbar_update(STATUS_SAVING_MODULE, TRUE);
-	if(XM_Save(xm, (gchar*)data, FALSE)) {
-	    xm->modified = 0;
-	    gui_auto_switch_page();
-	    statusbar_update(STATUS_MODULE_SAVED, FALSE);
-	    gui_update_title ((gchar*)data);
-	} else {
-	    statusbar_update(STATUS_IDLE, FALSE);
-	}
+	gui_save_start((gchar*)data, FALSE);
     }
 }
 
@@ -426,14 +503,7 @@ gui_save_song_callback (gint reply,
 	                gpointer data)
 {
     if(reply == 0) {
-	statusbar_update(STATUS_SAVING_SONG, TRUE);
-	if(XM_Save(xm, (gchar*)data, TRUE)) {
-	    gui_auto_switch_page();
-	    statusbar_update(STATUS_SONG_SAVED, FALSE);
-	    gui_update_title ((gchar*)data);
-	} else {
-	    statusbar_update(STATUS_IDLE, FALSE);
-	}
+	gui_save_start((gchar*)data, TRUE);
     }
 }
 
@@ -442,14 +512,14 @@ gui_save_wav_callback (gint reply,
 		       gpointer data)
 {
     if(reply == 0) {
-	int l = strlen(data);
+	int a[3] = { gui_settings.render_stems, gui_settings.render_stems_mix, strlen(data) };
 	audio_ctlpipe_id i = AUDIO_CTLPIPE_RENDER_SONG_TO_FILE;
 
 	gui_play_stop();
 
 	write(audio_ctlpipe, &i, sizeof(i));
-	write(audio_ctlpipe, &l, sizeof(l));
-	write(audio_ctlpipe, data, l + 1);
+	write(audio_ctlpipe, a, sizeof(a));
+	write(audio_ctlpipe, data, a[2] + 1);
 	wait_for_player();
     }
 }
@@ -668,6 +738,7 @@ current_instrument_changed (GtkSpinButton *spin)
     instrument_editor_set_instrument(i);
     sample_editor_set_sample(s);
     modinfo_set_current_instrument(ins);
+    audio_input_set_instrument(ins + 1);
     xm_set_modified(m);
 }
 
@@ -1080,7 +1151,7 @@ notebook_page_switched (GtkNotebook *notebook,
    FastTracker scroll the patterns while the song is playing, and we
    need the time-buffer and event-waiter interfaces here for correct
    synchronization (we're called from
-   track-editor.c::tracker_timeout() which hands us time-correct data)
+   track-editor.c::tracker_frame() which hands us time-correct data)
 
    We have an ImpulseTracker-like editing mode as well ("asynchronous
    editing"), which disables the scrolling, but still updates the
@@ -1135,16 +1206,29 @@ gui_update_player_pos (const audio_player_pos *p)
     xm_set_modified(m);
 }
 
-void
-gui_clipping_indicator_update (double songtime)
+static void
+gui_clipping_indicator_update (double songtime,
+			       gpointer data)
 {
-    if(songtime < 0.0) {
-	gui_clipping_led_status = 0;
-    } else {
+    gboolean status = FALSE;
+
+    if(songtime >= 0.0) {
 	audio_clipping_indicator *c = time_buffer_get(audio_clipping_indicator_tb, songtime);
-	gui_clipping_led_status = c && c->clipping;
+	status = c && c->clipping;
+    }
+
+    if(status != gui_clipping_led_status) {
+	gui_clipping_led_status = status;
+	gtk_widget_draw(gui_clipping_led, NULL);
     }
-    gtk_widget_draw(gui_clipping_led, NULL);
+}
+
+static void
+gui_analyze_song (void)
+{
+    audio_ctlpipe_id i = AUDIO_CTLPIPE_ANALYZE_SONG;
+
+    write(audio_ctlpipe, &i, sizeof(i));
 }
 
 static void
@@ -1155,6 +1239,8 @@ read_mixer_pipe (gpointer data,
     audio_backpipe_id a;
     struct pollfd pfd = { source, POLLIN, 0 };
     int x;
+    song_analysis *analysis;
+    audio_input_event input_event;
 
     static char *msgbuf = NULL;
     static int msgbuflen = 0;
@@ -1174,10 +1260,12 @@ read_mixer_pipe (gpointer data,
 	    /* can be equal to zero when the audio subsystem decides to stop playing on its own. */
 	    gui_ewc_startstop--;
 	}
+	if(gui_playing_mode == PLAYING_SONG || gui_playing_mode == PLAYING_PATTERN) {
+	    /* the song may have been edited while playing */
+	    gui_analyze_song();
+	}
 	gui_playing_mode = 0;
-	scope_group_stop_updating(scopegroup);
-	tracker_stop_updating();
-	sample_editor_stop_updating();
+	frame_clock_stop();
 	gui_enable(1);
 	break;
 
@@ -1195,25 +1283,38 @@ read_mixer_pipe (gpointer data,
 	    gtk_toggle_button_set_state(GTK_TOGGLE_BUTTON(editing_toggle), FALSE);
 	}
 	gui_enable(0);
-	scope_group_start_updating(scopegroup);
-	tracker_start_updating();
-	sample_editor_start_updating();
+	frame_clock_start();
 	break;
 
     case AUDIO_BACKPIPE_PLAYING_NOTE_STARTED:
 	gui_ewc_startstop--;
 	if(!gui_playing_mode) {
 	    gui_playing_mode = PLAYING_NOTE;
-	    scope_group_start_updating(scopegroup);
-	    tracker_start_updating();
-	    sample_editor_start_updating();
+	    frame_clock_start();
 	}
 	break;
 
     case AUDIO_BACKPIPE_DRIVER_OPEN_FAILED:
+    case AUDIO_BACKPIPE_DEVICE_RELEASED:
 	gui_ewc_startstop--;
         break;
 
+    case AUDIO_BACKPIPE_INPUT_EVENT:
+	readpipe(source, &input_event, sizeof(input_event));
+	if(input_event.type == AUDIO_INPUT_NOTE && !gui_playing_mode) {
+	    gui_playing_mode = PLAYING_NOTE;
+	    frame_clock_start();
+	}
+#if defined(DRIVER_ALSA_09x)
+	midi_record_event(&input_event);
+#endif
+	break;
+
+    case AUDIO_BACKPIPE_SONG_ANALYZED:
+	readpipe(source, &analysis, sizeof(analysis));
+	modinfo_set_song_analysis(analysis);
+	break;
+
     case AUDIO_BACKPIPE_ERROR_MESSAGE:
     case AUDIO_BACKPIPE_WARNING_MESSAGE:
         statusbar_update(STATUS_IDLE, FALSE);
@@ -1291,6 +1392,15 @@ gui_play_stop (void)
     wait_for_player();
 }
 
+void
+gui_release_device (void)
+{
+    audio_ctlpipe_id i = AUDIO_CTLPIPE_RELEASE_DEVICE;
+
+    write(audio_ctlpipe, &i, sizeof(i));
+    wait_for_player();
+}
+
 void
 gui_init_xm (int new_xm, gboolean updatechspin)
 {
@@ -1299,6 +1409,7 @@ gui_init_xm (int new_xm, gboolean updatechspin)
 
     i = AUDIO_CTLPIPE_INIT_PLAYER;
     write(audio_ctlpipe, &i, sizeof(i));
+    gui_analyze_song();
     tracker_reset(tracker);
     if(new_xm) {
 	gui_playlist_initialize();
@@ -1330,6 +1441,9 @@ gui_free_xm (void)
     instrument_editor_set_instrument(NULL);
     sample_editor_set_sample(NULL);
     tracker_set_pattern(tracker, NULL);
+    pattern_undo_clear();
+    if(save_job_xm == xm)
+	save_job_xm = NULL;
     XM_Free(xm);
     xm = NULL;
 }
@@ -1641,6 +1755,51 @@ gui_clipping_led_event (GtkWidget *thing,
     return 0;
 }
 
+static void
+gui_audio_stats_sigusr1 (int parameter)
+{
+    gui_audio_stats_dump_requested = 1;
+}
+
+/* Show the audio engine load in the status bar. Sending SIGUSR1 to
+   the process dumps the full statistics to stdout. */
+static gint
+gui_audio_stats_timeout (gpointer data)
+{
+    static guint32 lastblocks = 0;
+    audio_stats s;
+    gchar buf[128];
+    int i, underruns = 0;
+
+    if(gui_audio_stats_dump_requested) {
+	gui_audio_stats_dump_requested = 0;
+	audio_stats_dump(stdout);
+    }
+
+    audio_stats_get(&s);
+
+    for(i = 0; i < s.num_drivers; i++) {
+	underruns += s.drivers[i].underruns;
+    }
+
+    if(s.blocks == lastblocks) {
+	g_snprintf(buf, sizeof(buf), _("DSP --  Underruns %d"), underruns);
+    } else {
+	g_snprintf(buf, sizeof(buf), _("DSP %d%%  Voices %d  Underruns %d"),
+		   (s.load + 5) / 10, s.voices.active_voices, underruns);
+    }
+    lastblocks = s.blocks;
+
+    if(s.latency_us) {
+	i = strlen(buf);
+	g_snprintf(buf + i, sizeof(buf) - i, _("  Latency %d ms"), (s.latency_us + 500) / 1000);
+    }
+
+    gtk_label_set_text(GTK_LABEL(gui_audio_stats_label), buf);
+
+    return TRUE;
+}
+
 void
 gui_go_to_fileops_page (void)
 {
@@ -2205,6 +2364,7 @@ gui_final (int argc,
     gdk_color_alloc(colormap, &gui_clipping_led_off);
     g_signal_connect(thing, "event", G_CALLBACK(gui_clipping_led_event), thing);
     gtk_widget_show (thing);
+    frame_clock_add_view(gui_clipping_indicator_update, NULL, thing, 50);
 
     hbox = gtk_vbox_new(FALSE, 2);
     gtk_widget_show(hbox);
@@ -2336,6 +2496,10 @@ gui_final (int argc,
     gtk_widget_set_usize (thing, 48, 20);
     gtk_frame_set_shadow_type (GTK_FRAME (thing), GTK_SHADOW_IN);
 
+    gui_audio_stats_label = gtk_label_new("");
+    gtk_widget_show (gui_audio_stats_label);
+    gtk_box_pack_start (GTK_BOX (hbox), gui_audio_stats_label, FALSE, FALSE, 4);
+
     gnome_appbar_set_status(GNOME_APPBAR(status_bar), WELCOME_MESSAGE);
 #else
     thing = gtk_hbox_new(FALSE, 1);
@@ -2347,9 +2511,16 @@ gui_final (int argc,
     gtk_widget_show(status_bar);
     gtk_widget_set_usize(status_bar, -2, 20);
 
+    gui_audio_stats_label = gtk_label_new("");
+    gtk_box_pack_start(GTK_BOX(thing), gui_audio_stats_label, FALSE, FALSE, 4);
+    gtk_widget_show(gui_audio_stats_label);
+
     statusbar_context_id = gtk_statusbar_get_context_id(GTK_STATUSBAR(status_bar), "ST Statusbar");
     gtk_statusbar_push(GTK_STATUSBAR(status_bar), statusbar_context_id, WELCOME_MESSAGE);
 #endif
+
+    gtk_timeout_add(500, gui_audio_stats_timeout, NULL);
+    signal(SIGUSR1, gui_audio_stats_sigusr1);
     
     /* capture all key presses */
     gtk_widget_add_events(GTK_WIDGET(mainwindow), GDK_KEY_RELEASE_MASK);
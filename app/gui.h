@@ -74,6 +74,8 @@ void                 gui_play_note_full               (unsigned channel,
 void                 gui_play_note_keyoff             (int channel);
 
 void                 gui_play_stop                    (void);
+/* Closes the editing output if it is being kept open after playing */
+void                 gui_release_device               (void);
 void                 gui_start_sampling               (void);
 void                 gui_stop_sampling                (void);
 
@@ -97,12 +99,13 @@ int                  gui_get_current_octave_value     (void);
 void		     gui_set_jump_value		      (int value);
 
 void                 gui_update_player_pos            (const audio_player_pos *p);
-void                 gui_clipping_indicator_update    (double songtime);
 
 void                 gui_init_xm                      (int new_xm, gboolean updatechspin);
 void                 gui_free_xm                      (void);
 void                 gui_new_xm                       (void);
 void                 gui_load_xm                      (const char *filename);
+/* Waits until a module that is being saved has been written */
+void                 gui_save_wait                    (void);
 
 void		     gui_direction_clicked 	      (GtkWidget *widget,
 						       gpointer data);
@@ -23,6 +23,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <sys/types.h>
 #include <unistd.h>
@@ -41,6 +42,8 @@
 #include "midi.h"
 #include "midi-settings.h"
 #include "file-operations.h"
+#include "module-index.h"
+#include "render-check.h"
 
 #include <glib.h>
 #include <gtk/gtk.h>
@@ -75,6 +78,9 @@ main (int argc,
 #ifdef DRIVER_ALSA_050
 	driver_out_alsa2, driver_in_alsa2,
 #endif
+#ifdef DRIVER_ALSA_09x
+	driver_out_alsa1x,
+#endif
 #ifdef DRIVER_ESD
 	driver_out_esd,
 #endif
@@ -138,6 +144,21 @@ main (int argc,
     textdomain(PACKAGE);
 #endif
 
+    mixers = g_list_append(mixers,
+			   &mixer_kbfloat);
+    mixers = g_list_append(mixers,
+			   &mixer_integer32);
+
+    if(argc >= 2 && !strcmp(argv[1], "--render-check")) {
+	/* Offline check of the player and the mixers, without GUI */
+	return render_check(mixers, argc >= 3 ? argv[2] : NULL) ? 1 : 0;
+    }
+
+    if(argc >= 2 && !strcmp(argv[1], "--render-bench")) {
+	/* Mixing throughput at each rate, without GUI */
+	return render_bench(mixers) ? 1 : 0;
+    }
+
     tips_dialog_load_settings();
 
     if(!gui_splash(argc, argv)) {
@@ -148,11 +169,6 @@ main (int argc,
     audio_ctlpipe = pipea[1];
     audio_backpipe = pipeb[0];
 
-    mixers = g_list_append(mixers,
-			   &mixer_kbfloat);
-    mixers = g_list_append(mixers,
-			   &mixer_integer32);
-
 #if 0
     drivers[DRIVER_OUTPUT] = g_list_append(drivers[DRIVER_OUTPUT],
 					   &driver_out_test);
@@ -201,6 +217,11 @@ main (int argc,
 					  &driver_in_alsa2); 
 #endif
 
+#ifdef DRIVER_ALSA_09x
+    drivers[DRIVER_OUTPUT] = g_list_append(drivers[DRIVER_OUTPUT],
+					   &driver_out_alsa1x);
+#endif
+
 #ifdef DRIVER_ESD
     drivers[DRIVER_OUTPUT] = g_list_append(drivers[DRIVER_OUTPUT],
 					   &driver_out_esd);
@@ -235,6 +256,7 @@ main (int argc,
     fileops_tmpclean();
     gui_settings_load_config();
     audioconfig_load_mixer_config(); // in case gui_init already loads a module
+    module_index_init();
 
     if(gui_final(argc, argv)) {
 	audioconfig_load_config();
@@ -248,6 +270,7 @@ main (int argc,
 
 	gtk_main();
 
+	gui_save_wait();
 	gui_play_stop(); /* so that audio driver is shut down correctly. */
 
 	menubar_write_accels();
@@ -49,6 +49,7 @@
 #include "tracker-settings.h"
 #include "midi-settings.h"
 #include "sample-editor.h"
+#include "pattern-undo.h"
 
 #ifdef USE_GNOME
 #include <gnome.h>
@@ -125,6 +126,7 @@ menubar_clear_callback (gint reply,
 	} else {
 	    gui_play_stop();
 	    st_clean_song(xm);
+	    pattern_undo_clear();
 	    gui_init_xm(1, TRUE);
 	    xm->modified = 0;
 	}
@@ -285,6 +287,17 @@ menubar_handle_cutcopypaste (void *p, guint a)
     }
 }
 
+static void
+menubar_handle_undo (void *p,
+		     guint a)
+{
+    gboolean done = a ? pattern_redo() : pattern_undo();
+
+    if(!done) {
+	gdk_beep();
+    }
+}
+
 static void
 menubar_handle_edit_menu (void *p,
 			  guint a)
@@ -408,6 +421,8 @@ typedef struct GnomeUIInfo {
 #define GNOME_STOCK_MENU_SAVE 0
 #define GNOME_STOCK_MENU_ABOUT 0
 #define GNOME_STOCK_MENU_BOOK_RED 0
+#define GNOME_STOCK_MENU_UNDO 0
+#define GNOME_STOCK_MENU_REDO 0
 
 #define GNOMEUIINFO_SEPARATOR { GNOME_APP_UI_SEPARATOR, "-", }
 #define GNOMEUIINFO_END { GNOME_APP_UI_END, }
@@ -519,6 +534,13 @@ static GnomeUIInfo edit_selection_menu[] = {
 };
 
 static GnomeUIInfo edit_menu[] = {
+    { GNOME_APP_UI_ITEM, N_("_Undo"), NULL, menubar_handle_undo, (gpointer)0, NULL,
+      GNOME_APP_PIXMAP_STOCK, GNOME_STOCK_MENU_UNDO, 'Z', GDK_CONTROL_MASK, NULL },
+    { GNOME_APP_UI_ITEM, N_("_Redo"), NULL, menubar_handle_undo, (gpointer)1, NULL,
+      GNOME_APP_PIXMAP_STOCK, GNOME_STOCK_MENU_REDO, 'Y', GDK_CONTROL_MASK, NULL },
+
+    GNOMEUIINFO_SEPARATOR,
+
     { GNOME_APP_UI_ITEM, N_("C_ut"), NULL, menubar_handle_cutcopypaste, (gpointer)0, NULL,
       GNOME_APP_PIXMAP_STOCK, GNOME_STOCK_MENU_CUT, 'X', GDK_CONTROL_MASK, NULL },
     { GNOME_APP_UI_ITEM, N_("_Copy"), NULL, menubar_handle_cutcopypaste, (gpointer)1, NULL,
@@ -724,7 +746,7 @@ menubar_init_prefs ()
     gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(settings_menu[8].widget), gui_settings.gui_disable_splash);
     gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(settings_menu[10].widget), gui_settings.save_settings_on_exit);
 
-    gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(edit_menu[5].widget), TRUE); // Record aftertouch
+    gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(edit_menu[8].widget), TRUE); // Record aftertouch
 #if USE_SNDFILE == 0 && defined (NO_AUDIOFILE)
     gtk_widget_set_sensitive(file_menu[SAVE_MOD_AS_WAV_POSITION].widget, FALSE);
 #endif
@@ -33,6 +33,7 @@
 #include "tracker.h"
 #include "xm.h"
 #include "gui-settings.h"
+#include "pattern-undo.h"
 
 /*********************************************************
  * Macro to transform a MIDI note (pitch) into a XM note
@@ -524,13 +525,15 @@ static void midi_process_note_on( snd_seq_ev_note *pnote)
 
 	/* Get and set current XM note pitch. */
 
-	xmnote = &(tracker->curpattern->channels[channel][row]);
+	xmnote = xm_pattern_note(tracker->curpattern, channel, row);
 
+	pattern_undo_begin(tracker->curpattern, channel, 1, row, 1);
 	xmnote->note = note;
 	xmnote->instrument = gui_get_current_instrument();
 	if ( volume >= 0 ) {
 	  xmnote->volume = volume;
 	}
+	pattern_undo_end();
 
 	/* Redraw screen and if not in ASYNCEDIT mode,
 	   jump to next position in the channel. */
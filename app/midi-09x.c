@@ -19,6 +19,12 @@
 
 /*
  * For ALSA driver, we use the ALSA sequencer API (not the rawmidi API).
+ *
+ * The sequencer is read by a thread of its own, which passes the
+ * events to the audio thread with the time they arrived at. The audio
+ * thread plays them and then hands them on to the GUI thread, which
+ * records them into the pattern (see midi_record_event()). So a busy
+ * GUI doesn't delay the notes.
  */
 
 #include <config.h>
@@ -27,13 +33,21 @@
 #include <gtk/gtk.h>
 #include <gdk/gdk.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/poll.h>
 #include "midi.h"
 #include "midi-utils.h"
 #include "midi-settings.h"
 #include "gui.h"
 #include "tracker.h"
 #include "xm.h"
+#include "main.h"
 #include "gui-settings.h"
+#include "audio.h"
+#include "audio-stats.h"
+#include "pattern-undo.h"
 
 /*********************************************************
  * Macro to transform a MIDI note (pitch) into a XM note
@@ -66,37 +80,27 @@ extern Tracker *tracker; /* from track-editor.c */
 /* Handle to sequencer device. */
 
 static snd_seq_t *midi_handle = NULL;
-static gint midi_file_tag = -1;
-static GIOChannel *midi_channel;
 
-/* Count the number of notes on to later turn them off gracefully...*/
+/* Input thread, and a pipe to tell it to quit. */
+
+static GThread *midi_thread = NULL;
+static int midi_quit_pipe[2] = { -1, -1 };
+
+/* Count the number of notes on to later turn them off gracefully...
+   Only used by the input thread. */
 
 static int nb_notes_on = 0;
 
 /* Local functions prototypes */
 
 static void close_handle( snd_seq_t *handle);
-static void midi_process_note_on( snd_seq_ev_note_t *pnote);
-static void midi_process_controller( snd_seq_ev_ctrl_t *pcontrol);
-static void midi_process_program_change( snd_seq_ev_ctrl_t *pcontrol);
+static void midi_process_note_on( snd_seq_ev_note_t *pnote, guint64 time);
+static void midi_process_controller( snd_seq_ev_ctrl_t *pcontrol, guint64 time);
+static void midi_process_program_change( snd_seq_ev_ctrl_t *pcontrol, guint64 time);
 static gint midi_get_fd( snd_seq_t *handle);
-static gint midi_add_to_main_loop( snd_seq_t *handle);
-
-gboolean midi_channel_ready( GIOChannel *src, GIOCondition cond, gpointer data);
-void midi_channel_destroy( gpointer data);
-
-
-/*******************************************************************
- * Called when the IO channel associated with 
- * the MIDI handle is destroyed.
- */
-
-void midi_channel_destroy( gpointer data)
-{
-  if (IS_MIDI_DEBUG_ON) {
-    g_print( "MIDI IO channel destroyed...\n");
-  }
-}
+static gboolean midi_start_thread( snd_seq_t *handle);
+static void midi_stop_thread( void);
+static gpointer midi_thread_func( gpointer data);
 
 /*******************************************************************
  * Get file descriptor of MIDI seq. handle.
@@ -134,51 +138,60 @@ midi_get_fd( snd_seq_t *seq_handle)
 }
 
 /****************************************************
- * Hook up the MIDI sequencer to GTK main loop.
+ * Start the thread reading the MIDI sequencer.
  */
 
-static gint midi_add_to_main_loop( snd_seq_t *handle)
+static gboolean midi_start_thread( snd_seq_t *handle)
 {
-  gint fd;
   int rc;
 
 
-  /* Get the file descriptor associated with the seq.
-   * Will be used to let GDK monitor MIDI input.
-   */
-
-  fd = midi_get_fd( midi_handle);
-  if (IS_MIDI_DEBUG_ON) {
-    g_print("FD = %d\n", fd);
+  if (midi_quit_pipe[0] == -1 && pipe(midi_quit_pipe) != 0) {
+    return FALSE;
   }
 
-  /* Install callback to process MIDI input. */
-
-  midi_channel = g_io_channel_unix_new(fd);
-
-  g_io_add_watch_full( midi_channel,
-		       G_PRIORITY_HIGH,
-		       G_IO_IN|G_IO_ERR|G_IO_HUP,
-		       midi_channel_ready,
-		       midi_handle, /*user data */
-		       midi_channel_destroy);
-
   /* Filter some MIDI events...
    * Let pass only interessting events...
    */
 
   rc = 0;
-  rc = rc + snd_seq_set_client_event_filter( midi_handle, SND_SEQ_EVENT_NOTE);
-  rc = rc + snd_seq_set_client_event_filter( midi_handle, SND_SEQ_EVENT_NOTEON);
-  rc = rc + snd_seq_set_client_event_filter( midi_handle, SND_SEQ_EVENT_NOTEOFF);
-  rc = rc + snd_seq_set_client_event_filter( midi_handle, SND_SEQ_EVENT_CONTROLLER);
-  rc = rc + snd_seq_set_client_event_filter( midi_handle, SND_SEQ_EVENT_PGMCHANGE);
+  rc = rc + snd_seq_set_client_event_filter( handle, SND_SEQ_EVENT_NOTE);
+  rc = rc + snd_seq_set_client_event_filter( handle, SND_SEQ_EVENT_NOTEON);
+  rc = rc + snd_seq_set_client_event_filter( handle, SND_SEQ_EVENT_NOTEOFF);
+  rc = rc + snd_seq_set_client_event_filter( handle, SND_SEQ_EVENT_CONTROLLER);
+  rc = rc + snd_seq_set_client_event_filter( handle, SND_SEQ_EVENT_PGMCHANGE);
 
   if (rc != 0) {
     g_print("Unable to set event filter(s) on MIDI input stream...\n");
   }
 
-  return 0;
+  /* The thread waits with poll(), reading must not block. */
+
+  snd_seq_nonblock( handle, 1);
+
+  nb_notes_on = 0;
+  midi_thread = g_thread_create( midi_thread_func, handle, TRUE, NULL);
+
+  return midi_thread != NULL;
+}
+
+/****************************************************
+ * Stop the input thread, if it is running.
+ */
+
+static void midi_stop_thread( void)
+{
+  char c = 0;
+
+
+  if (midi_thread == NULL) {
+    return;
+  }
+
+  write( midi_quit_pipe[1], &c, 1);
+  g_thread_join( midi_thread);
+  read( midi_quit_pipe[0], &c, 1);
+  midi_thread = NULL;
 }
 
 /***********************************************
@@ -206,10 +219,7 @@ void midi_init() {
 	g_print( "Reinitializing MIDI input\n");
       }
 
-      if (midi_file_tag >= 0) {
-	gdk_input_remove( midi_file_tag);
-	midi_file_tag = -1;
-      }
+      midi_stop_thread();
 
       close_handle( midi_handle);
       midi_handle = NULL;
@@ -314,14 +324,11 @@ void midi_init() {
       }
     }
 
-    midi_file_tag = midi_add_to_main_loop( midi_handle);
-
-    if (midi_file_tag < 0) {
+    if (!midi_start_thread( midi_handle)) {
 	close_handle( midi_handle);
 	midi_handle = NULL;
 
-	g_warning( "error installing MIDI input callback (%s)\n",
-		 g_strerror(midi_file_tag));
+	g_warning( "error starting MIDI input thread\n");
 	return;
     }
 
@@ -334,76 +341,108 @@ void midi_init() {
 } /* midi_init() */
 
 /**************************************************
- * Callback for MIDI input events.
+ * MIDI input thread.
  *
- * NOTE:
- *	before leaving, "data" must be freed.
- *	It was created in snd_seq_event_input().
+ * Events are timestamped as soon as poll() returns,
+ * so that the audio thread can play them with the
+ * same distances between them as they came in.
  */
 
-gboolean midi_channel_ready( GIOChannel *channel, GIOCondition cond, gpointer data)
+static gpointer midi_thread_func( gpointer data)
 {
   snd_seq_t *handle = (snd_seq_t *)data;
   snd_seq_event_t *ev;
+  struct pollfd pfd[2];
+  guint64 now;
   int rc;
 
-  if (cond != G_IO_IN) {
-    g_print( "MIDI IO channel condition not G_IO_IN.\n");
-    return FALSE;
-  }
 
-  g_return_val_if_fail( handle != NULL, FALSE);
+  /* Like the audio thread. */
 
-  do {
-    /* Process MIDI event.  Don't forget to free the event after usage. */
+  nice(-14);
 
-    rc = snd_seq_event_input( handle, &ev);
-    if (rc < 0) {
-      g_print("unable to get event");
-      return TRUE;
+  pfd[0].fd = midi_get_fd( handle);
+  pfd[0].events = POLLIN;
+  pfd[1].fd = midi_quit_pipe[0];
+  pfd[1].events = POLLIN;
+
+  while (1) {
+    pfd[0].revents = pfd[1].revents = 0;
+
+    if (poll( pfd, 2, -1) < 0) {
+      if (errno == EINTR) {
+	continue;
+      }
+      if (errno == EAGAIN || errno == ENOMEM) {
+	/* Out of resources for the moment, try again later. */
+	g_usleep(10000);
+	continue;
+      }
+      g_warning( "MIDI input thread: poll() failed (%s)\n", g_strerror(errno));
+      break;
     }
 
-    switch (ev->type) {
-    case SND_SEQ_EVENT_NOTEOFF:
-	/* Simulate a note on event. */
-	ev->data.note.velocity = 0;
-	/* no break here. Go to next case...*/
-    case SND_SEQ_EVENT_NOTE:
-    case SND_SEQ_EVENT_NOTEON:
-      if (IS_MIDI_DEBUG_ON) {
-	  midi_print_event(ev);
-	}
-	midi_process_note_on( &(ev->data.note));
-	break;
+    if (pfd[1].revents & POLLIN) {
+      break;
+    }
 
-    case SND_SEQ_EVENT_CONTROLLER:
-      if (IS_MIDI_DEBUG_ON) {
-	  midi_print_event(ev);
-	}
-	midi_process_controller( &(ev->data.control));
-	break;
+    if (pfd[0].revents & (POLLERR|POLLHUP)) {
+      g_print( "MIDI input stream closed.\n");
+      break;
+    }
 
-    case SND_SEQ_EVENT_PGMCHANGE:
-      if (IS_MIDI_DEBUG_ON) {
-	  midi_print_event(ev);
-	}
-	midi_process_program_change( &(ev->data.control));
-	break;
+    now = audio_stats_now();
 
-    default:
-      if (IS_MIDI_DEBUG_ON) {
-	  /* Some events (like SND_SEQ_EVENT_SENSING) are not printed
-	     by the print_event routine. */
-	  midi_print_event(ev);
-	}
+    do {
+      /* Process MIDI event.  Don't forget to free the event after usage. */
+
+      rc = snd_seq_event_input( handle, &ev);
+      if (rc < 0) {
 	break;
-    }
+      }
+
+      switch (ev->type) {
+      case SND_SEQ_EVENT_NOTEOFF:
+	  /* Simulate a note on event. */
+	  ev->data.note.velocity = 0;
+	  /* no break here. Go to next case...*/
+      case SND_SEQ_EVENT_NOTE:
+      case SND_SEQ_EVENT_NOTEON:
+	if (IS_MIDI_DEBUG_ON) {
+	    midi_print_event(ev);
+	  }
+	  midi_process_note_on( &(ev->data.note), now);
+	  break;
+
+      case SND_SEQ_EVENT_CONTROLLER:
+	if (IS_MIDI_DEBUG_ON) {
+	    midi_print_event(ev);
+	  }
+	  midi_process_controller( &(ev->data.control), now);
+	  break;
+
+      case SND_SEQ_EVENT_PGMCHANGE:
+	if (IS_MIDI_DEBUG_ON) {
+	    midi_print_event(ev);
+	  }
+	  midi_process_program_change( &(ev->data.control), now);
+	  break;
+
+      default:
+	if (IS_MIDI_DEBUG_ON) {
+	    /* Some events (like SND_SEQ_EVENT_SENSING) are not printed
+	       by the print_event routine. */
+	    midi_print_event(ev);
+	  }
+	  break;
+      }
 
-    snd_seq_free_event(ev);
+      snd_seq_free_event(ev);
 
-  } while (snd_seq_event_input_pending(handle,0) > 0);
+    } while (snd_seq_event_input_pending(handle,0) > 0);
+  }
 
-  return TRUE;
+  return NULL;
 }
 
 
@@ -431,13 +470,22 @@ static void close_handle(snd_seq_t *handle)
  * Change the XM instrument.
  */
 
-static void midi_process_program_change( snd_seq_ev_ctrl_t *pcontrol)
+static void midi_process_program_change( snd_seq_ev_ctrl_t *pcontrol, guint64 time)
 {
+    audio_input_event e;
+
     /* In XM, instrument number is from 1 to 127.
-       0 is reserved. */
+       0 is reserved. The audio thread uses the new one right
+       away, the GUI is told when the event gets there. */
 
     if (pcontrol->value > 0) {
-	gui_set_current_instrument(pcontrol->value);
+	audio_input_set_instrument(pcontrol->value);
+
+	memset( &e, 0, sizeof(e));
+	e.type = AUDIO_INPUT_PROGRAM;
+	e.instrument = pcontrol->value;
+	e.time = time;
+	audio_input_event_put( &e);
     }
 
     if ( 0 ) {
@@ -456,7 +504,7 @@ static void midi_process_program_change( snd_seq_ev_ctrl_t *pcontrol)
  * If we receive Sustain event, transform it into a XM note off.
  */
 
-static void midi_process_controller( snd_seq_ev_ctrl_t *pcontrol)
+static void midi_process_controller( snd_seq_ev_ctrl_t *pcontrol, guint64 time)
 {
     snd_seq_ev_note_t note;
 
@@ -479,7 +527,7 @@ static void midi_process_controller( snd_seq_ev_ctrl_t *pcontrol)
 	} else {
 	    note.velocity = MIDI_VELOCITY_MAX;
 	}
-	midi_process_note_on( &note);
+	midi_process_note_on( &note, time);
 	break;
 
     default:
@@ -496,7 +544,7 @@ static void midi_process_controller( snd_seq_ev_ctrl_t *pcontrol)
 
 /*******************************************************
  * Process MIDI note ON.
- * Called from the MIDI input callback (most of the time).
+ * Called from the MIDI input thread.
  *
  * If the note velocity is 0, just turn off the sound. Don't
  * see it as a XM note off event.
@@ -510,19 +558,24 @@ static void midi_process_controller( snd_seq_ev_ctrl_t *pcontrol)
  * when the last key is released...
  */
 
-static void midi_process_note_on( snd_seq_ev_note_t *pnote)
+static void midi_process_note_on( snd_seq_ev_note_t *pnote, guint64 time)
 {
+    audio_input_event e;
     gint note;
     int channel;
+    int cursor_ch, num_channels;
     int volume;
     gboolean note_on = pnote->velocity > 0 ? 1 : 0;
 
-    /* Set local value for channel. */
+    /* Set local value for channel.  This is the MIDI thread, the
+       tracker's own fields belong to the GUI thread. */
+
+    tracker_get_channels(tracker, &cursor_ch, &num_channels);
 
     if (midi_settings.input.channel_enabled) {
 	channel = (int)pnote->channel;
     } else {
-	channel = tracker->cursor_ch;
+	channel = cursor_ch;
     }
 
     /* Set local value for volume. */
@@ -552,7 +605,7 @@ static void midi_process_note_on( snd_seq_ev_note_t *pnote)
 	return;
     }
 
-    if (channel > tracker->num_channels) {
+    if (channel >= num_channels) {
 	g_warning( "Channel out of range");
 	return;
     }
@@ -564,83 +617,119 @@ static void midi_process_note_on( snd_seq_ev_note_t *pnote)
 		 note);
     }
 
-    /* If necessary, jump to channel */
+    memset( &e, 0, sizeof(e));
+    e.channel = channel;
+    e.note = note;
+    e.volume = volume;
+    e.time = time;
 
-    if (tracker->cursor_ch != channel) {
-	int diff = channel - tracker->cursor_ch;
+    if ( note_on ) {
+	/* Increment the number of notes on. */
 
-	/*g_warning("MIDI channel and current channel are not the same..."); */
+	nb_notes_on++;
 
-	tracker_step_cursor_channel( tracker, diff);
-    }
+	e.type = AUDIO_INPUT_NOTE;
+	audio_input_event_put( &e);
 
-    /* Play the note. Record it if we're in the track editor. */
+    } else {
+	/* Decrement the number of note on.
+	   If it is 0, then turn the note off in the track (channel). */
 
-    if ( note_on ) {
-	int row;
-	XMNote *xmnote;
+	nb_notes_on--;
 
-	/* Increment the number of notes on. */
+	if (nb_notes_on <= 0) {
+	    e.type = AUDIO_INPUT_KEYOFF;
+	    audio_input_event_put( &e);
+	    nb_notes_on = 0;
+	}
+    }
+ 
+    return;
 
-	nb_notes_on++;
+} /* midi_process_note_on() */
+
+/*******************************************************
+ * Record a MIDI event after it has been played.
+ * Called from the GUI thread.
+ *
+ * While a song or pattern is playing, the note goes into
+ * the row that could be heard when the key was pressed,
+ * not into the one shown by the time the event gets here.
+ */
+
+void midi_record_event( const audio_input_event *e)
+{
+    XMPattern *pattern;
+    XMNote *xmnote;
+    int row;
 
-	/* Play the note in the channel specified by the MIDI channel. */
+    if (e->type == AUDIO_INPUT_PROGRAM) {
+	gui_set_current_instrument(e->instrument);
+	return;
+    }
 
-	gui_play_note( channel, note);
+    if (e->type != AUDIO_INPUT_NOTE) {
+	return;
+    }
 
-	/* Give warning when MIDI channel and cursor channel are different. */
+    /* If necessary, jump to channel */
 
-	if(tracker->cursor_ch != channel) {
-	    g_warning( "MIDI channel and current channel are not the same...");
-	}
+    if (tracker->cursor_ch != e->channel) {
+	int diff = e->channel - tracker->cursor_ch;
 
- 	/* Edit track if:
- 	   1- we're in the track editor tab,
- 	   2- edit mode is active...
- 	*/
- 
- 	if ( !GUI_EDITING || notebook_current_page != NOTEBOOK_PAGE_TRACKER) {
- 	    return;
- 	}
+	tracker_step_cursor_channel( tracker, diff);
+    }
 
-	/* Current position in channel. */
+    /* Edit track if:
+       1- we're in the track editor tab,
+       2- edit mode is active...
+    */
 
-	row = tracker->patpos;
+    if ( !GUI_EDITING || notebook_current_page != NOTEBOOK_PAGE_TRACKER) {
+	return;
+    }
 
-	/* Get and set current XM note pitch. */
+    /* Current position in channel. */
 
-	xmnote = &(tracker->curpattern->channels[channel][row]);
+    pattern = tracker->curpattern;
+    row = tracker->patpos;
 
-	xmnote->note = note;
-	xmnote->instrument = gui_get_current_instrument();
-	if ( volume >= 0 ) {
-	  xmnote->volume = volume;
+    if ((gui_playing_mode == PLAYING_SONG || gui_playing_mode == PLAYING_PATTERN)
+	&& e->patpos >= 0 && e->songpos < xm->song_length) {
+	if (gui_playing_mode == PLAYING_SONG) {
+	    pattern = &xm->patterns[xm->pattern_order_table[e->songpos]];
 	}
+	row = e->patpos;
+    }
 
-	/* Redraw screen and if not in ASYNCEDIT mode,
-	   jump to next position in the channel. */
+    if (row >= pattern->length || e->channel >= xm->num_channels) {
+	return;
+    }
 
-	tracker_redraw_current_row(tracker);
-	if (!ASYNCEDIT) {
-	    tracker_step_cursor_row(tracker, gui_get_current_jump_value());
-	}
-	
-	/* Don't forget: the XM has been changed... */
+    /* Get and set current XM note pitch. */
 
-	xm_set_modified(1);
+    xmnote = xm_pattern_note(pattern, e->channel, row);
 
-    } else {
-	/* Decrement the number of note on.
-	   If it is 0, then turn the note off in the track (channel). */
+    pattern_undo_begin(pattern, e->channel, 1, row, 1);
+    xmnote->note = e->note;
+    xmnote->instrument = e->instrument;
+    if ( e->volume >= 0 ) {
+      xmnote->volume = e->volume;
+    }
+    pattern_undo_end();
 
-	nb_notes_on--;
+    /* Redraw the row, if it is on screen, and if not in ASYNCEDIT
+       mode, jump to next position in the channel. */
 
-	if (nb_notes_on <= 0) {
-	    gui_play_note_keyoff( channel);
-	    nb_notes_on = 0;
-	}
+    if (pattern == tracker->curpattern) {
+	tracker_redraw_row(tracker, row);
     }
- 
-    return;
+    if (!ASYNCEDIT) {
+	tracker_step_cursor_row(tracker, gui_get_current_jump_value());
+    }
+	
+    /* Don't forget: the XM has been changed... */
 
-} /* midi_process_note_on() */
+    xm_set_modified(1);
+
+} /* midi_record_event() */
@@ -40,6 +40,13 @@
 
 void midi_init (void);
 
+#if defined(DRIVER_ALSA_09x)
+#include "audio.h"
+
+/* Called by the GUI for the input events the audio thread has played */
+void midi_record_event (const audio_input_event *e);
+#endif
+
 #endif
 
 #endif /* _MIDI_H */
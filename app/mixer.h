@@ -31,6 +31,7 @@ typedef struct st_mixer_sample_info {
     guint32 loopend;      /* offset to first sample not being played */
     gint16 *data;         /* pointer to sample data */
     GMutex *lock;
+    guint32 format;       /* see ST_MIXER_SAMPLE_FORMAT_ defines below */
 } st_mixer_sample_info;
 
 /* values for st_mixer_sample_info.looptype */
@@ -38,11 +39,23 @@ typedef struct st_mixer_sample_info {
 #define ST_MIXER_SAMPLE_LOOPTYPE_AMIGA     1
 #define ST_MIXER_SAMPLE_LOOPTYPE_PINGPONG  2
 
+/* values for st_mixer_sample_info.format. 8 bit samples are kept as
+   loaded from the module; data then really is a gint8 pointer. */
+#define ST_MIXER_SAMPLE_FORMAT_16BIT       0
+#define ST_MIXER_SAMPLE_FORMAT_8BIT        1
+
 typedef struct st_mixer_channel_status {
     st_mixer_sample_info *current_sample;
     guint32 current_position;
 } st_mixer_channel_status;
 
+typedef struct st_mixer_stats {
+    guint32 active_voices;  /* voices running during the last mix() call */
+    guint32 culled_voices;  /* ...of which were inaudible and only advanced */
+    guint64 mixed_samples;  /* voice-samples rendered since reset() */
+    guint64 culled_samples; /* voice-samples advanced without rendering since reset() */
+} st_mixer_stats;
+
 typedef struct st_mixer {
     const char *id;
     const char *description;
@@ -60,7 +73,7 @@ typedef struct st_mixer {
     gboolean (*setstereo)    (int on);
 
     /* set mixing frequency */
-    void     (*setmixfreq)   (guint16 frequency);
+    void     (*setmixfreq)   (guint32 frequency);
 
     /* set final amplification factor (0.0 = mute ... 1.0 = normal ... +inf = REAL LOUD! :D)*/
     void     (*setampfactor) (float amplification);
@@ -98,7 +111,9 @@ typedef struct st_mixer {
     /* set channel filter resonance (0.0 ... +1.0) */
     void     (*setchreso)    (int channel, float reso);
 
-    /* do the mix, return pointer to end of dest */
+    /* do the mix, return pointer to end of dest. If dest is NULL, the
+       voices are only advanced, leaving them in exactly the state they
+       would be in after mixing; scopebufs is NULL then, too. */
     void*    (*mix)          (void *dest, guint32 count, gint16 *scopebufs[], int scopebuf_offset);
 
     /* get status information */
@@ -107,6 +122,19 @@ typedef struct st_mixer {
     /* load channel settings from tracer */
     void     (*loadchsettings) (int channel);
 
+    /* get voice statistics (may be NULL) */
+    void     (*getstats)     (st_mixer_stats *stats);
+
+    /* like mix(), without scopes, but every voice additionally goes to
+       stems[stem(channel, sample)], for the channel it is on and the
+       sample it was started with (unless that is -1 or the entry is
+       NULL), with the same amplification as the full mix. The full
+       mix must be exactly the same as from mix(). dest may be NULL.
+       The stems[] pointers are advanced past the data written. (may
+       be NULL) */
+    void*    (*mixstems)     (void *dest, void *stems[], int (*stem)(int channel, st_mixer_sample_info *sample),
+			      int numstems, guint32 count);
+
     guint32 max_sample_length;
 
     struct st_mixer *next;
@@ -24,23 +24,13 @@
 
 #include <glib.h>
 
-gint32 mixerasm_stereo_16_scopes (gint32 current,     // 8
-				  gint32 increment,   // 12
-				  gint16 *data,       // 16
-				  gint32 *mixed,      // 20
-				  gint16 *scopedata,   // 24
-				  guint32 volume,     // 28
-				  guint32 leftvol,    // 32
-				  guint32 rightvol,   // 36
-				  guint32 count);     // 40
-
-gint32 mixerasm_mono_16_scopes (gint32 current,     // 8
-				gint32 increment,   // 12
-				gint16 *data,       // 16
-				gint32 *mixed,      // 20
-				gint16 *scopedata,   // 24
-				guint32 volume,     // 28
-				guint32 count);     // 32
+/* The routines below come from integer32-asm.S on i386, and from
+   integer32-simd.c where SSE2 or NEON is available. */
+#if defined(__i386__) && !defined(NO_ASM)
+#define INTEGER32_ASM 1
+#elif defined(__SSE2__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define INTEGER32_SIMD 1
+#endif
 
 gint32 mixerasm_stereo_16(gint32 current,     // 8
 			  gint32 increment,   // 12
@@ -0,0 +1,142 @@
+/*
+ * The Real SoundTracker - SIMD routines for the integer mixer
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* Replacements for integer32-asm.S on x86-64 (SSE2) and ARM (NEON),
+   computing exactly the same values as the C loops in integer32.c.
+
+   There is no interpolation, so the samples have to be fetched one by
+   one anyway; what is done in parallel is scaling four of them and
+   adding them to the mixing buffer. For stereo, the products with the
+   panning are taken from the sample directly, using
+   vl * (v * s) == (vl * v) * s; vl * v is at most 64 * 64, so all
+   factors fit into 16 bits. */
+
+#include <config.h>
+
+#include "integer32-asm.h"
+
+#ifdef INTEGER32_SIMD
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#else
+#include <arm_neon.h>
+#endif
+
+#define ACCURACY 12 /* as in integer32.c */
+
+#define FETCH4(smp) \
+    smp[0] = data[current >> ACCURACY]; current += increment; \
+    smp[1] = data[current >> ACCURACY]; current += increment; \
+    smp[2] = data[current >> ACCURACY]; current += increment; \
+    smp[3] = data[current >> ACCURACY]; current += increment;
+
+gint32
+mixerasm_stereo_16 (gint32 current,
+		    gint32 increment,
+		    gint16 *data,
+		    gint32 *mixed,
+		    guint32 leftvol,
+		    guint32 rightvol,
+		    guint32 count)
+{
+    gint16 smp[4];
+    gint32 val;
+#if defined(__SSE2__)
+    const __m128i vlr = _mm_set_epi32(rightvol, leftvol, rightvol, leftvol);
+    __m128i s, s01, s23;
+
+    for(; count >= 4; count -= 4) {
+	FETCH4(smp)
+	s = _mm_loadl_epi64((__m128i*)smp);
+	s = _mm_unpacklo_epi16(s, s);
+	s01 = _mm_unpacklo_epi32(s, s);
+	s23 = _mm_unpackhi_epi32(s, s);
+	_mm_storeu_si128((__m128i*)mixed,
+			 _mm_add_epi32(_mm_loadu_si128((__m128i*)mixed),
+				       _mm_srai_epi32(_mm_madd_epi16(s01, vlr), 6)));
+	_mm_storeu_si128((__m128i*)mixed + 1,
+			 _mm_add_epi32(_mm_loadu_si128((__m128i*)mixed + 1),
+				       _mm_srai_epi32(_mm_madd_epi16(s23, vlr), 6)));
+	mixed += 8;
+    }
+#else
+    int32x4x2_t m;
+    int16x4_t s;
+
+    for(; count >= 4; count -= 4) {
+	FETCH4(smp)
+	s = vld1_s16(smp);
+	m = vld2q_s32(mixed);
+	m.val[0] = vaddq_s32(m.val[0], vshrq_n_s32(vmull_n_s16(s, leftvol), 6));
+	m.val[1] = vaddq_s32(m.val[1], vshrq_n_s32(vmull_n_s16(s, rightvol), 6));
+	vst2q_s32(mixed, m);
+	mixed += 8;
+    }
+#endif
+
+    for(; count; count--) {
+	val = data[current >> ACCURACY];
+	*mixed++ += (gint32)leftvol * val >> 6;
+	*mixed++ += (gint32)rightvol * val >> 6;
+	current += increment;
+    }
+
+    return current;
+}
+
+gint32
+mixerasm_mono_16 (gint32 current,
+		  gint32 increment,
+		  gint16 *data,
+		  gint32 *mixed,
+		  guint32 volume,
+		  guint32 count)
+{
+    gint16 smp[4];
+#if defined(__SSE2__)
+    const __m128i vol = _mm_set1_epi32(volume);
+    __m128i s;
+
+    for(; count >= 4; count -= 4) {
+	FETCH4(smp)
+	s = _mm_loadl_epi64((__m128i*)smp);
+	s = _mm_madd_epi16(_mm_unpacklo_epi16(s, s), vol);
+	_mm_storeu_si128((__m128i*)mixed,
+			 _mm_add_epi32(_mm_loadu_si128((__m128i*)mixed), s));
+	mixed += 4;
+    }
+#else
+    for(; count >= 4; count -= 4) {
+	FETCH4(smp)
+	vst1q_s32(mixed, vaddq_s32(vld1q_s32(mixed), vmull_n_s16(vld1_s16(smp), volume)));
+	mixed += 4;
+    }
+#endif
+
+    for(; count; count--) {
+	*mixed++ += (gint32)volume * data[current >> ACCURACY];
+	current += increment;
+    }
+
+    return current;
+}
+
+#endif /* INTEGER32_SIMD */
@@ -29,35 +29,40 @@
 #include "mixer.h"
 #include "i18n.h"
 #include "tracer.h"
+#include "scope-capture.h"
 
-#if defined(__i386__) && !defined(NO_ASM)
+#include "integer32-asm.h"
+
+#if defined(INTEGER32_ASM) || defined(INTEGER32_SIMD)
 #define MIX_ASM 1
 #else
 #undef MIX_ASM
 #endif
 
-#ifdef MIX_ASM
-#include "integer32-asm.h"
-#endif
-
 static int num_channels, mixfreq, amp = 8;
 static gint32 *mixbuf = NULL;
 static int mixbufsize = 0, clipflag;
+static gint32 *stembuf = NULL;
+static int stembufsize = 0;
+static gboolean *stemused = NULL;
+static int stemusedsize = 0;
 static int stereo;
+static st_mixer_stats stats;
 
 typedef struct integer32_channel {
     st_mixer_sample_info *sample;
 
     void *data;                 /* copy of sample->data */
-    guint32 length;             /* length of sample (converted) */
-    guint32 playend;            /* for a forced premature end of the sample */
+    guint32 format;             /* copy of sample->format */
+    gint64 length;              /* length of sample (converted) */
+    gint64 playend;             /* for a forced premature end of the sample */
 
     int running;                /* this channel is active */
-    guint32 current;            /* current playback position in sample (converted) */
+    gint64 current;             /* current playback position in sample (converted) */
     guint32 speed;              /* sample playback speed (converted) */
 
-    guint32 loopstart;          /* loop start (converted) */
-    guint32 loopend;            /* loop end (converted) */
+    gint64 loopstart;           /* loop start (converted) */
+    gint64 loopend;             /* loop end (converted) */
     int loopflags;              /* 0 none, 1 forward, 2 pingpong */
     int direction;              /* current pingpong direction (+1 forward, -1 backward) */
 
@@ -69,7 +74,11 @@ static integer32_channel channels[32];
 
 #define ACCURACY           12         /* accuracy of the fixed point stuff, ALSO HARDCODED in the assembly routines!! */
 
-#define MAX_SAMPLE_LENGTH  ((1 << (32 - ACCURACY)) - 1)
+/* Sample positions are 64 bit fixed point numbers, so there is no
+   limit on the sample length. The mixing routines are given the
+   sample data from the current position on and work with 32 bit
+   positions relative to it. */
+#define CONVERT(x)         ((gint64)(x) << ACCURACY)
 
 static void
 integer32_setnumch (int n)
@@ -91,16 +100,19 @@ integer32_updatesample (st_mixer_sample_info *si)
 	    continue;
 	}
 
-	if(c->data != si->data
-	   || c->length != MIN(si->length, MAX_SAMPLE_LENGTH) << ACCURACY
+	if((c->data != si->data && c->format == si->format)
+	   || c->length != CONVERT(si->length)
 	   || c->loopflags != si->looptype) {
 	    c->running = 0;
 	}
 	 
 	/* No relevant data has changed. Don't stop the sample, but update
-	   our local loop data instead. */
-	c->loopstart = MIN(si->loopstart, MAX_SAMPLE_LENGTH) << ACCURACY;
-	c->loopend = MIN(si->loopend, MAX_SAMPLE_LENGTH) << ACCURACY;
+	   our local loop data instead. A sample that has only been
+	   converted to 16 bits goes on playing from the new data. */
+	c->data = si->data;
+	c->format = si->format;
+	c->loopstart = CONVERT(si->loopstart);
+	c->loopend = CONVERT(si->loopend);
 	c->loopflags = si->looptype;
 	if(c->loopflags != ST_MIXER_SAMPLE_LOOPTYPE_NONE) {
 	    // we can be more clever here...
@@ -127,7 +139,7 @@ integer32_setstereo (int on)
 }
 
 static void
-integer32_setmixfreq (guint16 frequency)
+integer32_setmixfreq (guint32 frequency)
 {
     mixfreq = frequency;
 }
@@ -148,6 +160,7 @@ static void
 integer32_reset (void)
 {
     memset(channels, 0, sizeof(channels));
+    memset(&stats, 0, sizeof(stats));
 }
 
 static void
@@ -158,13 +171,14 @@ integer32_startnote (int channel,
 
     c->sample = s;
     c->data = s->data;
-    c->length = MIN(s->length, MAX_SAMPLE_LENGTH) << ACCURACY;
+    c->format = s->format;
+    c->length = CONVERT(s->length);
     c->playend = 0;
     c->running = 1;
     c->speed = 1;
     c->current = 0;
-    c->loopstart = MIN(s->loopstart, MAX_SAMPLE_LENGTH) << ACCURACY;
-    c->loopend = MIN(s->loopend, MAX_SAMPLE_LENGTH) << ACCURACY;
+    c->loopstart = CONVERT(s->loopstart);
+    c->loopend = CONVERT(s->loopend);
     c->loopflags = s->looptype;
     c->direction = 1;
 }
@@ -184,7 +198,7 @@ integer32_setsmplpos (int channel,
     integer32_channel *c = &channels[channel];
 
     if(offset < c->length >> ACCURACY) {
-	c->current = offset << ACCURACY;
+	c->current = CONVERT(offset);
 	c->direction = 1;
     } else {
 	c->running = 0;
@@ -198,7 +212,7 @@ integer32_setsmplend (int channel,
     integer32_channel *c = &channels[channel];
 
     if(c->current != 0 || offset < c->length >> ACCURACY) {
-	c->playend = MIN(offset, MAX_SAMPLE_LENGTH) << ACCURACY;
+	c->playend = CONVERT(offset);
     }
 }
 
@@ -236,24 +250,93 @@ integer32_setpanning (int channel,
     c->panning = panning;
 }
 
+/* The mixing loops for samples stored with 8 bits. There are no
+   assembly versions of these; the values are scaled up to 16 bits, so
+   the results are the same as for the converted sample. Works like
+   the assembly routines and returns the new sample position. */
+static gint32
+integer32_mix_8bit (gint32 j,
+		    gint32 s,
+		    const gint8 *data,
+		    int *m,
+		    int v,
+		    int vl,
+		    int vr,
+		    int done)
+{
+    int val;
+
+    if(stereo) {
+	vl *= v;
+	vr *= v;
+	for(; done; done--, j += s) {
+	    val = data[j >> ACCURACY] << 8;
+	    *m++ += vl * val >> 6;
+	    *m++ += vr * val >> 6;
+	}
+    } else {
+	for(; done; done--, j += s) {
+	    val = v * (data[j >> ACCURACY] << 8);
+	    *m++ += val;
+	}
+    }
+
+    return j;
+}
+
 static void *
-integer32_mix (void *dest,
-	       guint32 count,
-	       gint16 *scopebufs[],
-	       int scopebuf_offset)
+integer32_output (void *dest,
+		  gint32 *buf,
+		  guint32 count,
+		  int *clip)
+{
+    gint16 *sndbuf;
+    int todo, t;
+
+    /* modules with many channels get additional amplification here */
+    t = (4 * log(num_channels) / log(4)) * 64 * 8;
+
+    for(sndbuf = dest, *clip = 0, todo = 0; todo < (stereo + 1) * count; todo++) {
+	gint32 a, b;
+
+	a = buf[todo];
+	a *= amp;                  /* amplify */
+	a /= t;
+
+	b = CLAMP(a, -32768, 32767);
+	if(a != b) {
+	    *clip = 1;
+	}
+
+	*sndbuf++ = b;
+    }
+
+    return dest + (stereo + 1) * 2 * count;
+}
+
+/* Channels going to a stem are mixed into that stem's part of stembuf,
+   which is added to the full mix afterwards; integer additions don't
+   depend on the order. Only the stems a voice goes to in this block
+   are cleared and added, the others are silent. */
+static void *
+integer32_mix_common (void *dest,
+		      void *stems[],
+		      int (*stem)(int channel, st_mixer_sample_info *sample),
+		      int numstems,
+		      guint32 count,
+		      gint16 *scopebufs[],
+		      int scopebuf_offset)
 {
-    int todo;
-    int i, j, t, *m, v;
+    int i, j, s, t, *m, v, clip, k;
     integer32_channel *c;
     int done;
-    int offs2end, oflcnt, looplen;
-    gint16 *sndbuf;
-    gint16 *scopedata = NULL;
+    gint64 offs2end, oflcnt, looplen, maxdone, base;
     int vl = 0;
     int vr = 0;
     gint16 *data;
+    gboolean inaudible;
 #ifndef MIX_ASM
-    int s, val;
+    int val;
 #endif
 
     if((stereo + 1) * count > mixbufsize) {
@@ -263,21 +346,58 @@ integer32_mix (void *dest,
     }
     memset(mixbuf, 0, (stereo + 1) * 4 * count);
 
+    if(stems) {
+	if(numstems * (stereo + 1) * count > stembufsize) {
+	    g_free(stembuf);
+	    stembufsize = numstems * (stereo + 1) * count;
+	    stembuf = g_new(gint32, stembufsize);
+	}
+	if(numstems > stemusedsize) {
+	    g_free(stemused);
+	    stemusedsize = numstems;
+	    stemused = g_new(gboolean, stemusedsize);
+	}
+	memset(stemused, 0, numstems * sizeof(stemused[0]));
+    }
+
+    stats.active_voices = 0;
+    stats.culled_voices = 0;
+
+    if(scopebufs) {
+	scope_capture_begin(scopebufs, scopebuf_offset, count);
+    }
+
     for(i = 0; i < num_channels; i++) {
 	c = &channels[i];
 	t = count;
 	m = mixbuf;
 	v = c->volume;
 
-	if(scopebufs)
-	    scopedata = scopebufs[i] + scopebuf_offset;
-
 	if(!c->running) {
-	    if(scopebufs)
-		memset(scopedata, 0, 2 * count);
 	    continue;
 	}
 
+	if(stems && (k = stem(i, c->sample)) >= 0 && k < numstems && stems[k]) {
+	    m = stembuf + k * (stereo + 1) * count;
+	    if(!stemused[k]) {
+		memset(m, 0, (stereo + 1) * 4 * count);
+		stemused[k] = TRUE;
+	    }
+	}
+
+	/* The pan factors always add up to 64, so a zero volume silences
+	   both sides. Such a voice is only moved forward, see below. The
+	   same is done for all voices if there is nothing to mix into. */
+	inaudible = (v == 0 || (!dest && m == mixbuf));
+
+	stats.active_voices++;
+	if(inaudible) {
+	    stats.culled_voices++;
+	    stats.culled_samples += count;
+	} else {
+	    stats.mixed_samples += count;
+	}
+
 	g_assert(c->sample->lock);
 	g_mutex_lock(c->sample->lock);
 
@@ -317,19 +437,21 @@ integer32_mix (void *dest,
 		    }
 		}
 		g_assert(offs2end >= 0);
-		done = offs2end / c->speed + 1;
+		// Up to the first position at or past the end of the loop
+		maxdone = (offs2end - 1) / c->speed + 1;
 	    } else /* if(c->loopflags == LOOP_NO) */ {
-		done = ((c->playend ? c->playend : c->length) - c->current) / c->speed;
-		if(!done) {
+		maxdone = ((c->playend ? c->playend : c->length) - c->current) / c->speed;
+		if(!maxdone) {
 		    c->running = 0;
 		    break;
 		}
 	    }
 
-	    g_assert(done > 0);
+	    g_assert(maxdone > 0);
 
-	    if(done > t)
-		done = t;
+	    /* The mixing routines work with 32 bit positions relative to
+	       the current one, which must not overflow either. */
+	    done = MIN(maxdone, MIN(t, (gint32)((0x7fffffff - (1 << ACCURACY)) / c->speed)));
 	    t -= done;
 
 	    g_assert(c->current >= 0 && (c->current >> ACCURACY) < c->length);
@@ -339,105 +461,118 @@ integer32_mix (void *dest,
 		vr = (c->panning + 1.0) * 32;
 	    }
 
-	    /* This one does the actual mixing */
-	    data = c->data;
+	    if(inaudible) {
+		/* Nothing to hear, just advance to where the
+		   mixing loops below would have ended up. */
+		c->current += (gint64)c->speed * c->direction * done;
+		m += (stereo + 1) * done;
+		continue;
+	    }
+
+	    base = c->current >> ACCURACY;
+	    j = c->current & ((1 << ACCURACY) - 1);
+	    s = c->speed * c->direction;
+
+	    /* The scopes are fed from the sample data, see scope-capture.h */
 	    if(scopebufs) {
-		if(stereo) {
-#ifdef MIX_ASM
-		    j = mixerasm_stereo_16_scopes(c->current, c->speed * c->direction,
-						  data, m, scopedata,
-						  v, vl, vr,
-						  done);
-		    
-		    m += 2 * done;
-		    scopedata += done;
-#else
-		    for(j = c->current, s = c->speed * c->direction; done; done--, j += s) {
-			val = v * data[j >> ACCURACY];
-			*m++ += vl * val >> 6;
-			*m++ += vr * val >> 6;
-			*scopedata++ = val >> 6;
-		    }
-#endif
-		} else {
+		scope_capture_voice(i, count - t - done, done,
+				    c->format == ST_MIXER_SAMPLE_FORMAT_8BIT
+				    ? (void*)((gint8*)c->data + base) : (void*)((gint16*)c->data + base),
+				    c->format,
+				    (guint32)j << (32 - ACCURACY),
+				    (gint64)s << (32 - ACCURACY),
+				    v / 64.0);
+	    }
+
+	    if(c->format == ST_MIXER_SAMPLE_FORMAT_8BIT) {
+		j = integer32_mix_8bit(j, s, (gint8*)c->data + base,
+				       m, v, vl, vr, done);
+		m += (stereo + 1) * done;
+		c->current = (base << ACCURACY) + j;
+		continue;
+	    }
+
+	    /* This one does the actual mixing */
+	    data = (gint16*)c->data + base;
+	    if(stereo) {
+		vl *= v;
+		vr *= v;
 #ifdef MIX_ASM
-		    j = mixerasm_mono_16_scopes(c->current, c->speed * c->direction,
-						data, m, scopedata,
-						v,
-						done);
- 
-		    m += done;
-		    scopedata += done;
+		j = mixerasm_stereo_16(j, s,
+				       data, m,
+				       vl, vr,
+				       done);
+		m += 2 * done;
 #else
-		    for(j = c->current, s = c->speed * c->direction; done; done--, j += s) {
-			val = v * data[j >> ACCURACY];
-			*m++ += val;
-			*scopedata++ = val >> 6;
-		    }
-#endif
+		for(; done; done--, j += s) {
+		    val = data[j >> ACCURACY];
+		    *m++ += vl * val >> 6;
+		    *m++ += vr * val >> 6;
 		}
-	    } else {
-		if(stereo) {
-		    vl *= v;
-		    vr *= v;
-#ifdef MIX_ASM
-		    j = mixerasm_stereo_16(c->current, c->speed * c->direction,
-					   data, m,
-					   vl, vr,
-					   done);
-		    
-		    m += 2 * done;
-		    scopedata += done;
-#else
-		    for(j = c->current, s = c->speed * c->direction; done; done--, j += s) {
-			val = data[j >> ACCURACY];
-			*m++ += vl * val >> 6;
-			*m++ += vr * val >> 6;
-		    }
 #endif
-		} else {
+	    } else {
 #ifdef MIX_ASM
-		    j = mixerasm_mono_16(c->current, c->speed * c->direction,
-					 data, m,
-					 v,
-					 done);
-		    
-		    m += done;
-		    scopedata += done;
+		j = mixerasm_mono_16(j, s,
+				     data, m,
+				     v,
+				     done);
+		m += done;
 #else
-		    for(j = c->current, s = c->speed * c->direction; done; done--, j += s) {
-			val = v * data[j >> ACCURACY];
-			*m++ += val;
-		    }
-#endif
+		for(; done; done--, j += s) {
+		    val = v * data[j >> ACCURACY];
+		    *m++ += val;
 		}
+#endif
 	    }
 
-	    c->current = j;
+	    c->current = (base << ACCURACY) + j;
 	}
 
 	g_mutex_unlock(c->sample->lock);
     }
 
-    /* modules with many channels get additional amplification here */
-    t = (4 * log(num_channels) / log(4)) * 64 * 8;
-
-    for(sndbuf = dest, clipflag = 0, todo = 0; todo < (stereo + 1) * count; todo++) {
-	gint32 a, b;
-
-	a = mixbuf[todo];
-	a *= amp;                  /* amplify */
-	a /= t;
+    if(scopebufs) {
+	scope_capture_end(num_channels);
+    }
 
-	b = CLAMP(a, -32768, 32767);
-	if(a != b) {
-	    clipflag = 1;
+    for(i = 0; stems && i < numstems; i++) {
+	if(stems[i] && !stemused[i]) {
+	    memset(stems[i], 0, (stereo + 1) * 2 * count);
+	    stems[i] += (stereo + 1) * 2 * count;
+	} else if(stems[i]) {
+	    m = stembuf + i * (stereo + 1) * count;
+	    for(j = 0; j < (stereo + 1) * count; j++) {
+		mixbuf[j] += m[j];
+	    }
+	    stems[i] = integer32_output(stems[i], m, count, &clip);
 	}
+    }
 
-	*sndbuf++ = b;
+    if(!dest) {
+	clipflag = 0;
+	return NULL;
     }
 
-    return dest + (stereo + 1) * 2 * count;
+    return integer32_output(dest, mixbuf, count, &clipflag);
+}
+
+static void *
+integer32_mix (void *dest,
+	       guint32 count,
+	       gint16 *scopebufs[],
+	       int scopebuf_offset)
+{
+    return integer32_mix_common(dest, NULL, NULL, 0, count, scopebufs, scopebuf_offset);
+}
+
+static void *
+integer32_mixstems (void *dest,
+		    void *stems[],
+		    int (*stem)(int channel, st_mixer_sample_info *sample),
+		    int numstems,
+		    guint32 count)
+{
+    return integer32_mix_common(dest, stems, stem, numstems, count, NULL, 0);
 }
 
 void
@@ -455,6 +590,12 @@ integer32_dumpstatus (st_mixer_channel_status array[])
     }
 }
 
+static void
+integer32_getstats (st_mixer_stats *s)
+{
+    *s = stats;
+}
+
 static void
 integer32_loadchsettings (int ch)
 {
@@ -469,28 +610,28 @@ integer32_loadchsettings (int ch)
 
     c->sample = tch->sample;
     c->data = tch->data;
+    c->format = tch->format;
 
     if (tch->sample){
 	c->loopflags = tch->sample->looptype;
-	c->loopstart = MIN(tch->sample->loopstart, MAX_SAMPLE_LENGTH) << ACCURACY;
-	c->loopend = MIN(tch->sample->loopend, MAX_SAMPLE_LENGTH) << ACCURACY;
+	c->loopstart = CONVERT(tch->sample->loopstart);
+	c->loopend = CONVERT(tch->sample->loopend);
     }
-    c->length = MIN(tch->length, MAX_SAMPLE_LENGTH) << ACCURACY;
+    c->length = CONVERT(tch->length);
     c->volume = tch->volume * 64;
     c->panning = tch->panning;
     c->direction = tch->direction;
-    c->playend = MIN(tch->playend, MAX_SAMPLE_LENGTH) << ACCURACY;
-    tmp64 = (((guint64)tch->positionw << 32) + tch->positionf) >> (32 - ACCURACY);
-    c->current = MIN(tmp64, MAX_SAMPLE_LENGTH << ACCURACY);
+    c->playend = CONVERT(tch->playend);
+    c->current = (((guint64)tch->positionw << 32) + tch->positionf) >> (32 - ACCURACY);
     tmp64 = (((guint64)tch->freqw << 32) + tch->freqf) >> (32 - ACCURACY);
-    c->speed = MIN(tmp64, MAX_SAMPLE_LENGTH << ACCURACY);
+    c->speed = MIN(tmp64, 0x7fffffff >> 1);
     
     c->running = tch->flags & TR_FLAG_SAMPLE_RUNNING;
 }
 
 st_mixer mixer_integer32 = {
     "integer32",
-    N_("Integers mixer, no interpolation, no filters, maximum sample length 1M"),
+    N_("Integers mixer, no interpolation, no filters, unlimited length samples"),
 
     integer32_setnumch,
     integer32_updatesample,
@@ -512,8 +653,10 @@ st_mixer mixer_integer32 = {
     integer32_mix,
     integer32_dumpstatus,
     integer32_loadchsettings,
+    integer32_getstats,
+    integer32_mixstems,
 
-    MAX_SAMPLE_LENGTH,
+    0x7fffffff,
 
     NULL
 };
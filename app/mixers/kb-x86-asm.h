@@ -44,16 +44,19 @@ typedef struct kb_x86_mixer_data {
     float freso;                // filter resonance (0<=x<1)           48
     float fl1;                  // filter lp buffer                    52
     float fb1;                  // filter bp buffer                    56
-    gint16 *scopebuf;           //                                     60
-    guint32 flags;              // which mixer to use                  64
+    guint32 flags;              // which mixer to use                  60
 } kb_x86_mixer_data;
 
 #define KB_X86_MIXER_FLAGS_BACKWARD  (1 << 2)
 #define KB_X86_MIXER_FLAGS_FILTERED  (1 << 3)
-#define KB_X86_MIXER_FLAGS_SCOPES    (1 << 4)
-#define KB_X86_MIXER_FLAGS_VOLRAMP   (1 << 5)
+#define KB_X86_MIXER_FLAGS_VOLRAMP   (1 << 4)
+
+/* positioni points to gint8 data; such blocks must be passed to
+   kbfloat_mix_8bit() instead of kbasm_mix() */
+#define KB_X86_MIXER_FLAGS_8BIT      (1 << 5)
 
 void      kbasm_mix          (kb_x86_mixer_data *data);
+void      kbfloat_mix_8bit   (kb_x86_mixer_data *data);
 
 gboolean  kbasm_post_mixing  (float *mixbuffer,
 			      gint16 *outbuffer,
@@ -34,15 +34,24 @@
 #include "kb-x86-asm.h"
 #include "i18n.h"
 #include "tracer.h"
+#include "scope-capture.h"
 
 static int num_channels, mixfreq;
 static int clipflag;
 
 static float *kb_x86_tempbuf = NULL;
+static float *kb_x86_voicebuf = NULL;   /* the full mix before a voice going to a stem */
 static int kb_x86_tempbufsize = 0;
 
+static float *kb_x86_stembuf = NULL;
+static int kb_x86_stembufsize = 0;
+static gboolean *kb_x86_stemused = NULL;
+static int kb_x86_stemusedsize = 0;
+
 static float kb_x86_amplification = 0.25;
 
+static st_mixer_stats stats;
+
 float kb_x86_ct0[256];
 float kb_x86_ct1[256];
 float kb_x86_ct2[256];
@@ -54,6 +63,7 @@ typedef struct kb_x86_channel {
     void *data;                   // for updatesample() to see if sample has changed
     int looptype;
     guint32 length;
+    guint32 format;
 
     guint32 flags;                // see below
     float volume;                 // 0.0 ... 1.0
@@ -95,6 +105,24 @@ static kb_x86_channel channels[2 * 32];
 // Number of samples the mixer needs in advance
 #define KB_X86_SAMPLE_PADDING           3
 
+/* Unidirectional loops shorter than KB_X86_UNROLL_MAX_LOOP are
+   repeated into a separate buffer of at least KB_X86_UNROLL_LENGTH
+   samples (plus padding), so that the mixing routines can run over
+   many loop cycles at once instead of being interrupted near every
+   loop end. The buffers are kept outside of channels[] so that
+   kb_x86_reset() can clear that; length == 0 means that the buffer
+   must be rebuilt. */
+#define KB_X86_UNROLL_MAX_LOOP          256
+#define KB_X86_UNROLL_LENGTH            2048
+
+typedef struct kb_x86_unrolled {
+    gint16 *data;
+    guint32 alloc;                // allocated size of data[]
+    guint32 length;               // loop length times number of cycles in data[]
+} kb_x86_unrolled;
+
+static kb_x86_unrolled unrolled[2 * 32];
+
 // A ramp from 32768 to 0 should take RAMP_MAX_DURATION seconds
 #define RAMP_MAX_DURATION 0.001
 
@@ -146,11 +174,17 @@ kb_x86_updatesample (st_mixer_sample_info *si)
     for(i = 0; i < 2 * 32; i++) {
 	c = &channels[i];
 
-	if(c->sample != si || !(c->flags & KB_FLAG_SAMPLE_RUNNING)) {
+	if(c->sample != si) {
 	    continue;
 	}
 
-	if(c->data != si->data
+	unrolled[i].length = 0;
+
+	if(!(c->flags & KB_FLAG_SAMPLE_RUNNING)) {
+	    continue;
+	}
+
+	if((c->data != si->data && c->format == si->format)
 	   || c->length != si->length
 	   || c->looptype != si->looptype) {
 	    c->flags &= ~KB_FLAG_SAMPLE_RUNNING;
@@ -158,7 +192,10 @@ kb_x86_updatesample (st_mixer_sample_info *si)
 	}
 	 
 	/* No relevant data has changed. Don't stop the sample, but update
-	   our local loop data instead. */
+	   our local loop data instead. A sample that has only been
+	   converted to 16 bits goes on playing from the new data. */
+	c->data = si->data;
+	c->format = si->format;
 	c->looptype = si->looptype;
 	if(c->looptype != ST_MIXER_SAMPLE_LOOPTYPE_NONE) {
 	    if(c->positionw < si->loopstart) {
@@ -191,7 +228,7 @@ kb_x86_setstereo (int on)
 }
 
 static void
-kb_x86_setmixfreq (guint16 frequency)
+kb_x86_setmixfreq (guint32 frequency)
 {
     mixfreq = frequency;
 }
@@ -214,8 +251,13 @@ kb_x86_reset (void)
     int i;
 
     memset(channels, 0, sizeof(channels));
+    memset(&stats, 0, sizeof(stats));
     clipflag = 0;
 
+    for(i = 0; i < 2 * 32; i++) {
+	unrolled[i].length = 0;
+    }
+
     for(i = 0; i < 256; i++) {
 	float x1 = i / 256.0;
 	float x2 = x1*x1;
@@ -236,11 +278,13 @@ kb_x86_startnote (int channel,
     c->flags &= KB_FLAG_UPPER_ACTIVE;
     
     c->sample = s;
+    unrolled[c - channels].length = 0;
 
-    // The following three for update_sample()
+    // The following four for update_sample()
     c->data = s->data;
     c->length = s->length;
     c->looptype = s->looptype;
+    c->format = s->format;
 
     c->positionw = 0;
     c->positionf = 0;
@@ -422,6 +466,67 @@ kb_x86_debug_dump_buffer (gint16 *buffer,
 }
 #endif
 
+/* Sample value scaled to 16 bits, for the auxiliary buffers */
+static inline gint16
+kb_x86_sample_value (st_mixer_sample_info *si,
+		     guint32 pos)
+{
+    if(si->format == ST_MIXER_SAMPLE_FORMAT_8BIT) {
+	return ((gint8*)si->data)[pos] << 8;
+    }
+    return si->data[pos];
+}
+
+/* Pointer into the sample data for the mixing routines */
+static inline gint16 *
+kb_x86_sample_pointer (st_mixer_sample_info *si,
+		       kb_x86_mixer_data *md,
+		       guint32 pos)
+{
+    if(si->format == ST_MIXER_SAMPLE_FORMAT_8BIT) {
+	md->flags |= KB_X86_MIXER_FLAGS_8BIT;
+	return (gint16*)((gint8*)si->data + pos);
+    }
+    return si->data + pos;
+}
+
+/* Advance the mixer data exactly like the mixing routines would do it,
+   without rendering anything. Only valid for voices which contribute
+   nothing to the output and have no filter state to update. */
+static void
+kb_x86_skip (kb_x86_mixer_data *md)
+{
+    const gint64 freq64 = ((gint64)md->freqi << 32) + md->freqf;
+    const gint64 adv64 = (gint64)md->positionf + freq64 * md->numsamples;
+
+    if(md->flags & KB_X86_MIXER_FLAGS_8BIT) {
+	md->positioni = (gint16*)((gint8*)md->positioni + (adv64 >> 32));
+    } else {
+	md->positioni += adv64 >> 32;
+    }
+    md->positionf = adv64 & 0xffffffff;
+    md->mixbuffer += 2 * md->numsamples;
+}
+
+/* Voices without filter and volume ramp have no state that depends on
+   the sample data, so they can be skipped if nothing is to be heard of
+   them. When only advancing (mix() called without dest), nothing is
+   heard at all, except for channels going to a stem. */
+static gboolean kb_x86_advance_only;
+
+/* Frame of the current mix() block the voice being mixed is at, for
+   the scopes; -1 if they are off. Both voices of a channel (see
+   kb_x86_get_channel_struct()) go to its scope, so that the one fading
+   out a previous note is shown, too. */
+static gint32 kb_x86_scope_pos = -1;
+
+static inline gboolean
+kb_x86_is_inaudible (kb_x86_mixer_data *md)
+{
+    return (kb_x86_advance_only || (md->volleft == 0.0 && md->volright == 0.0))
+	&& !(md->flags & (KB_X86_MIXER_FLAGS_FILTERED | KB_X86_MIXER_FLAGS_VOLRAMP));
+}
+
 static void
 kb_x86_call_mixer (kb_x86_channel *ch,
 		   kb_x86_mixer_data *md,
@@ -430,17 +535,81 @@ kb_x86_call_mixer (kb_x86_channel *ch,
     if(!forward) {
 	md->flags |= KB_X86_MIXER_FLAGS_BACKWARD;
     }
-    kbasm_mix(md);
+    if(kb_x86_scope_pos >= 0) {
+	scope_capture_voice((ch - channels) & 31, kb_x86_scope_pos, md->numsamples,
+			    md->positioni,
+			    (md->flags & KB_X86_MIXER_FLAGS_8BIT) ? ST_MIXER_SAMPLE_FORMAT_8BIT : ST_MIXER_SAMPLE_FORMAT_16BIT,
+			    md->positionf, ((gint64)md->freqi << 32) + md->freqf,
+			    md->volleft + md->volright);
+    }
+    if(kb_x86_is_inaudible(md)) {
+	kb_x86_skip(md);
+	stats.culled_samples += md->numsamples;
+    } else {
+	if(md->flags & KB_X86_MIXER_FLAGS_8BIT) {
+	    kbfloat_mix_8bit(md);
+	} else {
+	    kbasm_mix(md);
+	}
+	stats.mixed_samples += md->numsamples;
+    }
+    ch->volleft = md->volleft;
+    ch->volright = md->volright;
+}
+
+/* Mix from the unrolled copy of a short unidirectional loop. The
+   current position must be inside the loop. */
+static guint32
+kb_x86_mix_unrolled (kb_x86_channel *ch,
+		     kb_x86_mixer_data *md,
+		     guint32 num_samples_left)
+{
+    kb_x86_unrolled *u = &unrolled[ch - channels];
+    const guint32 loopstart = ch->sample->loopstart;
+    const guint32 looplen = ch->sample->loopend - loopstart;
+    const gint64 freq64 = (((guint64)ch->freqw) << 32) + (guint64)ch->freqf;
+    const gint64 pos64 = ((guint64)(ch->positionw - loopstart) << 32) + (guint64)ch->positionf;
+    guint32 num_samples, i;
+
+    if(u->length == 0) {
+	guint32 cycles = (KB_X86_UNROLL_LENGTH + looplen - 1) / looplen;
+	guint32 size = cycles * looplen + KB_X86_SAMPLE_PADDING;
+
+	if(u->alloc < size) {
+	    g_free(u->data);
+	    u->data = g_new(gint16, size);
+	    u->alloc = size;
+	}
+	for(i = 0; i < size; i++) {
+	    u->data[i] = kb_x86_sample_value(ch->sample, loopstart + i % looplen);
+	}
+	u->length = cycles * looplen;
+    }
+
+    /* Stop before the mixer would need samples behind the padding */
+    num_samples = ((((guint64)u->length) << 32) - pos64 + (freq64 - 1)) / freq64;
+    g_assert(num_samples > 0);
+    num_samples = MIN(num_samples_left, num_samples);
+
+    md->positioni = u->data + (ch->positionw - loopstart);
+    md->numsamples = num_samples;
+    kb_x86_call_mixer(ch, md, TRUE);
+
+    ch->positionw = loopstart + (md->positioni - u->data) % looplen;
+    ch->positionf = md->positionf;
     ch->volleft = md->volleft;
     ch->volright = md->volright;
+    ch->fl1 = md->fl1;
+    ch->fb1 = md->fb1;
+
+    return num_samples;
 }
 
 static guint32
 kb_x86_mix_sub (kb_x86_channel *ch,
 		guint32 num_samples_left,
 		gboolean volramping,
-		float *mixbuf,
-		gint16 *scopebuf)
+		float *mixbuf)
 {
     kb_x86_mixer_data md;
 
@@ -477,7 +646,6 @@ kb_x86_mix_sub (kb_x86_channel *ch,
 	md.freqf = freq64_ & 0xffffffff;
     }
     md.mixbuffer = mixbuf;
-    md.scopebuf = scopebuf;
     md.freso = ch->freso;
     md.ffreq = ch->ffreq;
     md.fl1 = ch->fl1;
@@ -487,13 +655,16 @@ kb_x86_mix_sub (kb_x86_channel *ch,
     if(md.ffreq == 1.0 && md.freso == 0.0) {
 	md.flags &= ~KB_X86_MIXER_FLAGS_FILTERED;
     }
-    if(md.scopebuf) {
-	md.flags |= KB_X86_MIXER_FLAGS_SCOPES;
-    }
     if(volramping) {
 	md.flags |= KB_X86_MIXER_FLAGS_VOLRAMP;
     }
 
+    if(loopit && !gonnapingpong && ch->direction == 1
+       && ch->sample->loopend - ch->sample->loopstart < KB_X86_UNROLL_MAX_LOOP
+       && pos >= (gint32)ch->sample->loopstart && pos < ende) {
+	return kb_x86_mix_unrolled(ch, &md, num_samples_left);
+    }
+
     if((ch->direction == 1 && pos >= ende - KB_X86_SAMPLE_PADDING)
        || (ch->direction == -1 && pos < (gint32)(ch->sample->loopstart + KB_X86_SAMPLE_PADDING))) {
 	/* This is the dangerous case. We are near one of the ends of
@@ -580,7 +751,7 @@ kb_x86_mix_sub (kb_x86_channel *ch,
 		bufferpt += (sizeof(buffer) / sizeof(buffer[0])) - 1;
 	    }
 	    for(i = 0, j = pos; i < sizeof(buffer) / sizeof(buffer[0]); i++) {
-		*bufferpt = ((gint16*)ch->sample->data)[j];
+		*bufferpt = kb_x86_sample_value(ch->sample, j);
 		if(dir == +1) {
 		    if(++j >= ch->sample->loopend) {
 			dir = -1;
@@ -596,7 +767,7 @@ kb_x86_mix_sub (kb_x86_channel *ch,
 	    }
 	} else {
 	    for(i = 0, j = pos; i < sizeof(buffer) / sizeof(buffer[0]); i++) {
-		buffer[i] = ((gint16*)ch->sample->data)[j];
+		buffer[i] = kb_x86_sample_value(ch->sample, j);
 		if(++j >= ende) {
 		    if(loopit) {
 			j -= (ch->sample->loopend - ch->sample->loopstart);
@@ -655,7 +826,7 @@ kb_x86_mix_sub (kb_x86_channel *ch,
 		num_samples = num_samples_left;
 	    }
 
-	    md.positioni = (gint16*)ch->sample->data + pos;
+	    md.positioni = kb_x86_sample_pointer(ch->sample, &md, pos);
 	    md.numsamples = num_samples;
 	    kb_x86_call_mixer(ch, &md, TRUE);
 	} else {
@@ -673,12 +844,16 @@ kb_x86_mix_sub (kb_x86_channel *ch,
 		num_samples = num_samples_left;
 	    }
 
-	    md.positioni = (gint16*)ch->sample->data + pos;
+	    md.positioni = kb_x86_sample_pointer(ch->sample, &md, pos);
 	    md.numsamples = num_samples;
 	    kb_x86_call_mixer(ch, &md, FALSE);
 	}
 	
-	ch->positionw = md.positioni - (gint16*)ch->sample->data;
+	if(md.flags & KB_X86_MIXER_FLAGS_8BIT) {
+	    ch->positionw = (gint8*)md.positioni - (gint8*)ch->sample->data;
+	} else {
+	    ch->positionw = md.positioni - ch->sample->data;
+	}
 	ch->positionf = md.positionf;
 	ch->volleft = md.volleft;
 	ch->volright = md.volright;
@@ -689,41 +864,75 @@ kb_x86_mix_sub (kb_x86_channel *ch,
     }
 }
 
+/* Voices going to a stem are mixed into the full mix like the others,
+   so that it stays exactly as from mix() (float additions depend on
+   the order). What they added there goes to their stem's part of
+   kb_x86_stembuf, which is cleared when the first voice of the block
+   goes there; stems without voices are silent. */
 static void *
-kb_x86_mix (void *dest,
-	    guint32 count,
-	    gint16 *scopebufs[],
-	    int scopebuf_offset)
+kb_x86_mix_common (void *dest,
+		   void *stems[],
+		   int (*stem)(int channel, st_mixer_sample_info *sample),
+		   int numstems,
+		   guint32 count,
+		   gint16 *scopebufs[],
+		   int scopebuf_offset)
 {
-    int chnr;
+    int chnr, i, j, k;
 
     if(count > kb_x86_tempbufsize) {
 	free(kb_x86_tempbuf);
+	free(kb_x86_voicebuf);
 	kb_x86_tempbufsize = count;
 	kb_x86_tempbuf = malloc(2 * sizeof(float) * kb_x86_tempbufsize);
+	kb_x86_voicebuf = malloc(2 * sizeof(float) * kb_x86_tempbufsize);
     }
 
     memset(kb_x86_tempbuf, 0, 2 * sizeof(float) * count);
 
+    if(stems) {
+	if(numstems * count > kb_x86_stembufsize) {
+	    free(kb_x86_stembuf);
+	    kb_x86_stembufsize = numstems * count;
+	    kb_x86_stembuf = malloc(2 * sizeof(float) * kb_x86_stembufsize);
+	}
+	if(numstems > kb_x86_stemusedsize) {
+	    free(kb_x86_stemused);
+	    kb_x86_stemusedsize = numstems;
+	    kb_x86_stemused = malloc(sizeof(gboolean) * kb_x86_stemusedsize);
+	}
+	memset(kb_x86_stemused, 0, sizeof(gboolean) * numstems);
+    }
+
+    stats.active_voices = 0;
+    stats.culled_voices = 0;
+
+    kb_x86_scope_pos = -1;
+    if(scopebufs) {
+	scope_capture_begin(scopebufs, scopebuf_offset, count);
+    }
+
     for(chnr = 0; chnr < 2 * 32; chnr++) {
 	kb_x86_channel *ch = channels + chnr;
-	float *tempbuf = kb_x86_tempbuf;
+	float *tempbuf = kb_x86_tempbuf, *stembuf = NULL;
 	int num_samples_left = count;
-	gint16 *scopedata = NULL;
 
 	if((chnr & 31) >= num_channels)
 	    continue;
 
-	if(scopebufs && (chnr < 32 || (channels[chnr - 32].flags & KB_FLAG_UPPER_ACTIVE))) {
-	    scopedata = scopebufs[chnr & 31] + scopebuf_offset;
+	if(!(ch->flags & KB_FLAG_SAMPLE_RUNNING)) {
+	    continue;
 	}
 
-	if(!(ch->flags & KB_FLAG_SAMPLE_RUNNING)) {
-	    if(scopedata) {
-		memset(scopedata, 0, 2 * num_samples_left);
+	if(stems && (k = stem(chnr & 31, ch->sample)) >= 0 && k < numstems && stems[k]) {
+	    stembuf = kb_x86_stembuf + 2 * count * k;
+	    if(!kb_x86_stemused[k]) {
+		memset(stembuf, 0, 2 * sizeof(float) * count);
+		kb_x86_stemused[k] = TRUE;
 	    }
-	    continue;
+	    memcpy(kb_x86_voicebuf, kb_x86_tempbuf, 2 * sizeof(float) * count);
 	}
+	kb_x86_advance_only = (dest == NULL && !stembuf);
 
 	if(ch->flags & KB_FLAG_JUST_STARTED) {
 	    if(ch->flags & KB_FLAG_DO_SAMPLE_START_DECLICK) {
@@ -740,6 +949,12 @@ kb_x86_mix (void *dest,
 	    ch->flags &= ~KB_FLAG_JUST_STARTED;
 	}
 
+	stats.active_voices++;
+	if(ch->ramp_num_samples == 0 && ch->volleft == 0.0 && ch->volright == 0.0
+	   && ch->ffreq == 1.0 && ch->freso == 0.0) {
+	    stats.culled_voices++;
+	}
+
 	g_assert(ch->sample->lock);
 	g_mutex_lock(ch->sample->lock);
 
@@ -748,9 +963,12 @@ kb_x86_mix (void *dest,
 	    gboolean vol_ramping = (ch->ramp_num_samples != 0);
 	    int max_samples_this_time = vol_ramping ? MIN(ch->ramp_num_samples, num_samples_left) : num_samples_left;
 
+	    if(scopebufs) {
+		kb_x86_scope_pos = count - num_samples_left;
+	    }
 	    num_samples = kb_x86_mix_sub(ch,
 					 max_samples_this_time, vol_ramping,
-					 tempbuf, scopedata);
+					 tempbuf);
 
 	    if(vol_ramping) {
 		ch->ramp_num_samples -= num_samples;
@@ -767,12 +985,34 @@ kb_x86_mix (void *dest,
 
 	    num_samples_left -= num_samples;
 	    tempbuf += (num_samples * 2);
-	    if(scopedata) {
-		scopedata += num_samples;
-	    }
 	}
 
 	g_mutex_unlock(ch->sample->lock);
+
+	for(j = 0; stembuf && j < 2 * count; j++) {
+	    stembuf[j] += kb_x86_tempbuf[j] - kb_x86_voicebuf[j];
+	}
+    }
+
+    kb_x86_scope_pos = -1;
+    if(scopebufs) {
+	scope_capture_end(num_channels);
+    }
+
+    for(i = 0; stems && i < numstems; i++) {
+	if(stems[i] && !kb_x86_stemused[i]) {
+	    memset(stems[i], 0, count * 2 * 2);
+	    stems[i] += count * 2 * 2;
+	} else if(stems[i]) {
+	    float *b = kb_x86_stembuf + 2 * count * i;
+	    kbasm_post_mixing(b, (gint16*)stems[i], count, kb_x86_amplification);
+	    stems[i] += count * 2 * 2;
+	}
+    }
+
+    if(!dest) {
+	clipflag = FALSE;
+	return NULL;
     }
 
     clipflag = kbasm_post_mixing(kb_x86_tempbuf, (gint16*)dest, count, kb_x86_amplification);
@@ -780,6 +1020,25 @@ kb_x86_mix (void *dest,
     return dest + count * 2 * 2;
 }
 
+static void *
+kb_x86_mix (void *dest,
+	    guint32 count,
+	    gint16 *scopebufs[],
+	    int scopebuf_offset)
+{
+    return kb_x86_mix_common(dest, NULL, NULL, 0, count, scopebufs, scopebuf_offset);
+}
+
+static void *
+kb_x86_mixstems (void *dest,
+		 void *stems[],
+		 int (*stem)(int channel, st_mixer_sample_info *sample),
+		 int numstems,
+		 guint32 count)
+{
+    return kb_x86_mix_common(dest, stems, stem, numstems, count, NULL, 0);
+}
+
 void
 kb_x86_dumpstatus (st_mixer_channel_status array[])
 {
@@ -804,6 +1063,12 @@ kb_x86_dumpstatus (st_mixer_channel_status array[])
     }
 }
 
+static void
+kb_x86_getstats (st_mixer_stats *s)
+{
+    *s = stats;
+}
+
 static void
 kb_x86_loadchsettings (int ch)
 {
@@ -817,6 +1082,7 @@ kb_x86_loadchsettings (int ch)
     
     kbch->sample = tch->sample;
     kbch->data = tch->data;
+    kbch->format = tch->format;
     kbch->looptype = tch->looptype;
     kbch->length = tch->length;
     kbch->volume = tch->volume;
@@ -862,6 +1128,8 @@ st_mixer mixer_kbfloat = {
     kb_x86_mix,
     kb_x86_dumpstatus,
     kb_x86_loadchsettings,
+    kb_x86_getstats,
+    kb_x86_mixstems,
 
     0x7fffffff,
 
@@ -54,6 +54,8 @@ kbasm_post_mixing (float *tempbuf,
     return clipped;
 }
 
+#endif
+
 #define CUBICMIXER_COMMON_HEAD \
     gint16 *positioni = data->positioni; \
     guint32 positionf = data->positionf; \
@@ -94,9 +96,6 @@ kbasm_post_mixing (float *tempbuf,
         fl1 += data->ffreq * fb1; \
         s0 = fl1; 
 
-#define CUBICMIXER_SCOPES \
-        *scopebuf++ = (gint16)(s0 * (voll + volr));
-
 #define CUBICMIXER_WRITE_OUT \
 	*mixbuffer++ += s0 * voll; \
 	*mixbuffer++ += s0 * volr;
@@ -114,9 +113,11 @@ kbasm_post_mixing (float *tempbuf,
     data->fl1 = fl1;                     \
     data->fb1 = fb1;
 
+#if defined(NO_ASM) || defined(NO_GASP) || !defined(__i386__)
+
 /* --- 0 --- */
 static void
-kbfloat_mix_cubic_noscopes_unfiltered_forward_noramp (kb_x86_mixer_data *data)
+kbfloat_mix_cubic_unfiltered_forward_noramp (kb_x86_mixer_data *data)
 {
     CUBICMIXER_COMMON_HEAD
 
@@ -130,7 +131,7 @@ kbfloat_mix_cubic_noscopes_unfiltered_forward_noramp (kb_x86_mixer_data *data)
 }
 
 static void
-kbfloat_mix_cubic_noscopes_unfiltered_backward_noramp (kb_x86_mixer_data *data)
+kbfloat_mix_cubic_unfiltered_backward_noramp (kb_x86_mixer_data *data)
 {
     CUBICMIXER_COMMON_HEAD
 
@@ -144,7 +145,7 @@ kbfloat_mix_cubic_noscopes_unfiltered_backward_noramp (kb_x86_mixer_data *data)
 }
 
 static void
-kbfloat_mix_cubic_noscopes_filtered_forward_noramp (kb_x86_mixer_data *data)
+kbfloat_mix_cubic_filtered_forward_noramp (kb_x86_mixer_data *data)
 {
     CUBICMIXER_COMMON_HEAD
 
@@ -159,7 +160,7 @@ kbfloat_mix_cubic_noscopes_filtered_forward_noramp (kb_x86_mixer_data *data)
 }
 
 static void
-kbfloat_mix_cubic_noscopes_filtered_backward_noramp (kb_x86_mixer_data *data)
+kbfloat_mix_cubic_filtered_backward_noramp (kb_x86_mixer_data *data)
 {
     CUBICMIXER_COMMON_HEAD
 
@@ -175,74 +176,7 @@ kbfloat_mix_cubic_noscopes_filtered_backward_noramp (kb_x86_mixer_data *data)
 
 /* --- 4 --- */
 static void
-kbfloat_mix_cubic_scopes_unfiltered_forward_noramp (kb_x86_mixer_data *data)
-{
-    CUBICMIXER_COMMON_HEAD
-    gint16 *scopebuf = data->scopebuf;
-
-    CUBICMIXER_COMMON_LOOP_START
-    CUBICMIXER_LOOP_FORWARD
-    CUBICMIXER_ADVANCE_POINTER
-    CUBICMIXER_SCOPES
-    CUBICMIXER_WRITE_OUT
-    }
-
-    CUBICMIXER_COMMON_FOOT
-}
-
-static void
-kbfloat_mix_cubic_scopes_unfiltered_backward_noramp (kb_x86_mixer_data *data)
-{
-    CUBICMIXER_COMMON_HEAD
-    gint16 *scopebuf = data->scopebuf;
-
-    CUBICMIXER_COMMON_LOOP_START
-    CUBICMIXER_LOOP_BACKWARD
-    CUBICMIXER_ADVANCE_POINTER
-    CUBICMIXER_SCOPES
-    CUBICMIXER_WRITE_OUT
-    }
-
-    CUBICMIXER_COMMON_FOOT
-}
-
-static void
-kbfloat_mix_cubic_scopes_filtered_forward_noramp (kb_x86_mixer_data *data)
-{
-    CUBICMIXER_COMMON_HEAD
-    gint16 *scopebuf = data->scopebuf;
-
-    CUBICMIXER_COMMON_LOOP_START
-    CUBICMIXER_LOOP_FORWARD
-    CUBICMIXER_ADVANCE_POINTER
-    CUBICMIXER_FILTER
-    CUBICMIXER_SCOPES
-    CUBICMIXER_WRITE_OUT
-    }
-
-    CUBICMIXER_COMMON_FOOT
-}
-
-static void
-kbfloat_mix_cubic_scopes_filtered_backward_noramp (kb_x86_mixer_data *data)
-{
-    CUBICMIXER_COMMON_HEAD
-    gint16 *scopebuf = data->scopebuf;
-
-    CUBICMIXER_COMMON_LOOP_START
-    CUBICMIXER_LOOP_BACKWARD
-    CUBICMIXER_ADVANCE_POINTER
-    CUBICMIXER_FILTER
-    CUBICMIXER_SCOPES
-    CUBICMIXER_WRITE_OUT
-    }
-
-    CUBICMIXER_COMMON_FOOT
-}
-
-/* --- 8 --- */
-static void
-kbfloat_mix_cubic_noscopes_unfiltered_forward (kb_x86_mixer_data *data)
+kbfloat_mix_cubic_unfiltered_forward (kb_x86_mixer_data *data)
 {
     CUBICMIXER_COMMON_HEAD
 
@@ -257,7 +191,7 @@ kbfloat_mix_cubic_noscopes_unfiltered_forward (kb_x86_mixer_data *data)
 }
 
 static void
-kbfloat_mix_cubic_noscopes_unfiltered_backward (kb_x86_mixer_data *data)
+kbfloat_mix_cubic_unfiltered_backward (kb_x86_mixer_data *data)
 {
     CUBICMIXER_COMMON_HEAD
 
@@ -272,7 +206,7 @@ kbfloat_mix_cubic_noscopes_unfiltered_backward (kb_x86_mixer_data *data)
 }
 
 static void
-kbfloat_mix_cubic_noscopes_filtered_forward (kb_x86_mixer_data *data)
+kbfloat_mix_cubic_filtered_forward (kb_x86_mixer_data *data)
 {
     CUBICMIXER_COMMON_HEAD
 
@@ -288,7 +222,7 @@ kbfloat_mix_cubic_noscopes_filtered_forward (kb_x86_mixer_data *data)
 }
 
 static void
-kbfloat_mix_cubic_noscopes_filtered_backward (kb_x86_mixer_data *data)
+kbfloat_mix_cubic_filtered_backward (kb_x86_mixer_data *data)
 {
     CUBICMIXER_COMMON_HEAD
 
@@ -303,100 +237,65 @@ kbfloat_mix_cubic_noscopes_filtered_backward (kb_x86_mixer_data *data)
     CUBICMIXER_COMMON_FOOT
 }
 
-/* --- 12 --- */
-static void
-kbfloat_mix_cubic_scopes_unfiltered_forward (kb_x86_mixer_data *data)
-{
-    CUBICMIXER_COMMON_HEAD
-    gint16 *scopebuf = data->scopebuf;
-
-    CUBICMIXER_COMMON_LOOP_START
-    CUBICMIXER_LOOP_FORWARD
-    CUBICMIXER_ADVANCE_POINTER
-    CUBICMIXER_SCOPES
-    CUBICMIXER_WRITE_OUT
-    CUBICMIXER_VOLRAMP
-    }
-
-    CUBICMIXER_COMMON_FOOT
-}
+static void (*kbfloat_mixers[8])(kb_x86_mixer_data *) = {
+    kbfloat_mix_cubic_unfiltered_forward_noramp,
+    kbfloat_mix_cubic_unfiltered_backward_noramp,
+    kbfloat_mix_cubic_filtered_forward_noramp,
+    kbfloat_mix_cubic_filtered_backward_noramp,
+    kbfloat_mix_cubic_unfiltered_forward,
+    kbfloat_mix_cubic_unfiltered_backward,
+    kbfloat_mix_cubic_filtered_forward,
+    kbfloat_mix_cubic_filtered_backward
+};
 
-static void
-kbfloat_mix_cubic_scopes_unfiltered_backward (kb_x86_mixer_data *data)
+void
+kbasm_mix (kb_x86_mixer_data *data)
 {
-    CUBICMIXER_COMMON_HEAD
-    gint16 *scopebuf = data->scopebuf;
-
-    CUBICMIXER_COMMON_LOOP_START
-    CUBICMIXER_LOOP_BACKWARD
-    CUBICMIXER_ADVANCE_POINTER
-    CUBICMIXER_SCOPES
-    CUBICMIXER_WRITE_OUT
-    CUBICMIXER_VOLRAMP
-    }
-
-    CUBICMIXER_COMMON_FOOT
+    kbfloat_mixers[data->flags >> 2](data);
 }
 
-static void
-kbfloat_mix_cubic_scopes_filtered_forward (kb_x86_mixer_data *data)
-{
-    CUBICMIXER_COMMON_HEAD
-    gint16 *scopebuf = data->scopebuf;
-
-    CUBICMIXER_COMMON_LOOP_START
-    CUBICMIXER_LOOP_FORWARD
-    CUBICMIXER_ADVANCE_POINTER
-    CUBICMIXER_FILTER
-    CUBICMIXER_SCOPES
-    CUBICMIXER_WRITE_OUT
-    CUBICMIXER_VOLRAMP
-    }
-
-    CUBICMIXER_COMMON_FOOT
-}
+#endif
 
-static void
-kbfloat_mix_cubic_scopes_filtered_backward (kb_x86_mixer_data *data)
+/* Samples stored with 8 bits are rare enough not to need specialized
+   routines for every flag combination, and there are none in the
+   assembly version. The values are scaled up to 16 bits after the
+   interpolation; scaling by a power of two is exact, so the results
+   are the same as for the sample converted to 16 bits. */
+void
+kbfloat_mix_8bit (kb_x86_mixer_data *data)
 {
-    CUBICMIXER_COMMON_HEAD
-    gint16 *scopebuf = data->scopebuf;
+    gint8 *positioni = (gint8*)data->positioni;
+    guint32 positionf = data->positionf;
+    float *mixbuffer = data->mixbuffer;
+    float fl1 = data->fl1;
+    float fb1 = data->fb1;
+    float voll = data->volleft;
+    float volr = data->volright;
+    unsigned n = data->numsamples;
+    const guint32 flags = data->flags;
 
     CUBICMIXER_COMMON_LOOP_START
-    CUBICMIXER_LOOP_BACKWARD
-    CUBICMIXER_ADVANCE_POINTER
-    CUBICMIXER_FILTER
-    CUBICMIXER_SCOPES
-    CUBICMIXER_WRITE_OUT
-    CUBICMIXER_VOLRAMP
+	if(flags & KB_X86_MIXER_FLAGS_BACKWARD) {
+	    CUBICMIXER_LOOP_BACKWARD
+	} else {
+	    CUBICMIXER_LOOP_FORWARD
+	}
+	s0 *= 256.0;
+	CUBICMIXER_ADVANCE_POINTER
+	if(flags & KB_X86_MIXER_FLAGS_FILTERED) {
+	    CUBICMIXER_FILTER
+	}
+	CUBICMIXER_WRITE_OUT
+	if(flags & KB_X86_MIXER_FLAGS_VOLRAMP) {
+	    CUBICMIXER_VOLRAMP
+	}
     }
 
-    CUBICMIXER_COMMON_FOOT
-}
-
-static void (*kbfloat_mixers[16])(kb_x86_mixer_data *) = {
-    kbfloat_mix_cubic_noscopes_unfiltered_forward_noramp,
-    kbfloat_mix_cubic_noscopes_unfiltered_backward_noramp,
-    kbfloat_mix_cubic_noscopes_filtered_forward_noramp,
-    kbfloat_mix_cubic_noscopes_filtered_backward_noramp,
-    kbfloat_mix_cubic_scopes_unfiltered_forward_noramp,
-    kbfloat_mix_cubic_scopes_unfiltered_backward_noramp,
-    kbfloat_mix_cubic_scopes_filtered_forward_noramp,
-    kbfloat_mix_cubic_scopes_filtered_backward_noramp,
-    kbfloat_mix_cubic_noscopes_unfiltered_forward,
-    kbfloat_mix_cubic_noscopes_unfiltered_backward,
-    kbfloat_mix_cubic_noscopes_filtered_forward,
-    kbfloat_mix_cubic_noscopes_filtered_backward,
-    kbfloat_mix_cubic_scopes_unfiltered_forward,
-    kbfloat_mix_cubic_scopes_unfiltered_backward,
-    kbfloat_mix_cubic_scopes_filtered_forward,
-    kbfloat_mix_cubic_scopes_filtered_backward
-};
-
-void
-kbasm_mix (kb_x86_mixer_data *data)
-{
-    kbfloat_mixers[data->flags >> 2](data);
+    data->volleft = voll;
+    data->volright = volr;
+    data->positioni = (gint16*)positioni;
+    data->positionf = positionf;
+    data->mixbuffer = mixbuffer;
+    data->fl1 = fl1;
+    data->fb1 = fb1;
 }
-
-#endif
@@ -0,0 +1,921 @@
+/*
+ * The Real SoundTracker - module library index
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* The file formats are parsed here once more instead of using
+   XM_Load(), which reads all the sample data and must not be called
+   from another thread than the GUI's since it reports errors with
+   dialogs.
+
+   The duration is estimated by walking the patterns and only looking
+   at the effects that change the speed or the order of the rows,
+   which is the part of xm-player.c that matters for the timing; the
+   player itself keeps its state in globals and can't run here. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "module-index.h"
+#include "preferences.h"
+#include "endian-conv.h"
+#include "recode.h"
+
+#define INDEX_MAGIC "STMIDX1\n"
+#define INDEX_VERSION 2
+
+/* Give up estimating the duration of songs that don't end within this
+   time (ms) */
+#define INDEX_MAX_DURATION (4 * 60 * 60 * 1000)
+
+typedef struct index_request {
+    gchar *path;
+    gboolean recursive;
+} index_request;
+
+/* Effect columns of one pattern, two bytes (type, parameter) per cell */
+typedef struct index_pattern {
+    int rows;
+    guint8 *fx;
+} index_pattern;
+
+static GHashTable *index_table;    /* path -> module_index_entry */
+static GMutex *index_mutex;
+static GAsyncQueue *index_queue;
+static gint index_queued = 0;
+static gboolean index_dirty = FALSE;
+static gchar *index_filename;
+
+/* --- Entries */
+
+static module_index_entry *
+index_entry_copy (const module_index_entry *e)
+{
+    module_index_entry *c = g_new(module_index_entry, 1);
+
+    *c = *e;
+    c->path = g_strdup(e->path);
+    c->instrument_names = g_strdupv(e->instrument_names);
+    c->sample_names = g_strdupv(e->sample_names);
+
+    return c;
+}
+
+void
+module_index_entry_free (module_index_entry *e)
+{
+    if(e) {
+	g_free(e->path);
+	g_strfreev(e->instrument_names);
+	g_strfreev(e->sample_names);
+	g_free(e);
+    }
+}
+
+static gchar **
+index_names_from_list (GPtrArray *names)
+{
+    g_ptr_array_add(names, NULL);
+    return (gchar**)g_ptr_array_free(names, FALSE);
+}
+
+static void
+index_add_name (GPtrArray *names,
+		const guint8 *src,
+		int len,
+		gboolean ibmpc)
+{
+    char buf[23];
+
+    g_assert(len < sizeof(buf));
+
+    memcpy(buf, src, len);
+    buf[len] = 0;
+    if(ibmpc) {
+	recode_ibmpc_to_latin1(buf, len);
+    }
+    g_strchomp(buf);
+    if(buf[0]) {
+	g_ptr_array_add(names, g_strdup(buf));
+    }
+}
+
+/* --- Duration estimation */
+
+static gint32
+index_duration (index_pattern *patterns,
+		int num_patterns,
+		const guint8 *orders,
+		int song_length,
+		int restart,
+		int num_channels,
+		int tempo,
+		int bpm)
+{
+    guint8 (*visited)[32] = g_malloc0(256 * 32);
+    int loopstart[32], loopcount[32];
+    int ord = 0, row = 0, loopord = -1, rows, ch, p, x;
+    int jump, brk, loopjump, delay;
+    double t = 0.0;
+    const guint8 *fx;
+    gint32 res = -1;
+
+    tempo = MAX(tempo, 1);
+    bpm = MAX(bpm, 1);
+
+    while(t * 1000 < INDEX_MAX_DURATION) {
+	if(ord >= song_length) {
+	    ord = restart;
+	    row = 0;
+	}
+	p = orders[ord];
+	rows = p < num_patterns ? patterns[p].rows : 64;
+	if(row >= rows) {
+	    ord++;
+	    row = 0;
+	    continue;
+	}
+	if(ord != loopord) {
+	    memset(loopstart, 0, sizeof(loopstart));
+	    memset(loopcount, 0, sizeof(loopcount));
+	    loopord = ord;
+	}
+
+	if(visited[ord][row >> 3] & (1 << (row & 7))) {
+	    res = t * 1000 + 0.5;
+	    break;
+	}
+	visited[ord][row >> 3] |= 1 << (row & 7);
+
+	jump = brk = loopjump = -1;
+	delay = 0;
+	fx = p < num_patterns ? patterns[p].fx + row * num_channels * 2 : NULL;
+	for(ch = 0; fx && ch < num_channels; ch++, fx += 2) {
+	    x = fx[1];
+	    switch(fx[0]) {
+	    case 0xb:
+		jump = x;
+		break;
+	    case 0xd:
+		brk = (x >> 4) * 10 + (x & 15);
+		break;
+	    case 0xe:
+		if((x >> 4) == 0x6) {
+		    if(!(x & 15)) {
+			loopstart[ch] = row;
+		    } else if(!loopcount[ch]) {
+			loopcount[ch] = x & 15;
+			loopjump = loopstart[ch];
+		    } else if(--loopcount[ch]) {
+			loopjump = loopstart[ch];
+		    }
+		} else if((x >> 4) == 0xe) {
+		    delay = x & 15;
+		}
+		break;
+	    case 0xf:
+		if(x == 0) {
+		    // Stops the song, the player restarts it from the beginning
+		    jump = 0;
+		} else if(x < 0x20) {
+		    tempo = x;
+		} else {
+		    bpm = x;
+		}
+		break;
+	    }
+	}
+
+	t += (double)tempo * (1 + delay) * 125 / (bpm * 50);
+
+	if(loopjump >= 0) {
+	    // The rows of a pattern loop are played again legitimately
+	    for(x = loopjump; x <= row; x++) {
+		visited[ord][x >> 3] &= ~(1 << (x & 7));
+	    }
+	    row = loopjump;
+	} else if(jump >= 0 || brk >= 0) {
+	    ord = jump >= 0 ? jump : ord + 1;
+	    row = brk >= 0 ? brk : 0;
+	} else {
+	    row++;
+	}
+    }
+
+    g_free(visited);
+    return res;
+}
+
+/* --- File parsing */
+
+static gboolean
+index_read_xm (FILE *f,
+	       module_index_entry *e)
+{
+    guint8 xh[80], orders[256], ph[9], ih[29], sh[40], *data;
+    index_pattern patterns[256];
+    GPtrArray *inames, *snames;
+    guint32 hdr_len, datasize, ihdr_len, slen[16];
+    int i, j, k, n, rows, num_samples, restart;
+    long pos;
+    gboolean ok = FALSE;
+
+    if(fread(xh, 1, sizeof(xh), f) != sizeof(xh)
+       || strncmp((char*)xh, "Extended Module: ", 17) != 0
+       || xh[37] != 0x1a) {
+	return FALSE;
+    }
+
+    memcpy(e->name, xh + 17, 20);
+    e->name[20] = 0;
+    recode_ibmpc_to_latin1(e->name, 20);
+    g_strchomp(e->name);
+    e->song_length = MIN(get_le_16(xh + 64), 256);
+    restart = get_le_16(xh + 66);
+    e->num_channels = get_le_16(xh + 68);
+    e->num_patterns = MIN(get_le_16(xh + 70), 256);
+    e->num_instruments = MIN(get_le_16(xh + 72), 128);
+    e->tempo = get_le_16(xh + 76);
+    e->bpm = get_le_16(xh + 78);
+
+    if(e->num_channels < 1 || e->num_channels > 32 || e->song_length < 1
+       || fread(orders, 1, sizeof(orders), f) != sizeof(orders)) {
+	return FALSE;
+    }
+    if(restart >= e->song_length) {
+	restart = e->song_length - 1;
+    }
+    fseek(f, 60 + get_le_32(xh + 60), SEEK_SET);
+
+    memset(patterns, 0, sizeof(patterns));
+    for(i = 0; i < e->num_patterns; i++) {
+	if(fread(ph, 1, sizeof(ph), f) != sizeof(ph)) {
+	    goto out;
+	}
+	hdr_len = get_le_32(ph);
+	rows = get_le_16(ph + 5);
+	datasize = get_le_16(ph + 7);
+	if(rows > 256) {
+	    goto out;
+	}
+	rows = MAX(rows, 1);
+	if(hdr_len > 9) {
+	    fseek(f, hdr_len - 9, SEEK_CUR);
+	}
+
+	patterns[i].rows = rows;
+	patterns[i].fx = g_new0(guint8, rows * e->num_channels * 2);
+	if(!datasize) {
+	    continue;
+	}
+
+	data = g_new(guint8, datasize);
+	if(fread(data, 1, datasize, f) != datasize) {
+	    g_free(data);
+	    goto out;
+	}
+	for(j = 0, k = 0; j < rows * e->num_channels && k < datasize; j++) {
+	    guint8 c = data[k++], cell[5] = { 0, 0, 0, 0, 0 };
+
+	    if(c & 0x80) {
+		for(n = 0; n < 5; n++) {
+		    if((c & (1 << n)) && k < datasize) {
+			cell[n] = data[k++];
+		    }
+		}
+	    } else {
+		cell[0] = c;
+		for(n = 1; n < 5 && k < datasize; n++) {
+		    cell[n] = data[k++];
+		}
+	    }
+	    patterns[i].fx[j * 2] = cell[3];
+	    patterns[i].fx[j * 2 + 1] = cell[4];
+	}
+	g_free(data);
+    }
+
+    inames = g_ptr_array_new();
+    snames = g_ptr_array_new();
+    for(i = 0; i < e->num_instruments; i++) {
+	pos = ftell(f);
+	if(fread(ih, 1, sizeof(ih), f) != sizeof(ih)) {
+	    break;
+	}
+	ihdr_len = get_le_32(ih);
+	index_add_name(inames, ih + 4, 22, TRUE);
+
+	num_samples = ihdr_len <= 29 ? 0 : MIN(get_le_16(ih + 27), 16);
+	fseek(f, pos + MAX(ihdr_len, 29), SEEK_SET);
+	for(j = 0; j < num_samples; j++) {
+	    if(fread(sh, 1, sizeof(sh), f) != sizeof(sh)) {
+		num_samples = j;
+		break;
+	    }
+	    slen[j] = get_le_32(sh);
+	    if(slen[j]) {
+		e->num_samples++;
+	    }
+	    index_add_name(snames, sh + 18, 22, TRUE);
+	}
+	for(j = 0; j < num_samples; j++) {
+	    e->sample_bytes += slen[j];
+	    fseek(f, slen[j], SEEK_CUR);
+	}
+    }
+    e->instrument_names = index_names_from_list(inames);
+    e->sample_names = index_names_from_list(snames);
+
+    e->duration = index_duration(patterns, e->num_patterns, orders, e->song_length, restart,
+				 e->num_channels, e->tempo, e->bpm);
+    ok = TRUE;
+
+  out:
+    for(i = 0; i < e->num_patterns; i++) {
+	g_free(patterns[i].fx);
+    }
+    return ok;
+}
+
+static gboolean
+index_read_mod (FILE *f,
+		module_index_entry *e)
+{
+    guint8 name[20], sh[31][30], mh[2], orders[128], magic[4], *data;
+    index_pattern patterns[256];        // the order bytes go up to 255
+    GPtrArray *inames;
+    int i, j, len, size;
+    gboolean ok = FALSE;
+
+    if(fread(name, 1, sizeof(name), f) != sizeof(name)
+       || fread(sh, 1, sizeof(sh), f) != sizeof(sh)
+       || fread(mh, 1, sizeof(mh), f) != sizeof(mh)
+       || fread(orders, 1, sizeof(orders), f) != sizeof(orders)
+       || fread(magic, 1, sizeof(magic), f) != sizeof(magic)) {
+	return FALSE;
+    }
+
+    // The same formats as xm_load_mod() knows
+    if(!memcmp("M.K.", magic, 4) || !memcmp("M&K!", magic, 4) || !memcmp("M!K!", magic, 4)
+       || !memcmp("FLT4", magic, 4)) {
+	e->num_channels = 4;
+    } else if(!memcmp("CHN", magic + 1, 3)) {
+	e->num_channels = magic[0] - 0x30;
+    } else if(!memcmp("CH", magic + 2, 2)) {
+	e->num_channels = (magic[0] - 0x30) * 10 + (magic[1] - 0x30);
+    } else {
+	return FALSE;
+    }
+    if(e->num_channels < 1 || e->num_channels > 32) {
+	return FALSE;
+    }
+
+    e->is_mod = TRUE;
+    memcpy(e->name, name, 20);
+    e->name[20] = 0;
+    e->song_length = CLAMP(mh[0], 1, 128);
+    e->tempo = 6;
+    e->bpm = 125;
+
+    for(i = 0; i < 128; i++) {
+	e->num_patterns = MAX(e->num_patterns, orders[i] + 1);
+    }
+
+    inames = g_ptr_array_new();
+    for(i = 0; i < 31; i++) {
+	index_add_name(inames, sh[i], 22, FALSE);
+	len = get_be_16(sh[i] + 22) << 1;
+	if(len) {
+	    e->num_instruments = i + 1;
+	    e->num_samples++;
+	    e->sample_bytes += len;
+	}
+    }
+    e->instrument_names = index_names_from_list(inames);
+    e->sample_names = index_names_from_list(g_ptr_array_new());
+
+    size = 64 * e->num_channels * 4;
+    data = g_new(guint8, size);
+    memset(patterns, 0, sizeof(patterns));
+    for(i = 0; i < e->num_patterns; i++) {
+	if(fread(data, 1, size, f) != size) {
+	    goto out;
+	}
+	patterns[i].rows = 64;
+	patterns[i].fx = g_new(guint8, 64 * e->num_channels * 2);
+	for(j = 0; j < 64 * e->num_channels; j++) {
+	    patterns[i].fx[j * 2] = data[j * 4 + 2] & 0x0f;
+	    patterns[i].fx[j * 2 + 1] = data[j * 4 + 3];
+	}
+    }
+
+    e->duration = index_duration(patterns, e->num_patterns, orders, e->song_length, 0,
+				 e->num_channels, e->tempo, e->bpm);
+    ok = TRUE;
+
+  out:
+    g_free(data);
+    for(i = 0; i < e->num_patterns; i++) {
+	g_free(patterns[i].fx);
+    }
+    return ok;
+}
+
+static void
+index_entry_clear (module_index_entry *e)
+{
+    g_strfreev(e->instrument_names);
+    g_strfreev(e->sample_names);
+    memset(&e->is_module, 0, sizeof(*e) - G_STRUCT_OFFSET(module_index_entry, is_module));
+    e->duration = -1;
+}
+
+static module_index_entry *
+index_read_file (const gchar *path,
+		 struct stat *st)
+{
+    module_index_entry *e = g_new0(module_index_entry, 1);
+    FILE *f;
+
+    e->path = g_strdup(path);
+    e->mtime = st->st_mtime;
+    e->size = st->st_size;
+    e->duration = -1;
+
+    if((f = fopen(path, "rb"))) {
+	if(!(e->is_module = index_read_xm(f, e))) {
+	    index_entry_clear(e);
+	    fseek(f, 0, SEEK_SET);
+	    if(!(e->is_module = index_read_mod(f, e))) {
+		index_entry_clear(e);
+	    }
+	}
+	fclose(f);
+    }
+
+    // Not a module; remembered anyway, so that it isn't looked at again
+    if(!e->instrument_names) {
+	e->instrument_names = g_new0(gchar*, 1);
+	e->sample_names = g_new0(gchar*, 1);
+    }
+
+    return e;
+}
+
+/* --- Cache file */
+
+static void
+index_write_string (FILE *f,
+		    const gchar *s)
+{
+    guint32 len = strlen(s);
+
+    fwrite(&len, sizeof(len), 1, f);
+    fwrite(s, 1, len, f);
+}
+
+static gchar *
+index_read_string (FILE *f)
+{
+    guint32 len;
+    gchar *s;
+
+    if(fread(&len, sizeof(len), 1, f) != 1 || len > 4096) {
+	return NULL;
+    }
+    s = g_new(gchar, len + 1);
+    if(fread(s, 1, len, f) != len) {
+	g_free(s);
+	return NULL;
+    }
+    s[len] = 0;
+
+    return s;
+}
+
+static void
+index_write_names (FILE *f,
+		   gchar **names)
+{
+    guint32 n = 0;
+
+    while(names[n]) {
+	n++;
+    }
+    fwrite(&n, sizeof(n), 1, f);
+    for(; *names; names++) {
+	index_write_string(f, *names);
+    }
+}
+
+static gchar **
+index_read_names (FILE *f)
+{
+    guint32 n, i;
+    gchar **names;
+
+    if(fread(&n, sizeof(n), 1, f) != 1 || n > 128 * 16) {
+	return NULL;
+    }
+    names = g_new0(gchar*, n + 1);
+    for(i = 0; i < n; i++) {
+	if(!(names[i] = index_read_string(f))) {
+	    g_strfreev(names);
+	    return NULL;
+	}
+    }
+
+    return names;
+}
+
+/* The fixed-size part of an entry is stored as it is in memory. The
+   header after the magic records the version of the entry structure,
+   its size and the byte order, and a cache that doesn't match all of
+   them is thrown away; bump INDEX_VERSION whenever the fields of
+   module_index_entry change. */
+#define INDEX_FIXED_START G_STRUCT_OFFSET(module_index_entry, mtime)
+#define INDEX_FIXED_END G_STRUCT_OFFSET(module_index_entry, instrument_names)
+
+static void
+index_make_header (guint32 *header)
+{
+    header[0] = INDEX_VERSION;
+    header[1] = INDEX_FIXED_END - INDEX_FIXED_START;
+    header[2] = 0x01020304;
+}
+
+static void
+index_copy_entry (gpointer key,
+		  gpointer value,
+		  gpointer data)
+{
+    g_ptr_array_add(data, index_entry_copy(value));
+}
+
+static void
+index_save_entry (FILE *f,
+		  module_index_entry *e)
+{
+    index_write_string(f, e->path);
+    fwrite((char*)e + INDEX_FIXED_START, 1, INDEX_FIXED_END - INDEX_FIXED_START, f);
+    index_write_names(f, e->instrument_names);
+    index_write_names(f, e->sample_names);
+}
+
+static void
+index_save (void)
+{
+    gchar *tmp = g_strconcat(index_filename, ".tmp", NULL);
+    GPtrArray *entries = g_ptr_array_new();
+    guint32 header[3];
+    gboolean ok = FALSE;
+    FILE *f;
+    guint i;
+
+    // Copy the entries, so that searches don't have to wait for the disk
+    g_mutex_lock(index_mutex);
+    g_hash_table_foreach(index_table, index_copy_entry, entries);
+    index_dirty = FALSE;
+    g_mutex_unlock(index_mutex);
+
+    if((f = fopen(tmp, "wb"))) {
+	index_make_header(header);
+	fwrite(INDEX_MAGIC, 1, strlen(INDEX_MAGIC), f);
+	fwrite(header, sizeof(header), 1, f);
+	for(i = 0; i < entries->len; i++) {
+	    index_save_entry(f, g_ptr_array_index(entries, i));
+	}
+	if(fclose(f) == 0 && rename(tmp, index_filename) == 0) {
+	    ok = TRUE;
+	} else {
+	    unlink(tmp);
+	}
+    }
+
+    if(!ok) {
+	g_mutex_lock(index_mutex);
+	index_dirty = TRUE;
+	g_mutex_unlock(index_mutex);
+    }
+
+    for(i = 0; i < entries->len; i++) {
+	module_index_entry_free(g_ptr_array_index(entries, i));
+    }
+    g_ptr_array_free(entries, TRUE);
+    g_free(tmp);
+}
+
+static void
+index_load (void)
+{
+    FILE *f = fopen(index_filename, "rb");
+    char magic[sizeof(INDEX_MAGIC) - 1];
+    guint32 header[3], expected[3];
+    module_index_entry *e;
+    gchar *path;
+
+    if(!f) {
+	return;
+    }
+
+    index_make_header(expected);
+    if(fread(magic, 1, sizeof(magic), f) == sizeof(magic)
+       && !memcmp(magic, INDEX_MAGIC, sizeof(magic))
+       && fread(header, sizeof(header), 1, f) == 1
+       && !memcmp(header, expected, sizeof(header))) {
+	while((path = index_read_string(f))) {
+	    e = g_new0(module_index_entry, 1);
+	    e->path = path;
+	    if(fread((char*)e + INDEX_FIXED_START, 1, INDEX_FIXED_END - INDEX_FIXED_START, f)
+	       != INDEX_FIXED_END - INDEX_FIXED_START
+	       || !(e->instrument_names = index_read_names(f))
+	       || !(e->sample_names = index_read_names(f))) {
+		module_index_entry_free(e);
+		break;
+	    }
+	    g_hash_table_replace(index_table, e->path, e);
+	}
+    }
+
+    fclose(f);
+}
+
+/* --- Indexer thread */
+
+static gboolean
+index_is_candidate (const gchar *name)
+{
+    const gchar *ext = strrchr(name, '.');
+
+    // Compressed modules would have to be unpacked first, see File_Load()
+    return ext && (!strcasecmp(ext, ".xm") || !strcasecmp(ext, ".mod"));
+}
+
+static void
+index_file (const gchar *path,
+	    struct stat *st)
+{
+    module_index_entry *e;
+    gboolean uptodate;
+
+    g_mutex_lock(index_mutex);
+    e = g_hash_table_lookup(index_table, path);
+    uptodate = e && e->mtime == st->st_mtime && e->size == st->st_size;
+    g_mutex_unlock(index_mutex);
+
+    if(uptodate) {
+	return;
+    }
+
+    e = index_read_file(path, st);
+
+    g_mutex_lock(index_mutex);
+    g_hash_table_replace(index_table, e->path, e);
+    index_dirty = TRUE;
+    g_mutex_unlock(index_mutex);
+}
+
+static gboolean
+index_entry_is_gone (gpointer key,
+		     gpointer value,
+		     gpointer data)
+{
+    const gchar *dir = data;
+    gchar *d = g_path_get_dirname(key);
+    struct stat st;
+    gboolean gone;
+
+    gone = !strcmp(d, dir) && stat(key, &st) != 0;
+    g_free(d);
+
+    return gone;
+}
+
+static void
+index_dir (const gchar *dir,
+	   gboolean recursive)
+{
+    DIR *d = opendir(dir);
+    struct dirent *de;
+    struct stat st;
+    gchar *path;
+
+    if(!d) {
+	return;
+    }
+
+    while((de = readdir(d))) {
+	if(de->d_name[0] == '.') {
+	    continue;
+	}
+	path = g_build_filename(dir, de->d_name, NULL);
+	if(stat(path, &st) == 0) {
+	    if(S_ISDIR(st.st_mode)) {
+		if(recursive) {
+		    index_dir(path, TRUE);
+		}
+	    } else if(S_ISREG(st.st_mode) && index_is_candidate(de->d_name)) {
+		index_file(path, &st);
+	    }
+	}
+	g_free(path);
+    }
+    closedir(d);
+
+    // Forget files that have been deleted
+    g_mutex_lock(index_mutex);
+    if(g_hash_table_foreach_remove(index_table, index_entry_is_gone, (gpointer)dir)) {
+	index_dirty = TRUE;
+    }
+    g_mutex_unlock(index_mutex);
+}
+
+static gpointer
+index_thread (gpointer data)
+{
+    index_request *r;
+    struct stat st;
+
+    while(1) {
+	r = g_async_queue_pop(index_queue);
+
+	if(stat(r->path, &st) == 0) {
+	    if(S_ISDIR(st.st_mode)) {
+		index_dir(r->path, r->recursive);
+	    } else if(S_ISREG(st.st_mode)) {
+		index_file(r->path, &st);
+	    }
+	}
+	g_free(r->path);
+	g_free(r);
+
+	if(g_atomic_int_dec_and_test(&index_queued) && index_dirty) {
+	    index_save();
+	}
+    }
+
+    return NULL;
+}
+
+static void
+index_queue_request (const gchar *path,
+		     gboolean recursive)
+{
+    index_request *r = g_new(index_request, 1);
+
+    r->path = g_strdup(path);
+    r->recursive = recursive;
+    g_atomic_int_inc(&index_queued);
+    g_async_queue_push(index_queue, r);
+}
+
+/* --- Interface */
+
+void
+module_index_init (void)
+{
+    index_table = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+					(GDestroyNotify)module_index_entry_free);
+    index_mutex = g_mutex_new();
+    index_queue = g_async_queue_new();
+    index_filename = g_strdup(prefs_get_filename("module-index"));
+
+    index_load();
+
+    if(!g_thread_create(index_thread, NULL, FALSE, NULL)) {
+	fprintf(stderr, "Can't create module indexer thread.\n");
+    }
+}
+
+void
+module_index_scan (const gchar *dir,
+		   gboolean recursive)
+{
+    index_queue_request(dir, recursive);
+}
+
+int
+module_index_pending (void)
+{
+    return g_atomic_int_get(&index_queued);
+}
+
+module_index_entry *
+module_index_lookup (const gchar *path)
+{
+    module_index_entry *e, *res = NULL;
+    struct stat st;
+
+    if(stat(path, &st) != 0) {
+	return NULL;
+    }
+
+    g_mutex_lock(index_mutex);
+    e = g_hash_table_lookup(index_table, path);
+    if(e && e->mtime == st.st_mtime && e->size == st.st_size) {
+	res = index_entry_copy(e);
+    }
+    g_mutex_unlock(index_mutex);
+
+    if(!res) {
+	index_queue_request(path, FALSE);
+    }
+
+    return res;
+}
+
+static gboolean
+index_names_match (gchar **names,
+		   const gchar *text)
+{
+    gchar *s;
+    gboolean match = FALSE;
+
+    for(; *names && !match; names++) {
+	s = g_ascii_strdown(*names, -1);
+	match = strstr(s, text) != NULL;
+	g_free(s);
+    }
+
+    return match;
+}
+
+static void
+index_search_entry (gpointer key,
+		    gpointer value,
+		    gpointer data)
+{
+    module_index_entry *e = value;
+    gpointer *search = data;
+    const gchar *text = search[0];
+    gchar *base, *s;
+    gboolean match;
+
+    if(!e->is_module) {
+	return;
+    }
+
+    base = g_path_get_basename(e->path);
+    s = g_ascii_strdown(base, -1);
+    match = strstr(s, text) != NULL;
+    g_free(s);
+    g_free(base);
+
+    if(!match) {
+	s = g_ascii_strdown(e->name, -1);
+	match = strstr(s, text) != NULL;
+	g_free(s);
+    }
+
+    if(match
+       || index_names_match(e->instrument_names, text)
+       || index_names_match(e->sample_names, text)) {
+	search[1] = g_list_prepend(search[1], index_entry_copy(e));
+    }
+}
+
+static gint
+index_compare_paths (gconstpointer a,
+		     gconstpointer b)
+{
+    return strcmp(((module_index_entry*)a)->path, ((module_index_entry*)b)->path);
+}
+
+GList *
+module_index_search (const gchar *text)
+{
+    gpointer search[2];
+
+    search[0] = g_ascii_strdown(text, -1);
+    search[1] = NULL;
+
+    g_mutex_lock(index_mutex);
+    g_hash_table_foreach(index_table, index_search_entry, search);
+    g_mutex_unlock(index_mutex);
+
+    g_free(search[0]);
+    return g_list_sort(search[1], index_compare_paths);
+}
@@ -0,0 +1,71 @@
+/*
+ * The Real SoundTracker - module library index (header)
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _MODULE_INDEX_H
+#define _MODULE_INDEX_H
+
+#include <glib.h>
+
+/* Metadata of XM and MOD files, gathered by a background thread from
+   the headers and the pattern data only -- the samples are skipped.
+   The results are kept in a cache file in the preferences directory,
+   so that only new and changed files are looked at again. */
+
+typedef struct module_index_entry {
+    gchar *path;
+    gint64 mtime, size;          // of the file when it was indexed
+
+    gboolean is_module;          // FALSE if the file isn't a module we know
+    gboolean is_mod;             // ProTracker MOD rather than XM
+    char name[21];
+    int num_channels;
+    int num_patterns;
+    int num_instruments;
+    int num_samples;             // non-empty ones
+    int song_length;
+    int tempo, bpm;
+    guint32 sample_bytes;        // size of the sample data in the file
+    gint32 duration;             // ms until the song repeats, -1 = unknown
+
+    gchar **instrument_names;    // NULL-terminated, empty names left out
+    gchar **sample_names;
+} module_index_entry;
+
+/* Loads the cache and starts the indexer thread */
+void                  module_index_init       (void);
+
+/* Index all modules in a directory in the background */
+void                  module_index_scan       (const gchar *dir,
+					       gboolean recursive);
+
+/* Number of files and directories waiting to be indexed */
+int                   module_index_pending    (void);
+
+/* Returns a copy of the entry for the file if it is up to date,
+   otherwise NULL, and the file is queued for indexing */
+module_index_entry *  module_index_lookup     (const gchar *path);
+
+/* Copies of all modules whose file name, song name or instrument or
+   sample names contain the text (ignoring case), sorted by path */
+GList *               module_index_search     (const gchar *text);
+
+void                  module_index_entry_free (module_index_entry *e);
+
+#endif /* _MODULE_INDEX_H */
@@ -37,10 +37,13 @@
 #include "instrument-editor.h"
 #include "keys.h"
 #include "track-editor.h"
+#include "song-analysis.h"
+#include "pattern-undo.h"
 
 static GtkWidget *ilist, *slist, *songname;
-static GtkWidget *freqmode_w[2], *ptmode_toggle;
+static GtkWidget *freqmode_w[2], *ptmode_toggle, *songlength;
 static int curi = 0, curs = 0;
+static song_analysis *analysis = NULL;
 
 static void
 ptmode_changed (GtkWidget *widget)
@@ -173,6 +176,14 @@ modinfo_page_create (GtkNotebook *nb)
 			     G_CALLBACK(songname_changed), NULL);
     gtk_widget_show(songname);
 
+    thing = gtk_label_new(_("Length:"));
+    gtk_box_pack_start(GTK_BOX(hbox), thing, FALSE, TRUE, 0);
+    gtk_widget_show(thing);
+
+    songlength = gtk_label_new("--:--");
+    gtk_box_pack_start(GTK_BOX(hbox), songlength, FALSE, TRUE, 0);
+    gtk_widget_show(songlength);
+
     hbox = gtk_hbox_new(FALSE, 4);
     gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, TRUE, 0);
     gtk_widget_show(hbox);
@@ -273,6 +284,30 @@ modinfo_update_all (void)
     xm_set_modified(m);
 }
 
+void
+modinfo_set_song_analysis (song_analysis *a)
+{
+    gchar buf[20];
+    guint32 s;
+
+    song_analysis_free(analysis);
+    analysis = a;
+
+    s = a->length / 1000;
+    if(s >= 3600) {
+	g_sprintf(buf, "%u:%02u:%02u%s", s / 3600, s / 60 % 60, s % 60, a->complete ? "" : "+");
+    } else {
+	g_sprintf(buf, "%u:%02u%s", s / 60, s % 60, a->complete ? "" : "+");
+    }
+    gtk_label_set_text(GTK_LABEL(songlength), buf);
+}
+
+song_analysis *
+modinfo_get_song_analysis (void)
+{
+    return analysis;
+}
+
 void
 modinfo_set_current_instrument (int n)
 {
@@ -343,6 +378,9 @@ modinfo_pack_patterns (void)
 	}
     }
 
+    // The journal refers to patterns by number
+    pattern_undo_clear();
+
     gui_playlist_initialize();
     xm_set_modified(1);
 }
@@ -361,9 +399,13 @@ modinfo_clear_unused_patterns (void)
 {
     int i;
     
+    pattern_undo_begin(NULL, 0, 0, 0, 0);
     for(i = 0; i < sizeof(xm->patterns) / sizeof(xm->patterns[0]); i++)
-	if(!st_is_pattern_used_in_song(xm, i))
+	if(!st_is_pattern_used_in_song(xm, i)) {
+	    pattern_undo_watch(&xm->patterns[i], 0, 32, 0, -1);
 	    st_clear_pattern(&xm->patterns[i]);
+	}
+    pattern_undo_end();
 
     tracker_redraw(tracker);
     xm_set_modified(1);
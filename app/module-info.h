@@ -24,6 +24,8 @@
 
 #include <gtk/gtk.h>
 
+#include "song-analysis.h"
+
 void            modinfo_page_create                (GtkNotebook *nb);
 
 gboolean        modinfo_page_handle_keys           (int shift,
@@ -36,6 +38,11 @@ void            modinfo_update_instrument          (int instr);
 void            modinfo_update_sample              (int sample);
 void            modinfo_update_all                 (void);
 
+/* Takes over the result of the last song analysis and shows the song
+   length; the result stays available for seeking and the like */
+void            modinfo_set_song_analysis          (song_analysis *a);
+song_analysis * modinfo_get_song_analysis          (void);
+
 void            modinfo_set_current_instrument     (int);
 void            modinfo_set_current_sample         (int);
 
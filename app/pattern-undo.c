@@ -0,0 +1,362 @@
+/*
+ * The Real SoundTracker - pattern editing undo journal
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* A step is a list of runs -- changed cells next to each other in one
+   row -- each with the old and the new contents of its cells.
+   Undoing writes back the old cells of all runs, redoing the new ones,
+   so both only touch what has changed. Steps are only valid as long
+   as the patterns keep their lengths; if that's not the case anymore,
+   the journal is thrown away. */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "pattern-undo.h"
+#include "main.h"
+#include "track-editor.h"
+#include "tracker.h"
+
+/* Maximum number of changed cells kept; the oldest steps are dropped
+   beyond that. Each cell takes 10 bytes (old and new). */
+#define PATTERN_UNDO_MAX_CELLS (256 * 1024)
+
+typedef struct undo_region {
+    int pattern, length;
+    int channel, num_channels;
+    int row, num_rows;
+    XMNote *cells;      // as they were at the beginning, row by row
+} undo_region;
+
+typedef struct undo_run {
+    guint8 pattern, channel;
+    guint16 row, count; // count channels from 'channel' on
+    guint16 length;     // of the pattern at the time
+    guint32 cells;      // index of the first old cell; the new ones follow
+} undo_run;
+
+typedef struct undo_step {
+    int num_runs, num_cells;
+    undo_run *runs;
+    XMNote *cells;
+} undo_step;
+
+static int depth = 0;
+static GSList *regions = NULL;
+
+static GList *undo_steps = NULL, *undo_last = NULL;  // newest first
+static GSList *redo_steps = NULL;
+static int total_cells = 0;
+
+static const XMNote empty_row[XM_PATTERN_WIDTH];
+
+static const XMNote *
+cell (XMPattern *p,
+      int channel,
+      int row)
+{
+    return p->notes ? xm_pattern_note(p, channel, row) : &empty_row[channel];
+}
+
+static void
+undo_step_free (undo_step *s)
+{
+    total_cells -= s->num_cells;
+    g_free(s->runs);
+    g_free(s->cells);
+    g_free(s);
+}
+
+static void
+pattern_undo_clear_redo (void)
+{
+    GSList *l;
+
+    for(l = redo_steps; l; l = l->next) {
+	undo_step_free(l->data);
+    }
+    g_slist_free(redo_steps);
+    redo_steps = NULL;
+}
+
+void
+pattern_undo_clear (void)
+{
+    GList *l;
+
+    for(l = undo_steps; l; l = l->next) {
+	undo_step_free(l->data);
+    }
+    g_list_free(undo_steps);
+    undo_steps = undo_last = NULL;
+
+    pattern_undo_clear_redo();
+}
+
+void
+pattern_undo_watch (XMPattern *p,
+		    int channel,
+		    int num_channels,
+		    int row,
+		    int num_rows)
+{
+    undo_region *r;
+    int i, j;
+
+    g_return_if_fail(depth > 0);
+    g_return_if_fail(p >= xm->patterns && p < xm->patterns + 256);
+
+    if(num_rows == -1 || row + num_rows > p->length) {
+	num_rows = p->length - row;
+    }
+    num_channels = MIN(num_channels, 32 - channel);
+    if(row < 0 || num_rows <= 0 || channel < 0 || num_channels <= 0) {
+	return;
+    }
+
+    r = g_new(undo_region, 1);
+    r->pattern = p - xm->patterns;
+    r->length = p->length;
+    r->channel = channel;
+    r->num_channels = num_channels;
+    r->row = row;
+    r->num_rows = num_rows;
+    r->cells = g_new(XMNote, num_channels * num_rows);
+
+    for(j = 0; j < num_rows; j++) {
+	for(i = 0; i < num_channels; i++) {
+	    r->cells[j * num_channels + i] = *cell(p, channel + i, row + j);
+	}
+    }
+
+    regions = g_slist_prepend(regions, r);
+}
+
+void
+pattern_undo_begin (XMPattern *p,
+		    int channel,
+		    int num_channels,
+		    int row,
+		    int num_rows)
+{
+    depth++;
+    if(p) {
+	pattern_undo_watch(p, channel, num_channels, row, num_rows);
+    }
+}
+
+/* Appends the runs of changed cells in a region */
+static gboolean
+pattern_undo_diff (undo_region *r,
+		   GArray *runs,
+		   GArray *cells)
+{
+    XMPattern *p = &xm->patterns[r->pattern];
+    const XMNote *now;
+    XMNote *old;
+    undo_run run;
+    int i, j, k, row;
+
+    if(p->length != r->length) {
+	// Cells can't describe resizing
+	return FALSE;
+    }
+
+    for(j = 0; j < r->num_rows; j++) {
+	row = r->row + j;
+	old = r->cells + j * r->num_channels;
+	now = cell(p, r->channel, row);
+
+	for(i = 0; i < r->num_channels; i = k) {
+	    if(!memcmp(&old[i], &now[i], sizeof(XMNote))) {
+		k = i + 1;
+		continue;
+	    }
+	    for(k = i + 1; k < r->num_channels; k++) {
+		if(!memcmp(&old[k], &now[k], sizeof(XMNote)))
+		    break;
+	    }
+
+	    run.pattern = r->pattern;
+	    run.channel = r->channel + i;
+	    run.row = row;
+	    run.count = k - i;
+	    run.length = r->length;
+	    run.cells = cells->len;
+	    g_array_append_val(runs, run);
+
+	    g_array_append_vals(cells, old + i, k - i);
+	    g_array_append_vals(cells, now + i, k - i);
+	}
+    }
+
+    return TRUE;
+}
+
+void
+pattern_undo_end (void)
+{
+    GArray *runs, *cells;
+    GSList *l;
+    undo_step *s;
+    gboolean valid = TRUE;
+
+    g_return_if_fail(depth > 0);
+
+    if(--depth > 0) {
+	return;
+    }
+
+    runs = g_array_new(FALSE, FALSE, sizeof(undo_run));
+    cells = g_array_new(FALSE, FALSE, sizeof(XMNote));
+
+    regions = g_slist_reverse(regions);
+    for(l = regions; l; l = l->next) {
+	undo_region *r = l->data;
+
+	if(valid) {
+	    valid = pattern_undo_diff(r, runs, cells);
+	}
+	g_free(r->cells);
+	g_free(r);
+    }
+    g_slist_free(regions);
+    regions = NULL;
+
+    if(!valid || runs->len == 0) {
+	g_array_free(runs, TRUE);
+	g_array_free(cells, TRUE);
+	if(!valid) {
+	    pattern_undo_clear();
+	}
+	return;
+    }
+
+    s = g_new(undo_step, 1);
+    s->num_runs = runs->len;
+    s->num_cells = cells->len;
+    s->runs = (undo_run*)g_array_free(runs, FALSE);
+    s->cells = (XMNote*)g_array_free(cells, FALSE);
+
+    pattern_undo_clear_redo();
+
+    undo_steps = g_list_prepend(undo_steps, s);
+    if(!undo_last) {
+	undo_last = undo_steps;
+    }
+    total_cells += s->num_cells;
+
+    // Keep at least the step that has just been made
+    while(total_cells > PATTERN_UNDO_MAX_CELLS && undo_last != undo_steps) {
+	GList *prev = undo_last->prev;
+
+	undo_step_free(undo_last->data);
+	undo_steps = g_list_delete_link(undo_steps, undo_last);
+	undo_last = prev;
+    }
+}
+
+static gboolean
+pattern_undo_apply (undo_step *s,
+		    gboolean redo)
+{
+    undo_run *r;
+    XMPattern *p;
+    int i, first = G_MAXINT, last = -1;
+
+    for(i = 0; i < s->num_runs; i++) {
+	r = &s->runs[i];
+	p = &xm->patterns[r->pattern];
+	if(p->length != r->length || !p->notes) {
+	    return FALSE;
+	}
+    }
+
+    // Undo back to front, as runs may overlap
+    for(i = 0; i < s->num_runs; i++) {
+	r = &s->runs[redo ? i : s->num_runs - 1 - i];
+	p = &xm->patterns[r->pattern];
+	memcpy(xm_pattern_note(p, r->channel, r->row),
+	       s->cells + r->cells + (redo ? r->count : 0),
+	       r->count * sizeof(XMNote));
+
+	if(p == tracker->curpattern) {
+	    first = MIN(first, r->row);
+	    last = MAX(last, r->row);
+	}
+    }
+
+    if(last >= 0) {
+	tracker_redraw_rows(tracker, first, last);
+    }
+    xm_set_modified(1);
+
+    return TRUE;
+}
+
+gboolean
+pattern_undo (void)
+{
+    undo_step *s;
+
+    if(!undo_steps) {
+	return FALSE;
+    }
+
+    s = undo_steps->data;
+    if(undo_last == undo_steps) {
+	undo_last = NULL;
+    }
+    undo_steps = g_list_delete_link(undo_steps, undo_steps);
+
+    if(!pattern_undo_apply(s, FALSE)) {
+	undo_step_free(s);
+	pattern_undo_clear();
+	return FALSE;
+    }
+
+    redo_steps = g_slist_prepend(redo_steps, s);
+    return TRUE;
+}
+
+gboolean
+pattern_redo (void)
+{
+    undo_step *s;
+
+    if(!redo_steps) {
+	return FALSE;
+    }
+
+    s = redo_steps->data;
+    redo_steps = g_slist_delete_link(redo_steps, redo_steps);
+
+    if(!pattern_undo_apply(s, TRUE)) {
+	undo_step_free(s);
+	pattern_undo_clear();
+	return FALSE;
+    }
+
+    undo_steps = g_list_prepend(undo_steps, s);
+    if(!undo_last) {
+	undo_last = undo_steps;
+    }
+    return TRUE;
+}
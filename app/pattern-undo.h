@@ -0,0 +1,63 @@
+/*
+ * The Real SoundTracker - pattern editing undo journal (header)
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _PATTERN_UNDO_H
+#define _PATTERN_UNDO_H
+
+#include <glib.h>
+
+#include "xm.h"
+
+/* Every editing operation on pattern cells is wrapped like this:
+
+     pattern_undo_begin(pattern, channel, num_channels, row, num_rows);
+     ... change the cells ...
+     pattern_undo_end();
+
+   The region is remembered at the beginning and compared at the end;
+   only the cells that have actually changed are recorded, as one
+   step. More regions (of other patterns, for example) can be added
+   with pattern_undo_watch() in between, and begin/end pairs may be
+   nested, the outermost one makes the step. num_rows == -1 means up
+   to the end of the pattern. If p is NULL, nothing is watched yet. */
+
+void          pattern_undo_begin     (XMPattern *p,
+				      int channel,
+				      int num_channels,
+				      int row,
+				      int num_rows);
+
+void          pattern_undo_watch     (XMPattern *p,
+				      int channel,
+				      int num_channels,
+				      int row,
+				      int num_rows);
+
+void          pattern_undo_end       (void);
+
+/* Take back the last step / do it again. FALSE if there is nothing
+   to undo or redo. */
+gboolean      pattern_undo           (void);
+gboolean      pattern_redo           (void);
+
+/* Forget everything, e.g. when another module is loaded */
+void          pattern_undo_clear     (void);
+
+#endif /* _PATTERN_UNDO_H */
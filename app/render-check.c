@@ -0,0 +1,398 @@
+/*
+ * The Real SoundTracker - offline render check
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "render-check.h"
+#include "audio.h"
+#include "audio-stats.h"
+#include "check-modules.h"
+#include "driver-inout.h"
+#include "main.h"
+#include "mixer.h"
+#include "xm.h"
+
+#define RENDER_CHECK_MIXFREQ     44100
+#define RENDER_CHECK_MAX_FRAMES  (RENDER_CHECK_MIXFREQ * 600)
+#define RENDER_CHECK_PARTS       16
+#define RENDER_CHECK_WORKERS     4
+
+typedef struct render_result {
+    guint32 frames;
+    guint32 hash;                    // FNV-1a of the output
+    GArray *blocks;                  // sum of squares of each block
+    int levels[RENDER_CHECK_PARTS];
+    guint64 usecs, hash_usecs;
+} render_result;
+
+typedef struct render_reference {
+    char module[64], mixer[64];
+    guint32 frames, hash;
+    int levels[RENDER_CHECK_PARTS];
+    double msecs;
+} render_reference;
+
+/* === Rendering */
+
+static void
+render_check_block (const void *buf,
+		    guint32 frames,
+		    void *data)
+{
+    render_result *r = data;
+    const guint8 *b = buf;
+    guint64 start = audio_stats_now();
+    double sum = 0.0;
+    guint32 i, h = r->hash;
+    int v;
+
+    for(i = 0; i < frames * 4; i += 2) {
+	h = (h ^ b[i]) * 16777619;
+	h = (h ^ b[i + 1]) * 16777619;
+	v = (gint16)(b[i] | (b[i + 1] << 8));
+	sum += (double)v * v;
+    }
+
+    r->hash = h;
+    r->frames += frames;
+    g_array_append_val(r->blocks, sum);
+    r->hash_usecs += audio_stats_now() - start;
+}
+
+static void
+render_check_levels (render_result *r)
+{
+    guint n = r->blocks->len, first, last, i;
+    double sum;
+    int k;
+
+    for(k = 0; k < RENDER_CHECK_PARTS; k++) {
+	first = k * n / RENDER_CHECK_PARTS;
+	last = (k + 1) * n / RENDER_CHECK_PARTS;
+	for(i = first, sum = 0.0; i < last; i++) {
+	    sum += g_array_index(r->blocks, double, i);
+	}
+	r->levels[k] = last > first ? (int)sqrt(sum / ((last - first) * AUDIO_RENDER_BLOCK * 2)) : 0;
+    }
+}
+
+static void
+render_check_print (const char *module,
+		    st_mixer *m,
+		    render_result *r)
+{
+    int k;
+
+    printf("%-12s %-10s %9u %08x ", module, m->id, r->frames, r->hash);
+    for(k = 0; k < RENDER_CHECK_PARTS; k++) {
+	printf(k ? ",%d" : "%d", r->levels[k]);
+    }
+    printf(" %.1f\n", r->usecs / 1000.0);
+    fflush(stdout);
+}
+
+/* === Reference */
+
+static GArray *
+render_check_load_reference (const char *filename)
+{
+    FILE *f;
+    GArray *a;
+    render_reference ref;
+    char line[512], *p, *q;
+    int n, k;
+
+    if(!(f = fopen(filename, "r"))) {
+	perror(filename);
+	return NULL;
+    }
+
+    a = g_array_new(FALSE, FALSE, sizeof(render_reference));
+    while(fgets(line, sizeof(line), f)) {
+	if(sscanf(line, "%63s %63s %u %x %n", ref.module, ref.mixer, &ref.frames, &ref.hash, &n) < 4) {
+	    continue;
+	}
+	for(k = 0, p = line + n; k < RENDER_CHECK_PARTS; k++, p = q + 1) {
+	    ref.levels[k] = strtol(p, &q, 10);
+	    if(q == p)
+		break;
+	}
+	if(k < RENDER_CHECK_PARTS) {
+	    continue;
+	}
+	ref.msecs = strtod(q, NULL);
+	g_array_append_val(a, ref);
+    }
+
+    fclose(f);
+    return a;
+}
+
+/* Mixers that only do integer arithmetic, whose output doesn't depend
+   on the compiler or the FPU */
+static const char * const exact_mixers[] = {
+    "integer32",
+    NULL
+};
+
+static gboolean
+render_check_exact (st_mixer *m)
+{
+    const char * const *id;
+
+    for(id = exact_mixers; *id; id++) {
+	if(!strcmp(*id, m->id))
+	    return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* Returns TRUE if the render is fine */
+static gboolean
+render_check_compare (GArray *refs,
+		      const char *module,
+		      st_mixer *m,
+		      render_result *r)
+{
+    render_reference *ref = NULL;
+    double speed;
+    guint i;
+    int k;
+
+    for(i = 0; i < refs->len; i++) {
+	ref = &g_array_index(refs, render_reference, i);
+	if(!strcmp(ref->module, module) && !strcmp(ref->mixer, m->id))
+	    break;
+    }
+    if(i == refs->len) {
+	fprintf(stderr, "%s/%s: no reference\n", module, m->id);
+	return FALSE;
+    }
+
+    if(r->frames != ref->frames) {
+	fprintf(stderr, "%s/%s: DIFFERS, %u frames instead of %u\n", module, m->id, r->frames, ref->frames);
+	return FALSE;
+    }
+
+    speed = r->usecs > 0 ? ref->msecs * 1000.0 / r->usecs : 0.0;
+
+    if(r->hash == ref->hash) {
+	fprintf(stderr, "%s/%s: ok, %.2fx the speed of the reference\n", module, m->id, speed);
+	return TRUE;
+    }
+
+    if(render_check_exact(m)) {
+	fprintf(stderr, "%s/%s: DIFFERS, hash is %08x instead of %08x\n", module, m->id, r->hash, ref->hash);
+	return FALSE;
+    }
+
+    // Allow for last-bit differences of the floating point mixers, e.g.
+    // with another compiler
+    for(k = 0; k < RENDER_CHECK_PARTS; k++) {
+	if(ABS(r->levels[k] - ref->levels[k]) > 2 + ref->levels[k] / 100) {
+	    fprintf(stderr, "%s/%s: DIFFERS, level of part %d is %d instead of %d\n",
+		    module, m->id, k, r->levels[k], ref->levels[k]);
+	    return FALSE;
+	}
+    }
+
+    fprintf(stderr, "%s/%s: close (levels match, hash doesn't), %.2fx the speed of the reference\n",
+	    module, m->id, speed);
+    return TRUE;
+}
+
+/* Renders the module again, in segments with render_parallel or with
+   stems mixed along, and returns TRUE if that gives exactly the same
+   output as the plain render serial */
+static gboolean
+render_check_again (const char *module,
+		    const char *how,
+		    st_mixer *m,
+		    int workers,
+		    int stems,
+		    render_result *serial)
+{
+    render_result r;
+
+    memset(&r, 0, sizeof(r));
+    r.hash = 2166136261u;
+    r.blocks = g_array_new(FALSE, FALSE, sizeof(double));
+
+    audio_render_song(m, RENDER_CHECK_MIXFREQ, 0, ST_MIXER_FORMAT_S16_LE | ST_MIXER_FORMAT_STEREO,
+		      workers, stems, RENDER_CHECK_MAX_FRAMES, render_check_block, &r);
+    g_array_free(r.blocks, TRUE);
+
+    if(r.frames != serial->frames || r.hash != serial->hash) {
+	fprintf(stderr, "%s/%s: %s render DIFFERS, %u frames with hash %08x instead of %u with %08x\n",
+		module, m->id, how, r.frames, r.hash, serial->frames, serial->hash);
+	return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* === Checking */
+
+int
+render_check (GList *mixers,
+	      const char *reference)
+{
+    XM *oldxm = xm, *m;
+    GArray *refs = NULL;
+    GList *l;
+    render_result r;
+    const char *name;
+    guint64 start;
+    int i, failed = 0, total = 0;
+
+    if(reference && !(refs = render_check_load_reference(reference))) {
+	return 1;
+    }
+
+    for(i = 0; i < CHECK_MODULES; i++) {
+	name = check_module_name(i);
+	if(!(m = check_module_new(i))) {
+	    fprintf(stderr, "%s: out of memory\n", name);
+	    failed++;
+	    continue;
+	}
+	xm = m;
+
+	for(l = mixers; l; l = l->next) {
+	    memset(&r, 0, sizeof(r));
+	    r.hash = 2166136261u;
+	    r.blocks = g_array_new(FALSE, FALSE, sizeof(double));
+
+	    start = audio_stats_now();
+	    if(!audio_render_song(l->data, RENDER_CHECK_MIXFREQ, 0,
+				  ST_MIXER_FORMAT_S16_LE | ST_MIXER_FORMAT_STEREO, 1, AUDIO_STEMS_NONE,
+				  RENDER_CHECK_MAX_FRAMES, render_check_block, &r)) {
+		fprintf(stderr, "%s/%s: song didn't end\n", name, ((st_mixer*)l->data)->id);
+		failed++;
+	    }
+	    r.usecs = audio_stats_now() - start - r.hash_usecs;
+	    render_check_levels(&r);
+	    render_check_print(name, l->data, &r);
+
+	    if(refs && !render_check_compare(refs, name, l->data, &r)) {
+		failed++;
+	    }
+	    total++;
+
+	    if(!render_check_again(name, "parallel", l->data,
+				   RENDER_CHECK_WORKERS, AUDIO_STEMS_NONE, &r)) {
+		failed++;
+	    }
+	    if(!render_check_again(name, "channel stems", l->data,
+				   1, AUDIO_STEMS_CHANNELS, &r)) {
+		failed++;
+	    }
+	    if(!render_check_again(name, "instrument stems", l->data,
+				   1, AUDIO_STEMS_INSTRUMENTS, &r)) {
+		failed++;
+	    }
+	    total += 3;
+
+	    g_array_free(r.blocks, TRUE);
+	}
+
+	xm = oldxm;
+	XM_Free(m);
+    }
+
+    if(refs) {
+	fprintf(stderr, "%d of %d checks failed\n", failed, total);
+	g_array_free(refs, TRUE);
+    }
+
+    return failed;
+}
+
+/* === Throughput */
+
+/* Mixing rate and output rate of each benchmark run, 0 = the same */
+static const int bench_rates[][2] = {
+    { 22050, 0 },
+    { 44100, 0 },
+    { 48000, 0 },
+    { 96000, 0 },
+    { 192000, 0 },
+    { 22050, 48000 },
+    { 44100, 48000 },
+    { 48000, 44100 },
+    { 96000, 48000 },
+    { 192000, 48000 }
+};
+
+static void
+render_bench_block (const void *buf,
+		    guint32 frames,
+		    void *data)
+{
+}
+
+int
+render_bench (GList *mixers)
+{
+    XM *oldxm = xm, *m;
+    GList *l;
+    guint64 usecs;
+    guint32 frames;
+    int i, rate, out, failed = 0;
+
+    if(!(m = check_module_new(CHECK_MODULE_HEAVIEST))) {
+	fprintf(stderr, "out of memory\n");
+	return 1;
+    }
+    xm = m;
+
+    for(l = mixers; l; l = l->next) {
+	for(i = 0; i < sizeof(bench_rates) / sizeof(bench_rates[0]); i++) {
+	    rate = bench_rates[i][0];
+	    out = bench_rates[i][1] ? bench_rates[i][1] : rate;
+
+	    usecs = audio_stats_now();
+	    frames = audio_render_song(l->data, out, rate,
+				       ST_MIXER_FORMAT_S16_LE | ST_MIXER_FORMAT_STEREO, 1, AUDIO_STEMS_NONE,
+				       (guint32)out * 600, render_bench_block, NULL);
+	    usecs = audio_stats_now() - usecs;
+	    if(!frames) {
+		fprintf(stderr, "%s at %d Hz: song didn't end\n", ((st_mixer*)l->data)->id, rate);
+		failed++;
+		continue;
+	    }
+
+	    printf("%-10s %6d %6d %9u %9.1f %8.1f\n", ((st_mixer*)l->data)->id, rate, out, frames,
+		   usecs / 1000.0, usecs ? (double)frames / out * 1000000 / usecs : 0.0);
+	    fflush(stdout);
+	}
+    }
+
+    xm = oldxm;
+    XM_Free(m);
+
+    return failed;
+}
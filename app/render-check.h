@@ -0,0 +1,61 @@
+/*
+ * The Real SoundTracker - offline render check (header)
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _RENDER_CHECK_H
+#define _RENDER_CHECK_H
+
+#include <glib.h>
+
+/* Renders a set of built-in test modules (covering the effects, loop
+   types, envelopes and filters) with each of the given mixers and
+   prints one line per module and mixer to stdout:
+
+     module mixer frames hash levels milliseconds
+
+   where levels are the RMS values of 16 equal parts of the output.
+   The output of an earlier run can be given as reference; every
+   render is then compared with it on stderr. The integer mixer must
+   match the reference exactly. Renders of the floating point mixers
+   with a different hash whose levels are all close to the reference
+   are reported, but don't count as failures. Every module is also
+   rendered in parallel segments and with stems mixed along, which
+   both have to give exactly the same output as a plain render.
+   Returns the number of failures.
+
+   Run with "soundtracker --render-check [reference]", before the GUI
+   is started. */
+
+int           render_check            (GList *mixers,
+				       const char *reference);
+
+/* Renders the heaviest test module with each mixer at a range of
+   mixing rates, directly and converted to another output rate, and
+   prints one line per mixer and rate:
+
+     mixer mixrate outrate frames milliseconds realtime
+
+   where realtime is how many times faster than playing the render
+   was. Returns the number of failures.
+
+   Run with "soundtracker --render-bench". */
+
+int           render_bench            (GList *mixers);
+
+#endif /* _RENDER_CHECK_H */
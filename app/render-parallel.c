@@ -0,0 +1,380 @@
+/*
+ * The Real SoundTracker - parallel song rendering
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* The player and the mixers keep their state in globals, so instead
+   of teaching them to save and restore every single field, each
+   segment is rendered by a fork() of the audio thread: the child
+   starts with exactly the state the serial render would have at that
+   point. Meanwhile, the parent runs audio_mix() without a buffer,
+   which advances the player and the voices just like mixing does but
+   skips the expensive part, to get to the start of the next segment.
+
+   Segments start at the first block boundary after the song position
+   has changed, once the current segment is at least a second long.
+   Parent and child apply the same rule to the same state, so they
+   agree about where a segment ends. The children write their blocks
+   to a temporary file, followed by the player position and the
+   mixer's channel status they ended up with; the parent checks these
+   against its own state at the same point, so that a mixer whose
+   fast-forward does not match its mixing is noticed. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "render-parallel.h"
+#include "driver-inout.h"
+#include "audio.h"
+#include "xm-player.h"
+#include "main.h"
+
+#define MAX_WORKERS 64
+
+typedef struct segment_state {
+    int songpos, patpos;
+    guint32 blocks;
+    st_mixer_channel_status dump[32];
+} segment_state;
+
+typedef struct segment {
+    pid_t pid;
+    FILE *file;
+    gboolean complete;
+    segment_state end;  /* parent's state at the end of the segment */
+} segment;
+
+struct render_parallel {
+    int num_workers;
+    int frames, mixfreq, mixformat, framesize;
+    render_parallel_write_func write;
+    void *data;
+
+    void *buf;
+
+    /* Running segments, oldest first; the last one is the one the
+       parent is advancing through */
+    segment *segments;
+    int head, count;
+
+    int songpos;        /* song position at the start of the current segment */
+    guint32 blocks;     /* blocks advanced in the current segment */
+};
+
+int
+render_parallel_default_workers (void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if(n < 1) {
+	return 1;
+    }
+    return MIN(n, MAX_WORKERS);
+}
+
+render_parallel *
+render_parallel_new (int num_workers,
+		     int frames,
+		     int mixfreq,
+		     int mixformat,
+		     int framesize,
+		     render_parallel_write_func write,
+		     void *data)
+{
+    render_parallel *r = g_new0(render_parallel, 1);
+
+    r->num_workers = CLAMP(num_workers, 1, MAX_WORKERS);
+    r->frames = frames;
+    r->mixfreq = mixfreq;
+    r->mixformat = mixformat;
+    r->framesize = framesize;
+    r->write = write;
+    r->data = data;
+    r->buf = g_malloc(frames * framesize);
+    r->segments = g_new0(segment, r->num_workers);
+
+    return r;
+}
+
+static gboolean
+segment_ends (render_parallel *r,
+	      guint32 blocks)
+{
+    return (gint64)blocks * r->frames >= r->mixfreq && player_songpos != r->songpos;
+}
+
+static void
+segment_get_state (segment_state *s,
+		   guint32 blocks)
+{
+    s->songpos = player_songpos;
+    s->patpos = player_patpos;
+    s->blocks = blocks;
+    memset(s->dump, 0, sizeof(s->dump));
+    mixer->dumpstatus(s->dump);
+}
+
+static gboolean
+write_all (int fd,
+	   const void *buf,
+	   size_t size)
+{
+    const char *p = buf;
+    ssize_t n;
+
+    while(size) {
+	n = write(fd, p, size);
+	if(n < 0) {
+	    if(errno == EINTR) {
+		continue;
+	    }
+	    return FALSE;
+	}
+	p += n;
+	size -= n;
+    }
+
+    return TRUE;
+}
+
+static void
+segment_worker (render_parallel *r,
+		int fd)
+{
+    segment_state s;
+    guint32 blocks = 0;
+
+    audio_render_worker_start();
+
+    while(blocks == 0 || !segment_ends(r, blocks)) {
+	audio_mix(r->buf, r->frames, r->mixfreq, r->mixformat);
+	if(!write_all(fd, r->buf, r->frames * r->framesize)) {
+	    _exit(1);
+	}
+	blocks++;
+	if(player_looped) {
+	    break;
+	}
+    }
+
+    segment_get_state(&s, blocks);
+    if(!write_all(fd, &s, sizeof(s))) {
+	_exit(1);
+    }
+    _exit(0);
+}
+
+/* Only the thread calling fork() lives on in the child, so a lock
+   another thread holds at that moment stays locked there forever. The
+   GUI thread locks a sample while editing it, and the mixer locks
+   each sample it plays; so all of them are taken around the fork(),
+   which makes sure that nobody is in the middle of changing one and
+   leaves them unlocked on both sides. The GUI thread never waits for
+   a second sample lock while holding one, so this can't deadlock. */
+static void
+segment_lock_samples (gboolean lock)
+{
+    int i, j;
+    GMutex *m;
+
+    for(i = 0; i < sizeof(xm->instruments) / sizeof(xm->instruments[0]); i++) {
+	for(j = 0; j < sizeof(xm->instruments[i].samples) / sizeof(xm->instruments[i].samples[0]); j++) {
+	    m = xm->instruments[i].samples[j].sample.lock;
+	    if(lock) {
+		g_mutex_lock(m);
+	    } else {
+		g_mutex_unlock(m);
+	    }
+	}
+    }
+}
+
+static gboolean
+segment_start (render_parallel *r)
+{
+    segment *s = &r->segments[(r->head + r->count) % r->num_workers];
+
+    if(!(s->file = tmpfile())) {
+	g_warning("render-parallel: can't create temporary file: %s", g_strerror(errno));
+	return FALSE;
+    }
+
+    // The worker decides where its segment ends by these, too
+    r->songpos = player_songpos;
+    r->blocks = 0;
+
+    segment_lock_samples(TRUE);
+    s->pid = fork();
+    segment_lock_samples(FALSE);
+    if(s->pid == 0) {
+	segment_worker(r, fileno(s->file));
+    } else if(s->pid < 0) {
+	g_warning("render-parallel: can't fork: %s", g_strerror(errno));
+	fclose(s->file);
+	return FALSE;
+    }
+
+    s->complete = FALSE;
+    r->count++;
+
+    return TRUE;
+}
+
+static void
+segment_discard (render_parallel *r)
+{
+    segment *s = &r->segments[r->head];
+
+    if(s->pid > 0) {
+	kill(s->pid, SIGKILL);
+	waitpid(s->pid, NULL, 0);
+    }
+    fclose(s->file);
+    r->head = (r->head + 1) % r->num_workers;
+    r->count--;
+}
+
+/* Wait for the oldest segment and pass its output on */
+static gboolean
+segment_finish (render_parallel *r,
+		gboolean block)
+{
+    segment *s = &r->segments[r->head];
+    segment_state state;
+    pid_t pid;
+    int status, i;
+    guint32 b;
+
+    g_assert(r->count > 0 && s->complete);
+
+    do {
+	pid = waitpid(s->pid, &status, block ? 0 : WNOHANG);
+    } while(pid < 0 && errno == EINTR);
+
+    if(pid == 0) {
+	return TRUE;
+    }
+    s->pid = 0;
+    if(pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+	g_warning("render-parallel: worker failed");
+	goto error;
+    }
+
+    rewind(s->file);
+    for(b = 0; b < s->end.blocks; b++) {
+	if(fread(r->buf, r->framesize, r->frames, s->file) != r->frames) {
+	    g_warning("render-parallel: segment is too short");
+	    goto error;
+	}
+	if(!r->write(r->data, r->buf, r->frames)) {
+	    goto error;
+	}
+    }
+
+    if(fread(&state, sizeof(state), 1, s->file) != 1) {
+	g_warning("render-parallel: segment length mismatch");
+	goto error;
+    }
+    if(state.songpos != s->end.songpos || state.patpos != s->end.patpos
+       || state.blocks != s->end.blocks) {
+	g_warning("render-parallel: player state mismatch at %d/%d", s->end.songpos, s->end.patpos);
+    }
+    for(i = 0; i < 32; i++) {
+	if(state.dump[i].current_sample != s->end.dump[i].current_sample
+	   || state.dump[i].current_position != s->end.dump[i].current_position) {
+	    g_warning("render-parallel: mixer state mismatch at %d/%d, channel %d",
+		      s->end.songpos, s->end.patpos, i);
+	    break;
+	}
+    }
+
+    segment_discard(r);
+    return TRUE;
+
+  error:
+    segment_discard(r);
+    return FALSE;
+}
+
+int
+render_parallel_pull (render_parallel *r)
+{
+    segment *current;
+
+    if(r->count == 0 || segment_ends(r, r->blocks)) {
+	if(r->count > 0) {
+	    current = &r->segments[(r->head + r->count - 1) % r->num_workers];
+	    segment_get_state(&current->end, r->blocks);
+	    current->complete = TRUE;
+	}
+	if(r->count == r->num_workers && !segment_finish(r, TRUE)) {
+	    return 0;
+	}
+	if(!segment_start(r)) {
+	    return 0;
+	}
+    }
+
+    audio_mix(NULL, r->frames, r->mixfreq, r->mixformat);
+    r->blocks++;
+
+    if(player_looped) {
+	current = &r->segments[(r->head + r->count - 1) % r->num_workers];
+	segment_get_state(&current->end, r->blocks);
+	current->complete = TRUE;
+	while(r->count) {
+	    if(!segment_finish(r, TRUE)) {
+		return 0;
+	    }
+	}
+	return r->frames;
+    }
+
+    // Pass on whatever is ready already, in order
+    while(r->count > 1) {
+	int count = r->count;
+	if(!segment_finish(r, FALSE)) {
+	    return 0;
+	}
+	if(r->count == count) {
+	    break;
+	}
+    }
+
+    return r->frames;
+}
+
+void
+render_parallel_free (render_parallel *r)
+{
+    while(r->count) {
+	segment_discard(r);
+    }
+    g_free(r->segments);
+    g_free(r->buf);
+    g_free(r);
+}
@@ -0,0 +1,59 @@
+/*
+ * The Real SoundTracker - parallel song rendering (header)
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _RENDER_PARALLEL_H
+#define _RENDER_PARALLEL_H
+
+#include <glib.h>
+
+/* Renders a song in segments starting at order boundaries, each one
+   in a worker process of its own. The calling (audio) thread only
+   fast-forwards the player and the mixer from segment to segment, and
+   hands the finished segments to the 'write' callback in song order,
+   so the output is the same as when calling audio_mix() directly. */
+
+typedef struct render_parallel render_parallel;
+
+/* Write 'frames' frames from 'buf'; return FALSE on error */
+typedef gboolean (*render_parallel_write_func) (void *data,
+						void *buf,
+						int frames);
+
+/* Number of workers to use by default (number of CPUs) */
+int               render_parallel_default_workers (void);
+
+render_parallel * render_parallel_new      (int num_workers,
+					    int frames,
+					    int mixfreq,
+					    int mixformat,
+					    int framesize,
+					    render_parallel_write_func write,
+					    void *data);
+
+/* To be called instead of audio_mix() from the driver's pull()
+   function. Returns the number of frames the song has been advanced
+   by, or 0 on error. When player_looped is set afterwards, all output
+   has been written. */
+int               render_parallel_pull     (render_parallel *r);
+
+/* Kills any workers still running */
+void              render_parallel_free     (render_parallel *r);
+
+#endif /* _RENDER_PARALLEL_H */
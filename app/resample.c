@@ -0,0 +1,343 @@
+/*
+ * The Real SoundTracker - output sample rate conversion
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* Every output frame is computed from the input frames around its
+   position with the coefficients of a low-pass filter (a
+   Kaiser-windowed sinc) for the fraction of an input frame it is at.
+   These are tabulated for RESAMPLE_PHASES + 1 fractions; the dot
+   products with the two nearest sets are interpolated linearly.
+
+   The input is kept as floats, in a buffer for each channel, so that
+   the dot products are plain runs of multiply-adds. These are done
+   four at a time with SSE2 on x86-64 and with NEON on ARM, as in
+   mixers/integer32-simd.c. (16 bit fixed point coefficients don't get
+   the errors below -70 dB.) */
+
+#include <config.h>
+
+#include <math.h>
+#include <string.h>
+
+#include "resample.h"
+
+#if defined(__SSE2__)
+#define RESAMPLE_SIMD 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define RESAMPLE_SIMD 1
+#include <arm_neon.h>
+#endif
+
+#define RESAMPLE_PHASES   128
+#define RESAMPLE_TAPS     64     /* per frame of the lower rate */
+
+/* Pass band and window, for at least 80 dB of attenuation from
+   Nyquist of the lower rate on with RESAMPLE_TAPS taps */
+#define RESAMPLE_CUTOFF   0.45   /* cycles per frame of the lower rate */
+#define RESAMPLE_BETA     8.0
+
+struct resample {
+    int channels;
+    guint32 inrate, outrate;
+    guint32 step, rem;           /* input frames per output frame: step + rem / outrate */
+    int taps;                    /* multiple of 8 */
+    float *coefs;                /* (RESAMPLE_PHASES + 1) * taps */
+
+    float *buf[2];               /* input, one buffer per channel */
+    guint32 size, len;           /* frames allocated, frames held */
+    guint32 pos, frac;           /* first frame of the next output frame's window,
+				    and its fraction (in 1 / outrate) */
+};
+
+static double
+resample_i0 (double x)
+{
+    double sum = 1.0, term = 1.0;
+    int k;
+
+    for(k = 1; k < 50 && term > sum * 1e-12; k++) {
+	term *= (x / (2 * k)) * (x / (2 * k));
+	sum += term;
+    }
+
+    return sum;
+}
+
+static void
+resample_make_coefs (resample *r)
+{
+    double *h = g_new(double, r->taps), fc, t, x, sum;
+    int half = r->taps / 2, p, j;
+    float *c;
+
+    fc = RESAMPLE_CUTOFF * MIN(1.0, (double)r->outrate / r->inrate);
+
+    for(p = 0; p <= RESAMPLE_PHASES; p++) {
+	sum = 0.0;
+	for(j = 0; j < r->taps; j++) {
+	    // Distance of input frame j of the window from the output frame
+	    t = (double)p / RESAMPLE_PHASES + half - 1 - j;
+	    x = t / half;
+	    h[j] = x <= -1.0 || x >= 1.0 ? 0.0 : resample_i0(RESAMPLE_BETA * sqrt(1.0 - x * x));
+	    if(t != 0.0) {
+		h[j] *= sin(2 * M_PI * fc * t) / (M_PI * t);
+	    } else {
+		h[j] *= 2 * fc;
+	    }
+	    sum += h[j];
+	}
+
+	// Unity gain at DC for every phase
+	c = r->coefs + p * r->taps;
+	for(j = 0; j < r->taps; j++) {
+	    c[j] = h[j] / sum;
+	}
+    }
+
+    g_free(h);
+}
+
+resample *
+resample_new (int channels,
+	      guint32 inrate,
+	      guint32 outrate)
+{
+    resample *r;
+    int taps;
+
+    g_assert(channels == 1 || channels == 2);
+    g_assert(inrate > 0 && outrate > 0);
+
+    /* When going down in rate, the filter is as long in output frames.
+       This must not be capped: with fewer taps, the transition band
+       gets wider and the cutoff no longer gives the attenuation. The
+       work per input frame stays the same. */
+    taps = (RESAMPLE_TAPS * (guint64)inrate + outrate - 1) / outrate;
+    taps = MAX((taps + 7) & ~7, RESAMPLE_TAPS);
+
+    r = g_new0(resample, 1);
+    r->channels = channels;
+    r->inrate = inrate;
+    r->outrate = outrate;
+    r->step = inrate / outrate;
+    r->rem = inrate % outrate;
+    r->taps = taps;
+    r->coefs = g_new(float, (RESAMPLE_PHASES + 1) * taps);
+    resample_make_coefs(r);
+
+    r->size = 4096;
+    r->buf[0] = g_new(float, r->size);
+    r->buf[1] = channels == 2 ? g_new(float, r->size) : NULL;
+    resample_reset(r);
+
+    return r;
+}
+
+void
+resample_free (resample *r)
+{
+    if(!r) {
+	return;
+    }
+
+    g_free(r->coefs);
+    g_free(r->buf[0]);
+    g_free(r->buf[1]);
+    g_free(r);
+}
+
+void
+resample_reset (resample *r)
+{
+    int i;
+
+    // The first input frame is where the first output frame is
+    r->len = r->taps / 2 - 1;
+    r->pos = 0;
+    r->frac = 0;
+    for(i = 0; i < r->channels; i++) {
+	memset(r->buf[i], 0, r->len * sizeof(float));
+    }
+}
+
+guint32
+resample_inrate (resample *r)
+{
+    return r->inrate;
+}
+
+guint32
+resample_outrate (resample *r)
+{
+    return r->outrate;
+}
+
+int
+resample_channels (resample *r)
+{
+    return r->channels;
+}
+
+guint32
+resample_needed (resample *r,
+		 guint32 frames)
+{
+    guint64 last;
+
+    if(frames == 0) {
+	return 0;
+    }
+
+    last = r->pos + (guint64)(frames - 1) * r->step
+	+ ((guint64)(frames - 1) * r->rem + r->frac) / r->outrate;
+
+    return last + r->taps > r->len ? last + r->taps - r->len : 0;
+}
+
+guint32
+resample_history (resample *r)
+{
+    return r->taps;
+}
+
+void
+resample_write (resample *r,
+		const gint16 *src,
+		guint32 frames)
+{
+    float *l, *rt;
+    guint32 i;
+
+    if(r->len + frames > r->size) {
+	r->size = MAX(r->size * 2, r->len + frames);
+	r->buf[0] = g_renew(float, r->buf[0], r->size);
+	if(r->channels == 2) {
+	    r->buf[1] = g_renew(float, r->buf[1], r->size);
+	}
+    }
+
+    l = r->buf[0] + r->len;
+    if(!src) {
+	memset(l, 0, frames * sizeof(float));
+	if(r->channels == 2) {
+	    memset(r->buf[1] + r->len, 0, frames * sizeof(float));
+	}
+    } else if(r->channels == 2) {
+	rt = r->buf[1] + r->len;
+	for(i = 0; i < frames; i++) {
+	    l[i] = src[2 * i];
+	    rt[i] = src[2 * i + 1];
+	}
+    } else {
+	for(i = 0; i < frames; i++) {
+	    l[i] = src[i];
+	}
+    }
+
+    r->len += frames;
+}
+
+/* Dot products of x with the coefficients c0 and c1 of two phases,
+   interpolated with weight w for c1 */
+static inline float
+resample_dot (const float *x,
+	      const float *c0,
+	      const float *c1,
+	      float w,
+	      int n)
+{
+    float s0 = 0.0, s1 = 0.0;
+#if defined(RESAMPLE_SIMD) && defined(__SSE2__)
+    __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps(), v;
+
+    for(; n >= 4; n -= 4, x += 4, c0 += 4, c1 += 4) {
+	v = _mm_loadu_ps(x);
+	a0 = _mm_add_ps(a0, _mm_mul_ps(v, _mm_loadu_ps(c0)));
+	a1 = _mm_add_ps(a1, _mm_mul_ps(v, _mm_loadu_ps(c1)));
+    }
+    // Sum up the lanes: a0 in the low half, a1 in the high half
+    a0 = _mm_add_ps(_mm_movelh_ps(a0, a1), _mm_movehl_ps(a1, a0));
+    a0 = _mm_add_ps(a0, _mm_shuffle_ps(a0, a0, _MM_SHUFFLE(2, 3, 0, 1)));
+    s0 = _mm_cvtss_f32(a0);
+    s1 = _mm_cvtss_f32(_mm_movehl_ps(a0, a0));
+#elif defined(RESAMPLE_SIMD)
+    float32x4_t a0 = vdupq_n_f32(0.0), a1 = vdupq_n_f32(0.0), v;
+    float32x2_t p;
+
+    for(; n >= 4; n -= 4, x += 4, c0 += 4, c1 += 4) {
+	v = vld1q_f32(x);
+	a0 = vmlaq_f32(a0, v, vld1q_f32(c0));
+	a1 = vmlaq_f32(a1, v, vld1q_f32(c1));
+    }
+    p = vpadd_f32(vadd_f32(vget_low_f32(a0), vget_high_f32(a0)),
+		  vadd_f32(vget_low_f32(a1), vget_high_f32(a1)));
+    s0 = vget_lane_f32(p, 0);
+    s1 = vget_lane_f32(p, 1);
+#endif
+
+    for(; n; n--) {
+	s0 += *x * *c0++;
+	s1 += *x++ * *c1++;
+    }
+
+    return s0 + (s1 - s0) * w;
+}
+
+void
+resample_read (resample *r,
+	       gint16 *dest,
+	       guint32 frames)
+{
+    const float *c;
+    guint64 phase;
+    float w;
+    gint32 v;
+    guint32 i, done;
+    int ch;
+
+    g_assert(resample_needed(r, frames) == 0);
+
+    for(i = 0; i < frames; i++) {
+	if(dest) {
+	    phase = (guint64)r->frac * RESAMPLE_PHASES;
+	    c = r->coefs + phase / r->outrate * r->taps;
+	    w = (float)(phase % r->outrate) / r->outrate;
+	    for(ch = 0; ch < r->channels; ch++) {
+		v = lrintf(resample_dot(r->buf[ch] + r->pos, c, c + r->taps, w, r->taps));
+		*dest++ = CLAMP(v, -32768, 32767);
+	    }
+	}
+
+	r->pos += r->step;
+	r->frac += r->rem;
+	if(r->frac >= r->outrate) {
+	    r->frac -= r->outrate;
+	    r->pos++;
+	}
+    }
+
+    // Drop what no window reaches any more
+    done = MIN(r->pos, r->len);
+    for(ch = 0; ch < r->channels; ch++) {
+	memmove(r->buf[ch], r->buf[ch] + done, (r->len - done) * sizeof(float));
+    }
+    r->len -= done;
+    r->pos -= done;
+}
@@ -0,0 +1,68 @@
+/*
+ * The Real SoundTracker - output sample rate conversion (header)
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _RESAMPLE_H
+#define _RESAMPLE_H
+
+#include <glib.h>
+
+/* Converts interleaved signed 16 bit frames (in machine endianness)
+   from one rate to another with a polyphase windowed-sinc filter, so
+   that the mixer can run at a rate other than the one of the device.
+
+   The caller asks how many input frames are needed for the next
+   block of output, writes them and then reads the block. The filter
+   only looks at the last resample_history() frames written before a
+   block is read; the ones before may be skipped (written as NULL) if
+   the output is skipped, too. */
+
+typedef struct resample resample;
+
+resample *    resample_new            (int channels,
+				       guint32 inrate,
+				       guint32 outrate);
+void          resample_free           (resample *r);
+
+/* Clears the history, as if only silence had been written */
+void          resample_reset          (resample *r);
+
+guint32       resample_inrate         (resample *r);
+guint32       resample_outrate        (resample *r);
+int           resample_channels       (resample *r);
+
+/* Number of input frames to write before 'frames' output frames can
+   be read */
+guint32       resample_needed         (resample *r,
+				       guint32 frames);
+
+/* Number of input frames the filter uses for one output frame */
+guint32       resample_history        (resample *r);
+
+/* src may be NULL for silence */
+void          resample_write          (resample *r,
+				       const gint16 *src,
+				       guint32 frames);
+
+/* dest may be NULL to skip the output */
+void          resample_read           (resample *r,
+				       gint16 *dest,
+				       guint32 frames);
+
+#endif /* _RESAMPLE_H */
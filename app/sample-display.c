@@ -146,6 +146,17 @@ sample_display_set_data_16 (SampleDisplay *s,
     sample_display_set_data(s, data, 16, len, copy);
 }
 
+/* data holds len pairs of the lowest and the highest value in some
+   stretch of time, as the oscilloscopes get them from the mixer */
+void
+sample_display_set_data_minmax (SampleDisplay *s,
+				gint16 *data,
+				int len,
+				gboolean copy)
+{
+    sample_display_set_data(s, data, 32, len, copy);
+}
+
 void
 sample_display_set_data_8 (SampleDisplay *s,
 			   gint8 *data,
@@ -352,7 +363,33 @@ sample_display_draw_data (GdkDrawable *win,
 
     gc = color ? s->bg_gc : s->fg_gc;
 
-    if(s->datatype == 16) {
+    if(s->datatype == 32) {
+	/* Each column gets a vertical line over the range of the pairs
+	   falling into it, extended to meet the previous column */
+	const gint16 *p = s->data;
+	gint32 lo, hi, plo, phi;
+	int o, oe;
+
+	o = OFFSET_RANGE(s->datalen, XPOS_TO_OFFSET(x - 1));
+	plo = p[2 * o];
+	phi = p[2 * o + 1];
+
+	for(; width > 0; x++, width--) {
+	    o = OFFSET_RANGE(s->datalen, XPOS_TO_OFFSET(x));
+	    oe = MIN(s->datalen, XPOS_TO_OFFSET(x + 1));
+	    lo = p[2 * o];
+	    hi = p[2 * o + 1];
+	    for(o++; o < oe; o++) {
+		lo = MIN(lo, p[2 * o]);
+		hi = MAX(hi, p[2 * o + 1]);
+	    }
+	    gdk_draw_line(win, gc,
+			  x, ((32767 - MAX(hi, plo)) * sh) >> 16,
+			  x, ((32767 - MIN(lo, phi)) * sh) >> 16);
+	    plo = lo;
+	    phi = hi;
+	}
+    } else if(s->datatype == 16) {
 	c = ((gint16*)s->data)[OFFSET_RANGE(s->datalen, XPOS_TO_OFFSET(x - 1))];
 	
 	while(width >= 0) {
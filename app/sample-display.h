@@ -92,6 +92,7 @@ GtkWidget*     sample_display_new                 (gboolean edit);
 
 void           sample_display_set_data_16         (SampleDisplay *s, gint16 *data, int len, gboolean copy);
 void           sample_display_set_data_8          (SampleDisplay *s, gint8 *data, int len, gboolean copy);
+void           sample_display_set_data_minmax     (SampleDisplay *s, gint16 *data, int len, gboolean copy);
 void           sample_display_set_loop            (SampleDisplay *s, int start, int end);
 void           sample_display_set_selection       (SampleDisplay *s, int start, int end);
 void           sample_display_set_mixer_position  (SampleDisplay *s, int offset);
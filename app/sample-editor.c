@@ -62,6 +62,8 @@
 #include "file-operations.h"
 #include "gui-settings.h"
 #include "xm.h"
+#include "sample-import.h"
+#include "frame-clock.h"
 
 // == GUI variables
 
@@ -100,13 +102,6 @@ static gfloat threshold = -50.0;
 // = Load sample dialog
 
 #if USE_SNDFILE || !defined (NO_AUDIOFILE)
-enum {
-    MODE_MONO = 0,
-    MODE_STEREO_LEFT,
-    MODE_STEREO_RIGHT,
-    MODE_STEREO_MIX
-};
-
 static gboolean wavload_through_library;
 
 static GtkWidget *wavload_dialog;
@@ -123,6 +118,11 @@ static AFframecount wavload_frameCount;
 
 static int wavload_sampleWidth, wavload_channelCount, wavload_endianness, wavload_unsignedwords;
 static long wavload_rate;
+static sample_import_format wavload_format;
+static FILE *wavload_raw_file;
+
+static sample_import *wavload_import;
+static GtkWidget *wavload_progress_dialog, *wavload_progress_bar;
 
 static const gchar *wavload_filename;
 static GtkWidget *wavload_raw_resolution_w[2];
@@ -164,9 +164,9 @@ static STSample copybuffer_sampleinfo;
 // = Realtime stuff
 
 static int update_freq = 50;
-static int gtktimer = -1;
 
 static void sample_editor_ok_clicked(void);
+static void sample_editor_update_mixer_position(double songtime, gpointer data);
 static void sample_editor_start_sampling_clicked(void);
 
 static void sample_editor_spin_volume_changed(GtkSpinButton *spin);
@@ -226,6 +226,21 @@ sample_editor_unlock_sample (void)
     g_mutex_unlock(current_sample->sample.lock);
 }
 
+/* Before the sample data is changed in place it has to be separated
+   from a module that is being saved in the background. The sample
+   must be locked; it is unlocked if this fails. */
+static gboolean
+sample_editor_unshare_sample (void)
+{
+    if(!st_sample_data_unshare(&current_sample->sample)) {
+	sample_editor_unlock_sample();
+	error_error(_("Out of memory for changing the sample."));
+	return FALSE;
+    }
+
+    return TRUE;
+}
+
 void
 sample_editor_page_create (GtkNotebook *nb)
 {
@@ -257,6 +272,7 @@ sample_editor_page_create (GtkNotebook *nb)
     g_signal_connect(thing, "window_changed",
 		       G_CALLBACK(sample_editor_display_window_changed), NULL);
     sampledisplay = SAMPLE_DISPLAY(thing);
+    frame_clock_add_view(sample_editor_update_mixer_position, NULL, thing, update_freq);
     sample_display_enable_zero_line(SAMPLE_DISPLAY(thing), TRUE);
 
     sample_editor_hscrollbar = gtk_hscrollbar_new(NULL);
@@ -596,6 +612,33 @@ sample_editor_blocked_set_display_loop (int start,
     gtk_signal_handler_unblock_by_func(GTK_OBJECT(sampledisplay), GTK_SIGNAL_FUNC(sample_editor_display_loop_changed), NULL);
 }
 
+/* Samples loaded with 8 bits are stored like that; the editor only
+   works on 16 bit data, so they are converted when they get shown
+   here for the first time. Returns FALSE if there is no memory for
+   that; the sample stays as it is then, and can't be edited. */
+static gboolean
+sample_editor_make_16bit (STSample *sts)
+{
+    gboolean ok;
+
+    if(!sts || !sts->sample.data || sts->sample.format == ST_MIXER_SAMPLE_FORMAT_16BIT) {
+	return TRUE;
+    }
+
+    g_mutex_lock(sts->sample.lock);
+    ok = st_sample_make_16bit(&sts->sample);
+    if(ok) {
+	mixer->updatesample(&sts->sample);
+    }
+    g_mutex_unlock(sts->sample.lock);
+
+    if(!ok) {
+	error_error(_("Out of memory for converting the sample to 16 bits."));
+    }
+
+    return ok;
+}
+
 void
 sample_editor_update (void)
 {
@@ -603,10 +646,11 @@ sample_editor_update (void)
     st_mixer_sample_info *s;
     char buf[20];
     int m = xm_get_modified();
+    gboolean editable = sample_editor_make_16bit(sts);
 
     sample_display_set_data_16(sampledisplay, NULL, 0, FALSE);
 
-    if(!sts || !sts->sample.data) {
+    if(!sts || !sts->sample.data || !editable) {
 	gtk_widget_set_sensitive(se->vertical_boxes[0], FALSE);
 	gtk_widget_set_sensitive(se->vertical_boxes[1], FALSE);
 	gtk_widget_set_sensitive(se->vertical_boxes[2], FALSE);
@@ -639,7 +683,7 @@ sample_editor_update (void)
     
     sample_editor_set_selection_label(-1, 0);
 
-    if(s->data) {
+    if(s->data && editable) {
 	sample_display_set_data_16(sampledisplay, s->data, s->length, FALSE);
 
 	if(s->looptype != ST_MIXER_SAMPLE_LOOPTYPE_NONE) {
@@ -698,7 +742,8 @@ sample_editor_set_sample (STSample *s)
 }
 
 static void
-sample_editor_update_mixer_position (double songtime)
+sample_editor_update_mixer_position (double songtime,
+				     gpointer data)
 {
     audio_mixer_position *p;
     int i;
@@ -715,40 +760,6 @@ sample_editor_update_mixer_position (double songtime)
     sample_display_set_mixer_position(sampledisplay, -1);
 }
 
-static gint
-sample_editor_update_timeout (gpointer data)
-{
-    double display_songtime = current_driver->get_play_time(current_driver_object);
-
-    sample_editor_update_mixer_position(display_songtime);
-
-    // Not quite the right place for this, but anyway...
-    gui_clipping_indicator_update(display_songtime);
-
-    return TRUE;
-}
-
-void
-sample_editor_start_updating (void)
-{
-    if(gtktimer != -1)
-	return;
-
-    gtktimer = gtk_timeout_add(1000 / update_freq, sample_editor_update_timeout, NULL);
-}
-
-void
-sample_editor_stop_updating (void)
-{
-    if(gtktimer == -1)
-	return;
-
-    gtk_timeout_remove(gtktimer);
-    gtktimer = -1;
-    gui_clipping_indicator_update(-1.0);
-    sample_editor_update_mixer_position(-1.0);
-}
-
 static void
 sample_editor_spin_volume_changed (GtkSpinButton *spin)
 {
@@ -947,7 +958,12 @@ sample_editor_resolution_changed (void)
 
     s = &sts->sample;
     if(n == 0 && !sts->treat_as_8bit) {
+	sample_editor_lock_sample();
+	if(!sample_editor_unshare_sample()) {
+	    return;
+	}
 	st_sample_cutoff_lowest_8_bits(s->data, s->length);
+	sample_editor_unlock_sample();
     }
 
     sts->treat_as_8bit = (n == 0);
@@ -1101,7 +1117,7 @@ sample_editor_copy_cut_common (gboolean copy,
 	   oldsample->sample.data + se,
 	   (oldsample->sample.length - se) * 2);
 
-    free(oldsample->sample.data);
+    st_sample_data_unref(oldsample->sample.data);
 
     oldsample->sample.data = newsample;
     oldsample->sample.length = newlen;
@@ -1228,7 +1244,7 @@ sample_editor_paste_clicked (void)
 	   oldsample->sample.data + ss,
 	   (oldsample->sample.length - ss) * 2);
 
-    free(oldsample->sample.data);
+    st_sample_data_unref(oldsample->sample.data);
 
     oldsample->sample.data = newsample;
     oldsample->sample.length = newlen;
@@ -1253,6 +1269,9 @@ sample_editor_reverse_clicked (void)
     }
 
     sample_editor_lock_sample();
+    if(!sample_editor_unshare_sample()) {
+	return;
+    }
 
     p = q = current_sample->sample.data;
     p += ss;
@@ -1272,69 +1291,70 @@ sample_editor_reverse_clicked (void)
 
 #if USE_SNDFILE || !defined (NO_AUDIOFILE)
 
-static void
-sample_editor_load_wav_main (int mode)
-{ 
-    /* Initialized global variables:
-
-       wavload_through_library (TRUE or FALSE)
-       wavload_samplename     (the name the sample is going to get in the XM)
-       wavload_frameCount     (length of the file /stereo /16bits)
-
-       with audiofile:
-	 wavload_file;
-	 wavload_sampleWidth, wavload_channelCount;
-       without audiofile:
-         wavload_filename;
-	 wavload_sampleWidth, wavload_channelCount;
-	 wavload_endianness, wavload_unsignedwords;
-    */
-
-    void *sbuf, *sbuf_loadto;
+static int
+sample_editor_wavload_read (void *source,
+			    void *buf,
+			    int count)
+{
 #if USE_SNDFILE
-    sf_count_t len;
+    switch(wavload_format) {
+    case SAMPLE_IMPORT_FLOAT:
+	return sf_readf_float(source, buf, count);
+    case SAMPLE_IMPORT_S32:
+	return sf_readf_int(source, buf, count);
+    default:
+	return sf_readf_short(source, buf, count);
+    }
 #else
-    int len;
+    return afReadFrames(source, AF_DEFAULT_TRACK, buf, count);
 #endif
-    int i, count;
-    float rate;
-
-    statusbar_update(STATUS_LOADING_SAMPLE, TRUE);
-    
-    len = 2 * wavload_frameCount * wavload_channelCount;
-    if(!(sbuf = malloc(len))) {
-	error_error(_("Out of memory for sample data."));
-	goto errnobuf;
-    }
+}
 
-    if(wavload_sampleWidth == 16) {
-	sbuf_loadto = sbuf;
-    } else {
-	sbuf_loadto = sbuf + len / 2;
-    }
+static int
+sample_editor_wavload_read_raw (void *source,
+				void *buf,
+				int count)
+{
+    return fread(buf, wavload_channelCount * wavload_sampleWidth / 8, count, source);
+}
 
+static void
+sample_editor_wavload_close (void)
+{
     if(wavload_through_library) {
+	if(wavload_file) {
 #if USE_SNDFILE
-	if(wavload_frameCount != sf_readf_short(wavload_file, sbuf_loadto, wavload_frameCount)) {
+	    sf_close (wavload_file);
 #else
-	if(wavload_frameCount != afReadFrames(wavload_file, AF_DEFAULT_TRACK, sbuf_loadto, wavload_frameCount)) {
+	    afCloseFile(wavload_file);
 #endif
-	    error_error(_("Read error."));
-	    goto errnodata;
+	    wavload_file = NULL;
 	}
-    } else {
-	FILE *f = fopen(wavload_filename, "r");
-	if(!f)
-	    goto errnodata;
-	if(wavload_frameCount != fread(sbuf_loadto,
-				       wavload_channelCount * wavload_sampleWidth / 8,
-				       wavload_frameCount,
-				       f)) {
-	    fclose(f);
+    } else if(wavload_raw_file) {
+	fclose(wavload_raw_file);
+	wavload_raw_file = NULL;
+    }
+}
+
+static void
+sample_editor_wavload_finish (void)
+{
+    sample_import_status status;
+    gint16 *sbuf;
+    float rate;
+
+    status = sample_import_finish(wavload_import, &sbuf);
+    wavload_import = NULL;
+    gtk_widget_destroy(wavload_progress_dialog);
+    wavload_progress_dialog = NULL;
+
+    if(status != SAMPLE_IMPORT_OK) {
+	if(status == SAMPLE_IMPORT_READ_ERROR) {
 	    error_error(_("Read error."));
-	    goto errnodata;
 	}
-	fclose(f);
+	statusbar_update(STATUS_IDLE, FALSE);
+	sample_editor_wavload_close();
+	return;
     }
 
     sample_editor_lock_sample();
@@ -1346,7 +1366,6 @@ sample_editor_load_wav_main (int mode)
     // Initialize relnote and finetune such that sample is played in original speed
     if(wavload_through_library) {
 #if USE_SNDFILE
-	current_sample->treat_as_8bit = ((wavinfo.format & (SF_FORMAT_PCM_S8 | SF_FORMAT_PCM_U8)) != 0);
 	rate = wavinfo.samplerate;
 #else
 	rate = afGetRate(wavload_file, AF_DEFAULT_TRACK);
@@ -1359,105 +1378,177 @@ sample_editor_load_wav_main (int mode)
 				     &current_sample->relnote,
 				     &current_sample->finetune);
 
-    if(wavload_sampleWidth == 8) {
-	if(wavload_through_library || wavload_unsignedwords) {
-	    st_sample_8bit_signed_unsigned(sbuf_loadto, len / 2);
-	}
-	st_convert_sample(sbuf_loadto,
-			  sbuf,
-			  8,
-			  16,
-			  len / 2);
-    } else {
-	if(wavload_through_library) {
-	    // I think that is what the virtualByteOrder stuff is for.
-	    // le_16_array_to_host_order(sbuf, len / 2);
-	} else {
-#ifdef WORDS_BIGENDIAN
-	    if(wavload_endianness == 0) {
-#else
-	    if(wavload_endianness == 1) {
-#endif
-		byteswap_16_array(sbuf, len / 2);
-	    }
-	    if(wavload_unsignedwords) {
-		st_sample_16bit_signed_unsigned(sbuf_loadto, len / 2);
-	    }
-	}
-    }
-
-    if(mode != MODE_MONO) {
-	gint16 *a = sbuf, *b = sbuf;
-
-	count = wavload_frameCount;
-
-	/* Code could probably be made shorter. But this is readable. */
-	switch(mode) {
-	case MODE_STEREO_MIX:
-	    for(i = 0; i < count; i++, a+=2, b+=1)
-		*b = (a[0] + a[1]) / 2;
-	    break;
-	case MODE_STEREO_LEFT:
-	    for(i = 0; i < count; i++, a+=2, b+=1)
-		*b = a[0];
-	    break;
-	case MODE_STEREO_RIGHT:
-	    for(i = 0; i < count; i++, a+=2, b+=1)
-		*b = a[1];
-	    break;
-	default:
-	    g_assert_not_reached();
-	    break;
-	}
-    }
-
     sample_editor_unlock_sample();
 
     instrument_editor_update();
     sample_editor_update();
     xm_set_modified(1);
     statusbar_update(STATUS_SAMPLE_LOADED, FALSE);
-    goto errnobuf;
+    sample_editor_wavload_close();
+}
+
+static gint
+sample_editor_wavload_timeout (gpointer data)
+{
+    int permille = sample_import_progress(wavload_import);
+
+    if(permille >= 0) {
+	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(wavload_progress_bar), permille / 1000.0);
+	statusbar_update_progress(STATUS_LOADING_SAMPLE, permille / 10);
+	return TRUE;
+    }
+
+    sample_editor_wavload_finish();
+    return FALSE;
+}
+
+static void
+sample_editor_wavload_cancel (void)
+{
+    sample_import_cancel(wavload_import);
+}
+
+static gboolean
+sample_editor_wavload_progress_delete (void)
+{
+    // The window goes away once the import thread has noticed
+    sample_editor_wavload_cancel();
+    return TRUE;
+}
+
+static void
+sample_editor_open_wavload_progress_dialog (void)
+{
+    GtkWidget *window;
+    GtkWidget *button;
+    GtkWidget *box1;
+    GtkWidget *label;
+
+    window = gtk_dialog_new ();
+
+    wavload_progress_dialog = window;
+
+    g_signal_connect(window, "delete_event",
+			G_CALLBACK(sample_editor_wavload_progress_delete), NULL);
+
+    gtk_window_set_position (GTK_WINDOW(window), GTK_WIN_POS_CENTER);
+    gtk_window_set_title (GTK_WINDOW(window), _("Loading sample"));
+    gtk_window_set_modal(GTK_WINDOW(window), TRUE);
+    gtk_window_set_transient_for(GTK_WINDOW(window), GTK_WINDOW(mainwindow));
+
+    gtk_container_set_border_width (GTK_CONTAINER (window), 10);
+
+    box1 = gtk_vbox_new (FALSE, 4);
+
+    label = gtk_label_new (wavload_samplename);
+    gtk_box_pack_start (GTK_BOX (box1), label, FALSE, TRUE, 0);
+    gtk_widget_show (label);
+
+    wavload_progress_bar = gtk_progress_bar_new ();
+    gtk_box_pack_start (GTK_BOX (box1), wavload_progress_bar, FALSE, TRUE, 0);
+    gtk_widget_show (wavload_progress_bar);
+
+    button = gtk_button_new_with_label (_("Cancel"));
+    g_signal_connect(button, "clicked",
+			G_CALLBACK(sample_editor_wavload_cancel), NULL);
+    gtk_box_pack_start (GTK_BOX (box1), button, FALSE, FALSE, 0);
+    gtk_widget_show (button);
+
+    gtk_container_add (GTK_CONTAINER (window), box1);
+
+    gtk_widget_show (box1);
+    gtk_widget_show (window);
+}
+
+static void
+sample_editor_load_wav_main (int mode)
+{ 
+    /* Initialized global variables:
+
+       wavload_through_library (TRUE or FALSE)
+       wavload_samplename     (the name the sample is going to get in the XM)
+       wavload_frameCount     (length of the file /stereo /16bits)
+
+       with audiofile or sndfile:
+	 wavload_file;
+	 wavload_format, wavload_sampleWidth, wavload_channelCount;
+       without:
+         wavload_filename;
+	 wavload_sampleWidth, wavload_channelCount;
+	 wavload_endianness, wavload_unsignedwords;
+
+       The file is read and converted by a thread of its own, see
+       sample-import.c; sample_editor_wavload_finish() takes over.
+    */
+
+    sample_import_read_func read;
+    void *source;
+    gboolean swapped;
 
-  errnodata:
-    statusbar_update(STATUS_IDLE, FALSE);
-    free(sbuf);
-  errnobuf:
     if(wavload_through_library) {
-#if USE_SNDFILE
-	sf_close (wavload_file);
+	read = sample_editor_wavload_read;
+	source = wavload_file;
+    } else {
+	if(!(wavload_raw_file = fopen(wavload_filename, "r"))) {
+	    error_error(_("Can't read sample"));
+	    return;
+	}
+	read = sample_editor_wavload_read_raw;
+	source = wavload_raw_file;
+
+#ifdef WORDS_BIGENDIAN
+	swapped = wavload_endianness == 0;
 #else
-	afCloseFile(wavload_file);
+	swapped = wavload_endianness == 1;
 #endif
-	wavload_file = NULL;
+	if(wavload_sampleWidth == 8) {
+	    wavload_format = wavload_unsignedwords ? SAMPLE_IMPORT_U8 : SAMPLE_IMPORT_S8;
+	} else if(wavload_unsignedwords) {
+	    wavload_format = swapped ? SAMPLE_IMPORT_U16_SWAPPED : SAMPLE_IMPORT_U16;
+	} else {
+	    wavload_format = swapped ? SAMPLE_IMPORT_S16_SWAPPED : SAMPLE_IMPORT_S16;
+	}
     }
+
+    wavload_import = sample_import_start(read, source, wavload_format,
+					 wavload_channelCount, mode, wavload_frameCount);
+    if(!wavload_import) {
+	error_error(_("Out of memory for sample data."));
+	sample_editor_wavload_close();
+	return;
+    }
+
+    statusbar_update(STATUS_LOADING_SAMPLE, TRUE);
+    sample_editor_open_wavload_progress_dialog();
+    gtk_timeout_add(100, sample_editor_wavload_timeout, NULL);
 }
 
 static void
 sample_editor_wavload_dialog_hide (GtkWidget *widget)
 {
     gtk_widget_destroy(wavload_dialog);
+    sample_editor_wavload_close();
 }
 
 static void
 sample_editor_wavload_dialog_left (GtkWidget *widget)
 {
     gtk_widget_destroy(wavload_dialog);
-    sample_editor_load_wav_main(MODE_STEREO_LEFT);
+    sample_editor_load_wav_main(SAMPLE_IMPORT_LEFT);
 }
 
 static void
 sample_editor_wavload_dialog_mix (GtkWidget *widget)
 {
     gtk_widget_destroy(wavload_dialog);
-    sample_editor_load_wav_main(MODE_STEREO_MIX);
+    sample_editor_load_wav_main(SAMPLE_IMPORT_MIX);
 }
 
 static void
 sample_editor_wavload_dialog_right (GtkWidget *widget)
 {
     gtk_widget_destroy(wavload_dialog);
-    sample_editor_load_wav_main(MODE_STEREO_RIGHT);
+    sample_editor_load_wav_main(SAMPLE_IMPORT_RIGHT);
 }
 
 static void
@@ -1559,7 +1650,7 @@ sample_editor_raw_sample_dialog_ok (GtkWidget *widget)
 	wavload_frameCount /= 2;
 	sample_editor_open_stereowav_dialog();
     } else {
-	sample_editor_load_wav_main(MODE_MONO);
+	sample_editor_load_wav_main(SAMPLE_IMPORT_MONO);
     }
 }
 
@@ -1770,13 +1861,47 @@ sample_editor_load_wav (void)
 #if USE_SNDFILE
 
     wavload_channelCount = wavinfo.channels;
-    wavload_sampleWidth = 16;
+    switch(wavinfo.format & SF_FORMAT_SUBMASK) {
+    case SF_FORMAT_PCM_S8:
+    case SF_FORMAT_PCM_U8:
+	wavload_sampleWidth = 8;
+	wavload_format = SAMPLE_IMPORT_S16;
+	break;
+    case SF_FORMAT_PCM_16:
+	wavload_sampleWidth = 16;
+	wavload_format = SAMPLE_IMPORT_S16;
+	break;
+    case SF_FORMAT_FLOAT:
+    case SF_FORMAT_DOUBLE:
+	wavload_sampleWidth = 16;
+	wavload_format = SAMPLE_IMPORT_FLOAT;
+	break;
+    default:
+	// 24 and 32 bit, and the compressed formats
+	wavload_sampleWidth = 16;
+	wavload_format = SAMPLE_IMPORT_S32;
+	break;
+    }
     
 #else
 
     wavload_channelCount = afGetChannels(wavload_file, AF_DEFAULT_TRACK);
     afGetSampleFormat(wavload_file, AF_DEFAULT_TRACK, &sampleFormat, &wavload_sampleWidth);
 
+    if(wavload_sampleWidth == 8) {
+	wavload_format = SAMPLE_IMPORT_U8;
+    } else if(sampleFormat == AF_SAMPFMT_FLOAT || sampleFormat == AF_SAMPFMT_DOUBLE) {
+	afSetVirtualSampleFormat(wavload_file, AF_DEFAULT_TRACK, AF_SAMPFMT_FLOAT, 32);
+	wavload_format = SAMPLE_IMPORT_FLOAT;
+    } else if(wavload_sampleWidth == 16) {
+	afSetVirtualSampleFormat(wavload_file, AF_DEFAULT_TRACK, AF_SAMPFMT_TWOSCOMP, 16);
+	wavload_format = SAMPLE_IMPORT_S16;
+    } else {
+	afSetVirtualSampleFormat(wavload_file, AF_DEFAULT_TRACK, AF_SAMPFMT_TWOSCOMP, 32);
+	wavload_format = SAMPLE_IMPORT_S32;
+	wavload_sampleWidth = 16;
+    }
+
     /* I think audiofile-0.1.7 does this automatically, but I'm not sure */
 #ifdef WORDS_BIGENDIAN
     afSetVirtualByteOrder(wavload_file, AF_DEFAULT_TRACK, AF_BYTEORDER_BIGENDIAN);
@@ -1787,13 +1912,13 @@ sample_editor_load_wav (void)
 #endif
 
 
-    if((wavload_sampleWidth != 16 && wavload_sampleWidth != 8) || wavload_channelCount > 2) {
-	error_error(_("Can only handle 8 and 16 bit samples with up to 2 channels"));
+    if(wavload_channelCount > 2) {
+	error_error(_("Can only handle samples with up to 2 channels"));
 	goto errwrongformat;
     }
 
     if(wavload_channelCount == 1) {
-	sample_editor_load_wav_main(MODE_MONO);
+	sample_editor_load_wav_main(SAMPLE_IMPORT_MONO);
     } else {
 	sample_editor_open_stereowav_dialog();
     }
@@ -2088,6 +2213,9 @@ sample_editor_monitor_clicked (void)
 
     gtk_widget_show (samplingwindow);
 
+    // The idle editing output may be blocking the sound card
+    gui_release_device();
+
     if(!sampling_driver->common.open(sampling_driver_object)) {
 	sample_editor_stop_sampling();
     }
@@ -2384,6 +2512,9 @@ sample_editor_perform_ramp (GtkWidget *w,
 
     // Now perform the actual operation
     sample_editor_lock_sample();
+    if(!sample_editor_unshare_sample()) {
+	return;
+    }
 
     p = current_sample->sample.data;
     p += ss;
@@ -2691,7 +2822,7 @@ sample_editor_delete (STSample *sample,int start, int end)
     memcpy(newdata, sample->sample.data, start * 2);
     memcpy(newdata + start, sample->sample.data + end, (sample->sample.length - end) * 2);
 
-    free(sample->sample.data);
+    st_sample_data_unref(sample->sample.data);
 
     sample->sample.data = newdata;
     sample->sample.length = newlen;
@@ -39,8 +39,6 @@ void         sample_editor_update                    (void);
 
 void         sample_editor_stop_sampling             (void);
 
-void         sample_editor_start_updating            (void);
-void         sample_editor_stop_updating             (void);
 
 void	     sample_editor_copy_cut_common	     (gboolean copy, gboolean spliceout);
 void	     sample_editor_paste_clicked	     (void);
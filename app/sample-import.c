@@ -0,0 +1,481 @@
+/*
+ * The Real SoundTracker - streaming sample import
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* Each chunk is first brought to 16 bit in a small buffer, then the
+   channel is picked or the two are mixed into the sample itself; mono
+   files are converted into the sample directly, and 16 bit mono ones
+   are even read right into it. The conversions have SSE2 and NEON
+   versions, which compute exactly the same as the C loops doing the
+   rest of each chunk. */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sample-import.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#define CHUNK_FRAMES 8192
+
+struct sample_import {
+    sample_import_read_func read;
+    void *source;
+    sample_import_format format;
+    int channels;
+    sample_import_mode mode;
+    guint32 length;
+
+    gint16 *data;       // the sample
+    void *readbuf;      // a chunk as it is in the file
+    gint16 *tmpbuf;     // a stereo chunk in 16 bit
+
+    GThread *thread;
+    gint done;          // frames
+    gint cancelled;
+    gint finished;
+    sample_import_status status;
+};
+
+static int
+format_size (sample_import_format format)
+{
+    switch(format) {
+    case SAMPLE_IMPORT_S8:
+    case SAMPLE_IMPORT_U8:
+	return 1;
+    case SAMPLE_IMPORT_S32:
+    case SAMPLE_IMPORT_FLOAT:
+	return 4;
+    default:
+	return 2;
+    }
+}
+
+static void
+convert_8 (gint16 *dest,
+	   const gint8 *src,
+	   gboolean is_unsigned,
+	   int count)
+{
+    const gint8 flip = is_unsigned ? -128 : 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vflip = _mm_set1_epi8(flip);
+    __m128i s;
+
+    for(; count >= 16; count -= 16) {
+	s = _mm_xor_si128(_mm_loadu_si128((__m128i*)src), vflip);
+	_mm_storeu_si128((__m128i*)dest, _mm_unpacklo_epi8(zero, s));
+	_mm_storeu_si128((__m128i*)dest + 1, _mm_unpackhi_epi8(zero, s));
+	src += 16;
+	dest += 16;
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const int8x16_t vflip = vdupq_n_s8(flip);
+    int8x16_t s;
+
+    for(; count >= 16; count -= 16) {
+	s = veorq_s8(vld1q_s8(src), vflip);
+	vst1q_s16(dest, vshll_n_s8(vget_low_s8(s), 8));
+	vst1q_s16(dest + 8, vshll_n_s8(vget_high_s8(s), 8));
+	src += 16;
+	dest += 16;
+    }
+#endif
+
+    for(; count; count--) {
+	*dest++ = (gint8)(*src++ ^ flip) * 256;
+    }
+}
+
+static void
+convert_16 (gint16 *dest,
+	    const gint16 *src,
+	    gboolean is_unsigned,
+	    gboolean swapped,
+	    int count)
+{
+    const guint16 flip = is_unsigned ? 0x8000 : 0;
+    guint16 v;
+#if defined(__SSE2__)
+    const __m128i vflip = _mm_set1_epi16(flip);
+    __m128i s;
+
+    for(; count >= 8; count -= 8) {
+	s = _mm_loadu_si128((__m128i*)src);
+	if(swapped) {
+	    s = _mm_or_si128(_mm_slli_epi16(s, 8), _mm_srli_epi16(s, 8));
+	}
+	_mm_storeu_si128((__m128i*)dest, _mm_xor_si128(s, vflip));
+	src += 8;
+	dest += 8;
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const uint16x8_t vflip = vdupq_n_u16(flip);
+    uint16x8_t s;
+
+    for(; count >= 8; count -= 8) {
+	s = vld1q_u16((const guint16*)src);
+	if(swapped) {
+	    s = vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(s)));
+	}
+	vst1q_u16((guint16*)dest, veorq_u16(s, vflip));
+	src += 8;
+	dest += 8;
+    }
+#endif
+
+    for(; count; count--) {
+	v = *src++;
+	if(swapped) {
+	    v = (v << 8) | (v >> 8);
+	}
+	*dest++ = v ^ flip;
+    }
+}
+
+static void
+convert_32 (gint16 *dest,
+	    const gint32 *src,
+	    int count)
+{
+#if defined(__SSE2__)
+    __m128i a, b;
+
+    for(; count >= 8; count -= 8) {
+	a = _mm_srai_epi32(_mm_loadu_si128((__m128i*)src), 16);
+	b = _mm_srai_epi32(_mm_loadu_si128((__m128i*)src + 1), 16);
+	_mm_storeu_si128((__m128i*)dest, _mm_packs_epi32(a, b));
+	src += 8;
+	dest += 8;
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for(; count >= 8; count -= 8) {
+	vst1q_s16(dest, vcombine_s16(vshrn_n_s32(vld1q_s32(src), 16),
+				     vshrn_n_s32(vld1q_s32(src + 4), 16)));
+	src += 8;
+	dest += 8;
+    }
+#endif
+
+    for(; count; count--) {
+	*dest++ = *src++ >> 16;
+    }
+}
+
+/* Clipped, and rounded half away from zero */
+static void
+convert_float (gint16 *dest,
+	       const float *src,
+	       int count)
+{
+    float v;
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    const __m128 lo = _mm_set1_ps(-32768.0f), hi = _mm_set1_ps(32767.0f);
+    const __m128 half = _mm_set1_ps(0.5f), sign = _mm_set1_ps(-0.0f);
+    __m128 f;
+    __m128i a, b;
+
+    for(; count >= 8; count -= 8) {
+	f = _mm_mul_ps(_mm_loadu_ps(src), scale);
+	f = _mm_min_ps(_mm_max_ps(f, lo), hi); // NaN becomes lo, too
+	a = _mm_cvttps_epi32(_mm_add_ps(f, _mm_or_ps(_mm_and_ps(f, sign), half)));
+	f = _mm_mul_ps(_mm_loadu_ps(src + 4), scale);
+	f = _mm_min_ps(_mm_max_ps(f, lo), hi);
+	b = _mm_cvttps_epi32(_mm_add_ps(f, _mm_or_ps(_mm_and_ps(f, sign), half)));
+	_mm_storeu_si128((__m128i*)dest, _mm_packs_epi32(a, b));
+	src += 8;
+	dest += 8;
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const float32x4_t lo = vdupq_n_f32(-32768.0f), hi = vdupq_n_f32(32767.0f);
+    const uint32x4_t half = vreinterpretq_u32_f32(vdupq_n_f32(0.5f));
+    const uint32x4_t sign = vdupq_n_u32(0x80000000);
+    float32x4_t f;
+    int32x4_t a, b;
+
+    for(; count >= 8; count -= 8) {
+	// Not vmaxq_f32(), that keeps NaN, which becomes 0
+	f = vmulq_n_f32(vld1q_f32(src), 32767.0f);
+	f = vminq_f32(vbslq_f32(vcgeq_f32(f, lo), f, lo), hi);
+	f = vaddq_f32(f, vreinterpretq_f32_u32(vorrq_u32(vandq_u32(vreinterpretq_u32_f32(f), sign), half)));
+	a = vcvtq_s32_f32(f);
+	f = vmulq_n_f32(vld1q_f32(src + 4), 32767.0f);
+	f = vminq_f32(vbslq_f32(vcgeq_f32(f, lo), f, lo), hi);
+	f = vaddq_f32(f, vreinterpretq_f32_u32(vorrq_u32(vandq_u32(vreinterpretq_u32_f32(f), sign), half)));
+	b = vcvtq_s32_f32(f);
+	vst1q_s16(dest, vcombine_s16(vmovn_s32(a), vmovn_s32(b)));
+	src += 8;
+	dest += 8;
+    }
+#endif
+
+    for(; count; count--) {
+	v = *src++ * 32767.0f;
+	if(!(v >= -32768.0f)) {
+	    v = -32768.0f;
+	} else if(v > 32767.0f) {
+	    v = 32767.0f;
+	}
+	*dest++ = v < 0 ? v - 0.5f : v + 0.5f;
+    }
+}
+
+static void
+convert_to_16 (gint16 *dest,
+	       const void *src,
+	       sample_import_format format,
+	       int count)
+{
+    switch(format) {
+    case SAMPLE_IMPORT_S8:
+    case SAMPLE_IMPORT_U8:
+	convert_8(dest, src, format == SAMPLE_IMPORT_U8, count);
+	break;
+    case SAMPLE_IMPORT_S16:
+	memcpy(dest, src, 2 * count);
+	break;
+    case SAMPLE_IMPORT_U16:
+    case SAMPLE_IMPORT_S16_SWAPPED:
+    case SAMPLE_IMPORT_U16_SWAPPED:
+	convert_16(dest, src,
+		   format != SAMPLE_IMPORT_S16_SWAPPED,
+		   format != SAMPLE_IMPORT_U16,
+		   count);
+	break;
+    case SAMPLE_IMPORT_S32:
+	convert_32(dest, src, count);
+	break;
+    case SAMPLE_IMPORT_FLOAT:
+	convert_float(dest, src, count);
+	break;
+    }
+}
+
+/* Stereo to mono; mixing divides like C does, rounding towards zero */
+static void
+mixdown (gint16 *dest,
+	 const gint16 *src,
+	 sample_import_mode mode,
+	 int frames)
+{
+#if defined(__SSE2__)
+    __m128i a, b, la, lb, ra, rb;
+
+    for(; frames >= 8; frames -= 8) {
+	a = _mm_loadu_si128((__m128i*)src);
+	b = _mm_loadu_si128((__m128i*)src + 1);
+	la = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+	lb = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+	ra = _mm_srai_epi32(a, 16);
+	rb = _mm_srai_epi32(b, 16);
+	if(mode == SAMPLE_IMPORT_LEFT) {
+	    a = la;
+	    b = lb;
+	} else if(mode == SAMPLE_IMPORT_RIGHT) {
+	    a = ra;
+	    b = rb;
+	} else {
+	    a = _mm_add_epi32(la, ra);
+	    b = _mm_add_epi32(lb, rb);
+	    a = _mm_srai_epi32(_mm_add_epi32(a, _mm_srli_epi32(a, 31)), 1);
+	    b = _mm_srai_epi32(_mm_add_epi32(b, _mm_srli_epi32(b, 31)), 1);
+	}
+	_mm_storeu_si128((__m128i*)dest, _mm_packs_epi32(a, b));
+	src += 16;
+	dest += 8;
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    int16x8x2_t s;
+    int32x4_t a, b;
+
+    for(; frames >= 8; frames -= 8) {
+	s = vld2q_s16(src);
+	if(mode == SAMPLE_IMPORT_LEFT) {
+	    vst1q_s16(dest, s.val[0]);
+	} else if(mode == SAMPLE_IMPORT_RIGHT) {
+	    vst1q_s16(dest, s.val[1]);
+	} else {
+	    a = vaddl_s16(vget_low_s16(s.val[0]), vget_low_s16(s.val[1]));
+	    b = vaddl_s16(vget_high_s16(s.val[0]), vget_high_s16(s.val[1]));
+	    a = vaddq_s32(a, vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(a), 31)));
+	    b = vaddq_s32(b, vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(b), 31)));
+	    vst1q_s16(dest, vcombine_s16(vshrn_n_s32(a, 1), vshrn_n_s32(b, 1)));
+	}
+	src += 16;
+	dest += 8;
+    }
+#endif
+
+    for(; frames; frames--, src += 2) {
+	switch(mode) {
+	case SAMPLE_IMPORT_LEFT:
+	    *dest++ = src[0];
+	    break;
+	case SAMPLE_IMPORT_RIGHT:
+	    *dest++ = src[1];
+	    break;
+	default:
+	    *dest++ = (src[0] + src[1]) / 2;
+	    break;
+	}
+    }
+}
+
+static gpointer
+sample_import_thread (gpointer data)
+{
+    sample_import *imp = data;
+    guint32 done = 0;
+    gint16 *out;
+    void *in;
+    int count, n;
+
+    imp->status = SAMPLE_IMPORT_OK;
+
+    while(done < imp->length) {
+	if(g_atomic_int_get(&imp->cancelled)) {
+	    imp->status = SAMPLE_IMPORT_CANCELLED;
+	    break;
+	}
+
+	count = MIN(imp->length - done, CHUNK_FRAMES);
+	out = imp->data + done;
+	if(imp->channels == 1 && imp->format == SAMPLE_IMPORT_S16) {
+	    in = out;
+	} else {
+	    in = imp->readbuf;
+	}
+
+	n = imp->read(imp->source, in, count);
+	if(n > 0) {
+	    if(imp->channels == 1) {
+		if(in != out) {
+		    convert_to_16(out, in, imp->format, n);
+		}
+	    } else if(imp->format == SAMPLE_IMPORT_S16) {
+		mixdown(out, in, imp->mode, n);
+	    } else {
+		convert_to_16(imp->tmpbuf, in, imp->format, 2 * n);
+		mixdown(out, imp->tmpbuf, imp->mode, n);
+	    }
+	    done += n;
+	    g_atomic_int_set(&imp->done, done);
+	}
+	if(n < count) {
+	    imp->status = SAMPLE_IMPORT_READ_ERROR;
+	    break;
+	}
+    }
+
+    g_atomic_int_set(&imp->finished, 1);
+    return NULL;
+}
+
+sample_import *
+sample_import_start (sample_import_read_func read,
+		     void *source,
+		     sample_import_format format,
+		     int channels,
+		     sample_import_mode mode,
+		     guint32 length)
+{
+    sample_import *imp;
+    gint16 *data;
+
+    g_return_val_if_fail(channels == 1 || channels == 2, NULL);
+
+    if(!(data = malloc(2 * length))) {
+	return NULL;
+    }
+
+    imp = g_new0(sample_import, 1);
+    imp->read = read;
+    imp->source = source;
+    imp->format = format;
+    imp->channels = channels;
+    imp->mode = channels == 1 ? SAMPLE_IMPORT_MONO : mode;
+    if(channels == 2 && mode == SAMPLE_IMPORT_MONO) {
+	imp->mode = SAMPLE_IMPORT_MIX;
+    }
+    imp->length = length;
+    imp->data = data;
+
+    imp->readbuf = g_malloc(CHUNK_FRAMES * channels * format_size(format));
+    if(channels == 2 && format != SAMPLE_IMPORT_S16) {
+	imp->tmpbuf = g_new(gint16, 2 * CHUNK_FRAMES);
+    }
+
+    imp->thread = g_thread_create(sample_import_thread, imp, TRUE, NULL);
+    if(!imp->thread) {
+	// Better late than never
+	sample_import_thread(imp);
+    }
+
+    return imp;
+}
+
+int
+sample_import_progress (sample_import *imp)
+{
+    if(g_atomic_int_get(&imp->finished)) {
+	return -1;
+    }
+
+    return (gint64)g_atomic_int_get(&imp->done) * 1000 / MAX(imp->length, 1);
+}
+
+void
+sample_import_cancel (sample_import *imp)
+{
+    g_atomic_int_set(&imp->cancelled, 1);
+}
+
+sample_import_status
+sample_import_finish (sample_import *imp,
+		      gint16 **data)
+{
+    sample_import_status status;
+
+    if(imp->thread) {
+	g_thread_join(imp->thread);
+    }
+
+    status = imp->status;
+    if(status == SAMPLE_IMPORT_OK) {
+	*data = imp->data;
+    } else {
+	free(imp->data);
+	*data = NULL;
+    }
+
+    g_free(imp->readbuf);
+    g_free(imp->tmpbuf);
+    g_free(imp);
+
+    return status;
+}
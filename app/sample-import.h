@@ -0,0 +1,83 @@
+/*
+ * The Real SoundTracker - streaming sample import (header)
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _SAMPLE_IMPORT_H
+#define _SAMPLE_IMPORT_H
+
+#include <glib.h>
+
+/* Reads sample data in chunks in a thread of its own and converts it
+   right into a mono 16 bit buffer of the final size, so that loading
+   long recordings neither blocks the GUI nor needs memory for the
+   whole file in its original format. */
+
+typedef enum sample_import_format {
+    SAMPLE_IMPORT_S8 = 0,
+    SAMPLE_IMPORT_U8,
+    SAMPLE_IMPORT_S16,          // host byte order
+    SAMPLE_IMPORT_U16,
+    SAMPLE_IMPORT_S16_SWAPPED,  // the other byte order
+    SAMPLE_IMPORT_U16_SWAPPED,
+    SAMPLE_IMPORT_S32,          // host byte order, 24 bit data in the upper bits
+    SAMPLE_IMPORT_FLOAT         // -1.0 .. 1.0
+} sample_import_format;
+
+typedef enum sample_import_mode {
+    SAMPLE_IMPORT_MONO = 0,
+    SAMPLE_IMPORT_LEFT,
+    SAMPLE_IMPORT_RIGHT,
+    SAMPLE_IMPORT_MIX
+} sample_import_mode;
+
+typedef enum sample_import_status {
+    SAMPLE_IMPORT_OK = 0,
+    SAMPLE_IMPORT_CANCELLED,
+    SAMPLE_IMPORT_READ_ERROR
+} sample_import_status;
+
+/* Reads up to 'count' frames into 'buf'; returns the number of frames
+   read, less than 'count' only at the end of the file or on errors.
+   Called from the import thread. */
+typedef int (*sample_import_read_func) (void *source,
+					void *buf,
+					int count);
+
+typedef struct sample_import sample_import;
+
+/* Starts importing 'length' frames with 1 or 2 channels. Returns NULL
+   if there is no memory for the sample. */
+sample_import *       sample_import_start     (sample_import_read_func read,
+					       void *source,
+					       sample_import_format format,
+					       int channels,
+					       sample_import_mode mode,
+					       guint32 length);
+
+/* Permille of the frames converted so far, or -1 once the thread is done */
+int                   sample_import_progress  (sample_import *imp);
+
+void                  sample_import_cancel    (sample_import *imp);
+
+/* Waits for the thread and frees the import. On success, the sample
+   data (malloc()ed) is returned in 'data', otherwise it is freed. */
+sample_import_status  sample_import_finish    (sample_import *imp,
+					       gint16 **data);
+
+#endif /* _SAMPLE_IMPORT_H */
@@ -0,0 +1,283 @@
+/*
+ * The Real SoundTracker - decimated oscilloscope capture
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+
+#include "scope-capture.h"
+#include "mixer.h"
+
+/* Sample values read per bucket at most (plus one). Voices playing
+   slower than the mixing frequency pass only a handful of sample
+   points per bucket anyway, so these are usually read completely. */
+#define SCOPE_CAPTURE_READS 8
+
+typedef struct scope_capture_channel {
+    guint32 pos;                /* frames of this block reported so far */
+    gint32 min, max;            /* of the current bucket, min > max if empty */
+} scope_capture_channel;
+
+static scope_capture_channel channels[32];
+
+static int step = 1;
+static guint32 phase;           /* frames of the current bucket before this block */
+
+static gint16 **bufs;
+static int bufoffset;
+static guint32 blocklength;
+
+void
+scope_capture_reset (void)
+{
+    int i;
+
+    phase = 0;
+    for(i = 0; i < 32; i++) {
+	channels[i].min = 1;
+	channels[i].max = 0;
+    }
+}
+
+void
+scope_capture_set_step (int frames)
+{
+    g_assert(frames >= 1);
+
+    step = frames;
+    scope_capture_reset();
+}
+
+int
+scope_capture_step (void)
+{
+    return step;
+}
+
+guint32
+scope_capture_frames (guint32 buckets)
+{
+    g_assert(buckets >= 1);
+
+    return buckets * step - phase;
+}
+
+guint32
+scope_capture_advance (guint32 frames)
+{
+    guint32 buckets = (phase + frames) / step;
+
+    phase = (phase + frames) % step;
+
+    return buckets;
+}
+
+void
+scope_capture_begin (gint16 *scopebufs[],
+		     int offset,
+		     guint32 count)
+{
+    int i;
+
+    bufs = scopebufs;
+    bufoffset = offset;
+    blocklength = count;
+
+    for(i = 0; i < 32; i++) {
+	channels[i].pos = 0;
+    }
+}
+
+/* Moves a channel on by n frames, which must not go past the end of
+   the current bucket, and writes the bucket out if it is complete */
+static void
+scope_capture_move (int channel,
+		    guint32 n)
+{
+    scope_capture_channel *c = &channels[channel];
+    gint16 *b;
+
+    c->pos += n;
+    if((phase + c->pos) % step) {
+	return;
+    }
+
+    b = bufs[channel] + 2 * (bufoffset + (phase + c->pos) / step - 1);
+    if(c->min > c->max) {
+	b[0] = b[1] = 0;
+    } else {
+	b[0] = CLAMP(c->min, -32768, 32767);
+	b[1] = CLAMP(c->max, -32768, 32767);
+    }
+    c->min = 1;
+    c->max = 0;
+}
+
+static inline guint32
+scope_capture_left (scope_capture_channel *c)
+{
+    return step - (phase + c->pos) % step;
+}
+
+static inline void
+scope_capture_merge (scope_capture_channel *c,
+		     gint32 min,
+		     gint32 max)
+{
+    if(c->min > c->max) {
+	c->min = min;
+	c->max = max;
+    } else {
+	c->min = MIN(c->min, min);
+	c->max = MAX(c->max, max);
+    }
+}
+
+static void
+scope_capture_silence (int channel,
+		       guint32 upto)
+{
+    scope_capture_channel *c = &channels[channel];
+    guint32 n;
+
+    while(c->pos < upto) {
+	n = MIN(upto - c->pos, scope_capture_left(c));
+	scope_capture_merge(c, 0, 0);
+	scope_capture_move(channel, n);
+    }
+}
+
+/* Lowest and highest value of n frames of a voice */
+static void
+scope_capture_range (const void *data,
+		     int format,
+		     guint32 frac,
+		     gint64 speed,
+		     guint32 n,
+		     gint32 *min,
+		     gint32 *max)
+{
+    gint64 last, lo, hi, stride, i;
+    gint32 v;
+
+    /* The voice moves linearly, so it passes all sample points
+       between the first and the last one it plays here */
+    last = ((gint64)frac + (n - 1) * speed) >> 32;
+    lo = MIN(last, 0);
+    hi = MAX(last, 0);
+    stride = (hi - lo + SCOPE_CAPTURE_READS - 1) / SCOPE_CAPTURE_READS;
+
+    *min = G_MAXINT;
+    *max = G_MININT;
+    for(i = lo; ; i = MIN(i + stride, hi)) {
+	if(format == ST_MIXER_SAMPLE_FORMAT_8BIT) {
+	    v = ((const gint8*)data)[i] << 8;
+	} else {
+	    v = ((const gint16*)data)[i];
+	}
+	*min = MIN(*min, v);
+	*max = MAX(*max, v);
+	if(i == hi) {
+	    break;
+	}
+    }
+}
+
+/* Merges values into the bucket of frame pos of this block, which has
+   been reported for the channel already */
+static void
+scope_capture_overlay (int channel,
+		       guint32 pos,
+		       gint32 min,
+		       gint32 max)
+{
+    scope_capture_channel *c = &channels[channel];
+    guint32 k = (phase + pos) / step;
+    gint16 *b;
+
+    if(k < (phase + c->pos) / step) {
+	// Written out already
+	b = bufs[channel] + 2 * (bufoffset + k);
+	b[0] = MIN(b[0], CLAMP(min, -32768, 32767));
+	b[1] = MAX(b[1], CLAMP(max, -32768, 32767));
+    } else {
+	scope_capture_merge(c, min, max);
+    }
+}
+
+void
+scope_capture_voice (int channel,
+		     guint32 start,
+		     guint32 frames,
+		     const void *data,
+		     int format,
+		     guint32 frac,
+		     gint64 speed,
+		     float amp)
+{
+    scope_capture_channel *c;
+    gint64 adv;
+    gint32 min, max;
+    guint32 n;
+
+    if(channel >= 32) {
+	return;
+    }
+
+    c = &channels[channel];
+    g_assert(start + frames <= blocklength);
+    scope_capture_silence(channel, start);
+
+    while(frames) {
+	n = MIN(frames, step - (phase + start) % step);
+	if(start < c->pos) {
+	    // Another voice of the channel has been here
+	    n = MIN(n, c->pos - start);
+	}
+
+	scope_capture_range(data, format, frac, speed, n, &min, &max);
+	if(start < c->pos) {
+	    scope_capture_overlay(channel, start, min * amp, max * amp);
+	} else {
+	    scope_capture_merge(c, min * amp, max * amp);
+	    scope_capture_move(channel, n);
+	}
+
+	start += n;
+	frames -= n;
+	if(frames) {
+	    adv = (gint64)frac + n * speed;
+	    if(format == ST_MIXER_SAMPLE_FORMAT_8BIT) {
+		data = (const gint8*)data + (adv >> 32);
+	    } else {
+		data = (const gint16*)data + (adv >> 32);
+	    }
+	    frac = adv & 0xffffffff;
+	}
+    }
+}
+
+void
+scope_capture_end (int numchannels)
+{
+    int i;
+
+    for(i = 0; i < numchannels; i++) {
+	scope_capture_silence(i, blocklength);
+    }
+}
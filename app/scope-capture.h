@@ -0,0 +1,83 @@
+/*
+ * The Real SoundTracker - decimated oscilloscope capture (header)
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _SCOPE_CAPTURE_H
+#define _SCOPE_CAPTURE_H
+
+#include <glib.h>
+
+/* The scopes can show a few hundred points at most, so the mixers
+   don't store every output frame of every voice for them. Instead,
+   each entry of a scope buffer covers a "bucket" of
+   scope_capture_step() frames and consists of two values, the lowest
+   and the highest one the voice had during that time.
+
+   The mixers run their plain mixing routines and afterwards report
+   each run of frames of a voice with scope_capture_voice(). The
+   values are taken from the sample data the voice has passed, reading
+   no more than a few points of it per bucket; interpolation and
+   filters are not taken into account.
+
+   Buckets may span several mix() calls. The caller of mix() decides
+   where to split blocks with scope_capture_frames() and moves on with
+   scope_capture_advance() after every call, whether the mixer was
+   given scope buffers or not. */
+
+void          scope_capture_set_step  (int frames);  /* also resets */
+int           scope_capture_step      (void);
+void          scope_capture_reset     (void);
+
+/* Number of frames that can be mixed until the given number of
+   buckets is complete */
+guint32       scope_capture_frames    (guint32 buckets);
+
+/* Moves on by the given number of frames; returns the number of
+   buckets completed */
+guint32       scope_capture_advance   (guint32 frames);
+
+/* --- For the mixers, inside mix(). Buckets completed in this call are
+   written to scopebufs[channel][2 * (offset + i)] (min) and
+   scopebufs[channel][2 * (offset + i) + 1] (max). */
+
+void          scope_capture_begin     (gint16 *scopebufs[],
+				       int offset,
+				       guint32 count);
+
+/* frames frames of a voice, starting at frame start of this block.
+   The runs of a voice are reported in order; a channel may have more
+   than one voice (one fading out the previous note, say), whose values
+   are merged into the same buckets. data points to the sample at the voice's position, frac
+   and speed are 32.32 fixed point (speed is negative when playing
+   backwards). format is one of ST_MIXER_SAMPLE_FORMAT_*, and the
+   sample values are multiplied by amp. Frames that are not reported
+   count as silence. */
+void          scope_capture_voice     (int channel,
+				       guint32 start,
+				       guint32 frames,
+				       const void *data,
+				       int format,
+				       guint32 frac,
+				       gint64 speed,
+				       float amp);
+
+/* Completes the buffers of channels 0 ... numchannels - 1 */
+void          scope_capture_end       (int numchannels);
+
+#endif /* _SCOPE_CAPTURE_H */
@@ -121,19 +121,29 @@ scope_group_enable_scopes (ScopeGroup *s,
     }
 }
 
-gint
-scope_group_timeout (ScopeGroup *s)
+static void
+scope_group_frame (double songtime,
+		   gpointer data)
 {
+    ScopeGroup *s = data;
     double time1, time2;
     int i, l;
     static gint16 *buf = NULL;
     static int bufsize = 0;
     int o1, o2;
 
-    if(!s->scopes_on || !scopebuf_ready || !current_driver)
-	return TRUE;
+    if(!s->scopes_on)
+	return;
+
+    if(songtime < 0.0) {
+	// Playing has stopped
+	goto ende;
+    }
+
+    if(!scopebuf_ready)
+	return;
 
-    time1 = current_driver->get_play_time(current_driver_object);
+    time1 = songtime;
     time2 = time1 + (double)1 / s->update_freq;
 
     for(i = 0; i < 2; i++) {
@@ -162,7 +172,7 @@ scope_group_timeout (ScopeGroup *s)
     l = o2 - o1;
     if(bufsize < l) {
 	free(buf);
-	buf = malloc(2 * l);
+	buf = malloc(4 * l);
 	bufsize = l;
     }
 
@@ -171,48 +181,23 @@ scope_group_timeout (ScopeGroup *s)
     g_assert(o1 >= 0 && o1 <= scopebuf_length);
     g_assert(o2 >= 0 && o2 <= scopebuf_length);
 
+    // Each entry is a pair of values, see audio.h
     for(i = 0; i < s->numchan; i++) {
 	if(o2 > o1) {
-	    sample_display_set_data_16(s->scopes[i], scopebufs[i] + o1, l, TRUE);
+	    sample_display_set_data_minmax(s->scopes[i], scopebufs[i] + 2 * o1, l, TRUE);
 	} else {
-	    memcpy(buf, scopebufs[i] + o1, 2 * (scopebuf_length - o1));
-	    memcpy(buf + scopebuf_length - o1, scopebufs[i], 2 * o2);
-	    sample_display_set_data_16(s->scopes[i], buf, l, TRUE);
+	    memcpy(buf, scopebufs[i] + 2 * o1, 4 * (scopebuf_length - o1));
+	    memcpy(buf + 2 * (scopebuf_length - o1), scopebufs[i], 4 * o2);
+	    sample_display_set_data_minmax(s->scopes[i], buf, l, TRUE);
 	}
     }
 
-    return TRUE;
+    return;
 
   ende:
     for(i = 0; i < s->numchan; i++) {
 	sample_display_set_data_8(s->scopes[i], NULL, 0, FALSE);
     }
-    return TRUE;
-}
-
-void
-scope_group_start_updating (ScopeGroup *s)
-{
-    if(!s->scopes_on || s->gtktimer != -1)
-	return;
-
-    s->gtktimer = gtk_timeout_add(1000/s->update_freq, (gint(*)())scope_group_timeout, s);
-}
-
-void
-scope_group_stop_updating (ScopeGroup *s)
-{
-    int i;
-
-    if(!s->scopes_on || s->gtktimer == -1)
-	return;
-
-    gtk_timeout_remove(s->gtktimer);
-    s->gtktimer = -1;
-
-    for(i = 0; i < s->numchan; i++) {
-	sample_display_set_data_8(s->scopes[i], NULL, 0, FALSE);
-    }
 }
 
 void
@@ -220,10 +205,7 @@ scope_group_set_update_freq (ScopeGroup *s,
 			     int freq)
 {
     s->update_freq = freq;
-    if(s->scopes_on && s->gtktimer != -1) {
-	scope_group_stop_updating(s);
-	scope_group_start_updating(s);
-    }
+    frame_clock_set_view_freq(s->view, freq);
 }
 
 static gint
@@ -274,7 +256,7 @@ scope_group_new (void)
     GTK_BOX(s)->homogeneous = FALSE;
     s->scopes_on = 0;
     s->update_freq = 40;
-    s->gtktimer = -1;
+    s->view = frame_clock_add_view(scope_group_frame, s, GTK_WIDGET(s), s->update_freq);
     s->numchan = 2;
     s->on_mask = 0xFFFFFFFF;
 
@@ -25,6 +25,7 @@
 #include <gtk/gtk.h>
 
 #include "sample-display.h"
+#include "frame-clock.h"
 
 #ifndef NO_GDK_PIXBUF
 #include <gdk-pixbuf/gdk-pixbuf.h>
@@ -50,7 +51,7 @@ struct _ScopeGroup
     int numchan;
     int scopes_on;
     int update_freq;
-    int gtktimer;
+    frame_clock_view *view;
     gint32 on_mask;
 };
 
@@ -76,12 +77,6 @@ scope_group_set_num_channels (ScopeGroup *s, int num_channels);
 void
 scope_group_enable_scopes (ScopeGroup *s, int enable);
 
-void
-scope_group_start_updating (ScopeGroup *s);
-
-void
-scope_group_stop_updating (ScopeGroup *s);
-
 void
 scope_group_set_update_freq (ScopeGroup *s, int freq);
 
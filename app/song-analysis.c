@@ -0,0 +1,244 @@
+/*
+ * The Real SoundTracker - song timing analysis
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* Timing only depends on the player, so the analysis runs nothing but
+   xmplayer_play(), with the global mixer temporarily replaced by one
+   that throws everything away -- just like tracer_trace() does. This
+   takes a few milliseconds even for long songs. */
+
+#include <config.h>
+
+#include "song-analysis.h"
+#include "audio.h"
+#include "xm.h"
+#include "main.h"
+#include "xm-player.h"
+
+/* Give up on songs that don't loop within this time (ms) */
+#define SONG_ANALYSIS_MAX_LENGTH (4 * 60 * 60 * 1000)
+
+static st_mixer *real_mixer;
+
+static void
+null_setnumch (int n)
+{
+}
+
+static void
+null_updatesample (st_mixer_sample_info *si)
+{
+    // The GUI thread may edit samples meanwhile; the real mixer
+    // must not miss that.
+    real_mixer->updatesample(si);
+}
+
+static void
+null_startnote (int channel,
+		st_mixer_sample_info *si)
+{
+}
+
+static void
+null_channel_int (int channel,
+		  guint32 offset)
+{
+}
+
+static void
+null_channel_float (int channel,
+		    float value)
+{
+}
+
+static void
+null_stopnote (int channel)
+{
+}
+
+static st_mixer mixer_null = {
+    "null",
+    "Pseudo-mixer for song analysis", /* It will NEVER be used and hence translated */
+
+    null_setnumch,
+    null_updatesample,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    null_startnote,
+    null_stopnote,
+    null_channel_int,
+    null_channel_int,
+    null_channel_float,
+    null_channel_float,
+    null_channel_float,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+
+    0x7fffffff,
+
+    NULL
+};
+
+static song_analysis *
+song_analysis_new (void)
+{
+    song_analysis *a = g_new0(song_analysis, 1);
+    int i, n;
+
+    a->num_orders = xm->song_length;
+    a->order_rows = g_new(int, a->num_orders);
+    a->order_offset = g_new(int, a->num_orders);
+
+    for(i = 0, n = 0; i < a->num_orders; i++) {
+	a->order_rows[i] = xm->patterns[xm->pattern_order_table[i]].length;
+	a->order_offset[i] = n;
+	n += a->order_rows[i];
+    }
+
+    a->times = g_new(gint32, n);
+    for(i = 0; i < n; i++) {
+	a->times[i] = -1;
+    }
+
+    return a;
+}
+
+song_analysis *
+song_analysis_run (void)
+{
+    song_analysis *a;
+    int tempo = player_tempo, bpm = player_bpm;
+    double t = 0.0, prev_t = 0.0, tick_t;
+    gboolean prev_row_start = FALSE, looped = FALSE, jumped;
+    gint32 ms;
+
+    g_assert(xm != NULL);
+
+    a = song_analysis_new();
+
+    real_mixer = mixer;
+    mixer_null.max_sample_length = real_mixer->max_sample_length;
+    mixer = &mixer_null;
+
+    xmplayer_init_play_song(0, 0, TRUE);
+
+    while(1) {
+	tick_t = t;
+	t = xmplayer_play();
+	jumped = player_looped;
+	player_looped = FALSE;
+
+	/* xmplayer_play() sets the position before running the tick,
+	   so now it tells us about the previous tick */
+	ms = prev_t * 1000 + 0.5;
+	if(prev_row_start && player_songpos < a->num_orders
+	   && player_patpos < a->order_rows[player_songpos]) {
+	    gint32 *row = &a->times[a->order_offset[player_songpos] + player_patpos];
+
+	    /* The player reports every Bxx as looping, and pattern loops
+	       (E6x) revisit rows without it; only a reported loop that
+	       leads back to a row that has been played already counts */
+	    if(looped && *row != -1) {
+		a->length = ms;
+		a->loop_songpos = player_songpos;
+		a->loop_patpos = player_patpos;
+		a->complete = TRUE;
+		break;
+	    }
+	    if(*row == -1) {
+		*row = ms;
+	    }
+	    looped = FALSE;
+	}
+	if(ms >= SONG_ANALYSIS_MAX_LENGTH) {
+	    a->length = ms;
+	    break;
+	}
+
+	prev_t = tick_t;
+	prev_row_start = curtick == 0;
+	looped = looped || jumped;
+    }
+
+    mixer = real_mixer;
+    player_tempo = tempo;
+    player_bpm = bpm;
+
+    return a;
+}
+
+void
+song_analysis_free (song_analysis *a)
+{
+    if(a) {
+	g_free(a->order_rows);
+	g_free(a->order_offset);
+	g_free(a->times);
+	g_free(a);
+    }
+}
+
+gint32
+song_analysis_time (song_analysis *a,
+		    int songpos,
+		    int patpos)
+{
+    if(songpos < 0 || songpos >= a->num_orders
+       || patpos < 0 || patpos >= a->order_rows[songpos]) {
+	return -1;
+    }
+
+    return a->times[a->order_offset[songpos] + patpos];
+}
+
+gboolean
+song_analysis_find (song_analysis *a,
+		    guint32 time,
+		    int *songpos,
+		    int *patpos)
+{
+    gint32 best = -1, t;
+    int i, j;
+
+    if(time >= a->length) {
+	return FALSE;
+    }
+
+    for(i = 0; i < a->num_orders; i++) {
+	for(j = 0; j < a->order_rows[i]; j++) {
+	    t = a->times[a->order_offset[i] + j];
+	    if(t != -1 && t <= time && t > best) {
+		best = t;
+		*songpos = i;
+		*patpos = j;
+	    }
+	}
+    }
+
+    return best != -1;
+}
@@ -0,0 +1,61 @@
+/*
+ * The Real SoundTracker - song timing analysis (header)
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _SONG_ANALYSIS_H
+#define _SONG_ANALYSIS_H
+
+#include <glib.h>
+
+/* Result of running the player over the whole song without mixing.
+   All times are in milliseconds from the start of the song. */
+
+typedef struct song_analysis {
+    guint32 length;             // time until the song starts repeating itself
+    gboolean complete;          // FALSE if it didn't within the time limit
+    int loop_songpos;           // where the song continues after looping
+    int loop_patpos;
+
+    int num_orders;
+    int *order_rows;            // number of rows of each order's pattern
+    int *order_offset;          // index of each order's first row in times[]
+    gint32 *times;              // time each row is first reached, -1 = never
+} song_analysis;
+
+/* Runs the player from the start of the current module until it loops,
+   with a mixer that ignores everything. Must be called from the audio
+   thread while nothing is playing. */
+song_analysis *     song_analysis_run          (void);
+
+void                song_analysis_free         (song_analysis *a);
+
+/* Time a row is first reached, or -1 if it is never played (or out of
+   the range that has been analyzed) */
+gint32              song_analysis_time         (song_analysis *a,
+						int songpos,
+						int patpos);
+
+/* The row that is playing at the given time; returns FALSE if the
+   time lies beyond the end of the song */
+gboolean            song_analysis_find         (song_analysis *a,
+						guint32 time,
+						int *songpos,
+						int *patpos);
+
+#endif /* _SONG_ANALYSIS_H */
@@ -28,21 +28,16 @@
 
 #include "st-subs.h"
 #include "xm.h"
+#include "xm-player.h"
 #include "gui-settings.h"
 
 int
 st_init_pattern_channels (XMPattern *p,
-			  unsigned length,
-			  int num_channels)
+			  unsigned length)
 {
-    int i;
-    
     p->length = p->alloc_length = length;
-    for(i = 0; i < num_channels; i++) {
-	if(!(p->channels[i] = calloc(1, length * sizeof(XMNote)))) {
-	    st_free_pattern_channels(p);
-	    return 0;
-	}
+    if(!(p->notes = calloc(length * XM_PATTERN_WIDTH, sizeof(XMNote)))) {
+	return 0;
     }
 	    
     return 1;
@@ -51,12 +46,8 @@ st_init_pattern_channels (XMPattern *p,
 void
 st_free_pattern_channels (XMPattern *pat)
 {
-    int i;
-    
-    for(i = 0; i < 32; i++) {
-	free(pat->channels[i]);
-	pat->channels[i] = NULL;
-    }
+    free(pat->notes);
+    pat->notes = NULL;
 }
 
 void
@@ -72,28 +63,19 @@ int
 st_copy_pattern (XMPattern *dst,
 		 XMPattern *src)
 {
-    XMNote *oldchans[32];
-    int i;
+    XMNote *n = NULL;
+    size_t size = src->length * XM_PATTERN_WIDTH * sizeof(XMNote);
 
-    for(i = 0; i < 32; i++) {
-	oldchans[i] = dst->channels[i];
-	if(src->channels[i]) {
-	    if(!(dst->channels[i] = st_dup_track(src->channels[i], src->length))) {
-		// Out of memory, restore previous pattern, return error
-		for(; i >= 0; i--) {
-		    free(dst->channels[i]);
-		    dst->channels[i] = oldchans[i];
-		}
-		return 0;
-	    }
-	} else {
-	    dst->channels[i] = NULL;
+    if(src->notes) {
+	if(!(n = malloc(size))) {
+	    // Out of memory, leave the previous pattern alone
+	    return 0;
 	}
+	memcpy(n, src->notes, size);
     }
 
-    for(i = 0; i < 32; i++)
-	free(oldchans[i]);
-
+    free(dst->notes);
+    dst->notes = n;
     dst->length = dst->alloc_length = src->length;
 
     return 1;
@@ -117,100 +99,88 @@ st_dup_pattern (XMPattern *p)
 }
 
 XMNote *
-st_dup_track (XMNote *n,
-	      int length)
+st_dup_track (XMPattern *p,
+	      int channel)
 {
-    XMNote *r;
-
-    if(!n)
-	return NULL;
-
-    r = malloc(length * sizeof(XMNote));
-    if(r) {
-	memcpy(r, n, length * sizeof(XMNote));
-    }
-
-    return r;
+    return st_dup_track_wrap(p, channel, 0, p->length);
 }
 
 /* Duplicate part of a track, wrap-around at end is handled */
 XMNote *
-st_dup_track_wrap (XMNote *n,
-		   int tracklength,
+st_dup_track_wrap (XMPattern *p,
+		   int channel,
 		   int copystart,
 		   int copylength)
 {
     XMNote *r;
+    int i;
 
-    if(!n || copylength > tracklength || copystart >= tracklength)
+    if(!p->notes || copylength > p->length || copystart >= p->length)
 	return NULL;
 
-    if(copylength > tracklength - copystart) {
-	r = malloc(copylength * sizeof(XMNote));
-	if(r) {
-	    memcpy(r, n + copystart, (tracklength - copystart) * sizeof(XMNote));
-	    memcpy(r + tracklength - copystart, n, (copylength - (tracklength - copystart)) * sizeof(XMNote));
+    r = malloc(copylength * sizeof(XMNote));
+    if(r) {
+	for(i = 0; i < copylength; i++) {
+	    r[i] = *xm_pattern_note(p, channel, (copystart + i) % p->length);
 	}
-    } else {
-	r = st_dup_track(n + copystart, copylength);
     }
 
     return r;
 }
 
 void
-st_clear_track (XMNote *n,
-		int length)
+st_clear_track (XMPattern *p,
+		int channel)
 {
-    if(!n)
+    int i;
+
+    if(!p->notes)
 	return;
 
-    memset(n, 0, length * sizeof(*n));
+    for(i = 0; i < p->alloc_length; i++) {
+	memset(xm_pattern_note(p, channel, i), 0, sizeof(XMNote));
+    }
 }
 
 /* Clear part of a track, wrap-around at end is handled */
 void
-st_clear_track_wrap (XMNote *n,
-		     int tracklength,
+st_clear_track_wrap (XMPattern *p,
+		     int channel,
 		     int clearstart,
 		     int clearlength)
 {
-    if(!n || clearlength > tracklength || clearstart >= tracklength)
+    int i;
+
+    if(!p->notes || clearlength > p->length || clearstart >= p->length)
 	return;
 
-    if(clearlength > tracklength - clearstart) {
-	st_clear_track(n + clearstart, tracklength - clearstart);
-	st_clear_track(n, clearlength - (tracklength - clearstart));
-    } else {
-	st_clear_track(n + clearstart, clearlength);
+    for(i = 0; i < clearlength; i++) {
+	memset(xm_pattern_note(p, channel, (clearstart + i) % p->length), 0, sizeof(XMNote));
     }
 }
 
 void
 st_paste_track_into_track_wrap (XMNote *from,
-				XMNote *to,
-				int tolength,
+				XMPattern *to,
+				int channel,
 				int insertstart,
 				int fromlength)
 {
-    if(!from || !to || tolength < fromlength || insertstart >= tolength)
+    int i;
+
+    if(!from || !to->notes || to->length < fromlength || insertstart >= to->length)
 	return;
 
-    if(fromlength > tolength - insertstart) {
-	memcpy(to + insertstart, from, (tolength - insertstart) * sizeof(XMNote));
-	memcpy(to, from + tolength - insertstart, (fromlength - (tolength - insertstart)) * sizeof(XMNote));
-    } else {
-	memcpy(to + insertstart, from, fromlength * sizeof(XMNote));
+    for(i = 0; i < fromlength; i++) {
+	*xm_pattern_note(to, channel, (insertstart + i) % to->length) = from[i];
     }
 }
 
 void
 st_clear_pattern (XMPattern *p)
 {
-    int i;
-
-    for(i = 0; i < 32; i++) {
-	st_clear_track(p->channels[i], p->alloc_length);
+    if(p->notes) {
+	memset(p->notes, 0, p->alloc_length * XM_PATTERN_WIDTH * sizeof(XMNote));
     }
 }
 
@@ -219,17 +189,16 @@ st_pattern_delete_track (XMPattern *p,
 			 int t)
 {
     int i;
-    XMNote *a;
+    XMNote *r;
 
-    a = p->channels[t];
-    g_assert(a != NULL);
+    g_assert(p->notes != NULL);
 
-    for(i = t; i < 31 && p->channels[i + 1] != NULL; i++) {
-	p->channels[i] = p->channels[i + 1];
+    for(i = 0; i < p->alloc_length; i++) {
+	r = xm_pattern_row(p, i);
+	memmove(r + t, r + t + 1, (XM_PATTERN_WIDTH - 1 - t) * sizeof(XMNote));
     }
 
-    p->channels[i] = a;
-    st_clear_track(a, p->alloc_length);
+    st_clear_track(p, XM_PATTERN_WIDTH - 1);
 }
 
 void
@@ -237,22 +206,16 @@ st_pattern_insert_track (XMPattern *p,
 			 int t)
 {
     int i;
-    XMNote *a;
+    XMNote *r;
     
-    a = p->channels[31];
-
-    for(i = 31; i > t; i--) {
-	p->channels[i] = p->channels[i - 1];
-    }
+    g_assert(p->notes != NULL);
 
-    if(!a) {
-	if(!(a = calloc(1, p->alloc_length * sizeof(XMNote)))) {
-	    g_assert_not_reached();
-	}
+    for(i = 0; i < p->alloc_length; i++) {
+	r = xm_pattern_row(p, i);
+	memmove(r + t + 1, r + t, (XM_PATTERN_WIDTH - 1 - t) * sizeof(XMNote));
     }
 
-    p->channels[t] = a;
-    st_clear_track(a, p->alloc_length);
+    st_clear_track(p, t);
 }
 
 gboolean
@@ -265,10 +228,10 @@ st_instrument_used_in_song (XM *xm,
 
     for(i = 0; i < xm->song_length; i++) {
 	p = &xm->patterns[(int)xm->pattern_order_table[i]];
-	for(j = 0; j < xm->num_channels; j++) {
-	    c = p->channels[j];
-	    for(k = 0; k < p->length; k++) {
-		if(c[k].instrument == instr)
+	for(k = 0; k < p->length; k++) {
+	    c = xm_pattern_row(p, k);
+	    for(j = 0; j < xm->num_channels; j++) {
+		if(c[j].instrument == instr)
 		    return TRUE;
 	    }
 	}
@@ -339,12 +302,13 @@ st_copy_instrument (STInstrument *src, STInstrument *dest)
 	lock[i] = dest->samples[i].sample.lock; // Preserve pointers to GMutex'es from modification
     memcpy(dest, src, sizeof(STInstrument));
     for(i = 0; i < sizeof(src->samples) / sizeof(src->samples[0]); i++){
-	if ((length = dest->samples[i].sample.length * sizeof(dest->samples[i].sample.data[0]))){
+	if ((length = dest->samples[i].sample.length * st_sample_bytes_per_sample(&dest->samples[i].sample))){
 	    dest->samples[i].sample.data = malloc(length);
 	    memcpy(dest->samples[i].sample.data, src->samples[i].sample.data, length);
 	}
 	dest->samples[i].sample.lock = lock[i];
     }
+    xmplayer_envelopes_changed();
 }
 
 void
@@ -367,6 +331,7 @@ st_clean_instrument (STInstrument *instr,
     instr->vol_env.points[0].val = 64;
     instr->pan_env.num_points = 1;
     instr->pan_env.points[0].val = 32;
+    xmplayer_envelopes_changed();
 }
 
 void
@@ -374,7 +339,7 @@ st_clean_sample (STSample *s,
 		 const char *name)
 {
     GMutex *lock = s->sample.lock;
-    free(s->sample.data);
+    st_sample_data_unref(s->sample.data);
     memset(s, 0, sizeof(STSample));
     if(name)
 	strncpy(s->name, name, 22);
@@ -401,25 +366,14 @@ st_clean_song (XM *xm)
     memset(xm->pattern_order_table, 0, sizeof(xm->pattern_order_table));
 
     for(i = 0; i < 256; i++)
-	st_init_pattern_channels(&xm->patterns[i], 64, xm->num_channels);
+	st_init_pattern_channels(&xm->patterns[i], 64);
 }
 
 void
 st_set_num_channels (XM *xm,
 		     int n)
 {
-    int i, j;
-    XMPattern *pat;
-
-    for(i = 0; i < sizeof(xm->patterns) / sizeof(xm->patterns[0]); i++) {
-	pat = &xm->patterns[i];
-	for(j = 0; j < n; j++) {
-	    if(!pat->channels[j]) {
-		pat->channels[j] = calloc(1, sizeof(XMNote) * pat->alloc_length);
-	    }
-	}
-    }
-
+    // The patterns have room for all channels anyway
     xm->num_channels = n;
 }
 
@@ -427,16 +381,15 @@ void
 st_set_pattern_length (XMPattern *pat,
 		       int l)
 {
-    int i;
     XMNote *n;
 
     if(l > pat->alloc_length) {
-	for(i = 0; i < 32 && pat->channels[i] != NULL; i++) {
-	    n = calloc(1, sizeof(XMNote) * l);
-	    memcpy(n, pat->channels[i], sizeof(XMNote) * pat->length);
-	    free(pat->channels[i]);
-	    pat->channels[i] = n;
+	n = calloc(l * XM_PATTERN_WIDTH, sizeof(XMNote));
+	if(pat->notes) {
+	    memcpy(n, pat->notes, sizeof(XMNote) * pat->length * XM_PATTERN_WIDTH);
+	    free(pat->notes);
 	}
+	pat->notes = n;
 	pat->alloc_length = l;
     }
 
@@ -471,17 +424,7 @@ st_find_first_unused_and_empty_pattern (XM *xm)
 gboolean
 st_is_empty_pattern (XMPattern *p)
 {
-    int i;
-    
-    for(i = 0; i < 32; i++) {
-	if(p->channels[i]) {
-	    if(!st_is_empty_track(p->channels[i], p->length)) {
-		return 0;
-	    }
-	}
-    }
-
-    return 1;
+    return !p->notes || st_is_empty_track(p->notes, p->length * XM_PATTERN_WIDTH);
 }
 
 gboolean
@@ -535,13 +478,16 @@ gboolean
 st_check_if_odd_are_not_empty (XMPattern *p)
 {
     int i, j;
+    XMNote *n;
 
-    for(i = 0; i < 32 && p->channels[i]; i++)
-	for(j = 1; j < p->length; j += 2)
-	    if((p->channels[i][j].note && p->channels[i][j].instrument) ||
-	       (p->channels[i][j].volume > 15) ||
-	        p->channels[i][j].fxtype || p->channels[i][j].fxparam)
+    for(j = 1; j < p->length; j += 2) {
+	n = xm_pattern_row(p, j);
+	for(i = 0; i < XM_PATTERN_WIDTH; i++)
+	    if((n[i].note && n[i].instrument) ||
+	       (n[i].volume > 15) ||
+	        n[i].fxtype || n[i].fxparam)
 		return TRUE;
+    }
 
     return FALSE;
 }
@@ -549,19 +495,12 @@ st_check_if_odd_are_not_empty (XMPattern *p)
 void
 st_shrink_pattern (XMPattern *p)
 {
-    int i, j, length = p->length;
+    int j, length = p->length;
     
-    for(i = 0; i < 32 && p->channels[i]; i++){
-	for(j = 1; j <= (length - 1) / 2; j++)
-	    memcpy(&p->channels[i][j], &p->channels[i][2 * j], sizeof(XMNote));
-	for(;j < p->alloc_length; j++){/* clear the rest of the pattern */
-	    p->channels[i][j].note = 0;
-	    p->channels[i][j].instrument = 0;
-	    p->channels[i][j].volume = 0;
-	    p->channels[i][j].fxtype = 0;
-	    p->channels[i][j].fxparam = 0;
-	}
-    }
+    for(j = 1; j <= (length - 1) / 2; j++)
+	memcpy(xm_pattern_row(p, j), xm_pattern_row(p, 2 * j), XM_PATTERN_WIDTH * sizeof(XMNote));
+    /* clear the rest of the pattern */
+    memset(xm_pattern_row(p, j), 0, (p->alloc_length - j) * XM_PATTERN_WIDTH * sizeof(XMNote));
     
     st_set_pattern_length(p, (length - 1) / 2 + 1);
 }
@@ -569,20 +508,14 @@ st_shrink_pattern (XMPattern *p)
 void
 st_expand_pattern (XMPattern *p)
 {
-    int i, j, length = MIN(p->length * 2, 256);
+    int j, length = MIN(p->length * 2, 256);
 
     st_set_pattern_length(p, length);
 
-    for(i = 0; i < 32 && p->channels[i]; i++){
-	for(j = length / 2 - 1; j >= 0; j--){
-	    /* copy to even positions and clear odd */
-	    memcpy(&p->channels[i][2 * j], &p->channels[i][j], sizeof(XMNote));
-	    p->channels[i][2 * j + 1].note = 0;
-	    p->channels[i][2 * j + 1].instrument = 0;
-	    p->channels[i][2 * j + 1].volume = 0;
-	    p->channels[i][2 * j + 1].fxtype = 0;
-	    p->channels[i][2 * j + 1].fxparam = 0;
-	}
+    for(j = length / 2 - 1; j >= 0; j--){
+	/* copy to even positions and clear odd */
+	memmove(xm_pattern_row(p, 2 * j), xm_pattern_row(p, j), XM_PATTERN_WIDTH * sizeof(XMNote));
+	memset(xm_pattern_row(p, 2 * j + 1), 0, XM_PATTERN_WIDTH * sizeof(XMNote));
     }
 }
 
@@ -615,6 +548,35 @@ st_convert_sample (void *src,
     }
 }
 
+int
+st_sample_bytes_per_sample (st_mixer_sample_info *s)
+{
+    return s->format == ST_MIXER_SAMPLE_FORMAT_8BIT ? 1 : 2;
+}
+
+gboolean
+st_sample_make_16bit (st_mixer_sample_info *s)
+{
+    gint16 *d16;
+
+    if(s->format != ST_MIXER_SAMPLE_FORMAT_8BIT) {
+	return TRUE;
+    }
+
+    if(s->length) {
+	d16 = malloc(2 * s->length);
+	if(!d16) {
+	    return FALSE;
+	}
+	st_convert_sample(s->data, d16, 8, 16, s->length);
+	st_sample_data_unref(s->data);
+	s->data = d16;
+    }
+    s->format = ST_MIXER_SAMPLE_FORMAT_16BIT;
+
+    return TRUE;
+}
+
 void
 st_sample_cutoff_lowest_8_bits (gint16 *data,
 				int count)
@@ -647,3 +609,78 @@ st_sample_16bit_signed_unsigned (gint16 *data,
     }
 }
 
+
+/* Number of holders of each shared piece of sample data. Data that
+   isn't in the table belongs to its sample alone. */
+G_LOCK_DEFINE_STATIC(st_shared_data);
+static GHashTable *st_shared_data = NULL;
+
+static guint
+st_sample_data_holders (void *data)
+{
+    return st_shared_data ? GPOINTER_TO_UINT(g_hash_table_lookup(st_shared_data, data)) : 0;
+}
+
+void *
+st_sample_data_ref (void *data)
+{
+    guint n;
+
+    if(!data)
+	return NULL;
+
+    G_LOCK(st_shared_data);
+    if(!st_shared_data)
+	st_shared_data = g_hash_table_new(g_direct_hash, NULL);
+    n = st_sample_data_holders(data);
+    g_hash_table_insert(st_shared_data, data, GUINT_TO_POINTER(n ? n + 1 : 2));
+    G_UNLOCK(st_shared_data);
+
+    return data;
+}
+
+void
+st_sample_data_unref (void *data)
+{
+    guint n;
+
+    if(!data)
+	return;
+
+    G_LOCK(st_shared_data);
+    n = st_sample_data_holders(data);
+    if(n > 2)
+	g_hash_table_insert(st_shared_data, data, GUINT_TO_POINTER(n - 1));
+    else if(n == 2)
+	g_hash_table_remove(st_shared_data, data);
+    G_UNLOCK(st_shared_data);
+
+    if(!n)
+	free(data);
+}
+
+gboolean
+st_sample_data_unshare (st_mixer_sample_info *s)
+{
+    guint32 length = s->length * st_sample_bytes_per_sample(s);
+    void *copy;
+    guint n;
+
+    if(!s->data || !length)
+	return TRUE;
+
+    G_LOCK(st_shared_data);
+    n = st_sample_data_holders(s->data);
+    G_UNLOCK(st_shared_data);
+    if(!n)
+	return TRUE;
+
+    copy = malloc(length);
+    if(!copy)
+	return FALSE;
+    memcpy(copy, s->data, length);
+    st_sample_data_unref(s->data);
+    s->data = copy;
+
+    return TRUE;
+}
@@ -26,7 +26,7 @@
 
 /* --- Module functions --- */
 void          st_free_all_pattern_channels             (XM *xm);
-int           st_init_pattern_channels                 (XMPattern *p, unsigned length, int num_channels);
+int           st_init_pattern_channels                 (XMPattern *p, unsigned length);
 int           st_instrument_num_save_samples           (STInstrument *instr);
 int           st_num_save_instruments                  (XM *xm);
 int           st_num_save_patterns                     (XM *xm);
@@ -54,11 +54,12 @@ void	      st_shrink_pattern			       (XMPattern *p);
 void	      st_expand_pattern			       (XMPattern *p);
 
 /* --- Track functions --- */
-XMNote*       st_dup_track                             (XMNote*, int length);
-XMNote*       st_dup_track_wrap                        (XMNote*, int tracklength, int copystart, int copylength);
-void          st_clear_track                           (XMNote*, int length);
-void          st_clear_track_wrap                      (XMNote*, int tracklength, int clearstart, int clearlength);
-void          st_paste_track_into_track_wrap           (XMNote *from, XMNote *to, int tolength, int insertstart, int fromlength);
+/* A track taken out of a pattern is a plain array of its notes */
+XMNote*       st_dup_track                             (XMPattern *p, int channel);
+XMNote*       st_dup_track_wrap                        (XMPattern *p, int channel, int copystart, int copylength);
+void          st_clear_track                           (XMPattern *p, int channel);
+void          st_clear_track_wrap                      (XMPattern *p, int channel, int clearstart, int clearlength);
+void          st_paste_track_into_track_wrap           (XMNote *from, XMPattern *to, int channel, int insertstart, int fromlength);
 gboolean      st_is_empty_track                        (XMNote *notes,
 							int length);
 
@@ -76,6 +77,10 @@ void          st_convert_sample                        (void *src,
 							int srcformat,
 							int dstformat,
 							int count);
+int           st_sample_bytes_per_sample               (st_mixer_sample_info *s);
+/* Convert a sample stored with 8 bits to 16 bits. The sample must be
+   locked, and the mixer must be notified afterwards. */
+gboolean      st_sample_make_16bit                     (st_mixer_sample_info *s);
 void          st_sample_cutoff_lowest_8_bits           (gint16 *data,
 							int count);
 void          st_sample_8bit_signed_unsigned           (gint8 *data,
@@ -83,4 +88,13 @@ void          st_sample_8bit_signed_unsigned           (gint8 *data,
 void          st_sample_16bit_signed_unsigned          (gint16 *data,
 							int count);
 
+/* Sample data can be shared with snapshots of the module (see
+   XM_Snapshot()). st_sample_data_ref() adds a holder, and
+   st_sample_data_unref() drops one, freeing the data with the last.
+   Data that is changed in place has to be unshared first, which gives
+   the sample its own copy if needed; the sample must be locked. */
+void*         st_sample_data_ref                       (void *data);
+void          st_sample_data_unref                     (void *data);
+gboolean      st_sample_data_unshare                   (st_mixer_sample_info *s);
+
 #endif /* _ST_SUBS_H */
@@ -21,6 +21,8 @@
 
 #include "time-buffer.h"
 
+#include <string.h>
+
 #include <glib.h>
 
 /* This implementation of the time buffer interface might be rather
@@ -118,3 +120,29 @@ time_buffer_get (time_buffer *t,
 
     return result;
 }
+
+gboolean
+time_buffer_peek (time_buffer *t,
+		  double time,
+		  void *dest,
+		  gsize size)
+{
+    GList *list, *found;
+
+    g_mutex_lock(t->mutex);
+
+    // The same item as time_buffer_get() would return
+    found = t->list;
+    for(list = t->list; list && list->next; list = list->next) {
+	if(time < ((time_buffer_item*)list->data)->time)
+	    break;
+	found = list;
+    }
+    if(found) {
+	memcpy(dest, found->data, size);
+    }
+
+    g_mutex_unlock(t->mutex);
+
+    return found != NULL;
+}
@@ -40,4 +40,10 @@ gboolean        time_buffer_add          (time_buffer *t, void *item, double tim
 void            time_buffer_clear        (time_buffer *t);
 void *          time_buffer_get          (time_buffer *t, double time);
 
+/* Copies the item time_buffer_get() would return to dest, without
+   discarding anything, so that another thread than the one calling
+   time_buffer_get() can look at the buffer. Returns FALSE if the
+   buffer is empty. */
+gboolean        time_buffer_peek         (time_buffer *t, double time, void *dest, gsize size);
+
 #endif /* _TIME_BUFFER_H */
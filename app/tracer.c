@@ -58,7 +58,7 @@ tracer_updatesample (st_mixer_sample_info *si)
 	    continue;
 	}
 
-	if(c->data != si->data
+	if((c->data != si->data && c->format == si->format)
 	   || c->length != si->length
 	   || c->looptype != si->looptype) {
 	    c->flags &= ~TR_FLAG_SAMPLE_RUNNING;
@@ -66,7 +66,10 @@ tracer_updatesample (st_mixer_sample_info *si)
 	}
 	 
 	/* No relevant data has changed. Don't stop the sample, but update
-	   our local loop data instead. */
+	   our local loop data instead. A sample that has only been
+	   converted to 16 bits goes on playing from the new data. */
+	c->data = si->data;
+	c->format = si->format;
 	c->looptype = si->looptype;
 	if(c->looptype != ST_MIXER_SAMPLE_LOOPTYPE_NONE) {
 	    if(c->positionw < si->loopstart) {
@@ -81,7 +84,7 @@ tracer_updatesample (st_mixer_sample_info *si)
 }
 
 static void
-tracer_setmixfreq (guint16 frequency)
+tracer_setmixfreq (guint32 frequency)
 {
     mixfreq = frequency;
 }
@@ -102,10 +105,11 @@ tracer_startnote (int channel,
     
     c->sample = s;
 
-    // The following three for update_sample()
+    // The following four for update_sample()
     c->data = s->data;
     c->length = s->length;
     c->looptype = s->looptype;
+    c->format = s->format;
 
     c->positionw = 0;
     c->positionf = 0;
@@ -257,15 +261,19 @@ tracer_mix_sub (tracer_channel *ch,
     }
 
     if(!gonnapingpong) {
-	/* End of Amiga-type loop */
-	num_samples = (ende64 - pos64) / freq64 + 1;/* plus one sample from the next loop cycle */
-	pos64 += num_samples * freq64 - ende64 + lstart64;
+	/* End of Amiga-type loop. Skip all loop cycles passed in this
+	   run at once, short loops at high pitches would take one call
+	   per cycle otherwise. */
+	const gint64 looplen64 = ende64 - lstart64;
 
-	ch->positionw = pos64 >> 32;
-	ch->positionf = pos64 & 0xffffffff;
+	if(vieweit64 >= ende64) {
+	    vieweit64 = lstart64 + (vieweit64 - lstart64) % looplen64;
+	}
 
-	g_assert(num_samples <= num_samples_left);
-	return num_samples;
+	ch->positionw = vieweit64 >> 32;
+	ch->positionf = vieweit64 & 0xffffffff;
+
+	return num_samples_left;
     }
 
     if(ch->direction == 1) {
@@ -352,6 +360,8 @@ static st_mixer mixer_tracer = {
     tracer_mix,
     NULL,
     NULL,
+    NULL,
+    NULL,
 
     0x7fffffff,
 
@@ -31,6 +31,7 @@ typedef struct tracer_channel {
     void *data;                   // for updatesample() to see if sample has changed
     int looptype;
     guint32 length;
+    guint32 format;
 
     guint32 flags;                // see below
     float volume;                 // 0.0 ... 1.0
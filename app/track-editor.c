@@ -41,6 +41,8 @@
 #include "tracker-settings.h"
 #include "menubar.h"
 #include "scope-group.h"
+#include "frame-clock.h"
+#include "pattern-undo.h"
 
 Tracker *tracker;
 GtkWidget *trackersettings;
@@ -54,14 +56,14 @@ static XMNote *track_buffer = NULL;
 static int track_buffer_length;
 
 /* Block stuff */
-static XMPattern block_buffer;
+static XMNote *block_buffer[32];
+static int block_buffer_length;
 
 /* this array contains -1 if the note is not running, or the channel number where
    it is being played. this is necessary to handle the key on/off situation. */
 static int note_running[96];
 
-static int update_freq = 30;
-static int gtktimer = -1;
+static frame_clock_view *tracker_view = NULL;
 
 static guint track_editor_editmode_status_idle_handler = 0;
 static gchar track_editor_editmode_status_ed_buf[128];
@@ -107,7 +109,7 @@ void
 show_editmode_status(void)
 {
     Tracker *t = tracker;
-    XMNote *note = &t->curpattern->channels[t->cursor_ch][t->patpos];
+    XMNote *note = xm_pattern_note(t->curpattern, t->cursor_ch, t->patpos);
     gchar tmp_buf[128];
     int cmd_p1, cmd_p2;
     
@@ -347,6 +349,26 @@ track_editor_set_num_channels (int n)
     jazz_numshown = n;
 }
 
+static void
+tracker_frame (double songtime,
+	       gpointer data)
+{
+    static double last_time = -1.0;
+    audio_player_pos *p;
+
+    if(songtime < 0.0) {
+	last_time = -1.0;
+	return;
+    }
+
+    p = time_buffer_get(audio_playerpos_tb, songtime);
+    if(p && p->time != last_time) {
+	// Still the same row otherwise
+	last_time = p->time;
+	gui_update_player_pos(p);
+    }
+}
+
 void
 tracker_page_create (GtkNotebook *nb)
 {
@@ -387,7 +409,7 @@ tracker_page_create (GtkNotebook *nb)
     g_signal_connect(thing, "mainmenu_blockmark_set", G_CALLBACK(update_mainmenu_blockmark), NULL);
     tracker = TRACKER(thing);
 
-    tracker_set_update_freq(gui_settings.tracker_update_freq);
+    tracker_view = frame_clock_add_view(tracker_frame, NULL, NULL, gui_settings.tracker_update_freq);
 
     trackersettings = trackersettings_new();
     trackersettings_set_tracker_widget(TRACKERSETTINGS(trackersettings), tracker);
@@ -407,7 +429,7 @@ tracker_page_create (GtkNotebook *nb)
     gtk_notebook_append_page(nb, vbox, gtk_label_new(_("Tracker")));
     gtk_container_border_width(GTK_CONTAINER(vbox), 10);
 
-    memset(&block_buffer, 0, sizeof(block_buffer));
+    memset(block_buffer, 0, sizeof(block_buffer));
 
 #ifdef USE_GNOME
     /* Create popup menu */
@@ -626,9 +648,11 @@ track_editor_handle_keys (int shift,
                             reckey[c].chn = t->cursor_ch;
                             reckey[c].act = TRUE;
                             
-                            XMNote *note = &t->curpattern->channels[t->cursor_ch][t->patpos];
+                            XMNote *note = xm_pattern_note(t->curpattern, t->cursor_ch, t->patpos);
+                            pattern_undo_begin(t->curpattern, t->cursor_ch, 1, t->patpos, 1);
                             note->note = i;
                             note->instrument = gui_get_current_instrument();
+                            pattern_undo_end();
                             tracker_redraw_current_row(t);
                             xm->modified = 1;
 			    
@@ -647,17 +671,21 @@ track_editor_handle_keys (int shift,
                            if (!insert_noteoff)
                                goto fin_note;
                            
-                           XMNote *note = &t->curpattern->channels[reckey[c].chn][t->patpos];
+                           XMNote *note = xm_pattern_note(t->curpattern, reckey[c].chn, t->patpos);
+                           pattern_undo_begin(t->curpattern, reckey[c].chn, 1, t->patpos, 1);
                            note->note = 97;
                            note->instrument = 0;
+                           pattern_undo_end();
                            tracker_redraw_current_row(t);
                            xm->modified = 1; 
                         }
                     } else if (pressed) {
 			
-			XMNote *note = &t->curpattern->channels[t->cursor_ch][t->patpos];
+			XMNote *note = xm_pattern_note(t->curpattern, t->cursor_ch, t->patpos);
+			pattern_undo_begin(t->curpattern, t->cursor_ch, 1, t->patpos, 1);
 			note->note = i;
 			note->instrument = gui_get_current_instrument();
+			pattern_undo_end();
 			tracker_redraw_current_row(t);
 			tracker_step_cursor_row(t, gui_get_current_jump_value());
 			xm->modified = 1;
@@ -668,9 +696,11 @@ fin_note:
 		break;
 	    case KEYS_MEANING_KEYOFF:
 		if(pressed && GTK_TOGGLE_BUTTON(editing_toggle)->active) {
-		    XMNote *note = &t->curpattern->channels[t->cursor_ch][t->patpos];
+		    XMNote *note = xm_pattern_note(t->curpattern, t->cursor_ch, t->patpos);
+		    pattern_undo_begin(t->curpattern, t->cursor_ch, 1, t->patpos, 1);
 		    note->note = 97;
 		    note->instrument = 0;
+		    pattern_undo_end();
 		    tracker_redraw_current_row(t);
 		    tracker_step_cursor_row(t, gui_get_current_jump_value());
 		    xm->modified = 1;
@@ -791,8 +821,9 @@ fin_note:
         break;*/
     case GDK_Delete:
 	if(GTK_TOGGLE_BUTTON(editing_toggle)->active) {
-	    XMNote *note = &t->curpattern->channels[t->cursor_ch][t->patpos];
+	    XMNote *note = xm_pattern_note(t->curpattern, t->cursor_ch, t->patpos);
 
+	    pattern_undo_begin(t->curpattern, t->cursor_ch, 1, t->patpos, 1);
             if(shift) {
 		note->note = 0;
 		note->instrument = 0;
@@ -824,6 +855,7 @@ fin_note:
                     break;
                 }
             }
+	    pattern_undo_end();
 
 	    tracker_redraw_current_row(t);
 	    tracker_step_cursor_row(t, gui_get_current_jump_value());
@@ -833,18 +865,20 @@ fin_note:
 	break;
     case GDK_Insert:
 	if(GTK_TOGGLE_BUTTON(editing_toggle)->active && !shift && !alt && !ctrl) {
-	    XMNote *note = &t->curpattern->channels[t->cursor_ch][t->patpos];
+	    XMNote *note = xm_pattern_note(t->curpattern, t->cursor_ch, t->patpos);
 
+	    pattern_undo_begin(t->curpattern, t->cursor_ch, 1, t->patpos, -1);
 	    for(i = t->curpattern->length - 1; i>t->patpos; --i)
-		t->curpattern->channels[t->cursor_ch][i] = t->curpattern->channels[t->cursor_ch][i-1];
+		*xm_pattern_note(t->curpattern, t->cursor_ch, i) = *xm_pattern_note(t->curpattern, t->cursor_ch, i-1);
 
 	    note->note = 0;
 	    note->instrument = 0;
 	    note->volume = 0;
 	    note->fxtype = 0;
 	    note->fxparam = 0;
+	    pattern_undo_end();
 
-	    tracker_redraw_current_row(t);
+	    tracker_redraw_rows(t, t->patpos, t->curpattern->length - 1);
 	    xm->modified = 1;
 	    handled = TRUE;
         }
@@ -855,17 +889,19 @@ fin_note:
 
 	    if(t->patpos) {
 		--t->patpos;
+		pattern_undo_begin(t->curpattern, t->cursor_ch, 1, t->patpos, -1);
 		for(i = t->patpos; i<t->curpattern->length-1; i++)
-		    t->curpattern->channels[t->cursor_ch][i] = t->curpattern->channels[t->cursor_ch][i+1];
+		    *xm_pattern_note(t->curpattern, t->cursor_ch, i) = *xm_pattern_note(t->curpattern, t->cursor_ch, i+1);
 		
-		note = &t->curpattern->channels[t->cursor_ch][t->curpattern->length - 1];
+		note = xm_pattern_note(t->curpattern, t->cursor_ch, t->curpattern->length - 1);
 		note->note = 0;
 		note->instrument = 0;
 		note->volume = 0;
 		note->fxtype = 0;
 		note->fxparam = 0;
+		pattern_undo_end();
 		
-		tracker_redraw_current_row(t);
+		tracker_redraw(t);
 		xm->modified = 1;
 		handled = TRUE;
 	    }
@@ -892,7 +928,9 @@ fin_note:
     default:
 	if(!ctrl && !alt) {
 	    if(GTK_TOGGLE_BUTTON(editing_toggle)->active) {
+		pattern_undo_begin(t->curpattern, t->cursor_ch, 1, t->patpos, 1);
 		handled = track_editor_handle_column_input(t, keyval);
+		pattern_undo_end();
 	    }
 	}
 	break;
@@ -926,7 +964,9 @@ track_editor_cut_pattern (Tracker *t)
 	free(pattern_buffer);
     }
     pattern_buffer = st_dup_pattern(p);
+    pattern_undo_begin(p, 0, 32, 0, -1);
     st_clear_pattern(p);
+    pattern_undo_end();
     xm->modified = 1;
     tracker_redraw(t);
 }
@@ -935,20 +975,22 @@ void
 track_editor_paste_pattern (Tracker *t)
 {
     XMPattern *p = t->curpattern;
-    int i;
+    int length;
 
     if(!pattern_buffer)
 	return;
-    for(i = 0; i < 32; i++) {
-	free(p->channels[i]);
-	p->channels[i] = st_dup_track(pattern_buffer->channels[i], pattern_buffer->length);
+    length = p->length;
+    pattern_undo_begin(p, 0, 32, 0, -1);
+    if(!st_copy_pattern(p, pattern_buffer)) {
+	pattern_undo_end();
+	return;
     }
-    p->alloc_length = pattern_buffer->length;
-    if(p->length != pattern_buffer->length) {
-	p->length = pattern_buffer->length;
+    if(p->length != length) {
+	pattern_undo_end();
 	gui_update_pattern_data();
 	tracker_reset(t);
     } else {
+	pattern_undo_end();
 	tracker_redraw(t);
     }
     xm->modified = 1;
@@ -957,29 +999,25 @@ track_editor_paste_pattern (Tracker *t)
 void
 track_editor_copy_track (Tracker *t)
 {
-    int l = t->curpattern->length;
-    XMNote *n = t->curpattern->channels[t->cursor_ch];
-
     if(track_buffer) {
 	free(track_buffer);
     }
-    track_buffer_length = l;
-    track_buffer = st_dup_track(n, l);
+    track_buffer_length = t->curpattern->length;
+    track_buffer = st_dup_track(t->curpattern, t->cursor_ch);
     tracker_redraw(t);
 }
 
 void
 track_editor_cut_track (Tracker *t)
 {
-    int l = t->curpattern->length;
-    XMNote *n = t->curpattern->channels[t->cursor_ch];
-
     if(track_buffer) {
 	free(track_buffer);
     }
-    track_buffer_length = l;
-    track_buffer = st_dup_track(n, l);
-    st_clear_track(n, l);
+    track_buffer_length = t->curpattern->length;
+    track_buffer = st_dup_track(t->curpattern, t->cursor_ch);
+    pattern_undo_begin(t->curpattern, t->cursor_ch, 1, 0, -1);
+    st_clear_track_wrap(t->curpattern, t->cursor_ch, 0, t->curpattern->length);
+    pattern_undo_end();
     xm->modified = 1;
     tracker_redraw(t);
 }
@@ -988,16 +1026,14 @@ void
 track_editor_paste_track (Tracker *t)
 {
     int l = t->curpattern->length;
-    XMNote *n = t->curpattern->channels[t->cursor_ch];
-    int i;
 
     if(!track_buffer)
 	return;
-    i = track_buffer_length;
-    if(l < i)
-	i = l;
-    while(i--)
-	n[i] = track_buffer[i];
+    if(l > track_buffer_length)
+	l = track_buffer_length;
+    pattern_undo_begin(t->curpattern, t->cursor_ch, 1, 0, -1);
+    st_paste_track_into_track_wrap(track_buffer, t->curpattern, t->cursor_ch, 0, l);
+    pattern_undo_end();
     xm->modified = 1;
     tracker_redraw(t);
 }
@@ -1005,7 +1041,9 @@ track_editor_paste_track (Tracker *t)
 void
 track_editor_delete_track (Tracker *t)
 {
+    pattern_undo_begin(t->curpattern, t->cursor_ch, 32 - t->cursor_ch, 0, -1);
     st_pattern_delete_track(t->curpattern, t->cursor_ch);
+    pattern_undo_end();
     xm->modified = 1;
     tracker_redraw(t);
 }
@@ -1013,7 +1051,9 @@ track_editor_delete_track (Tracker *t)
 void
 track_editor_insert_track (Tracker *t)
 {
+    pattern_undo_begin(t->curpattern, t->cursor_ch, 32 - t->cursor_ch, 0, -1);
     st_pattern_insert_track(t->curpattern, t->cursor_ch);
+    pattern_undo_end();
     xm->modified = 1;
     tracker_redraw(t);
 }
@@ -1024,14 +1064,16 @@ track_editor_kill_notes_track (Tracker *t)
     int i;
     XMNote *note;
 
+    pattern_undo_begin(t->curpattern, t->cursor_ch, 1, t->patpos, -1);
     for(i = t->patpos; i<t->curpattern->length; i++) {
-       note = &t->curpattern->channels[t->cursor_ch][i];
+       note = xm_pattern_note(t->curpattern, t->cursor_ch, i);
        note->note = 0;
        note->instrument = 0;
        note->volume = 0;
        note->fxtype = 0;
        note->fxparam = 0;
     }
+    pattern_undo_end();
 
     xm->modified = 1;
     tracker_redraw(t);
@@ -1046,7 +1088,7 @@ track_editor_cmd_mvalue (Tracker *t, gboolean mode)
     tpos = t->cursor_item;
 
     if(tpos>=3) {
-        note = &t->curpattern->channels[t->cursor_ch][(t->patpos - gui_get_current_jump_value()) % t->curpattern->length];
+        note = xm_pattern_note(t->curpattern, t->cursor_ch, (t->patpos - gui_get_current_jump_value()) % t->curpattern->length);
 
         if(tpos<5)
             nparam = note->volume & 0xf;
@@ -1058,11 +1100,13 @@ track_editor_cmd_mvalue (Tracker *t, gboolean mode)
         else
             nparam = (nparam - 1) & 0xff;
 
-        note = &t->curpattern->channels[t->cursor_ch][t->patpos];
+        note = xm_pattern_note(t->curpattern, t->cursor_ch, t->patpos);
+        pattern_undo_begin(t->curpattern, t->cursor_ch, 1, t->patpos, 1);
         if(tpos<5)
             note->volume |= nparam & 0xf;
         else
             note->fxparam = nparam;
+        pattern_undo_end();
 
         tracker_step_cursor_row(t, gui_get_current_jump_value());
         xm->modified = 1;
@@ -1098,21 +1142,21 @@ track_editor_copy_cut_selection_common (Tracker *t,
 
     tracker_get_selection_rect(t, &chStart, &rowStart, &width, &height);
 
-    block_buffer.alloc_length = block_buffer.length = height;
+    block_buffer_length = height;
 
     for(i = 0; i < 32; i++) {
-	free(block_buffer.channels[i]);
-	block_buffer.channels[i] = NULL;
+	free(block_buffer[i]);
+	block_buffer[i] = NULL;
     }
 
     for(i = 0; i < width; i++) {
-	block_buffer.channels[i] = st_dup_track_wrap(t->curpattern->channels[(chStart + i) % xm->num_channels],
-						     t->curpattern->length,
-						     rowStart,
-						     height);
+	block_buffer[i] = st_dup_track_wrap(t->curpattern,
+					    (chStart + i) % xm->num_channels,
+					    rowStart,
+					    height);
 	if(cut) {
-	    st_clear_track_wrap(t->curpattern->channels[(chStart + i) % xm->num_channels],
-				t->curpattern->length,
+	    st_clear_track_wrap(t->curpattern,
+				(chStart + i) % xm->num_channels,
 				rowStart,
 				height);
 	}
@@ -1129,7 +1173,10 @@ track_editor_copy_selection (Tracker *t)
 void
 track_editor_cut_selection (Tracker *t)
 {
+    // The selection may wrap around, so watch the whole pattern
+    pattern_undo_begin(t->curpattern, 0, 32, 0, -1);
     track_editor_copy_cut_selection_common(t, TRUE);
+    pattern_undo_end();
     menubar_block_mode_set(FALSE);
     xm->modified = 1;
     tracker_redraw(t);
@@ -1140,25 +1187,27 @@ track_editor_paste_selection (Tracker *t)
 {
     int i;
 
-    if(block_buffer.length > t->curpattern->length)
+    if(block_buffer_length > t->curpattern->length)
 		return;
 
+    pattern_undo_begin(t->curpattern, 0, 32, 0, -1);
     for(i = 0; i < 32; i++) {
-		st_paste_track_into_track_wrap(block_buffer.channels[i],
-				       t->curpattern->channels[(t->cursor_ch + i) % xm->num_channels],
-				       t->curpattern->length,
+		st_paste_track_into_track_wrap(block_buffer[i],
+				       t->curpattern,
+				       (t->cursor_ch + i) % xm->num_channels,
 				       t->patpos,
-				       block_buffer.length);
+				       block_buffer_length);
     }
+    pattern_undo_end();
 
     xm->modified = 1;
  	/* I'm not sure if it's a good idea (Olivier GLORIEUX) */
-    tracker_set_patpos(t, (t->patpos + block_buffer.length) % t->curpattern->length);
+    tracker_set_patpos(t, (t->patpos + block_buffer_length) % t->curpattern->length);
     tracker_redraw(t);
 }
 
-void
-track_editor_interpolate_fx (Tracker *t)
+static void
+track_editor_interpolate_fx_column (Tracker *t)
 {
     int height, width, chStart, rowStart;
     int xmnote_offset;
@@ -1175,8 +1224,8 @@ track_editor_interpolate_fx (Tracker *t)
     if(width != 1 || t->cursor_ch != chStart)
 	return;
 
-    note_start = &t->curpattern->channels[t->cursor_ch][rowStart];
-    note_end = &t->curpattern->channels[t->cursor_ch][rowStart + height - 1];
+    note_start = xm_pattern_note(t->curpattern, t->cursor_ch, rowStart);
+    note_end = xm_pattern_note(t->curpattern, t->cursor_ch, rowStart + height - 1);
 
     if(t->cursor_item == 3 || t->cursor_item == 4) {
 	// Interpolate volume column
@@ -1221,11 +1270,11 @@ track_editor_interpolate_fx (Tracker *t)
 
 	for(i = 1; i < height - 1; i++) {
 	    // Skip lines that allready have effect on them
-	    if((note_start + i)->fxtype)
+	    if((note_start + i * XM_PATTERN_WIDTH)->fxtype)
 		continue;
 
 	    // Copy the effect type into all rows in between
-	    (note_start + i)->fxtype = note_start->fxtype;
+	    (note_start + i * XM_PATTERN_WIDTH)->fxtype = note_start->fxtype;
 	}
 
     } else {
@@ -1244,19 +1293,33 @@ track_editor_interpolate_fx (Tracker *t)
 	int new_value;
 
         // On effect interpolation, skip lines that allready contain different effects
-        if(t->cursor_item >= 5 && (note_start + i)->fxtype != note_start->fxtype)
+        if(t->cursor_item >= 5 && (note_start + i * XM_PATTERN_WIDTH)->fxtype != note_start->fxtype)
             continue;
 
 	new_value = start_value + (int)((float)i * dy / (height - 1) + (dy >= 0 ? 1.0 : -1.0) * 0.5);
 	new_value &= xmnote_mask;
 	new_value |= (start_char & ~xmnote_mask);
 
-	*((guint8*)(note_start + i) + xmnote_offset) = new_value;
+	*((guint8*)(note_start + i * XM_PATTERN_WIDTH) + xmnote_offset) = new_value;
     }
 
     tracker_redraw(t);
 }
 
+void
+track_editor_interpolate_fx (Tracker *t)
+{
+    int height, width, chStart, rowStart;
+
+    if(!tracker_is_valid_selection(t))
+	return;
+
+    tracker_get_selection_rect(t, &chStart, &rowStart, &width, &height);
+    pattern_undo_begin(t->curpattern, chStart, 1, rowStart, height);
+    track_editor_interpolate_fx_column(t);
+    pattern_undo_end();
+}
+
 static void
 track_editor_handle_semidec_column_input (Tracker *t,
 					  int exp,
@@ -1322,7 +1385,7 @@ track_editor_handle_column_input (Tracker *t,
 				  int gdkkey)
 {
     int n;
-    XMNote *note = &t->curpattern->channels[t->cursor_ch][t->patpos];
+    XMNote *note = xm_pattern_note(t->curpattern, t->cursor_ch, t->patpos);
 
     if(t->cursor_item == 5) {
 	/* Effect column (not the parameter) */
@@ -1367,54 +1430,11 @@ track_editor_handle_column_input (Tracker *t,
     return TRUE;
 }
 
-static gint
-tracker_timeout (gpointer data)
-{
-    double display_songtime;
-    audio_player_pos *p;
-
-    if(current_driver_object == NULL) {
-	/* Can happen when audio thread stops on its own. Note that
-	 * tracker_stop_updating() is called in
-	 * gui.c::read_mixer_pipe(). */
-	return TRUE;
-    }
-
-    display_songtime = current_driver->get_play_time(current_driver_object);
-
-    p = time_buffer_get(audio_playerpos_tb, display_songtime);
-    if(p) {
-	gui_update_player_pos(p);
-    }
-    return TRUE;
-}
-
-void
-tracker_start_updating (void)
-{
-    if(gtktimer != -1)
-	return;
-
-    gtktimer = gtk_timeout_add(1000/update_freq, tracker_timeout, NULL);
-}
-
-void
-tracker_stop_updating (void)
-{
-    if(gtktimer == -1)
-	return;
-
-    gtk_timeout_remove(gtktimer);
-    gtktimer = -1;
-}
-
 void
 tracker_set_update_freq (int freq)
 {
-    update_freq = freq;
-    if(gtktimer != -1) {
-	tracker_stop_updating();
-	tracker_start_updating();
+    if(tracker_view) {
+	frame_clock_set_view_freq(tracker_view, freq);
     }
 }
 
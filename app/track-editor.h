@@ -53,8 +53,6 @@ void      track_editor_load_config         (void);
 void      track_editor_save_config         (void);
 
 /* Handling of real-time scrolling */
-void      tracker_start_updating      (void);
-void      tracker_stop_updating       (void);
 void      tracker_set_update_freq     (int);
 
 /* c'n'p operations */
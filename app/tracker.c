@@ -98,6 +98,8 @@ do { gdk_draw_rectangle(win, t->bg_gc, TRUE, x, y, w, h); } while(0)
 static guint tracker_signals[LAST_SIGNAL] = { 0 };
 
 static gint tracker_idle_draw_function (Tracker *t);
+static void print_notes_and_bars (GtkWidget *widget, GdkDrawable *win, int x, int y, int w, int h, int cursor_row);
+static void print_cursor (GtkWidget *widget, GdkDrawable *win);
 
 static void
 tracker_idle_draw (Tracker *t)
@@ -109,6 +111,23 @@ tracker_idle_draw (Tracker *t)
     }
 }
 
+static void
+tracker_share_channels (Tracker *t)
+{
+    g_atomic_int_set(&t->shared_channels, t->num_channels << 8 | t->cursor_ch);
+}
+
+void
+tracker_get_channels (Tracker *t,
+		      int *cursor_ch,
+		      int *num_channels)
+{
+    gint c = g_atomic_int_get(&t->shared_channels);
+
+    *cursor_ch = c & 0xff;
+    *num_channels = c >> 8;
+}
+
 void
 tracker_set_num_channels (Tracker *t,
 			  int n)
@@ -116,6 +135,7 @@ tracker_set_num_channels (Tracker *t,
     GtkWidget *widget = GTK_WIDGET(t);
 
     t->num_channels = n;
+    tracker_share_channels(t);
     if(GTK_WIDGET_REALIZED(widget)) {
 	init_display(t, widget->allocation.width, widget->allocation.height);
 	gtk_widget_queue_draw(widget);
@@ -150,12 +170,50 @@ tracker_redraw (Tracker *t)
     gtk_widget_queue_draw(GTK_WIDGET(t));
 }
 
+void
+tracker_redraw_rows (Tracker *t,
+		     int first,
+		     int last)
+{
+    GtkWidget *widget = GTK_WIDGET(t);
+    GdkDrawable *win;
+    int top, y, h;
+
+    if(!GTK_WIDGET_MAPPED(widget) || t->curpattern == NULL
+       || t->idle_handler || t->oldpos != t->patpos) {
+	/* The display is about to be redrawn from scratch anyway, or
+	   the picture on screen doesn't belong to patpos */
+	tracker_redraw(t);
+	return;
+    }
+
+    top = t->patpos - t->disp_cursor;
+    first = MAX(first, top);
+    last = MIN(last, top + t->disp_rows - 1);
+    if(first > last) {
+	return;
+    }
+
+    win = t->enable_backing_store ? (GdkDrawable*)t->pixmap : widget->window;
+    y = t->disp_starty + (first - top) * t->fonth;
+    h = (last - first + 1) * t->fonth;
+
+    print_notes_and_bars(widget, win, 0, y, widget->allocation.width, h, t->patpos);
+    if(t->patpos >= first && t->patpos <= last) {
+	print_cursor(widget, win);
+    }
+
+    if(t->enable_backing_store) {
+	gdk_draw_pixmap(widget->window, t->bg_gc, t->pixmap,
+			0, y, 0, y, widget->allocation.width, h);
+    }
+}
+
 void
 tracker_redraw_row (Tracker *t,
 		    int row)
 {
-    // This is yet to be optimized :-)
-    tracker_redraw(t);
+    tracker_redraw_rows(t, row, row);
 }
 
 void
@@ -229,6 +287,7 @@ tracker_set_xpanning (Tracker *t,
 		t->cursor_ch = t->leftchan;
 	    else if(t->cursor_ch >= t->leftchan + t->disp_numchans)
 		t->cursor_ch = t->leftchan + t->disp_numchans - 1;
+	    tracker_share_channels(t);
 	}
 	gtk_signal_emit(GTK_OBJECT(t), tracker_signals[SIG_XPANNING], t->leftchan, t->num_channels, t->disp_numchans);
     }
@@ -243,6 +302,8 @@ adjust_xpanning (Tracker *t)
 	tracker_set_xpanning(t, t->cursor_ch - t->disp_numchans + 1);
     else if(t->leftchan + t->disp_numchans > t->num_channels)
 	tracker_set_xpanning(t, t->num_channels - t->disp_numchans);
+
+    tracker_share_channels(t);
 }
 
 void
@@ -590,7 +651,7 @@ print_notes_line (GtkWidget *widget,
     
     /* The notes */
     for(numch += ch, bufpt = buf; ch < numch; ch++, bufpt += 14) {
-	note2string(&t->curpattern->channels[ch][row], bufpt);
+	note2string(xm_pattern_note(t->curpattern, ch, row), bufpt);
     }	
 
     gdk_draw_string(win, t->font, t->notes_gc, t->disp_startx, y, buf);
@@ -76,6 +76,9 @@ struct _Tracker
     int cursor_ch, cursor_item;
     int leftchan;
 
+    /* num_channels << 8 | cursor_ch, for other threads */
+    gint shared_channels;
+
     /* Block selection stuff */
     gboolean inSelMode;
     int sel_start_ch, sel_start_row;
@@ -108,6 +111,7 @@ void           	tracker_reset               (Tracker *t);
 void           	tracker_redraw              (Tracker *t);
 
 void           	tracker_redraw_row          (Tracker *t, int row);
+void           	tracker_redraw_rows         (Tracker *t, int first, int last);
 void           	tracker_redraw_current_row  (Tracker *t);
 
 /* These are the navigation functions. */
@@ -115,6 +119,10 @@ void           	tracker_step_cursor_item    (Tracker *t, int direction);
 void           	tracker_step_cursor_channel (Tracker *t, int direction);
 void            tracker_set_cursor_channel  (Tracker *t, int channel);
 void            tracker_set_cursor_item     (Tracker *t, int item);
+
+/* The cursor channel and number of channels, consistent with each
+   other; may be called from any thread */
+void            tracker_get_channels        (Tracker *t, int *cursor_ch, int *num_channels);
 void           	tracker_set_patpos          (Tracker *t, int row);
 void           	tracker_step_cursor_row     (Tracker *t, int direction);
 
@@ -27,6 +27,7 @@
 #include "gui.h"
 #include "st-subs.h"
 #include "track-editor.h"
+#include "pattern-undo.h"
 
 static GtkWidget *transposition_window = NULL,
     *transposition_scope_w[4],
@@ -40,6 +41,8 @@ transposition_close_requested (void)
     transposition_window = NULL;
 }
 
+/* The function gets the first note of each track; the following notes
+   of the track are XM_PATTERN_WIDTH apart */
 static void
 transposition_for_each (void (*function)(XMNote *track, int patlen, int data),
 			int functiondata)
@@ -47,12 +50,15 @@ transposition_for_each (void (*function)(XMNote *track, int patlen, int data),
     int i, j;
     int mode = find_current_toggle(transposition_scope_w, 4);
 
+    pattern_undo_begin(NULL, 0, 0, 0, 0);
+
     switch(mode) {
     case 0: // Whole Song
 	for(i = 0; i < sizeof(xm->patterns) / sizeof(xm->patterns[0]); i++) {
 	    if(st_is_pattern_used_in_song(xm, i)) {
 		for(j = 0; j < xm->num_channels; j++) {
-		    function(xm->patterns[i].channels[j], xm->patterns[i].length, functiondata);
+		    pattern_undo_watch(&xm->patterns[i], j, 1, 0, -1);
+		    function(xm_pattern_note(&xm->patterns[i], j, 0), xm->patterns[i].length, functiondata);
 		}
 	    }
 	}
@@ -60,22 +66,27 @@ transposition_for_each (void (*function)(XMNote *track, int patlen, int data),
     case 1: // All Patterns
 	for(i = 0; i < sizeof(xm->patterns) / sizeof(xm->patterns[0]); i++) {
 	    for(j = 0; j < xm->num_channels; j++) {
-		function(xm->patterns[i].channels[j], xm->patterns[i].length, functiondata);
+		pattern_undo_watch(&xm->patterns[i], j, 1, 0, -1);
+		function(xm_pattern_note(&xm->patterns[i], j, 0), xm->patterns[i].length, functiondata);
 	    }
 	}
 	break;
     case 2: // Current Pattern
 	i = gui_get_current_pattern();
 	for(j = 0; j < xm->num_channels; j++) {
-	    function(xm->patterns[i].channels[j], xm->patterns[i].length, functiondata);
+	    pattern_undo_watch(&xm->patterns[i], j, 1, 0, -1);
+	    function(xm_pattern_note(&xm->patterns[i], j, 0), xm->patterns[i].length, functiondata);
 	}
 	break;
     case 3: // Current Track
 	i = gui_get_current_pattern();
 	j = tracker->cursor_ch;
-	function(xm->patterns[i].channels[j], xm->patterns[i].length, functiondata);
+	pattern_undo_watch(&xm->patterns[i], j, 1, 0, -1);
+	function(xm_pattern_note(&xm->patterns[i], j, 0), xm->patterns[i].length, functiondata);
 	break;
     }
+
+    pattern_undo_end();
 }
 
 static void
@@ -89,7 +100,7 @@ transposition_transpose_notes_full (XMNote *track,
 	   && (instrument == -1 || instrument == track->instrument)) {
 	    track->note = CLAMP(track->note + add, 1, 96);
 	}
-	track++;
+	track += XM_PATTERN_WIDTH;
     }
 }
 
@@ -117,7 +128,7 @@ transposition_change_instruments_sub (XMNote *track,
 	    track->instrument = i2;
 	else if(mode == 0 && track->instrument == i2)
 	    track->instrument = i1;
-	track++;
+	track += XM_PATTERN_WIDTH;
     }
 }
 
@@ -160,10 +171,12 @@ transposition_transpose_selection (Tracker *t,
 
     tracker_get_selection_rect(t, &chStart, &rowStart, &width, &height);
 
+    pattern_undo_begin(t->curpattern, chStart, width, rowStart, height);
     for(i = chStart; i < chStart + width; i++) {
-	transposition_transpose_notes_full(t->curpattern->channels[i] + rowStart,
+	transposition_transpose_notes_full(xm_pattern_note(t->curpattern, i, rowStart),
 					   height, by, -1);
     }
+    pattern_undo_end();
 
     xm_set_modified(1);
     tracker_redraw(t);
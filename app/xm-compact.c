@@ -0,0 +1,918 @@
+/*
+ * The Real SoundTracker - compact native module format
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* File layout, all numbers little endian, strings in Latin-1:
+
+     magic "STCompact" 0x1a
+     header: u16 version, name[20], u16 flags, num_channels, tempo,
+             bpm, song_length, restart_position, num_patterns,
+             num_instruments
+     u8 order[song_length]
+     per pattern: u16 length, u32 size, packed notes
+     per instrument: name[22], u8 num_samples, samplemap[96],
+             volume and panning envelope (u8 num_points,
+             sustain_point, loop_start, loop_end, flags, then u16
+             pos, val per point), u8 vibtype, u16 vibrate, vibdepth,
+             vibsweep, volfade
+         per sample: name[22], u8 volume, finetune, panning, relnote,
+             flags (1: save as 8 bit, 2: 8 bit data), looptype,
+             u32 length, loopstart, loopend
+         per sample: u8 codec, u32 size, data
+
+   Patterns are packed channel by channel. A byte with the top bit
+   set skips 1..128 empty rows; otherwise its bits 0..4 tell which of
+   note, instrument, volume, effect and parameter differ from the
+   last non-empty cell of the channel, and those follow.
+
+   Sample data is kept exactly as it is in memory (8 or 16 bit). It
+   is coded in blocks with the best of the fixed polynomial
+   predictors of order 0 to 3, and the residuals are Rice coded with
+   a parameter chosen per block; if that doesn't pay off, the data is
+   stored raw. Everything comes with its size, so a file can be read
+   front to back, and the samples can be decoded in parallel. */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "i18n.h"
+#include "xm-compact.h"
+#include "endian-conv.h"
+#include "errors.h"
+#include "st-subs.h"
+#include "xm-player.h"
+
+#define XM_COMPACT_VERSION 1
+
+#define HEADER_SIZE        38
+#define INSTRUMENT_SIZE    (22 + 1 + 96)
+#define VIBRATO_SIZE       9
+#define SAMPLE_SIZE        44
+
+/* Samples are coded in blocks of this many frames */
+#define BLOCK_LENGTH 4096
+
+/* Unary codes of this length are an escape, the value follows in 32
+   bits. Keeps outliers cheap to code and to decode. */
+#define RICE_ESCAPE 32
+
+#define MAX_SAMPLE_LENGTH (1 << 28)
+#define MAX_DECODE_THREADS 8
+
+enum {
+    CODEC_RAW = 0,
+    CODEC_RICE
+};
+
+/* === Writing bits and bytes */
+
+typedef struct buffer {
+    guint8 *data;
+    guint32 length, alloc;
+    guint64 acc;                 // pending bits, the newest lowest
+    int bits;
+} buffer;
+
+static inline void
+buffer_byte (buffer *b,
+	     guint8 c)
+{
+    if(b->length == b->alloc) {
+	b->alloc = b->alloc ? 2 * b->alloc : 4096;
+	b->data = g_realloc(b->data, b->alloc);
+    }
+    b->data[b->length++] = c;
+}
+
+/* Appends the lowest n (<= 32) bits of value, most significant first */
+static inline void
+buffer_bits (buffer *b,
+	     guint32 value,
+	     int n)
+{
+    b->acc = (b->acc << n) | (value & (((guint64)1 << n) - 1));
+    b->bits += n;
+    while(b->bits >= 8) {
+	b->bits -= 8;
+	buffer_byte(b, b->acc >> b->bits);
+    }
+}
+
+static void
+buffer_flush_bits (buffer *b)
+{
+    if(b->bits > 0) {
+	buffer_bits(b, 0, 8 - b->bits);
+    }
+}
+
+static inline void
+buffer_rice (buffer *b,
+	     guint32 u,
+	     int k)
+{
+    guint32 q = u >> k;
+
+    if(q < RICE_ESCAPE) {
+	buffer_bits(b, 1, q + 1);
+	if(k) {
+	    buffer_bits(b, u, k);
+	}
+    } else {
+	buffer_bits(b, 0, RICE_ESCAPE);
+	buffer_bits(b, u, 32);
+    }
+}
+
+/* === Reading bits */
+
+typedef struct bitreader {
+    const guint8 *data;
+    guint32 length, pos;
+    guint64 acc;                 // the lowest 'bits' bits are unread
+    int bits;
+    gboolean error;
+} bitreader;
+
+static inline void
+bitreader_fill (bitreader *r)
+{
+    r->acc <<= 8;
+    if(r->pos < r->length) {
+	r->acc |= r->data[r->pos++];
+    } else {
+	r->error = TRUE;
+    }
+    r->bits += 8;
+}
+
+static inline guint32
+bitreader_get (bitreader *r,
+	       int n)
+{
+    while(r->bits < n) {
+	bitreader_fill(r);
+    }
+    r->bits -= n;
+    return (r->acc >> r->bits) & (((guint64)1 << n) - 1);
+}
+
+/* Returns the number of zeros before the next one (which is skipped),
+   or RICE_ESCAPE */
+static inline guint32
+bitreader_unary (bitreader *r)
+{
+    guint32 q = 0, avail;
+    int n, z;
+
+    while(q < RICE_ESCAPE && !r->error) {
+	if(r->bits == 0) {
+	    bitreader_fill(r);
+	}
+	n = MIN(r->bits, MIN(24, RICE_ESCAPE - q));
+	avail = (r->acc >> (r->bits - n)) & ((1 << n) - 1);
+	if(avail) {
+	    z = n - 1 - g_bit_nth_msf(avail, -1);
+	    r->bits -= z + 1;
+	    return q + z;
+	}
+	r->bits -= n;
+	q += n;
+    }
+
+    return RICE_ESCAPE;
+}
+
+/* === Samples */
+
+static inline guint32
+zigzag (gint32 e)
+{
+    return ((guint32)e << 1) ^ (guint32)(e >> 31);
+}
+
+/* x points at the current frame, preceded by at least three others */
+static inline gint32
+predict (const gint32 *x,
+	 int order)
+{
+    switch(order) {
+    case 0:
+	return 0;
+    case 1:
+	return x[-1];
+    case 2:
+	return 2 * x[-1] - x[-2];
+    default:
+	return 3 * x[-1] - 3 * x[-2] + x[-3];
+    }
+}
+
+static guint8 *
+xm_compact_encode (st_mixer_sample_info *s,
+		   guint32 *size)
+{
+    gint32 x[3 + BLOCK_LENGTH];
+    guint64 sums[4], cost, best_cost;
+    buffer b = { NULL, 0, 0, 0, 0 };
+    guint32 start, n, i;
+    int order, k, best_order, best_k;
+
+    memset(x, 0, 3 * sizeof(x[0]));
+
+    for(start = 0; start < s->length; start += n) {
+	n = MIN(BLOCK_LENGTH, s->length - start);
+
+	if(s->format == ST_MIXER_SAMPLE_FORMAT_8BIT) {
+	    const gint8 *d8 = (gint8*)s->data + start;
+	    for(i = 0; i < n; i++)
+		x[3 + i] = d8[i];
+	} else {
+	    const gint16 *d16 = s->data + start;
+	    for(i = 0; i < n; i++)
+		x[3 + i] = d16[i];
+	}
+
+	// Pick the predictor with the smallest residuals, and the Rice
+	// parameter that suits them
+	memset(sums, 0, sizeof(sums));
+	for(i = 3; i < n + 3; i++) {
+	    sums[0] += zigzag(x[i]);
+	    sums[1] += zigzag(x[i] - x[i - 1]);
+	    sums[2] += zigzag(x[i] - 2 * x[i - 1] + x[i - 2]);
+	    sums[3] += zigzag(x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3]);
+	}
+
+	best_cost = G_MAXUINT64;
+	best_order = best_k = 0;
+	for(order = 0; order < 4; order++) {
+	    for(k = 0; k < 24; k++) {
+		cost = (guint64)n * (k + 1) + (sums[order] >> k);
+		if(cost < best_cost) {
+		    best_cost = cost;
+		    best_order = order;
+		    best_k = k;
+		}
+	    }
+	}
+
+	buffer_bits(&b, best_order, 2);
+	buffer_bits(&b, best_k, 5);
+	for(i = 3; i < n + 3; i++) {
+	    buffer_rice(&b, zigzag(x[i] - predict(x + i, best_order)), best_k);
+	}
+
+	// The last frames are the history of the next block
+	x[0] = x[n];
+	x[1] = x[n + 1];
+	x[2] = x[n + 2];
+    }
+
+    buffer_flush_bits(&b);
+    *size = b.length;
+    return b.data;
+}
+
+static gboolean
+xm_compact_decode (st_mixer_sample_info *s,
+		   const guint8 *data,
+		   guint32 size)
+{
+    bitreader r = { data, size, 0, 0, 0, FALSE };
+    gint32 x[3 + BLOCK_LENGTH];
+    gint32 lo, hi, v;
+    guint32 start, n, i, q, u;
+    int order, k;
+
+    if(s->format == ST_MIXER_SAMPLE_FORMAT_8BIT) {
+	lo = -128;
+	hi = 127;
+    } else {
+	lo = -32768;
+	hi = 32767;
+    }
+
+    memset(x, 0, 3 * sizeof(x[0]));
+
+    for(start = 0; start < s->length; start += n) {
+	n = MIN(BLOCK_LENGTH, s->length - start);
+
+	order = bitreader_get(&r, 2);
+	k = bitreader_get(&r, 5);
+	for(i = 3; i < n + 3; i++) {
+	    q = bitreader_unary(&r);
+	    if(q == RICE_ESCAPE) {
+		u = bitreader_get(&r, 32);
+	    } else {
+		u = (q << k) | (k ? bitreader_get(&r, k) : 0);
+	    }
+	    v = predict(x + i, order) + (gint32)((u >> 1) ^ -(u & 1));
+	    if(v < lo || v > hi) {
+		return FALSE;
+	    }
+	    x[i] = v;
+	}
+	if(r.error) {
+	    return FALSE;
+	}
+
+	if(s->format == ST_MIXER_SAMPLE_FORMAT_8BIT) {
+	    gint8 *d8 = (gint8*)s->data + start;
+	    for(i = 0; i < n; i++)
+		d8[i] = x[3 + i];
+	} else {
+	    gint16 *d16 = s->data + start;
+	    for(i = 0; i < n; i++)
+		d16[i] = x[3 + i];
+	}
+
+	x[0] = x[n];
+	x[1] = x[n + 1];
+	x[2] = x[n + 2];
+    }
+
+    return TRUE;
+}
+
+/* === Patterns */
+
+static void
+xm_compact_pack_pattern (buffer *b,
+			 XMPattern *p,
+			 int num_channels)
+{
+    static const XMNote empty;
+    XMNote prev, *n;
+    int ch, row, run, mask;
+
+    for(ch = 0; ch < num_channels; ch++) {
+	memset(&prev, 0, sizeof(prev));
+	for(row = 0; row < p->length; ) {
+	    n = xm_pattern_note(p, ch, row);
+	    if(!memcmp(n, &empty, sizeof(XMNote))) {
+		for(run = 1; run < 128 && row + run < p->length; run++) {
+		    if(memcmp(xm_pattern_note(p, ch, row + run), &empty, sizeof(XMNote)))
+			break;
+		}
+		buffer_byte(b, 0x80 | (run - 1));
+		row += run;
+		continue;
+	    }
+
+	    mask = (n->note != prev.note)
+		| (n->instrument != prev.instrument) << 1
+		| (n->volume != prev.volume) << 2
+		| (n->fxtype != prev.fxtype) << 3
+		| (n->fxparam != prev.fxparam) << 4;
+	    buffer_byte(b, mask);
+	    if(mask & 1)
+		buffer_byte(b, n->note);
+	    if(mask & 2)
+		buffer_byte(b, n->instrument);
+	    if(mask & 4)
+		buffer_byte(b, n->volume);
+	    if(mask & 8)
+		buffer_byte(b, n->fxtype);
+	    if(mask & 16)
+		buffer_byte(b, n->fxparam);
+	    prev = *n;
+	    row++;
+	}
+    }
+}
+
+static gboolean
+xm_compact_unpack_pattern (XMPattern *p,
+			   int num_channels,
+			   const guint8 *data,
+			   guint32 size)
+{
+    const guint8 *end = data + size;
+    XMNote prev, *n;
+    int ch, row, mask;
+
+    for(ch = 0; ch < num_channels; ch++) {
+	memset(&prev, 0, sizeof(prev));
+	for(row = 0; row < p->length; ) {
+	    if(data == end)
+		return FALSE;
+	    mask = *data++;
+	    if(mask & 0x80) {
+		row += (mask & 0x7f) + 1;
+		continue;
+	    }
+	    if(end - data < (mask & 1) + (mask >> 1 & 1) + (mask >> 2 & 1) + (mask >> 3 & 1) + (mask >> 4 & 1))
+		return FALSE;
+	    if(mask & 1)
+		prev.note = *data++;
+	    if(mask & 2)
+		prev.instrument = *data++;
+	    if(mask & 4)
+		prev.volume = *data++;
+	    if(mask & 8)
+		prev.fxtype = *data++;
+	    if(mask & 16)
+		prev.fxparam = *data++;
+	    n = xm_pattern_note(p, ch, row);
+	    *n = prev;
+	    row++;
+	}
+	if(row != p->length)
+	    return FALSE;
+    }
+
+    return data == end;
+}
+
+int
+xm_compact_num_patterns (XM *xm)
+{
+    int i, n = st_num_save_patterns(xm);
+
+    for(i = 0; i < xm->song_length; i++) {
+	n = MAX(n, xm->pattern_order_table[i] + 1);
+    }
+    for(i = n; i < 256; i++) {
+	if(xm->patterns[i].length != 64)
+	    n = i + 1;
+    }
+
+    return n;
+}
+
+/* === Saving */
+
+static void
+xm_compact_put_envelope (buffer *b,
+			 STEnvelope *e)
+{
+    guint8 h[4];
+    int i;
+
+    buffer_byte(b, e->num_points);
+    buffer_byte(b, e->sustain_point);
+    buffer_byte(b, e->loop_start);
+    buffer_byte(b, e->loop_end);
+    buffer_byte(b, e->flags);
+    for(i = 0; i < e->num_points && i < ST_MAX_ENVELOPE_POINTS; i++) {
+	put_le_16(h + 0, e->points[i].pos);
+	put_le_16(h + 2, e->points[i].val);
+	buffer_byte(b, h[0]);
+	buffer_byte(b, h[1]);
+	buffer_byte(b, h[2]);
+	buffer_byte(b, h[3]);
+    }
+}
+
+static void
+xm_compact_save_instrument (STInstrument *ins,
+			    FILE *f,
+			    gboolean song,
+			    xm_compact_progress progress,
+			    gpointer data)
+{
+    buffer b = { NULL, 0, 0, 0, 0 };
+    guint8 h[SAMPLE_SIZE], *code;
+    guint32 size, bytes;
+    int i, num_samples;
+    STSample *s;
+    st_mixer_sample_info info[16];
+
+    num_samples = song ? 0 : st_instrument_num_save_samples(ins);
+
+    /* 8 bit data is only kept for samples to be saved with 8 bits, the
+       loader refuses anything else. Other 8 bit data is widened. */
+    for(i = 0; i < num_samples; i++) {
+	s = &ins->samples[i];
+	info[i] = s->sample;
+	if(info[i].format == ST_MIXER_SAMPLE_FORMAT_8BIT && !s->treat_as_8bit && info[i].data) {
+	    info[i].data = g_new(gint16, info[i].length);
+	    st_convert_sample(s->sample.data, info[i].data, 8, 16, info[i].length);
+	    info[i].format = ST_MIXER_SAMPLE_FORMAT_16BIT;
+	}
+    }
+
+    memset(h, 0, sizeof(h));
+    strncpy(h, ins->name, 22);
+    h[22] = num_samples;
+    fwrite(h, 1, 23, f);
+    fwrite(ins->samplemap, 1, 96, f);
+
+    xm_compact_put_envelope(&b, &ins->vol_env);
+    xm_compact_put_envelope(&b, &ins->pan_env);
+    fwrite(b.data, 1, b.length, f);
+    g_free(b.data);
+
+    h[0] = ins->vibtype;
+    put_le_16(h + 1, ins->vibrate);
+    put_le_16(h + 3, ins->vibdepth);
+    put_le_16(h + 5, ins->vibsweep);
+    put_le_16(h + 7, ins->volfade);
+    fwrite(h, 1, VIBRATO_SIZE, f);
+
+    for(i = 0; i < num_samples; i++) {
+	s = &ins->samples[i];
+	memset(h, 0, sizeof(h));
+	strncpy(h, s->name, 22);
+	h[22] = s->volume;
+	h[23] = s->finetune;
+	h[24] = s->panning;
+	h[25] = s->relnote;
+	h[26] = (s->treat_as_8bit ? 1 : 0) | (info[i].format == ST_MIXER_SAMPLE_FORMAT_8BIT ? 2 : 0);
+	h[27] = s->sample.looptype;
+	put_le_32(h + 28, s->sample.length);
+	put_le_32(h + 32, s->sample.loopstart);
+	put_le_32(h + 36, s->sample.loopend);
+	fwrite(h, 1, SAMPLE_SIZE - 4, f);
+    }
+
+    for(i = 0; i < num_samples; i++) {
+	bytes = info[i].data ? info[i].length * st_sample_bytes_per_sample(&info[i]) : 0;
+	code = bytes ? xm_compact_encode(&info[i], &size) : NULL;
+
+	if(code && size < bytes) {
+	    h[0] = CODEC_RICE;
+	    put_le_32(h + 1, size);
+	    fwrite(h, 1, 5, f);
+	    fwrite(code, 1, size, f);
+	} else {
+	    h[0] = CODEC_RAW;
+	    put_le_32(h + 1, bytes);
+	    fwrite(h, 1, 5, f);
+	    if(info[i].format == ST_MIXER_SAMPLE_FORMAT_8BIT) {
+		fwrite(info[i].data, 1, bytes, f);
+	    } else if(bytes) {
+		gint16 *tmp = g_memdup(info[i].data, bytes);
+		le_16_array_to_host_order(tmp, bytes / 2);
+		fwrite(tmp, 1, bytes, f);
+		g_free(tmp);
+	    }
+	}
+	g_free(code);
+	if(info[i].data != ins->samples[i].sample.data) {
+	    g_free(info[i].data);
+	}
+
+	if(progress)
+	    progress(bytes, data);
+    }
+}
+
+gboolean
+xm_compact_save (XM *xm,
+		 FILE *f,
+		 gboolean song,
+		 xm_compact_progress progress,
+		 gpointer data)
+{
+    buffer b = { NULL, 0, 0, 0, 0 };
+    guint8 h[HEADER_SIZE];
+    int i, num_patterns, num_instruments;
+
+    num_patterns = xm_compact_num_patterns(xm);
+    num_instruments = st_num_save_instruments(xm);
+
+    fwrite(XM_COMPACT_MAGIC, 1, XM_COMPACT_MAGIC_LENGTH, f);
+
+    memset(h, 0, sizeof(h));
+    put_le_16(h + 0, XM_COMPACT_VERSION);
+    strncpy(h + 2, xm->name, 20);
+    put_le_16(h + 22, xm->flags);
+    put_le_16(h + 24, xm->num_channels);
+    put_le_16(h + 26, xm->tempo);
+    put_le_16(h + 28, xm->bpm);
+    put_le_16(h + 30, xm->song_length);
+    put_le_16(h + 32, xm->restart_position);
+    put_le_16(h + 34, num_patterns);
+    put_le_16(h + 36, num_instruments);
+    fwrite(h, 1, HEADER_SIZE, f);
+    fwrite(xm->pattern_order_table, 1, xm->song_length, f);
+
+    for(i = 0; i < num_patterns; i++) {
+	b.length = 0;
+	xm_compact_pack_pattern(&b, &xm->patterns[i], xm->num_channels);
+	put_le_16(h + 0, xm->patterns[i].length);
+	put_le_32(h + 2, b.length);
+	fwrite(h, 1, 6, f);
+	fwrite(b.data, 1, b.length, f);
+	if(progress)
+	    progress(xm->patterns[i].length * xm->num_channels, data);
+    }
+    g_free(b.data);
+
+    for(i = 0; i < num_instruments; i++) {
+	xm_compact_save_instrument(&xm->instruments[i], f, song, progress, data);
+    }
+
+    return !ferror(f);
+}
+
+/* === Loading */
+
+typedef struct decode_job {
+    st_mixer_sample_info *sample;
+    guint8 *code;
+    guint32 size;
+} decode_job;
+
+typedef struct decode_queue {
+    GPtrArray *jobs;
+    GMutex *mutex;
+    guint next;
+    gboolean failed;
+} decode_queue;
+
+static gpointer
+xm_compact_decode_thread (gpointer data)
+{
+    decode_queue *q = data;
+    decode_job *j;
+    gboolean ok;
+
+    while(1) {
+	g_mutex_lock(q->mutex);
+	j = q->next < q->jobs->len ? g_ptr_array_index(q->jobs, q->next++) : NULL;
+	g_mutex_unlock(q->mutex);
+	if(!j)
+	    break;
+
+	ok = xm_compact_decode(j->sample, j->code, j->size);
+	g_free(j->code);
+	j->code = NULL;
+
+	if(!ok) {
+	    g_mutex_lock(q->mutex);
+	    q->failed = TRUE;
+	    g_mutex_unlock(q->mutex);
+	}
+    }
+
+    return NULL;
+}
+
+/* Decodes the samples on as many processors as there are, returns
+   FALSE if any of them is damaged */
+static gboolean
+xm_compact_decode_all (GPtrArray *jobs)
+{
+    decode_queue q;
+    GThread *threads[MAX_DECODE_THREADS];
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int i, n;
+
+    q.jobs = jobs;
+    q.mutex = g_mutex_new();
+    q.next = 0;
+    q.failed = FALSE;
+
+    n = CLAMP(cpus, 1, MAX_DECODE_THREADS);
+    n = MIN(n, (int)jobs->len) - 1;
+    for(i = 0; i < n; i++) {
+	if(!(threads[i] = g_thread_create(xm_compact_decode_thread, &q, TRUE, NULL)))
+	    break;
+    }
+    n = i;
+
+    xm_compact_decode_thread(&q);
+
+    for(i = 0; i < n; i++) {
+	g_thread_join(threads[i]);
+    }
+    g_mutex_free(q.mutex);
+
+    return !q.failed;
+}
+
+static gboolean
+xm_compact_get_envelope (FILE *f,
+			 STEnvelope *e)
+{
+    guint8 h[5 + 4 * ST_MAX_ENVELOPE_POINTS];
+    int i;
+
+    if(fread(h, 1, 5, f) != 5 || h[0] > ST_MAX_ENVELOPE_POINTS)
+	return FALSE;
+    if(fread(h + 5, 4, h[0], f) != h[0])
+	return FALSE;
+
+    e->num_points = h[0];
+    e->sustain_point = h[1];
+    e->loop_start = h[2];
+    e->loop_end = h[3];
+    e->flags = h[4];
+    for(i = 0; i < e->num_points; i++) {
+	e->points[i].pos = get_le_16(h + 5 + 4 * i);
+	e->points[i].val = get_le_16(h + 7 + 4 * i);
+    }
+
+    return TRUE;
+}
+
+static gboolean
+xm_compact_load_instrument (STInstrument *ins,
+			    FILE *f,
+			    GPtrArray *jobs)
+{
+    guint8 h[INSTRUMENT_SIZE + SAMPLE_SIZE];
+    int i, num_samples;
+    guint32 size, bytes;
+    STSample *s;
+    decode_job *j;
+
+    if(fread(h, 1, INSTRUMENT_SIZE, f) != INSTRUMENT_SIZE)
+	return FALSE;
+    memcpy(ins->name, h, 22);
+    ins->name[22] = 0;
+    num_samples = h[22];
+    memcpy(ins->samplemap, h + 23, 96);
+    if(num_samples > 16)
+	return FALSE;
+
+    if(!xm_compact_get_envelope(f, &ins->vol_env)
+       || !xm_compact_get_envelope(f, &ins->pan_env)
+       || fread(h, 1, VIBRATO_SIZE, f) != VIBRATO_SIZE)
+	return FALSE;
+    xmplayer_envelopes_changed();
+    ins->vibtype = h[0];
+    ins->vibrate = get_le_16(h + 1);
+    ins->vibdepth = get_le_16(h + 3);
+    ins->vibsweep = get_le_16(h + 5);
+    ins->volfade = get_le_16(h + 7);
+
+    for(i = 0; i < num_samples; i++) {
+	s = &ins->samples[i];
+	if(fread(h, 1, SAMPLE_SIZE - 4, f) != SAMPLE_SIZE - 4)
+	    return FALSE;
+	memcpy(s->name, h, 22);
+	s->name[22] = 0;
+	s->volume = h[22];
+	s->finetune = h[23];
+	s->panning = h[24];
+	s->relnote = h[25];
+	s->treat_as_8bit = (h[26] & 1) != 0;
+	s->sample.format = h[26] & 2 ? ST_MIXER_SAMPLE_FORMAT_8BIT : ST_MIXER_SAMPLE_FORMAT_16BIT;
+	s->sample.looptype = h[27];
+	s->sample.length = get_le_32(h + 28);
+	s->sample.loopstart = get_le_32(h + 32);
+	s->sample.loopend = get_le_32(h + 36);
+
+	// 8 bit data is only kept for samples saved with 8 bits
+	if((h[26] & 2 && !(h[26] & 1))
+	   || s->sample.looptype > ST_MIXER_SAMPLE_LOOPTYPE_PINGPONG
+	   || s->sample.length > MAX_SAMPLE_LENGTH
+	   || (s->sample.length && (s->sample.loopend > s->sample.length
+				    || s->sample.loopstart > s->sample.loopend)))
+	    return FALSE;
+    }
+
+    for(i = 0; i < num_samples; i++) {
+	s = &ins->samples[i];
+	bytes = s->sample.length * st_sample_bytes_per_sample(&s->sample);
+	if(fread(h, 1, 5, f) != 5)
+	    return FALSE;
+	size = get_le_32(h + 1);
+
+	if(bytes && !(s->sample.data = malloc(bytes)))
+	    return FALSE;
+
+	if(h[0] == CODEC_RAW) {
+	    if(size != bytes || fread(s->sample.data, 1, bytes, f) != bytes)
+		return FALSE;
+	    if(s->sample.format == ST_MIXER_SAMPLE_FORMAT_16BIT)
+		le_16_array_to_host_order(s->sample.data, s->sample.length);
+	} else if(h[0] == CODEC_RICE && bytes && size <= bytes) {
+	    j = g_new(decode_job, 1);
+	    j->sample = &s->sample;
+	    j->size = size;
+	    j->code = g_malloc(size);
+	    g_ptr_array_add(jobs, j);
+	    if(fread(j->code, 1, size, f) != size)
+		return FALSE;
+	} else {
+	    return FALSE;
+	}
+    }
+
+    return TRUE;
+}
+
+XM *
+xm_compact_load (FILE *f)
+{
+    XM *xm;
+    GPtrArray *jobs;
+    guint8 h[HEADER_SIZE], *code = NULL;
+    int i, num_patterns, num_instruments, length;
+    guint32 size;
+    gboolean ok = FALSE;
+
+    if(fread(h, 1, XM_COMPACT_MAGIC_LENGTH, f) != XM_COMPACT_MAGIC_LENGTH
+       || memcmp(h, XM_COMPACT_MAGIC, XM_COMPACT_MAGIC_LENGTH)
+       || fread(h, 1, HEADER_SIZE, f) != HEADER_SIZE) {
+	error_error(_("Error while loading the module header."));
+	return NULL;
+    }
+    if(get_le_16(h + 0) > XM_COMPACT_VERSION) {
+	error_error(_("The module was saved by a newer version of SoundTracker."));
+	return NULL;
+    }
+
+    if(!(xm = XM_New())) {
+	error_error(_("Out of memory."));
+	return NULL;
+    }
+    jobs = g_ptr_array_new();
+
+    memcpy(xm->name, h + 2, 20);
+    xm->name[20] = 0;
+    xm->flags = get_le_16(h + 22);
+    xm->num_channels = get_le_16(h + 24);
+    xm->tempo = get_le_16(h + 26);
+    xm->bpm = get_le_16(h + 28);
+    xm->song_length = get_le_16(h + 30);
+    xm->restart_position = get_le_16(h + 32);
+    num_patterns = get_le_16(h + 34);
+    num_instruments = get_le_16(h + 36);
+    player_tempo = xm->tempo;
+    player_bpm = xm->bpm;
+
+    if(xm->num_channels < 1 || xm->num_channels > 32
+       || xm->song_length < 1 || xm->song_length > 256
+       || xm->restart_position >= xm->song_length
+       || num_patterns > 256 || num_instruments > 128
+       || fread(xm->pattern_order_table, 1, xm->song_length, f) != xm->song_length) {
+	error_error(_("Error while loading the module header."));
+	goto ende;
+    }
+
+    for(i = 0; i < num_patterns; i++) {
+	if(fread(h, 1, 6, f) != 6) {
+	    goto pattern_error;
+	}
+	length = get_le_16(h + 0);
+	size = get_le_32(h + 2);
+	if(length < 1 || length > 256 || size > 256 * 32 * 6) {
+	    goto pattern_error;
+	}
+
+	st_free_pattern_channels(&xm->patterns[i]);
+	code = g_realloc(code, size);
+	if(!st_init_pattern_channels(&xm->patterns[i], length)
+	   || fread(code, 1, size, f) != size
+	   || !xm_compact_unpack_pattern(&xm->patterns[i], xm->num_channels, code, size)) {
+	    goto pattern_error;
+	}
+    }
+
+    for(i = 0; i < num_instruments; i++) {
+	if(!xm_compact_load_instrument(&xm->instruments[i], f, jobs)) {
+	    error_error(_("Error while loading instruments."));
+	    goto ende;
+	}
+    }
+
+    if(!xm_compact_decode_all(jobs)) {
+	error_error(_("Error while loading instruments."));
+	goto ende;
+    }
+
+    ok = TRUE;
+    goto ende;
+
+  pattern_error:
+    error_error(_("Error while loading patterns."));
+  ende:
+    for(i = 0; i < jobs->len; i++) {
+	decode_job *j = g_ptr_array_index(jobs, i);
+	g_free(j->code);
+	g_free(j);
+    }
+    g_ptr_array_free(jobs, TRUE);
+    g_free(code);
+
+    if(!ok) {
+	XM_Free(xm);
+	return NULL;
+    }
+    return xm;
+}
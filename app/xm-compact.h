@@ -0,0 +1,59 @@
+/*
+ * The Real SoundTracker - compact native module format (header)
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _XM_COMPACT_H
+#define _XM_COMPACT_H
+
+#include <stdio.h>
+
+#include <glib.h>
+
+#include "xm.h"
+
+/* Modules saved under a name with this extension are written in the
+   compact format; any other name gets an XM. XM_Load() recognizes
+   compact files by their magic, whatever they are called. */
+#define XM_COMPACT_EXTENSION    ".stc"
+#define XM_COMPACT_MAGIC        "STCompact\x1a"
+#define XM_COMPACT_MAGIC_LENGTH 10
+
+/* Called with the number of bytes of pattern / sample data written
+   since the last call */
+typedef void (*xm_compact_progress) (gint64 bytes, gpointer data);
+
+/* Writes the module to f; in song mode without the sample data, like
+   XM_Save(). Returns FALSE on write errors. */
+gboolean      xm_compact_save         (XM *xm,
+				       FILE *f,
+				       gboolean song,
+				       xm_compact_progress progress,
+				       gpointer data);
+
+/* Number of patterns xm_compact_save() writes: unlike in XMs, trailing
+   empty patterns are kept if they are in the order table or don't
+   have the default length */
+int           xm_compact_num_patterns (XM *xm);
+
+/* Reads a module from f, which is positioned at the magic. The file
+   is only read front to back, so it may as well be a pipe. Returns
+   NULL (after telling the user) if it is damaged. */
+XM*           xm_compact_load         (FILE *f);
+
+#endif /* _XM_COMPACT_H */
@@ -67,26 +67,85 @@ env_interpolate (int v1, int v2, int p1, int p, int p2)
     return (p - p1) * (v2 - v1) / (p2 - p1);
 }
 
-static int
-env_handle (STEnvelope *env, guint32 *p, guint8 sustain)
+/* Envelopes are flattened to one value per tick before playing. Each
+   table remembers the value of env_serial it was made at; whoever
+   changes an envelope (the envelope editor, the loaders, st-subs.c)
+   calls xmplayer_envelopes_changed(), so that the tables in use are
+   rebuilt at the next tick. Starting to play, possibly another module,
+   does the same. */
+
+typedef struct env_table {
+    STEnvelope env;             /* copy the values were computed from */
+    int serial;
+    int length;
+    int alloc_length;
+    guint8 *vals;               /* length + 1 values, 0..64 */
+} env_table;
+
+static env_table vol_env_tables[128], pan_env_tables[128];
+static gint env_serial = 1;
+
+void
+xmplayer_envelopes_changed (void)
 {
-    int i, v;
+    g_atomic_int_inc(&env_serial);
+}
 
-    /* this happens sometimes in KB's "m6v-tlb.xm". i think it's a bug in the player somewhere. */
-    if(*p > env_length(env))
-	*p = env_length(env);
+static void
+env_compile (env_table *t,
+	     STEnvelope *env)
+{
+    int i, p;
 
-    for(i = env->num_points - 1; i >= 1; i--) {
-	if(env->points[i].pos <= *p)
-	    break;
+    t->serial = g_atomic_int_get(&env_serial);
+    memcpy(&t->env, env, sizeof(t->env));
+    env = &t->env;
+    t->length = env_length(env);
+
+    if(t->alloc_length < t->length + 1) {
+	t->alloc_length = t->length + 1;
+	g_free(t->vals);
+	t->vals = g_new(guint8, t->alloc_length);
+    }
+
+    for(p = 0, i = 0; p <= t->length; p++) {
+	while(i < env->num_points - 1 && env->points[i + 1].pos <= p)
+	    i++;
+
+	t->vals[p] = env->points[i].val;
+	if(p != env->points[i].pos) {
+	    t->vals[p] += env_interpolate(env->points[i].val, env->points[i+1].val, env->points[i].pos, p, env->points[i+1].pos);
+	}
     }
+}
+
+static inline env_table *
+env_get_table (env_table *tables,
+	       STInstrument *ins,
+	       STEnvelope *env)
+{
+    env_table *t = &tables[ins - xm->instruments];
 
-    v = env->points[i].val;
-    if(*p != env->points[i].pos) {
-	v += env_interpolate(env->points[i].val, env->points[i+1].val, env->points[i].pos, *p, env->points[i+1].pos);
+    if(t->serial != g_atomic_int_get(&env_serial)) {
+	env_compile(t, env);
     }
 
-    if(*p < env_length(env) && !(sustain && (env->flags & EF_SUSTAIN) && *p == env->points[env->sustain_point].pos)) {
+    return t;
+}
+
+static int
+env_handle (env_table *t, guint32 *p, guint8 sustain)
+{
+    STEnvelope *env = &t->env;
+    int v;
+
+    /* this happens sometimes in KB's "m6v-tlb.xm". i think it's a bug in the player somewhere. */
+    if(*p > t->length)
+	*p = t->length;
+
+    v = t->vals[*p];
+
+    if(*p < t->length && !(sustain && (env->flags & EF_SUSTAIN) && *p == env->points[env->sustain_point].pos)) {
 	*p += 1;
 	if(env->flags & EF_LOOP) {
 	    if(*p == env->points[env->loop_end].pos
@@ -100,10 +159,46 @@ env_handle (STEnvelope *env, guint32 *p, guint8 sustain)
     return 4 * v;
 }
 
+/* pitch_to_freq() is split into an octave, handled by ldexp(), and a
+   position within the octave, looked up in pitchtab. */
+static double pitchtab[PITCH_OCTAVE];
+
+/* Filter cutoff frequencies for the 256 cutoff values */
+static double cutofftab[256];
+
+/* One period of sin(), for vibrato, tremolo and autovibrato */
+static double sintab[256];
+
+static void
+xm_player_init_tables (void)
+{
+    static gboolean done = FALSE;
+    int i;
+
+    if(done)
+	return;
+
+    for(i = 0; i < PITCH_OCTAVE; i++)
+	pitchtab[i] = 8363 * pow(2, -(double)i / PITCH_OCTAVE);
+    for(i = 0; i < 256; i++)
+	cutofftab[i] = 0.5 * pow(2,(float)(i-255)/32.0);
+    for(i = 0; i < 256; i++)
+	sintab[i] = sin(2 * M_PI * (double)i / 256);
+
+    done = TRUE;
+}
+
 static inline double
 pitch_to_freq (int pitch)
 {
-    return 8363 * pow(2,( (float)(- pitch) / (float)PITCH_OCTAVE));
+    int oct = pitch / PITCH_OCTAVE, frac = pitch % PITCH_OCTAVE;
+
+    if(frac < 0) {
+	oct--;
+	frac += PITCH_OCTAVE;
+    }
+
+    return ldexp(pitchtab[frac], -oct);
 }
 
 static inline guint32
@@ -687,18 +782,19 @@ xmplayer_final_channel_ops (int chnr)
 	}
 
 	if(ch->curins->vol_env.flags & EF_ON) {
-	    vol = (vol * env_handle(&ch->curins->vol_env, &ch->chVolEnvPos, ch->chSustain)) >> 8;
+	    vol = (vol * env_handle(env_get_table(vol_env_tables, ch->curins, &ch->curins->vol_env), &ch->chVolEnvPos, ch->chSustain)) >> 8;
 	}
 
 	if(ch->curins->pan_env.flags & EF_ON) {
-	    pan += ((env_handle(&ch->curins->pan_env, &ch->chPanEnvPos, ch->chSustain)-128)*(128-((pan<0)?-pan:pan)))>>7;
+	    pan += ((env_handle(env_get_table(pan_env_tables, ch->curins, &ch->curins->pan_env), &ch->chPanEnvPos, ch->chSustain)-128)*(128-((pan<0)?-pan:pan)))>>7;
 	}
 
 	if(ch->curins->vibrate && ch->curins->vibdepth) {
 	    int dep=0;
 	    switch (ch->curins->vibtype) {
 	    case 0:
-		dep = sin(2 * M_PI * (double)ch->chAVibPos / 256 / 256) * (double)(ch->curins->vibdepth << 2);
+		/* the low byte of chAVibPos is always 0 */
+		dep = sintab[ch->chAVibPos >> 8] * (double)(ch->curins->vibdepth << 2);
 		break;
 	    case 1:
 		dep=(ch->chAVibPos&0x8000)? -(ch->curins->vibdepth << 2) : (ch->curins->vibdepth << 2);
@@ -761,7 +857,7 @@ xmplayer_final_channel_ops (int chnr)
     if(ch->chCutoff == 0xff && ch->chReso == 0) {
 	driver_set_ch_filter_freq(chnr, -1.0);
     } else {
-	driver_set_ch_filter_freq(chnr, 0.5 * pow(2,(float)(ch->chCutoff-255)/32.0));
+	driver_set_ch_filter_freq(chnr, cutofftab[ch->chCutoff & 0xff]);
 	driver_set_ch_filter_reso(chnr, (float)ch->chReso / 255);
     }
 }
@@ -883,14 +979,15 @@ static void xmpPlayTick()
 	}
 
 	gboolean patdelay_on_this_tick = FALSE;
+	XMNote *row = xm_pattern_row(curpattern, currow);
 	for (i=0; i<nchan; i++) {
 	    channel *ch=&channels[i];
 
-	    procnot = curpattern->channels[i][currow].note;
-	    procins = curpattern->channels[i][currow].instrument;
-	    procvol = curpattern->channels[i][currow].volume;
-	    proccmd = curpattern->channels[i][currow].fxtype;
-	    procdat = curpattern->channels[i][currow].fxparam;
+	    procnot = row[i].note;
+	    procins = row[i].instrument;
+	    procvol = row[i].volume;
+	    proccmd = row[i].fxtype;
+	    procdat = row[i].fxparam;
 
 	    if(proccmd == 0xE) {
 		proccmd = 36 + (procdat >> 4);
@@ -1177,7 +1274,7 @@ static void xmpPlayTick()
 	case xmpVCmdVibDep: // KB says "FICKEN" :)
 	    switch (ch->chVibType) {
 	    case 0:
-		ch->chFinalPitch = freqrange(( 16 * sin(2 * M_PI * (double)ch->chVibPos / 256) * (double)ch->chVibDep) + (double)ch->chPitch);
+		ch->chFinalPitch = freqrange(( 16 * sintab[ch->chVibPos] * (double)ch->chVibDep) + (double)ch->chPitch);
 		break;
 	    case 1:
 		ch->chFinalPitch=freqrange((( (ch->chVibPos-0x80)   *ch->chVibDep)>>3)+ch->chPitch);
@@ -1258,7 +1355,7 @@ static void xmpPlayTick()
 	case xmpCmdVibrato:
 	    switch (ch->chVibType) {
 	    case 0:
-		ch->chFinalPitch=freqrange(8 * sin(2 * M_PI * (double)ch->chVibPos / 256) * (double)ch->chVibDep + (double)ch->chPitch);
+		ch->chFinalPitch=freqrange(8 * sintab[ch->chVibPos] * (double)ch->chVibDep + (double)ch->chPitch);
 		break;
 	    case 1:
 		ch->chFinalPitch=freqrange((( (ch->chVibPos-0x80)   *ch->chVibDep)>>4)+ch->chPitch);
@@ -1290,7 +1387,7 @@ static void xmpPlayTick()
 	case xmpCmdVibVol:
 	    switch (ch->chVibType) {
 	    case 0:
-		ch->chFinalPitch=freqrange(8 * sin(2 * M_PI * (double)ch->chVibPos / 256) * (double)ch->chVibDep + (double)ch->chPitch);
+		ch->chFinalPitch=freqrange(8 * sintab[ch->chVibPos] * (double)ch->chVibDep + (double)ch->chPitch);
 		break;
 	    case 1:
 		ch->chFinalPitch=freqrange((( (ch->chVibPos-0x80)   *ch->chVibDep)>>4)+ch->chPitch);
@@ -1309,7 +1406,7 @@ static void xmpPlayTick()
 	case xmpCmdTremolo:
 	    switch (ch->chTremType) {
 	    case 0:
-		ch->chFinalVol += sin(2 * M_PI * (double)ch->chTremPos / 256) * (double)ch->chTremDep;
+		ch->chFinalVol += sintab[ch->chTremPos] * (double)ch->chTremDep;
 		break;
 	    case 1:
 		ch->chFinalVol+=(( (ch->chTremPos-0x80)   *ch->chTremDep)>>7);
@@ -1434,6 +1531,7 @@ xmplayer_init_module (void)
 
     player_tempo = xm->tempo;
     player_bpm = xm->bpm;
+    xmplayer_envelopes_changed();
 }
 
 static gboolean
@@ -1441,6 +1539,8 @@ xmplayer_init_playing (gboolean init_all)
 {
     int i;
 
+    xm_player_init_tables();
+    xmplayer_envelopes_changed();
     driver_setnumch(xm->num_channels);
 
     current_time = 0.0;
@@ -48,4 +48,8 @@ void        xmplayer_set_pattern       (int pattern);
 void        xmplayer_set_tempo         (int tempo);
 void        xmplayer_set_bpm           (int bpm);
 
+/* To be called after changing an envelope of an instrument, in any
+   thread */
+void        xmplayer_envelopes_changed (void);
+
 #endif /* _ST_XMPLAYER_H */
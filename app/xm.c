@@ -41,6 +41,7 @@
 #include "i18n.h"
 #include "gui-settings.h"
 #include "xm.h"
+#include "xm-compact.h"
 #include "xm-player.h"
 #include "endian-conv.h"
 #include "st-subs.h"
@@ -52,6 +53,28 @@
 
 #define LFSTAT_IS_MODULE 1
 
+/* Samples are delta-encoded and written in pieces of this many
+   frames, and the file gets a buffer of XM_SAVE_BUFSIZE bytes */
+#define XM_SAVE_CHUNK 65536
+#define XM_SAVE_BUFSIZE (1 << 20)
+
+typedef struct xm_save_progress {
+    gint64 done, total;          /* bytes */
+    gint *permille;
+} xm_save_progress;
+
+struct XMSaveJob {
+    XM *xm;                      /* snapshot, owned by the job */
+    gchar *filename;
+    gboolean song;
+    GThread *thread;
+    gint permille;
+    gint finished;
+    int result;
+};
+
+static int f_extension_cmp (const char *filename, char *exten);
+
 static guint16 npertab[60]={
     /* -> Tuning 0 */
     1712,1616,1524,1440,1356,1280,1208,1140,1076,1016, 960, 906,
@@ -204,9 +227,7 @@ xm_load_xm_pattern (XMPattern *pat,
 	fseek(f, hdr_len - 9, SEEK_CUR);
     position = ftell(f);
 
-    if(!st_init_pattern_channels(pat,
-				 len > 0 ? len : 1,
-				 (num_channels + 1) & 0xfe))
+    if(!st_init_pattern_channels(pat, len > 0 ? len : 1))
 	return 0;
 
     if((datasize = get_le_16(ph + 7)) == 0)
@@ -214,8 +235,9 @@ xm_load_xm_pattern (XMPattern *pat,
 
     /* Read channel data */
     for(j = 0; j < len; j++) {
+	XMNote *row = xm_pattern_row(pat, j);
 	for(i = 0; i < num_channels; i++) {
-	    xm_load_xm_note(&pat->channels[i][j], f);
+	    xm_load_xm_note(&row[i], f);
 	}
     }
 
@@ -237,7 +259,7 @@ xm_load_patterns (XMPattern ptr[],
 	if(i < num_patterns)
 	    e = loadfunc(&ptr[i], num_channels, f);
 	else
-	    e = st_init_pattern_channels(&ptr[i], 64, (num_channels + 1) & 0xfe);
+	    e = st_init_pattern_channels(&ptr[i], 64);
 
 	if(!e)
 	    return 0;
@@ -246,6 +268,39 @@ xm_load_patterns (XMPattern ptr[],
     return 1;
 }
 
+static void
+xm_save_progress_add (xm_save_progress *prog,
+		      gint64 bytes)
+{
+    if(prog) {
+	prog->done += bytes;
+	if(prog->total > 0)
+	    g_atomic_int_set(prog->permille, MIN(1000, prog->done * 1000 / prog->total));
+    }
+}
+
+static void
+xm_save_progress_add_samples (xm_save_progress *prog,
+			      XM *xm,
+			      int num_instruments,
+			      gboolean song)
+{
+    int i, j;
+
+    for(i = 0; i < num_instruments && !song; i++) {
+	STInstrument *ins = &xm->instruments[i];
+	for(j = 0; j < st_instrument_num_save_samples(ins); j++)
+	    prog->total += ins->samples[j].sample.length * (ins->samples[j].treat_as_8bit ? 1 : 2);
+    }
+}
+
+static void
+xm_save_progress_compact (gint64 bytes,
+			  gpointer data)
+{
+    xm_save_progress_add(data, bytes);
+}
+
 static void
 xm_save_xm_pattern (XMPattern *p,
 		    int num_channels,
@@ -253,13 +308,14 @@ xm_save_xm_pattern (XMPattern *p,
 {
     int i, j;
     guint8 sh[9];
-    static guint8 buf[32 * 256 * 5];
+    guint8 buf[32 * 256 * 5];   /* not static, patterns may be saved by another thread */
     int bp;
 
     bp = 0;
     for(j = 0; j < p->length; j++) {
+	XMNote *row = xm_pattern_row(p, j);
 	for(i = 0; i < num_channels; i++) {
-	    bp += xm_put_xm_note(&p->channels[i][j], buf + bp);
+	    bp += xm_put_xm_note(&row[i], buf + bp);
 	}
     }
 
@@ -337,16 +393,16 @@ xm_load_xm_samples (STSample samples[],
 		*d16++ = p;
 	    }
 	} else {
+	    /* 8 bit sample, kept like this until it is edited */
 	    s->treat_as_8bit = TRUE;
+	    s->sample.format = ST_MIXER_SAMPLE_FORMAT_8BIT;
 
-	    d16 = s->sample.data = malloc(2 * s->sample.length);
-	    d8 = (gint8*)d16;
-	    d8 += s->sample.length;
+	    d8 = (gint8*)(s->sample.data = malloc(s->sample.length));
 	    fread(d8, 1, s->sample.length, f);
 
 	    for(j = s->sample.length, p = 0; j; j--) {
-		p += *d8++;
-		*d16++ = p << 8;
+		p += *d8;
+		*d8++ = p;
 	    }
 	}
 
@@ -366,11 +422,13 @@ xm_load_xm_samples (STSample samples[],
 static void
 xm_save_xm_samples (STSample samples[],
 		    FILE *f,
-		    int num_samples)
+		    int num_samples,
+		    xm_save_progress *prog)
 {
-    int i, k;
+    int i, k, n;
     guint8 sh[40];
     STSample *s;
+    gint16 *packbuf;
 
     for(i = 0; i < num_samples; i++) {
 	/* save sample header */
@@ -389,48 +447,82 @@ xm_save_xm_samples (STSample samples[],
 	recode_latin1_to_ibmpc(sh + 18, 22);
 	fwrite(sh, 1, sizeof(sh), f);
     }
+
+    packbuf = malloc(XM_SAVE_CHUNK * 2);
     
     for(i = 0; i < num_samples; i++) {
 	s = &samples[i];
 
-	if(!s->treat_as_8bit) {
+	/* The data format decides how to read the data, treat_as_8bit
+	   how to write it */
+	if(s->sample.format == ST_MIXER_SAMPLE_FORMAT_8BIT && !s->treat_as_8bit) {
+	    // Save 8 bit data as 16 bit sample
+	    gint8 *d8 = (gint8*)s->sample.data;
+	    gint16 *ss;
+	    gint16 p = 0, d;
+
+	    for(k = s->sample.length; k; k -= n) {
+		n = MIN(k, XM_SAVE_CHUNK);
+		for(ss = packbuf; ss < packbuf + n; d8++) {
+		    d = (*d8 << 8) - p;
+		    *ss++ = d;
+		    p = *d8 << 8;
+		}
+		le_16_array_to_host_order(packbuf, n);
+		fwrite(packbuf, 1, n * 2, f);
+		xm_save_progress_add(prog, n * 2);
+	    }
+	} else if(s->sample.format == ST_MIXER_SAMPLE_FORMAT_8BIT) {
+	    // Save 8 bit sample as it is
+	    gint8 *d8 = (gint8*)s->sample.data, *ss;
+	    gint8 p = 0, d;
+
+	    for(k = s->sample.length; k; k -= n) {
+		n = MIN(k, XM_SAVE_CHUNK);
+		for(ss = (gint8*)packbuf; ss < (gint8*)packbuf + n; d8++) {
+		    d = *d8 - p;
+		    *ss++ = d;
+		    p = *d8;
+		}
+		fwrite(packbuf, 1, n, f);
+		xm_save_progress_add(prog, n);
+	    }
+	} else if(!s->treat_as_8bit) {
 	    // Save as 16 bit sample
-	    gint16 *packbuf, *d16, *ss;
-	    gint16 p, d;
-
-	    packbuf = malloc(s->sample.length * 2);
-	    d16 = s->sample.data;
-	    ss = packbuf;
-
-	    for(k = s->sample.length, p = 0, d = 0; k; k--) {
-		d = *d16 - p;
-		*ss++ = d;
-		p = *d16++;
+	    gint16 *d16 = s->sample.data, *ss;
+	    gint16 p = 0, d;
+
+	    for(k = s->sample.length; k; k -= n) {
+		n = MIN(k, XM_SAVE_CHUNK);
+		for(ss = packbuf; ss < packbuf + n; d16++) {
+		    d = *d16 - p;
+		    *ss++ = d;
+		    p = *d16;
+		}
+		le_16_array_to_host_order(packbuf, n);
+		fwrite(packbuf, 1, n * 2, f);
+		xm_save_progress_add(prog, n * 2);
 	    }
-
-	    le_16_array_to_host_order(packbuf, s->sample.length);
-	    fwrite(packbuf, 1, s->sample.length * 2, f);
-	    free(packbuf);
 	} else {
-	    // Save as 8 bit sample
-	    gint16 *d16;
-	    gint8 *packbuf, *ss;
-	    gint8 p, d;
-
-	    packbuf = malloc(s->sample.length);
-	    d16 = s->sample.data;
-	    ss = packbuf;
-
-	    for(k = s->sample.length, p = 0, d = 0; k; k--) {
-		d = (*d16 >> 8) - p;
-		*ss++ = d;
-		p = (*d16++ >> 8);
+	    // Save 16 bit data as 8 bit sample
+	    gint16 *d16 = s->sample.data;
+	    gint8 *ss;
+	    gint8 p = 0, d;
+
+	    for(k = s->sample.length; k; k -= n) {
+		n = MIN(k, XM_SAVE_CHUNK);
+		for(ss = (gint8*)packbuf; ss < (gint8*)packbuf + n; d16++) {
+		    d = (*d16 >> 8) - p;
+		    *ss++ = d;
+		    p = (*d16 >> 8);
+		}
+		fwrite(packbuf, 1, n, f);
+		xm_save_progress_add(prog, n);
 	    }
-
-	    fwrite(packbuf, 1, s->sample.length, f);
-	    free(packbuf);
 	}
     }
+
+    free(packbuf);
 }
 
 static void
@@ -504,6 +596,7 @@ xm_load_xm_instrument (STInstrument *instr,
 
 	xm_check_envelope(&instr->vol_env);
 	xm_check_envelope(&instr->pan_env);
+	xmplayer_envelopes_changed();
 
 	instr->vibtype = b[10];
 	if(instr->vibtype >= 4) {
@@ -580,6 +673,7 @@ xm_load_xi (STInstrument *instr,
 
     xm_check_envelope(&instr->vol_env);
     xm_check_envelope(&instr->pan_env);
+    xmplayer_envelopes_changed();
 
     instr->vibtype = b[10];
     if(instr->vibtype >= 4) {
@@ -650,7 +744,7 @@ xm_save_xi (STInstrument *instr,
     put_le_16(a + 22, num_samples);
     fwrite(a, 1, 24, f);
 
-    xm_save_xm_samples(instr->samples, f, num_samples);
+    xm_save_xm_samples(instr->samples, f, num_samples, NULL);
 
     return TRUE;
 }
@@ -658,7 +752,8 @@ xm_save_xi (STInstrument *instr,
 static void
 xm_save_xm_instrument (STInstrument *instr,
                        FILE *f,
-                       gboolean mode)
+                       gboolean mode,
+                       xm_save_progress *prog)
 {
     guint8 h[48];
     int num_samples;
@@ -717,7 +812,7 @@ xm_save_xm_instrument (STInstrument *instr,
     
     fwrite(&h, 1, 38, f);
 
-    if (mode==TRUE) xm_save_xm_samples(instr->samples, f, num_samples);
+    if (mode==TRUE) xm_save_xm_samples(instr->samples, f, num_samples, prog);
 }
 
 static void
@@ -759,13 +854,14 @@ xm_load_mod_pattern (XMPattern *pat,
 
     pat->length = pat->alloc_length = len;
 
-    if(!st_init_pattern_channels(pat, len, num_channels))
+    if(!st_init_pattern_channels(pat, len))
 	return 0;
 
     /* Read channel data */
     for(j = 0; j < len; j++) {
+	XMNote *row = xm_pattern_row(pat, j);
 	for(i = 0; i < num_channels; i++) {
-	    xm_load_mod_note(&pat->channels[i][j], f);
+	    xm_load_mod_note(&row[i], f);
 	}
     }
 
@@ -891,16 +987,12 @@ xm_load_mod (FILE *f,int *status)
 		s->sample.looptype = 0;
 	    }
 
-	    s->sample.data = malloc(2 * s->sample.length);
+	    s->sample.data = malloc(s->sample.length);
 	    if(!s->sample.data) {
 		goto ende;
 	    }
-	    fread((char*)s->sample.data + s->sample.length, 1, s->sample.length, f);
-	    st_convert_sample((char*)s->sample.data + s->sample.length,
-			      s->sample.data,
-			      8,
-			      16,
-			      s->sample.length);
+	    fread(s->sample.data, 1, s->sample.length, f);
+	    s->sample.format = ST_MIXER_SAMPLE_FORMAT_8BIT;
 	}
     }
 
@@ -914,13 +1006,31 @@ xm_load_mod (FILE *f,int *status)
     return NULL;
 }
 
+static void
+xm_check_sample_lengths (XM *xm)
+{
+    int i, j;
+
+    for(i = 0; i < sizeof(xm->instruments) / sizeof(xm->instruments[0]); i++) {
+	STInstrument *instr = &xm->instruments[i];
+	for(j = 0; j < (sizeof(instr->samples) / sizeof(instr->samples[0])); j++) {
+	    if(instr->samples[j].sample.length > mixer->max_sample_length) {
+		char buf[128];
+		g_sprintf(buf, _("Module contains sample(s) that are too long for the current mixer.\nMaximum sample length is %d."), mixer->max_sample_length);
+		error_warning(buf);
+		return;
+	    }
+	}
+    }
+}
+
 XM *
 XM_Load (const char *filename,int *status)
 {
     XM *xm;
     FILE *f;
     guint8 xh[80];
-    int i, j, num_patterns, num_instruments;
+    int i, num_patterns, num_instruments;
 
     *status = 0;
     f = fopen(filename, "rb");
@@ -935,6 +1045,14 @@ XM_Load (const char *filename,int *status)
        || strncmp(xh + 0, "Extended Module: ", 17) != 0
        || xh[37] != 0x1a) {
 	fseek(f, 0, SEEK_SET);
+	if(!memcmp(xh, XM_COMPACT_MAGIC, XM_COMPACT_MAGIC_LENGTH)) {
+	    *status |= LFSTAT_IS_MODULE;
+	    xm = xm_compact_load(f);
+	    fclose(f);
+	    if(xm)
+		xm_check_sample_lengths(xm);
+	    return xm;
+	}
 	return xm_load_mod(f,status);
     }
 
@@ -993,20 +1111,8 @@ XM_Load (const char *filename,int *status)
 	}
     }
 
-    // Check if sample lengths are okay
-    for(i = 0; i < num_instruments; i++) {
-	STInstrument *instr = &xm->instruments[i];
-	for(j = 0; j < (sizeof(instr->samples) / sizeof(instr->samples[0])); j++) {
-	    if(instr->samples[j].sample.length > mixer->max_sample_length) {
-		char buf[128];
-		g_sprintf(buf, _("Module contains sample(s) that are too long for the current mixer.\nMaximum sample length is %d."), mixer->max_sample_length);
-		error_warning(buf);
-		goto weiter;
-	    }
-	}
-    }
+    xm_check_sample_lengths(xm);
 
-  weiter:
     if(xm->num_channels & 1) {
 	/* Yes, mods like these *do* exist. */
 	xm->num_channels++;
@@ -1022,23 +1128,25 @@ XM_Load (const char *filename,int *status)
     return NULL;
 }
 
-int
-XM_Save (XM *xm,
-	 const char *filename,
-	 gboolean song)
+static int
+xm_save_xm (XM *xm,
+	    FILE *f,
+	    gboolean song,
+	    xm_save_progress *prog)
 {
-    FILE *f;
     int i;
     guint8 xh[80];
     int num_patterns, num_instruments;
 
-    f = fopen(filename, "wb");
-    if(!f)
-	return 0;
-
     num_patterns = st_num_save_patterns(xm);
     num_instruments = st_num_save_instruments(xm);
 
+    if(prog) {
+	for(i = 0; i < num_patterns; i++)
+	    prog->total += xm->patterns[i].length * xm->num_channels;
+	xm_save_progress_add_samples(prog, xm, num_instruments, song);
+    }
+
     memcpy(xh + 0, "Extended Module: ", 17);
     memcpy(xh + 17, xm->name, 20);
     recode_latin1_to_ibmpc(xh + 17, 20);
@@ -1058,22 +1166,209 @@ XM_Save (XM *xm,
     fwrite(&xh, 1, sizeof(xh), f);
     fwrite(xm->pattern_order_table, 1, 256, f);
 
-    for(i = 0; i < num_patterns; i++)
+    for(i = 0; i < num_patterns; i++) {
 	xm_save_xm_pattern(&xm->patterns[i], xm->num_channels, f);
+	xm_save_progress_add(prog, xm->patterns[i].length * xm->num_channels);
+    }
 
     for(i = 0; i < num_instruments; i++)
         if(song==TRUE)
-            xm_save_xm_instrument(&xm->instruments[i], f, FALSE);
+            xm_save_xm_instrument(&xm->instruments[i], f, FALSE, prog);
         else
-            xm_save_xm_instrument(&xm->instruments[i], f, TRUE);
-   
-    if(ferror(f)) {
-	fclose(f);
+            xm_save_xm_instrument(&xm->instruments[i], f, TRUE, prog);
+
+    return !ferror(f);
+}
+
+/* The module is written to a temporary file next to the target which
+   then replaces it, so that a failed save doesn't destroy the old
+   version. Symbolic links are followed, and the new file gets the
+   mode of the old one. A file with other hard links, or one whose
+   directory we can't write to, is overwritten in place. */
+static int
+xm_save_file (XM *xm,
+	      const char *filename,
+	      gboolean song,
+	      xm_save_progress *prog)
+{
+    FILE *f = NULL;
+    gchar *target, *tmpname = NULL;
+    char *buf;
+    struct stat st;
+    int i, ok, exists;
+
+    buf = realpath(filename, NULL);
+    target = g_strdup(buf ? buf : filename);
+    free(buf);
+    exists = stat(target, &st) == 0;
+
+    if(!exists || st.st_nlink == 1) {
+	tmpname = g_strconcat(target, ".tmp", NULL);
+	f = fopen(tmpname, "wb");
+	if(!f) {
+	    g_free(tmpname);
+	    tmpname = NULL;
+	} else if(exists) {
+	    fchmod(fileno(f), st.st_mode & 07777);
+	}
+    }
+    if(!f)
+	f = fopen(target, "wb");
+    if(!f) {
+	g_free(target);
 	return 0;
     }
-	
-    fclose(f);
-    return 1;
+
+    buf = malloc(XM_SAVE_BUFSIZE);
+    if(buf)
+	setvbuf(f, buf, _IOFBF, XM_SAVE_BUFSIZE);
+
+    if(f_extension_cmp(filename, XM_COMPACT_EXTENSION)) {
+	if(prog) {
+	    for(i = 0; i < xm_compact_num_patterns(xm); i++)
+		prog->total += xm->patterns[i].length * xm->num_channels;
+	    xm_save_progress_add_samples(prog, xm, st_num_save_instruments(xm), song);
+	}
+	ok = xm_compact_save(xm, f, song, prog ? xm_save_progress_compact : NULL, prog);
+    } else {
+	ok = xm_save_xm(xm, f, song, prog);
+    }
+
+    if(fclose(f) != 0)
+	ok = 0;
+    free(buf);
+
+    if(tmpname) {
+	if(ok && rename(tmpname, target) != 0)
+	    ok = 0;
+	if(!ok)
+	    unlink(tmpname);
+	g_free(tmpname);
+    }
+
+    g_free(target);
+    return ok;
+}
+
+int
+XM_Save (XM *xm,
+	 const char *filename,
+	 gboolean song)
+{
+    return xm_save_file(xm, filename, song, NULL);
+}
+
+XM *
+XM_Snapshot (XM *xm,
+	     gboolean samples)
+{
+    XM *r;
+    int i, j;
+
+    r = malloc(sizeof(XM));
+    if(!r)
+	return NULL;
+
+    /* First detach the copy from the original, so that it can be
+       freed with XM_Free() if we run out of memory halfway */
+    memcpy(r, xm, sizeof(XM));
+    for(i = 0; i < 256; i++) {
+	r->patterns[i].notes = NULL;
+    }
+    for(i = 0; i < sizeof(r->instruments) / sizeof(r->instruments[0]); i++) {
+	for(j = 0; j < sizeof(r->instruments[i].samples) / sizeof(r->instruments[i].samples[0]); j++)
+	    r->instruments[i].samples[j].sample.data = NULL;
+    }
+    xm_init_locks(r);
+
+    for(i = 0; i < 256; i++) {
+	if(!st_copy_pattern(&r->patterns[i], &xm->patterns[i]))
+	    goto ende;
+    }
+
+    if(!samples)
+	return r;
+
+    for(i = 0; i < sizeof(xm->instruments) / sizeof(xm->instruments[0]); i++) {
+	for(j = 0; j < sizeof(xm->instruments[i].samples) / sizeof(xm->instruments[i].samples[0]); j++) {
+	    st_mixer_sample_info *src = &xm->instruments[i].samples[j].sample;
+	    st_mixer_sample_info *dst = &r->instruments[i].samples[j].sample;
+
+	    /* The data is shared, an edit copies it while the snapshot
+	       holds it. The header fields have to match the data. */
+	    g_mutex_lock(src->lock);
+	    memcpy(dst, src, G_STRUCT_OFFSET(st_mixer_sample_info, data));
+	    dst->format = src->format;
+	    dst->data = st_sample_data_ref(src->data);
+	    g_mutex_unlock(src->lock);
+	}
+    }
+
+    return r;
+
+  ende:
+    XM_Free(r);
+    return NULL;
+}
+
+static gpointer
+xm_save_thread (gpointer data)
+{
+    XMSaveJob *job = data;
+    xm_save_progress prog = { 0, 0, &job->permille };
+
+    job->result = xm_save_file(job->xm, job->filename, job->song, &prog);
+    g_atomic_int_set(&job->finished, 1);
+
+    return NULL;
+}
+
+XMSaveJob *
+XM_SaveAsync (XM *xm,
+	      const char *filename,
+	      gboolean song)
+{
+    XMSaveJob *job;
+    XM *snapshot;
+
+    snapshot = XM_Snapshot(xm, !song);
+    if(!snapshot)
+	return NULL;
+
+    job = g_new0(XMSaveJob, 1);
+    job->xm = snapshot;
+    job->filename = g_strdup(filename);
+    job->song = song;
+
+    job->thread = g_thread_create(xm_save_thread, job, TRUE, NULL);
+    if(!job->thread)
+	xm_save_thread(job);
+
+    return job;
+}
+
+int
+XM_SaveAsyncProgress (XMSaveJob *job)
+{
+    if(g_atomic_int_get(&job->finished))
+	return -1;
+    return g_atomic_int_get(&job->permille);
+}
+
+int
+XM_SaveAsyncFinish (XMSaveJob *job)
+{
+    int result;
+
+    if(job->thread)
+	g_thread_join(job->thread);
+
+    result = job->result;
+    XM_Free(job->xm);
+    g_free(job->filename);
+    g_free(job);
+
+    return result;
 }
 
 XM *
@@ -1439,7 +1734,7 @@ xm_xp_load (FILE *f, int length, XMPattern *patt, XM *xm)
     for (j = 0; j <= MIN (length, patt->length) - 1; j++) {
 	bp = j * 5 * 32;
 	for (i = 0; i <= xm->num_channels - 1; i++) {
-	    memcpy (&patt->channels[i][j].note, &buf[bp], 5);
+	    memcpy (&xm_pattern_note (patt, i, j)->note, &buf[bp], 5);
 	    bp += 5;
 	}
     }
@@ -1447,7 +1742,7 @@ xm_xp_load (FILE *f, int length, XMPattern *patt, XM *xm)
 	for (j = length; j < patt->length; j++) {
 	    bp = j * 5 * 32;
 	    for (i = 0; i <= xm->num_channels - 1; i++) {
-		memset (&patt->channels[i][j].note, 0, 5);
+		memset (&xm_pattern_note (patt, i, j)->note, 0, 5);
 		bp += 5;
 	    }
 	}
@@ -1475,11 +1770,12 @@ xm_xp_save (gint reply, gpointer data)
 	    for (j = 0; j <= fnp->pattern->length - 1; j++)//row
 		for (i = 0; i <= 31; i++){//ch
 		    if ( i <= fnp->xm->num_channels - 1){
-			buf[bp + 0] = fnp->pattern->channels[i][j].note;
-			buf[bp + 1] = fnp->pattern->channels[i][j].instrument;
-			buf[bp + 2] = fnp->pattern->channels[i][j].volume;
-			buf[bp + 3] = fnp->pattern->channels[i][j].fxtype;
-			buf[bp + 4] = fnp->pattern->channels[i][j].fxparam;
+			XMNote *n = xm_pattern_note (fnp->pattern, i, j);
+			buf[bp + 0] = n->note;
+			buf[bp + 1] = n->instrument;
+			buf[bp + 2] = n->volume;
+			buf[bp + 3] = n->fxtype;
+			buf[bp + 4] = n->fxparam;
 		    } else {
 			buf[bp + 0] = 0;
 			buf[bp + 1] = 0;
@@ -51,11 +51,31 @@ typedef struct XMNote {
     unsigned char fxparam;
 } XMNote;
 
+/* Patterns are stored row by row in one block, and every row has room
+   for XM_PATTERN_WIDTH notes, however many channels the song uses. So
+   the notes of one channel are XM_PATTERN_WIDTH apart. */
+#define XM_PATTERN_WIDTH 32
+
 typedef struct XMPattern {
     int length, alloc_length;
-    XMNote *channels[32];
+    XMNote *notes;
 } XMPattern;
 
+static inline XMNote *
+xm_pattern_row (XMPattern *p,
+		int row)
+{
+    return p->notes + row * XM_PATTERN_WIDTH;
+}
+
+static inline XMNote *
+xm_pattern_note (XMPattern *p,
+		 int channel,
+		 int row)
+{
+    return p->notes + row * XM_PATTERN_WIDTH + channel;
+}
+
 /* -- Sample definitions -- */
 
 typedef struct STSample {
@@ -149,6 +169,23 @@ int           XM_Save                                  (XM *xm, const char *file
 XM*           XM_New                                   (void);
 void          XM_Free                                  (XM*);
 
+/* Copy of the module for saving it while editing goes on. The copy
+   shares the sample data (see st_sample_data_ref()) if samples is
+   TRUE; otherwise the samples keep their lengths but have no data. */
+XM*           XM_Snapshot                              (XM *xm, gboolean samples);
+
+/* Saving in a separate thread. XM_SaveAsync() takes a snapshot of the
+   module, so it may be edited or freed right away. Returns NULL if
+   there isn't enough memory for that. XM_SaveAsyncProgress() returns
+   the part already written in 1/1000, or -1 once the thread is done;
+   XM_SaveAsyncFinish() waits for it, frees the job and returns the
+   same as XM_Save(). */
+typedef struct XMSaveJob XMSaveJob;
+
+XMSaveJob*    XM_SaveAsync                             (XM *xm, const char *filename, gboolean song);
+int           XM_SaveAsyncProgress                     (XMSaveJob *job);
+int           XM_SaveAsyncFinish                       (XMSaveJob *job);
+
 gboolean      xm_load_xi                               (STInstrument *instr,
 							FILE *f);
 gboolean      xm_save_xi                               (STInstrument *instr,